@@ -0,0 +1,121 @@
+/*
+Scaling benchmark for the JobSystem: runs the same workloads with 1..N threads and reports the speedup
+relative to a single thread.
+
+    make bench && ./build/job_scaling [max threads] [repetitions]
+*/
+
+#include "../src/job_system.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// --------------------------------------------- workloads ---------------------------------------------
+
+// data parallel: a compute-heavy map + reduction over a large array
+static double ParallelForWorkload(JobSystem& jobs, const std::vector<float>& input) {
+    std::vector<double> partial(jobs.GetThreadCount() * 64, 0.0);
+    std::atomic<size_t> nextSlot{0};
+
+    jobs.ParallelFor(input.size(), [&](size_t begin, size_t end) {
+        double sum = 0.0;
+        for(size_t i = begin; i < end; ++i) {
+            float x = input[i];
+            sum += std::sqrt(x) * std::sin(x) + std::cos(x * 0.5f);
+        }
+        partial[nextSlot.fetch_add(1) % partial.size()] += sum;
+    });
+
+    double total = 0.0;
+    for(double value : partial) {
+        total += value;
+    }
+    return total;
+}
+
+// task graph: many small independent jobs fanning into one job that depends on all of them
+static double DependencyWorkload(JobSystem& jobs, int jobCount, int workPerJob) {
+    std::vector<double> results(jobCount, 0.0);
+    JobHandle gather = jobs.CreateJob([] {});
+
+    std::vector<JobHandle> leaves;
+    leaves.reserve(jobCount);
+    for(int j = 0; j < jobCount; ++j) {
+        JobHandle leaf = jobs.CreateJob([&results, j, workPerJob] {
+            double value = 0.0;
+            for(int i = 0; i < workPerJob; ++i) {
+                value += std::sin((double)(i + j));
+            }
+            results[j] = value;
+        });
+        jobs.AddDependency(gather, leaf);
+        leaves.push_back(leaf);
+    }
+
+    jobs.Submit(gather);
+    for(const JobHandle& leaf : leaves) {
+        jobs.Submit(leaf);
+    }
+    jobs.Wait(gather);
+
+    double total = 0.0;
+    for(double value : results) {
+        total += value;
+    }
+    return total;
+}
+
+// --------------------------------------------- driver ---------------------------------------------
+
+template<typename Function>
+static double BestTimeMs(int repetitions, Function&& function) {
+    double best = 1e30;
+    for(int r = 0; r < repetitions; ++r) {
+        auto start = std::chrono::steady_clock::now();
+        function();
+        auto stop = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::milli>(stop - start).count());
+    }
+    return best;
+}
+
+int main(int argc, char* args[]) {
+    unsigned maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    int repetitions = 5;
+    if(argc > 1) {
+        maxThreads = (unsigned)std::max(1, std::atoi(args[1]));
+    }
+    if(argc > 2) {
+        repetitions = std::max(1, std::atoi(args[2]));
+    }
+
+    std::vector<float> input(1 << 23);
+    for(size_t i = 0; i < input.size(); ++i) {
+        input[i] = (float)(i % 1000) * 0.01f;
+    }
+
+    std::printf("%8s %16s %10s %16s %10s\n", "threads", "parallel_for ms", "speedup", "task graph ms", "speedup");
+
+    double baseParallelFor = 0.0, baseGraph = 0.0;
+    volatile double sink = 0.0;
+    for(unsigned threads = 1; threads <= maxThreads; ++threads) {
+        JobSystem jobs(threads);
+
+        double parallelForMs = BestTimeMs(repetitions, [&] { sink = sink + ParallelForWorkload(jobs, input); });
+        double graphMs = BestTimeMs(repetitions, [&] { sink = sink + DependencyWorkload(jobs, 4096, 4000); });
+
+        if(threads == 1) {
+            baseParallelFor = parallelForMs;
+            baseGraph = graphMs;
+        }
+        std::printf("%8u %16.2f %9.2fx %16.2f %9.2fx\n", threads,
+                    parallelForMs, baseParallelFor / parallelForMs,
+                    graphMs, baseGraph / graphMs);
+    }
+    return 0;
+}
@@ -0,0 +1,25 @@
+#!/bin/sh
+# Throughput of the batch render server on llvmpipe: every combination of render contexts (--serve-contexts)
+# and llvmpipe rasterizer threads (LP_NUM_THREADS, 0 = rasterize on the context's own thread) renders the same
+# generated jobs, read back but not written. One line per run, frames/s at the end.
+#
+#     make && bench/llvmpipe_scaling.sh [jobs] [max contexts] [extra program arguments...]
+#
+# SDL_VIDEODRIVER=offscreen gives EGL contexts without a display server (SDL 2.0.16+).
+
+JOBS=${1:-400}
+MAX_CONTEXTS=${2:-$(nproc)}
+if [ $# -ge 2 ]; then shift 2; else shift $#; fi
+PROG=${PROG:-./build/prog}
+
+export LIBGL_ALWAYS_SOFTWARE=1
+export GALLIUM_DRIVER=llvmpipe
+export SDL_VIDEODRIVER=${SDL_VIDEODRIVER:-offscreen}
+
+for threads in $(printf "0\n1\n2\n4\n%s\n" "$(nproc)" | sort -nu); do
+    contexts=1
+    while [ "$contexts" -le "$MAX_CONTEXTS" ]; do
+        LP_NUM_THREADS=$threads "$PROG" --serve-benchmark "$JOBS" --serve-contexts "$contexts" --fps 0 "$@" | grep '^benchmark:'
+        contexts=$((contexts * 2))
+    done
+done
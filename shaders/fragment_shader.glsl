@@ -1,10 +1,13 @@
 #version 410 core
 
 in vec3 vColor;
+in vec2 vTexCoord;
+
+uniform sampler2D u_Texture; // texture unit 0; sRGB textures are decoded to linear by the sampler
 
 out vec4 fragColor;
 
 void main()
 {
-   fragColor = vec4(vColor.r, vColor.g, vColor.b, 1.0);
+   fragColor = vec4(vColor.r, vColor.g, vColor.b, 1.0) * texture(u_Texture, vTexCoord);
 }
\ No newline at end of file
@@ -2,16 +2,22 @@
 
 layout(location = 3) in vec3 position;
 layout(location = 1) in vec3 color;
+layout(location = 2) in vec2 texCoord;
+layout(location = 4) in mat4 instanceModel; // per-instance model matrix, occupies locations 4..7
+layout(location = 8) in vec4 instanceUvRect; // per-instance atlas UV offset (xy) and scale (zw); (0, 0, 1, 1) without an atlas
 
 uniform mat4 u_ModelMatrix;
+uniform mat4 u_View;
 uniform mat4 u_Projection;
 
 out vec3 vColor;
+out vec2 vTexCoord;
 
 void main()
 {
-   vec4 newPosition = u_Projection * u_ModelMatrix * vec4(position, 1.0f);
+   vec4 newPosition = u_Projection * u_View * u_ModelMatrix * instanceModel * vec4(position, 1.0f);
 
    gl_Position = newPosition; // 将顶点位置传递给固定功能管线，进行后续的裁剪、视口变换等处理 
    vColor = color;
+   vTexCoord = instanceUvRect.xy + texCoord * instanceUvRect.zw;
 }
\ No newline at end of file
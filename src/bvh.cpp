@@ -0,0 +1,371 @@
+#include "bvh.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace {
+
+const int BinCount = 16;
+
+struct Aabb {
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+
+    void Grow(const glm::vec3& p) { min = glm::min(min, p); max = glm::max(max, p); }
+    void Grow(const Aabb& b) { min = glm::min(min, b.min); max = glm::max(max, b.max); }
+    float HalfArea() const {
+        glm::vec3 e = max - min;
+        return (e.x < 0.0f) ? 0.0f : e.x * e.y + e.y * e.z + e.z * e.x;
+    }
+};
+
+Aabb ObjectBox(const BoundsSoA& bounds, uint32_t i) {
+    Aabb box;
+    box.min = bounds.GetMin(i);
+    box.max = bounds.GetMax(i);
+    return box;
+}
+
+glm::vec3 ObjectCentroid(const BoundsSoA& bounds, uint32_t i) {
+    return (bounds.GetMin(i) + bounds.GetMax(i)) * 0.5f;
+}
+
+void SetNodeBox(BvhNode& node, const Aabb& box) {
+    node.minX = box.min.x; node.minY = box.min.y; node.minZ = box.min.z;
+    node.maxX = box.max.x; node.maxY = box.max.y; node.maxZ = box.max.z;
+}
+
+Aabb NodeBox(const BvhNode& node) {
+    Aabb box;
+    box.min = glm::vec3(node.minX, node.minY, node.minZ);
+    box.max = glm::vec3(node.maxX, node.maxY, node.maxZ);
+    return box;
+}
+
+// -1 outside, 0 intersecting, 1 completely inside. 'planeMask' has a bit per plane still to be tested;
+// planes the box is completely inside of are cleared for the children.
+int ClassifyBox(const Frustum& frustum, const BvhNode& node, unsigned& planeMask) {
+    int result = 1;
+    for(int i = 0; i < 6; ++i) {
+        if(!(planeMask & (1u << i))) {
+            continue;
+        }
+        const glm::vec4& p = frustum.planes[i];
+        // p-vertex: corner furthest along the normal, n-vertex: the opposite one
+        float pDistance = (p.x > 0 ? p.x * node.maxX : p.x * node.minX) +
+                          (p.y > 0 ? p.y * node.maxY : p.y * node.minY) +
+                          (p.z > 0 ? p.z * node.maxZ : p.z * node.minZ) + p.w;
+        if(pDistance < 0.0f) {
+            return -1;
+        }
+        float nDistance = (p.x > 0 ? p.x * node.minX : p.x * node.maxX) +
+                          (p.y > 0 ? p.y * node.minY : p.y * node.maxY) +
+                          (p.z > 0 ? p.z * node.minZ : p.z * node.maxZ) + p.w;
+        if(nDistance >= 0.0f) {
+            planeMask &= ~(1u << i);
+        }
+        else {
+            result = 0;
+        }
+    }
+    return result;
+}
+
+// slab test, returns entry distance or FLT_MAX on miss
+float IntersectBox(const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance,
+                   const glm::vec3& boxMin, const glm::vec3& boxMax) {
+    float tMin = 0.0f;
+    float tMax = maxDistance;
+    for(int axis = 0; axis < 3; ++axis) {
+        float t0 = (boxMin[axis] - origin[axis]) * inverseDirection[axis];
+        float t1 = (boxMax[axis] - origin[axis]) * inverseDirection[axis];
+        if(t0 > t1) {
+            std::swap(t0, t1);
+        }
+        tMin = std::max(tMin, t0);
+        tMax = std::min(tMax, t1);
+        if(tMin > tMax) {
+            return FLT_MAX;
+        }
+    }
+    return tMin;
+}
+
+} // namespace
+
+void Bvh::Build(const BoundsSoA& bounds, size_t objectCount) {
+    mNodes.clear();
+    mParent.clear();
+    mObjects.resize(objectCount);
+    mObjectLeaf.assign(objectCount, 0);
+    for(uint32_t i = 0; i < objectCount; ++i) {
+        mObjects[i] = i;
+    }
+    if(objectCount == 0) {
+        return;
+    }
+
+    // centroids are needed many times per object during binning, compute them once
+    std::vector<glm::vec3> centroids(objectCount);
+    for(uint32_t i = 0; i < objectCount; ++i) {
+        centroids[i] = ObjectCentroid(bounds, i);
+    }
+
+    mNodes.reserve(objectCount * 2 / MaxLeafSize + 2);
+    mNodes.resize(2);     // root + unused slot, so sibling pairs start at even indices
+    mParent.resize(2, 0);
+    mNodes[0].leftOrFirst = 0;
+    mNodes[0].count = (uint32_t)objectCount;
+    mNodes[1] = BvhNode{};
+
+    std::vector<uint32_t> stack;
+    stack.push_back(0);
+
+    while(!stack.empty()) {
+        const uint32_t nodeIndex = stack.back();
+        stack.pop_back();
+
+        const uint32_t first = mNodes[nodeIndex].leftOrFirst;
+        const uint32_t count = mNodes[nodeIndex].count;
+
+        Aabb box, centroidBox;
+        for(uint32_t i = first; i < first + count; ++i) {
+            box.Grow(ObjectBox(bounds, mObjects[i]));
+            centroidBox.Grow(centroids[mObjects[i]]);
+        }
+        SetNodeBox(mNodes[nodeIndex], box);
+
+        auto makeLeaf = [&]() {
+            for(uint32_t i = first; i < first + count; ++i) {
+                mObjectLeaf[mObjects[i]] = nodeIndex;
+            }
+        };
+
+        if(count <= MaxLeafSize) {
+            makeLeaf();
+            continue;
+        }
+
+        // ---- binned SAH along the axis with the largest centroid extent ----
+        glm::vec3 extent = centroidBox.max - centroidBox.min;
+        int axis = 0;
+        if(extent.y > extent[axis]) { axis = 1; }
+        if(extent.z > extent[axis]) { axis = 2; }
+        if(extent[axis] <= 0.0f) {
+            makeLeaf(); // all centroids coincide, nothing to split
+            continue;
+        }
+
+        Aabb binBox[BinCount];
+        uint32_t binCount[BinCount] = {};
+        const float scale = BinCount / extent[axis];
+        const float axisMin = centroidBox.min[axis];
+        auto binOf = [&](uint32_t object) {
+            int bin = (int)((centroids[object][axis] - axisMin) * scale);
+            return std::min(bin, BinCount - 1);
+        };
+        for(uint32_t i = first; i < first + count; ++i) {
+            int bin = binOf(mObjects[i]);
+            binCount[bin]++;
+            binBox[bin].Grow(ObjectBox(bounds, mObjects[i]));
+        }
+
+        // sweep from both sides to get the cost of every split plane
+        float leftArea[BinCount - 1], rightArea[BinCount - 1];
+        uint32_t leftCount[BinCount - 1], rightCount[BinCount - 1];
+        Aabb leftBox, rightBox;
+        uint32_t leftSum = 0, rightSum = 0;
+        for(int i = 0; i < BinCount - 1; ++i) {
+            leftSum += binCount[i];
+            leftCount[i] = leftSum;
+            leftBox.Grow(binBox[i]);
+            leftArea[i] = leftBox.HalfArea();
+
+            rightSum += binCount[BinCount - 1 - i];
+            rightCount[BinCount - 2 - i] = rightSum;
+            rightBox.Grow(binBox[BinCount - 1 - i]);
+            rightArea[BinCount - 2 - i] = rightBox.HalfArea();
+        }
+
+        int bestSplit = -1;
+        float bestCost = FLT_MAX;
+        for(int i = 0; i < BinCount - 1; ++i) {
+            if(leftCount[i] == 0 || rightCount[i] == 0) {
+                continue;
+            }
+            float cost = leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i];
+            if(cost < bestCost) {
+                bestCost = cost;
+                bestSplit = i;
+            }
+        }
+
+        // not splitting is cheaper (traversal cost folded into the leaf size limit)
+        float leafCost = count * box.HalfArea();
+        if(bestSplit < 0 || (bestCost >= leafCost && count <= MaxLeafSize * 4)) {
+            makeLeaf();
+            continue;
+        }
+
+        // partition the object range in place
+        uint32_t* begin = mObjects.data() + first;
+        uint32_t* middle = std::partition(begin, begin + count, [&](uint32_t object) {
+            return binOf(object) <= bestSplit;
+        });
+        uint32_t leftObjects = (uint32_t)(middle - begin);
+
+        const uint32_t leftChild = (uint32_t)mNodes.size();
+        mNodes.resize(leftChild + 2);
+        mParent.resize(leftChild + 2, nodeIndex);
+        mNodes[leftChild].leftOrFirst = first;
+        mNodes[leftChild].count = leftObjects;
+        mNodes[leftChild + 1].leftOrFirst = first + leftObjects;
+        mNodes[leftChild + 1].count = count - leftObjects;
+
+        mNodes[nodeIndex].leftOrFirst = leftChild;
+        mNodes[nodeIndex].count = 0;
+
+        stack.push_back(leftChild + 1);
+        stack.push_back(leftChild);
+    }
+
+    mNodeDirty.assign(mNodes.size(), 0);
+    mAnyDirty = false;
+}
+
+void Bvh::MarkObjectChanged(uint32_t object) {
+    if(object >= mObjectLeaf.size()) {
+        return;
+    }
+    mNodeDirty[mObjectLeaf[object]] = 1;
+    mAnyDirty = true;
+}
+
+void Bvh::UpdateNodeBounds(uint32_t nodeIndex, const BoundsSoA& bounds) {
+    BvhNode& node = mNodes[nodeIndex];
+    Aabb box;
+    if(node.IsLeaf()) {
+        for(uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i) {
+            box.Grow(ObjectBox(bounds, mObjects[i]));
+        }
+    }
+    else {
+        box.Grow(NodeBox(mNodes[node.leftOrFirst]));
+        box.Grow(NodeBox(mNodes[node.leftOrFirst + 1]));
+    }
+    SetNodeBox(node, box);
+}
+
+void Bvh::Refit(const BoundsSoA& bounds) {
+    if(!mAnyDirty) {
+        return;
+    }
+
+    // children always have larger indices than their parent, so a reverse sweep visits them first
+    for(size_t i = mNodes.size(); i-- > 0; ) {
+        if(!mNodeDirty[i] || i == 1) {
+            continue;
+        }
+        UpdateNodeBounds((uint32_t)i, bounds);
+        mNodeDirty[i] = 0;
+        if(i != 0) {
+            mNodeDirty[mParent[i]] = 1;
+        }
+    }
+    mAnyDirty = false;
+}
+
+size_t Bvh::QueryFrustum(const Frustum& frustum, const BoundsSoA& bounds, std::vector<uint32_t>& visible) const {
+    if(mNodes.empty()) {
+        return 0;
+    }
+
+    size_t appended = 0;
+    struct Entry { uint32_t node; unsigned planeMask; };
+    std::vector<Entry> stack;
+    stack.reserve(64);
+    stack.push_back(Entry{0, 0x3Fu});
+
+    while(!stack.empty()) {
+        Entry entry = stack.back();
+        stack.pop_back();
+        const BvhNode& node = mNodes[entry.node];
+
+        unsigned planeMask = entry.planeMask;
+        if(planeMask != 0 && ClassifyBox(frustum, node, planeMask) < 0) {
+            continue;
+        }
+
+        if(node.IsLeaf()) {
+            for(uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i) {
+                // completely inside: no per-object test needed
+                if(planeMask == 0 || IsVisible(frustum, bounds, mObjects[i])) {
+                    visible.push_back(mObjects[i]);
+                    ++appended;
+                }
+            }
+            continue;
+        }
+
+        stack.push_back(Entry{node.leftOrFirst + 1, planeMask});
+        stack.push_back(Entry{node.leftOrFirst, planeMask});
+    }
+    return appended;
+}
+
+bool Bvh::Raycast(const glm::vec3& origin, const glm::vec3& direction, const BoundsSoA& bounds,
+                  uint32_t& hitObject, float& hitDistance, float maxDistance) const {
+    if(mNodes.empty()) {
+        return false;
+    }
+
+    glm::vec3 inverseDirection(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+    float closest = maxDistance;
+    bool hit = false;
+
+    if(IntersectBox(origin, inverseDirection, closest, NodeBox(mNodes[0]).min, NodeBox(mNodes[0]).max) == FLT_MAX) {
+        return false;
+    }
+    std::vector<uint32_t> stack;
+    stack.reserve(64);
+    stack.push_back(0);
+
+    while(!stack.empty()) {
+        const BvhNode& node = mNodes[stack.back()];
+        stack.pop_back();
+
+        if(node.IsLeaf()) {
+            for(uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i) {
+                uint32_t object = mObjects[i];
+                float t = IntersectBox(origin, inverseDirection, closest, bounds.GetMin(object), bounds.GetMax(object));
+                if(t < closest) {
+                    closest = t;
+                    hitObject = object;
+                    hit = true;
+                }
+            }
+            continue;
+        }
+
+        // visit the nearer child first so 'closest' shrinks early and prunes the other side
+        uint32_t near = node.leftOrFirst, far = node.leftOrFirst + 1;
+        float tNear = IntersectBox(origin, inverseDirection, closest, NodeBox(mNodes[near]).min, NodeBox(mNodes[near]).max);
+        float tFar = IntersectBox(origin, inverseDirection, closest, NodeBox(mNodes[far]).min, NodeBox(mNodes[far]).max);
+        if(tFar < tNear) {
+            std::swap(near, far);
+            std::swap(tNear, tFar);
+        }
+        if(tFar != FLT_MAX) {
+            stack.push_back(far);
+        }
+        if(tNear != FLT_MAX) {
+            stack.push_back(near);
+        }
+    }
+
+    if(hit) {
+        hitDistance = closest;
+    }
+    return hit;
+}
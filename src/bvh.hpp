@@ -0,0 +1,82 @@
+#pragma once
+
+/*
+Bounding volume hierarchy over object AABBs (taken from a BoundsSoA).
+
+- Build(): top-down binned SAH (16 bins on the centroid axis with the largest extent), iterative so a million
+  objects do not blow the stack
+- Nodes are 32 bytes and flattened into one array; the two children of a node are stored next to each other
+  starting at an even index, so a sibling pair shares one 64-byte cache line (node 1 is left unused for that,
+  and the array itself is allocated on a 64-byte boundary)
+- Refit(): after objects moved, only the leaves holding changed objects and their ancestors are recomputed
+- QueryFrustum(): frustum culling, skipping plane tests for subtrees that are completely inside
+- Raycast(): closest-hit query for mouse picking
+*/
+
+#include "culling.hpp"
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+struct alignas(32) BvhNode {
+    float minX, minY, minZ;
+    uint32_t leftOrFirst; // interior: index of the left child (right = left + 1); leaf: first entry in the object list
+    float maxX, maxY, maxZ;
+    uint32_t count;       // 0 for interior nodes, number of objects for leaves
+
+    bool IsLeaf() const { return count > 0; }
+};
+
+// std::allocator only guarantees alignof(BvhNode) = 32, which would let a sibling pair straddle two lines
+template<typename T>
+struct CacheLineAllocator {
+    using value_type = T;
+    static const size_t Alignment = 64;
+
+    CacheLineAllocator() = default;
+    template<typename U>
+    CacheLineAllocator(const CacheLineAllocator<U>&) {}
+
+    T* allocate(size_t count) { return static_cast<T*>(::operator new(count * sizeof(T), std::align_val_t(Alignment))); }
+    void deallocate(T* pointer, size_t) { ::operator delete(pointer, std::align_val_t(Alignment)); }
+
+    template<typename U>
+    bool operator==(const CacheLineAllocator<U>&) const { return true; }
+    template<typename U>
+    bool operator!=(const CacheLineAllocator<U>&) const { return false; }
+};
+
+class Bvh {
+public:
+    static const uint32_t MaxLeafSize = 4;
+
+    // Builds over objects [0, objectCount) of 'bounds'
+    void Build(const BoundsSoA& bounds, size_t objectCount);
+    bool IsBuilt() const { return !mNodes.empty(); }
+
+    // Incremental refit: mark objects whose bounds changed, then call Refit()
+    void MarkObjectChanged(uint32_t object);
+    void Refit(const BoundsSoA& bounds);
+
+    // Appends visible object indices (unsorted) to 'visible'; returns how many were appended
+    size_t QueryFrustum(const Frustum& frustum, const BoundsSoA& bounds, std::vector<uint32_t>& visible) const;
+
+    // Closest object whose AABB is hit by origin + t * direction, t in [0, maxDistance]
+    bool Raycast(const glm::vec3& origin, const glm::vec3& direction, const BoundsSoA& bounds,
+                 uint32_t& hitObject, float& hitDistance, float maxDistance = 1e30f) const;
+
+    size_t NodeCount() const { return mNodes.size(); }
+
+private:
+    void UpdateNodeBounds(uint32_t nodeIndex, const BoundsSoA& bounds);
+
+    std::vector<BvhNode, CacheLineAllocator<BvhNode>> mNodes;
+    std::vector<uint32_t> mObjects;    // object indices, leaves reference contiguous ranges
+    std::vector<uint32_t> mParent;     // per node, for refitting upwards
+    std::vector<uint32_t> mObjectLeaf; // per object, the leaf that holds it
+    std::vector<uint8_t> mNodeDirty;
+    bool mAnyDirty = false;
+};
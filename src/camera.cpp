@@ -0,0 +1,135 @@
+#include "camera.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <iostream>
+
+Camera::Camera()
+    : mEye(0.0f, 0.0f, 0.0f),
+      mTarget(0.0f, 0.0f, -1.0f), // looking down -Z: the view matrix starts out as identity
+      mUp(0.0f, 1.0f, 0.0f) {
+}
+
+void Camera::MarkProjectionChanged() {
+    mDirty |= DirtyProjection | DirtyViewProjection | DirtyInverseProjection | DirtyInverseViewProj;
+    ++mProjectionVersion;
+}
+
+void Camera::MarkViewChanged() {
+    mDirty |= DirtyView | DirtyViewProjection | DirtyInverseView | DirtyInverseViewProj;
+    ++mViewVersion;
+}
+
+void Camera::SetViewport(int width, int height) {
+    // minimized windows report 0x0; keep the old aspect instead of dividing by zero
+    if(width <= 0 || height <= 0) {
+        return;
+    }
+    if(width == mWidth && height == mHeight) {
+        return;
+    }
+    mWidth = width;
+    mHeight = height;
+    MarkProjectionChanged();
+}
+
+void Camera::SetPerspective(float fovYDegrees, float nearPlane, float farPlane) {
+    if(fovYDegrees == mFovYDegrees && nearPlane == mNearPlane && farPlane == mFarPlane) {
+        return;
+    }
+    mFovYDegrees = fovYDegrees;
+    mNearPlane = nearPlane;
+    mFarPlane = farPlane;
+    MarkProjectionChanged();
+}
+
+void Camera::SetFieldOfView(float fovYDegrees) {
+    SetPerspective(fovYDegrees, mNearPlane, mFarPlane);
+}
+
+void Camera::LookAt(const glm::vec3& eye, const glm::vec3& target, const glm::vec3& up) {
+    if(eye == mEye && target == mTarget && up == mUp) {
+        return;
+    }
+    mEye = eye;
+    mTarget = target;
+    mUp = up;
+    MarkViewChanged();
+}
+
+const glm::mat4& Camera::GetProjection() {
+    if(mDirty & DirtyProjection) {
+        mProjection = glm::perspective(glm::radians(mFovYDegrees), GetAspect(), mNearPlane, mFarPlane);
+        mDirty &= ~DirtyProjection;
+    }
+    return mProjection;
+}
+
+const glm::mat4& Camera::GetView() {
+    if(mDirty & DirtyView) {
+        mView = glm::lookAt(mEye, mTarget, mUp);
+        mDirty &= ~DirtyView;
+    }
+    return mView;
+}
+
+const glm::mat4& Camera::GetViewProjection() {
+    if(mDirty & DirtyViewProjection) {
+        mViewProjection = GetProjection() * GetView();
+        mDirty &= ~DirtyViewProjection;
+    }
+    return mViewProjection;
+}
+
+const glm::mat4& Camera::GetInverseProjection() {
+    if(mDirty & DirtyInverseProjection) {
+        mInverseProjection = glm::inverse(GetProjection());
+        mDirty &= ~DirtyInverseProjection;
+    }
+    return mInverseProjection;
+}
+
+const glm::mat4& Camera::GetInverseView() {
+    if(mDirty & DirtyInverseView) {
+        mInverseView = glm::inverse(GetView());
+        mDirty &= ~DirtyInverseView;
+    }
+    return mInverseView;
+}
+
+const glm::mat4& Camera::GetInverseViewProjection() {
+    if(mDirty & DirtyInverseViewProj) {
+        mInverseViewProjection = glm::inverse(GetViewProjection());
+        mDirty &= ~DirtyInverseViewProj;
+    }
+    return mInverseViewProjection;
+}
+
+bool Camera::Upload(GLuint program) {
+    if(program != mUploadedProgram) {
+        // new (or relinked) program: look the locations up once and force a full upload
+        mUploadedProgram = program;
+        mUploadedProjectionVersion = 0;
+        mUploadedViewVersion = 0;
+        mProjectionLocation = glGetUniformLocation(program, "u_Projection");
+        mViewLocation = glGetUniformLocation(program, "u_View");
+    }
+
+    if(mProjectionLocation < 0) {
+        std::cout << "Could not find u_ProjectionLocation\n";
+        return false;
+    }
+    if(mViewLocation < 0) {
+        std::cout << "Could not find u_ViewLocation\n";
+        return false;
+    }
+
+    if(mUploadedProjectionVersion != mProjectionVersion) {
+        glUniformMatrix4fv(mProjectionLocation, 1, GL_FALSE, &GetProjection()[0][0]);
+        mUploadedProjectionVersion = mProjectionVersion;
+    }
+    if(mUploadedViewVersion != mViewVersion) {
+        glUniformMatrix4fv(mViewLocation, 1, GL_FALSE, &GetView()[0][0]);
+        mUploadedViewVersion = mViewVersion;
+    }
+    return true;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+/*
+Camera owns the view and projection matrices and only rebuilds them when one of their inputs changes
+(viewport size, field of view, clip planes, eye/target). Derived matrices (view-projection and the inverses)
+are computed lazily on first use after a change.
+
+Upload() pushes u_Projection / u_View to a program only when they changed since the last upload to that
+program - uniform values live in the program object, so there is no need to resend them every frame.
+*/
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/mat4x4.hpp>
+
+class Camera {
+public:
+    Camera();
+
+    // ------------------------------- inputs (each one marks the dependent matrices dirty) -------------------------------
+    void SetViewport(int width, int height);
+    void SetPerspective(float fovYDegrees, float nearPlane, float farPlane);
+    void SetFieldOfView(float fovYDegrees);
+    void LookAt(const glm::vec3& eye, const glm::vec3& target, const glm::vec3& up = glm::vec3(0.0f, 1.0f, 0.0f));
+
+    int GetWidth() const { return mWidth; }
+    int GetHeight() const { return mHeight; }
+    float GetAspect() const { return (float)mWidth / (float)mHeight; }
+    float GetFieldOfView() const { return mFovYDegrees; }
+    float GetNearPlane() const { return mNearPlane; }
+    float GetFarPlane() const { return mFarPlane; }
+    const glm::vec3& GetEye() const { return mEye; }
+
+    // ------------------------------- outputs (recomputed on demand) -------------------------------
+    const glm::mat4& GetProjection();
+    const glm::mat4& GetView();
+    const glm::mat4& GetViewProjection();
+    const glm::mat4& GetInverseProjection();
+    const glm::mat4& GetInverseView();
+    const glm::mat4& GetInverseViewProjection();
+
+    // Incremented whenever the projection / view inputs change. Useful for caches built on top of the camera (culling etc.)
+    unsigned GetProjectionVersion() const { return mProjectionVersion; }
+    unsigned GetViewVersion() const { return mViewVersion; }
+
+    // Sends u_Projection and u_View to 'program' if they changed since the last upload to it.
+    // The program must currently be bound with glUseProgram. Returns false if a uniform is missing.
+    bool Upload(GLuint program);
+
+private:
+    enum DirtyBits : unsigned {
+        DirtyProjection        = 1u << 0,
+        DirtyView              = 1u << 1,
+        DirtyViewProjection    = 1u << 2,
+        DirtyInverseProjection = 1u << 3,
+        DirtyInverseView       = 1u << 4,
+        DirtyInverseViewProj   = 1u << 5,
+    };
+
+    void MarkProjectionChanged();
+    void MarkViewChanged();
+
+    int mWidth = 640;
+    int mHeight = 480;
+    float mFovYDegrees = 45.0f;
+    float mNearPlane = 0.1f;
+    float mFarPlane = 10.0f;
+    glm::vec3 mEye;
+    glm::vec3 mTarget;
+    glm::vec3 mUp;
+
+    unsigned mDirty = ~0u;
+    unsigned mProjectionVersion = 1;
+    unsigned mViewVersion = 1;
+
+    glm::mat4 mProjection;
+    glm::mat4 mView;
+    glm::mat4 mViewProjection;
+    glm::mat4 mInverseProjection;
+    glm::mat4 mInverseView;
+    glm::mat4 mInverseViewProjection;
+
+    // what was last sent to which program
+    GLuint mUploadedProgram = 0;
+    unsigned mUploadedProjectionVersion = 0;
+    unsigned mUploadedViewVersion = 0;
+    GLint mProjectionLocation = -1;
+    GLint mViewLocation = -1;
+};
@@ -0,0 +1,40 @@
+#include "cpu_features.hpp"
+
+#include <cstdlib>
+#include <cstring>
+
+static SimdLevel DetectSimdLevel() {
+    SimdLevel level = SimdLevel::Scalar;
+#if LEARNGL_X86
+    __builtin_cpu_init();
+    level = SimdLevel::SSE2;
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        level = SimdLevel::AVX2;
+    }
+#endif
+
+    // optional override, can only lower the level
+    if(const char* forced = std::getenv("LEARNGL_SIMD")) {
+        SimdLevel wanted = level;
+        if(std::strcmp(forced, "scalar") == 0)    { wanted = SimdLevel::Scalar; }
+        else if(std::strcmp(forced, "sse2") == 0) { wanted = SimdLevel::SSE2; }
+        else if(std::strcmp(forced, "avx2") == 0) { wanted = SimdLevel::AVX2; }
+        if(wanted < level) {
+            level = wanted;
+        }
+    }
+    return level;
+}
+
+SimdLevel GetSimdLevel() {
+    static const SimdLevel level = DetectSimdLevel();
+    return level;
+}
+
+const char* SimdLevelName(SimdLevel level) {
+    switch(level) {
+        case SimdLevel::AVX2: return "AVX2";
+        case SimdLevel::SSE2: return "SSE2";
+        default:              return "scalar";
+    }
+}
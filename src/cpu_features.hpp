@@ -0,0 +1,24 @@
+#pragma once
+
+/*
+Runtime CPU feature detection. SIMD kernels are compiled with per-function target attributes and picked at
+runtime through GetSimdLevel(), so one binary runs on old and new CPUs alike.
+Set LEARNGL_SIMD=scalar|sse2|avx2 to force a lower level (useful for comparing kernels).
+*/
+
+enum class SimdLevel {
+    Scalar = 0,
+    SSE2   = 1, // 4 floats per op (baseline on x86-64)
+    AVX2   = 2, // 8 floats per op, AVX2 + FMA
+};
+
+SimdLevel GetSimdLevel();
+const char* SimdLevelName(SimdLevel level);
+
+#if defined(__x86_64__) || defined(__i386__)
+#define LEARNGL_X86 1
+#define LEARNGL_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#else
+#define LEARNGL_X86 0
+#define LEARNGL_TARGET_AVX2
+#endif
@@ -0,0 +1,208 @@
+#include "culling.hpp"
+#include "cpu_features.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if LEARNGL_X86
+#include <immintrin.h>
+#endif
+
+Frustum Frustum::FromMatrix(const glm::mat4& m) {
+    // rows of the matrix (glm is column-major: m[column][row])
+    glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+    glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+    glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+    glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+    Frustum frustum;
+    frustum.planes[0] = row3 + row0; // left
+    frustum.planes[1] = row3 - row0; // right
+    frustum.planes[2] = row3 + row1; // bottom
+    frustum.planes[3] = row3 - row1; // top
+    frustum.planes[4] = row3 + row2; // near (OpenGL clip space, z in [-w, w])
+    frustum.planes[5] = row3 - row2; // far
+
+    for(glm::vec4& plane : frustum.planes) {
+        float length = glm::length(glm::vec3(plane));
+        plane /= length;
+    }
+    return frustum;
+}
+
+MeshBounds MeshBounds::FromVertices(const float* vertices, size_t vertexCount, size_t strideFloats) {
+    MeshBounds bounds;
+    if(vertexCount == 0) {
+        return bounds;
+    }
+
+    bounds.aabbMin = glm::vec3(vertices[0], vertices[1], vertices[2]);
+    bounds.aabbMax = bounds.aabbMin;
+    for(size_t i = 1; i < vertexCount; ++i) {
+        const float* v = vertices + i * strideFloats;
+        glm::vec3 position(v[0], v[1], v[2]);
+        bounds.aabbMin = glm::min(bounds.aabbMin, position);
+        bounds.aabbMax = glm::max(bounds.aabbMax, position);
+    }
+
+    // sphere around the AABB center; not minimal, but cheap and good enough for culling
+    bounds.center = (bounds.aabbMin + bounds.aabbMax) * 0.5f;
+    for(size_t i = 0; i < vertexCount; ++i) {
+        const float* v = vertices + i * strideFloats;
+        bounds.radius = std::max(bounds.radius, glm::distance(bounds.center, glm::vec3(v[0], v[1], v[2])));
+    }
+    return bounds;
+}
+
+void BoundsSoA::Resize(size_t count) {
+    for(std::vector<float>* stream : {&mCenterX, &mCenterY, &mCenterZ, &mRadius,
+                                      &mMinX, &mMinY, &mMinZ, &mMaxX, &mMaxY, &mMaxZ}) {
+        stream->resize(count, 0.0f);
+    }
+}
+
+void BoundsSoA::SetFromLocal(size_t index, const MeshBounds& local, const glm::mat4& world) {
+    glm::vec3 center = glm::vec3(world * glm::vec4(local.center, 1.0f));
+    float maxScale = std::max(glm::length(glm::vec3(world[0])),
+                     std::max(glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2]))));
+
+    mCenterX[index] = center.x;
+    mCenterY[index] = center.y;
+    mCenterZ[index] = center.z;
+    mRadius[index] = local.radius * maxScale;
+
+    // Arvo: transformed AABB = translation + sum over axes of min/max(matrix element * local extent)
+    glm::vec3 newMin(world[3]), newMax(world[3]);
+    for(int column = 0; column < 3; ++column) {
+        for(int row = 0; row < 3; ++row) {
+            float a = world[column][row] * local.aabbMin[column];
+            float b = world[column][row] * local.aabbMax[column];
+            newMin[row] += std::min(a, b);
+            newMax[row] += std::max(a, b);
+        }
+    }
+    mMinX[index] = newMin.x; mMinY[index] = newMin.y; mMinZ[index] = newMin.z;
+    mMaxX[index] = newMax.x; mMaxY[index] = newMax.y; mMaxZ[index] = newMax.z;
+}
+
+bool IsVisible(const Frustum& frustum, const BoundsSoA& bounds, size_t i) {
+    for(const glm::vec4& p : frustum.planes) {
+        // sphere completely behind the plane
+        float distance = p.x * bounds.mCenterX[i] + p.y * bounds.mCenterY[i] + p.z * bounds.mCenterZ[i] + p.w;
+        if(distance < -bounds.mRadius[i]) {
+            return false;
+        }
+        // AABB: the corner furthest along the plane normal (p-vertex) is behind the plane
+        float pVertex = std::max(p.x * bounds.mMinX[i], p.x * bounds.mMaxX[i]) +
+                        std::max(p.y * bounds.mMinY[i], p.y * bounds.mMaxY[i]) +
+                        std::max(p.z * bounds.mMinZ[i], p.z * bounds.mMaxZ[i]) + p.w;
+        if(pVertex < 0.0f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static size_t CullScalar(const Frustum& frustum, const BoundsSoA& bounds, size_t first, size_t count, std::vector<uint32_t>& visible) {
+    size_t appended = 0;
+    for(size_t i = first; i < first + count; ++i) {
+        if(IsVisible(frustum, bounds, i)) {
+            visible.push_back((uint32_t)i);
+            ++appended;
+        }
+    }
+    return appended;
+}
+
+#if LEARNGL_X86
+static size_t CullSSE2(const Frustum& frustum, const BoundsSoA& bounds, size_t first, size_t count, std::vector<uint32_t>& visible) {
+    size_t appended = 0;
+    size_t i = first;
+    const size_t end = first + count;
+
+    for(; i + 4 <= end; i += 4) {
+        __m128 cx = _mm_loadu_ps(&bounds.mCenterX[i]);
+        __m128 cy = _mm_loadu_ps(&bounds.mCenterY[i]);
+        __m128 cz = _mm_loadu_ps(&bounds.mCenterZ[i]);
+        __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&bounds.mRadius[i]));
+        __m128 minX = _mm_loadu_ps(&bounds.mMinX[i]), maxX = _mm_loadu_ps(&bounds.mMaxX[i]);
+        __m128 minY = _mm_loadu_ps(&bounds.mMinY[i]), maxY = _mm_loadu_ps(&bounds.mMaxY[i]);
+        __m128 minZ = _mm_loadu_ps(&bounds.mMinZ[i]), maxZ = _mm_loadu_ps(&bounds.mMaxZ[i]);
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for(const glm::vec4& p : frustum.planes) {
+            __m128 px = _mm_set1_ps(p.x), py = _mm_set1_ps(p.y), pz = _mm_set1_ps(p.z), pw = _mm_set1_ps(p.w);
+
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, cx), _mm_mul_ps(py, cy)),
+                                         _mm_add_ps(_mm_mul_ps(pz, cz), pw));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+
+            __m128 pVertex = _mm_add_ps(_mm_add_ps(_mm_max_ps(_mm_mul_ps(px, minX), _mm_mul_ps(px, maxX)),
+                                                   _mm_max_ps(_mm_mul_ps(py, minY), _mm_mul_ps(py, maxY))),
+                                        _mm_add_ps(_mm_max_ps(_mm_mul_ps(pz, minZ), _mm_mul_ps(pz, maxZ)), pw));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(pVertex, _mm_setzero_ps()));
+        }
+
+        int mask = _mm_movemask_ps(inside);
+        while(mask != 0) {
+            int lane = __builtin_ctz(mask);
+            visible.push_back((uint32_t)(i + lane));
+            ++appended;
+            mask &= mask - 1;
+        }
+    }
+
+    return appended + CullScalar(frustum, bounds, i, end - i, visible);
+}
+
+LEARNGL_TARGET_AVX2
+static size_t CullAVX2(const Frustum& frustum, const BoundsSoA& bounds, size_t first, size_t count, std::vector<uint32_t>& visible) {
+    size_t appended = 0;
+    size_t i = first;
+    const size_t end = first + count;
+
+    for(; i + 8 <= end; i += 8) {
+        __m256 cx = _mm256_loadu_ps(&bounds.mCenterX[i]);
+        __m256 cy = _mm256_loadu_ps(&bounds.mCenterY[i]);
+        __m256 cz = _mm256_loadu_ps(&bounds.mCenterZ[i]);
+        __m256 negRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&bounds.mRadius[i]));
+        __m256 minX = _mm256_loadu_ps(&bounds.mMinX[i]), maxX = _mm256_loadu_ps(&bounds.mMaxX[i]);
+        __m256 minY = _mm256_loadu_ps(&bounds.mMinY[i]), maxY = _mm256_loadu_ps(&bounds.mMaxY[i]);
+        __m256 minZ = _mm256_loadu_ps(&bounds.mMinZ[i]), maxZ = _mm256_loadu_ps(&bounds.mMaxZ[i]);
+
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for(const glm::vec4& p : frustum.planes) {
+            __m256 px = _mm256_set1_ps(p.x), py = _mm256_set1_ps(p.y), pz = _mm256_set1_ps(p.z), pw = _mm256_set1_ps(p.w);
+
+            __m256 distance = _mm256_fmadd_ps(px, cx, _mm256_fmadd_ps(py, cy, _mm256_fmadd_ps(pz, cz, pw)));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negRadius, _CMP_GE_OQ));
+
+            __m256 pVertex = _mm256_add_ps(_mm256_add_ps(_mm256_max_ps(_mm256_mul_ps(px, minX), _mm256_mul_ps(px, maxX)),
+                                                         _mm256_max_ps(_mm256_mul_ps(py, minY), _mm256_mul_ps(py, maxY))),
+                                           _mm256_add_ps(_mm256_max_ps(_mm256_mul_ps(pz, minZ), _mm256_mul_ps(pz, maxZ)), pw));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(pVertex, _mm256_setzero_ps(), _CMP_GE_OQ));
+        }
+
+        int mask = _mm256_movemask_ps(inside);
+        while(mask != 0) {
+            int lane = __builtin_ctz(mask);
+            visible.push_back((uint32_t)(i + lane));
+            ++appended;
+            mask &= mask - 1;
+        }
+    }
+
+    return appended + CullSSE2(frustum, bounds, i, end - i, visible);
+}
+#endif
+
+size_t CullFrustum(const Frustum& frustum, const BoundsSoA& bounds, size_t first, size_t count, std::vector<uint32_t>& visible) {
+#if LEARNGL_X86
+    switch(GetSimdLevel()) {
+        case SimdLevel::AVX2: return CullAVX2(frustum, bounds, first, count, visible);
+        case SimdLevel::SSE2: return CullSSE2(frustum, bounds, first, count, visible);
+        default: break;
+    }
+#endif
+    return CullScalar(frustum, bounds, first, count, visible);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+/*
+CPU frustum culling.
+
+- Frustum::FromMatrix() extracts the six planes from a (view-)projection matrix (Gribb/Hartmann)
+- MeshBounds is the local-space bounding sphere + AABB of a mesh
+- BoundsSoA holds world-space bounds of all objects as separate float streams
+- CullFrustum() tests them 8 (AVX2) / 4 (SSE2) objects at a time against all planes - sphere first, then the
+  AABB - and appends the indices of visible objects to the draw list
+*/
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct Frustum {
+    // plane i: dot(xyz, p) + w >= 0 means "inside"; normalized so w is a real distance.
+    // Order: left, right, bottom, top, near, far
+    glm::vec4 planes[6];
+
+    static Frustum FromMatrix(const glm::mat4& viewProjection);
+};
+
+struct MeshBounds {
+    glm::vec3 center;
+    float radius = 0.0f;
+    glm::vec3 aabbMin;
+    glm::vec3 aabbMax;
+
+    // positions are the first 3 floats of each vertex, 'strideFloats' floats apart
+    static MeshBounds FromVertices(const float* vertices, size_t vertexCount, size_t strideFloats);
+};
+
+class BoundsSoA {
+public:
+    void Resize(size_t count);
+    size_t Size() const { return mCenterX.size(); }
+
+    // Transforms local bounds by 'world' and stores them at 'index' (sphere radius uses the largest axis scale)
+    void SetFromLocal(size_t index, const MeshBounds& local, const glm::mat4& world);
+
+    glm::vec3 GetCenter(size_t index) const { return glm::vec3(mCenterX[index], mCenterY[index], mCenterZ[index]); }
+    float GetRadius(size_t index) const { return mRadius[index]; }
+    glm::vec3 GetMin(size_t index) const { return glm::vec3(mMinX[index], mMinY[index], mMinZ[index]); }
+    glm::vec3 GetMax(size_t index) const { return glm::vec3(mMaxX[index], mMaxY[index], mMaxZ[index]); }
+
+    std::vector<float> mCenterX, mCenterY, mCenterZ, mRadius;
+    std::vector<float> mMinX, mMinY, mMinZ;
+    std::vector<float> mMaxX, mMaxY, mMaxZ;
+};
+
+// Tests objects [first, first + count) and appends the visible indices to 'visible'. Returns how many were appended.
+size_t CullFrustum(const Frustum& frustum, const BoundsSoA& bounds, size_t first, size_t count, std::vector<uint32_t>& visible);
+
+// Same test, one object at a time (reference path and for callers that test single objects)
+bool IsVisible(const Frustum& frustum, const BoundsSoA& bounds, size_t index);
@@ -0,0 +1,314 @@
+#include "frame_capture.hpp"
+
+#include "image_encoder.hpp"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+static bool Fail(std::string* error, const std::string& message) {
+    if(error) {
+        *error = message;
+    }
+    return false;
+}
+
+// Binary PPM (P6): header, then RGB rows top-down
+static bool WritePpmFile(const std::string& path, const Image& image, std::string* error) {
+    std::ofstream file(path.c_str(), std::ios::binary | std::ios::trunc);
+    if(!file.is_open()) {
+        return Fail(error, "cannot write " + path);
+    }
+    file << "P6\n" << image.width << " " << image.height << "\n255\n";
+    std::vector<uint8_t> row((size_t)image.width * 3);
+    for(int y = image.height - 1; y >= 0; --y) {
+        const uint8_t* source = image.Row(y);
+        for(int x = 0; x < image.width; ++x) {
+            row[x * 3 + 0] = source[x * 4 + 0];
+            row[x * 3 + 1] = source[x * 4 + 1];
+            row[x * 3 + 2] = source[x * 4 + 2];
+        }
+        file.write((const char*)row.data(), (std::streamsize)row.size());
+    }
+    if(!file.good()) {
+        return Fail(error, "cannot write " + path);
+    }
+    return true;
+}
+
+FrameCapture::FrameCapture(JobSystem& jobs, const FrameCaptureOptions& options) : mJobs(jobs), mOptions(options) {
+    mOptions.ringSize = std::max(mOptions.ringSize, 2);
+    if(mOptions.maxPendingWrites <= 0) {
+        mOptions.maxPendingWrites = (int)std::max(2u, jobs.GetThreadCount() * 2);
+    }
+    if(mOptions.format == CaptureFormat::Y4m || mOptions.format == CaptureFormat::Ffmpeg) {
+        VideoEncoderOptions video;
+        video.path = mOptions.path;
+        video.sink = mOptions.format == CaptureFormat::Ffmpeg ? VideoSink::Ffmpeg : VideoSink::Y4m;
+        video.framesPerSecond = mOptions.framesPerSecond;
+        video.maxQueuedFrames = mOptions.maxPendingWrites;
+        mVideo = std::make_unique<VideoEncoder>(jobs, video);
+    }
+    else if(!mOptions.path.empty()) {
+        mkdir(mOptions.path.c_str(), 0755);
+    }
+
+    mSlots.resize(mOptions.ringSize);
+    for(Slot& slot : mSlots) {
+        glGenBuffers(1, &slot.buffer);
+    }
+}
+
+FrameCapture::~FrameCapture() {
+    Finish();
+    for(Slot& slot : mSlots) {
+        glDeleteBuffers(1, &slot.buffer);
+    }
+}
+
+void FrameCapture::Capture(int width, int height, const std::string& path, CompletionCallback done) {
+    if(width <= 0 || height <= 0) {
+        return;
+    }
+    if(mInFlight == (int)mSlots.size()) {
+        // every buffer still waits for the GPU or for Update(); the oldest frame has to come out first
+        ResolveOldest(true);
+    }
+
+    Slot& slot = mSlots[mNext];
+    const size_t size = (size_t)width * height * 4;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    if(slot.capacity < size) {
+        glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)size, nullptr, GL_STREAM_READ);
+        slot.capacity = size;
+    }
+    // RGBA rows are always 4-byte aligned, the default GL_PACK_ALIGNMENT fits.
+    // With a pack buffer bound this only queues the copy, nothing waits for the GPU.
+    // The stored sRGB bytes are what the files need; some drivers decode them while GL_FRAMEBUFFER_SRGB is on.
+    const GLboolean srgb = glIsEnabled(GL_FRAMEBUFFER_SRGB);
+    glDisable(GL_FRAMEBUFFER_SRGB);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if(srgb) {
+        glEnable(GL_FRAMEBUFFER_SRGB); // the caller's later draws still expect encoding
+    }
+
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush(); // lets the fence signal without waiting for a buffer swap (offscreen rendering never swaps)
+    slot.width = width;
+    slot.height = height;
+    slot.frame = mNextFrame++;
+    slot.path = path;
+    slot.done = std::move(done);
+    mNext = (mNext + 1) % (int)mSlots.size();
+    ++mInFlight;
+}
+
+void FrameCapture::Update() {
+    while(mInFlight > 0 && IsReady(mSlots[mOldest], false)) {
+        ResolveOldest(false);
+    }
+    RetireWrites(mWrites.size()); // only drops the handles of writes that finished
+    CollectResults();
+}
+
+void FrameCapture::Finish() {
+    while(mInFlight > 0) {
+        ResolveOldest(true);
+    }
+    RetireWrites(0);
+    CollectResults();
+    std::string error;
+    if(mVideo && !mVideo->Finish(&error)) {
+        std::cout << "Frame capture failed: " << error << "\n";
+    }
+}
+
+bool FrameCapture::IsReady(const Slot& slot, bool wait) const {
+    if(!wait) {
+        const GLenum result = glClientWaitSync(slot.fence, 0, 0);
+        return result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED;
+    }
+    for(;;) {
+        const GLenum result = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 100000000); // 100 ms
+        if(result != GL_TIMEOUT_EXPIRED) {
+            return result != GL_WAIT_FAILED;
+        }
+    }
+}
+
+void FrameCapture::ResolveOldest(bool wait) {
+    Slot& slot = mSlots[mOldest];
+    if(wait) {
+        IsReady(slot, true);
+    }
+    glDeleteSync(slot.fence);
+    slot.fence = nullptr;
+    mOldest = (mOldest + 1) % (int)mSlots.size();
+    --mInFlight;
+
+    // backpressure: the disk (or the encoder) is slower than rendering
+    RetireWrites((size_t)mOptions.maxPendingWrites - 1);
+
+    // copy out and unmap at once, the buffer is reused a few frames from now
+    const size_t size = (size_t)slot.width * slot.height * 4;
+    std::vector<uint8_t> pixels = mVideo ? mVideo->AcquireFrame(size) : AcquireStorage(size);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    const void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)size, GL_MAP_READ_BIT);
+    bool copied = false;
+    if(mapped) {
+        std::memcpy(pixels.data(), mapped, size);
+        copied = glUnmapBuffer(GL_PIXEL_PACK_BUFFER) == GL_TRUE; // false: the contents were lost (e.g. mode switch)
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    CompletionCallback done = std::move(slot.done);
+    slot.done = nullptr;
+    if(!copied) {
+        const std::string error = "frame " + std::to_string(slot.frame) + ": mapping the pixel buffer failed";
+        if(done) {
+            done(false, error);
+        }
+        std::lock_guard<std::mutex> lock(mMutex);
+        mErrors.push_back(error);
+        return;
+    }
+
+    if(mVideo) {
+        mVideo->Submit(std::move(pixels), slot.width, slot.height); // converted on a worker, may wait for a free queue slot
+        if(done) {
+            done(true, std::string());
+        }
+        return;
+    }
+
+    if(slot.path.empty() && mOptions.path.empty()) {
+        // nowhere to write (render server benchmarks): the readback itself is what is measured
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mFreeStorage.push_back(std::move(pixels));
+        }
+        if(done) {
+            done(true, std::string());
+        }
+        return;
+    }
+
+    const uint64_t frame = slot.frame;
+    const std::string path = slot.path;
+    const int width = slot.width;
+    const int height = slot.height;
+    // std::function needs a copyable callable, so the pixels travel in a shared_ptr instead of being copied
+    auto data = std::make_shared<std::vector<uint8_t>>(std::move(pixels));
+    mWrites.push_back(mJobs.Run([this, frame, path, width, height, data, done] {
+        std::string error;
+        const bool ok = WriteFrame(frame, path, width, height, std::move(*data), &error);
+        if(done) {
+            done(ok, error);
+        }
+    }));
+}
+
+void FrameCapture::RetireWrites(size_t keep) {
+    while(!mWrites.empty() && JobSystem::IsFinished(mWrites.front())) {
+        mWrites.pop_front();
+    }
+    while(mWrites.size() > keep) {
+        mJobs.Wait(mWrites.front()); // runs the write here if no worker took it yet
+        mWrites.pop_front();
+    }
+}
+
+std::vector<uint8_t> FrameCapture::AcquireStorage(size_t size) {
+    std::vector<uint8_t> storage;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if(!mFreeStorage.empty()) {
+            storage = std::move(mFreeStorage.back());
+            mFreeStorage.pop_back();
+        }
+    }
+    storage.resize(size); // reused buffers keep their pages, no zero-filling of fresh allocations every frame
+    return storage;
+}
+
+bool FrameCapture::WriteFrame(uint64_t frame, const std::string& explicitPath, int width, int height, std::vector<uint8_t> pixels,
+                              std::string* error) {
+    Image image;
+    image.width = width;
+    image.height = height;
+    image.pixels = std::move(pixels); // bottom-up, exactly what glReadPixels returned
+
+    std::string path = explicitPath;
+    bool png = mOptions.format == CaptureFormat::Png;
+    if(path.empty()) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "frame_%06llu", (unsigned long long)frame);
+        path = mOptions.path + "/" + name + (png ? ".png" : ".ppm");
+    }
+    else {
+        png = path.size() < 4 || path.compare(path.size() - 4, 4, ".ppm") != 0;
+        const size_t slash = path.find_last_of('/');
+        if(slash != std::string::npos) {
+            mkdir(path.substr(0, slash).c_str(), 0755);
+        }
+    }
+    const std::string temporary = path + ".tmp";
+
+    // the alpha channel of the window is whatever blending left there, not worth keeping
+    std::string message;
+    bool ok = png ? WritePngFile(temporary, image, mOptions.pngLevel, false, &message) : WritePpmFile(temporary, image, &message);
+    if(ok && std::rename(temporary.c_str(), path.c_str()) != 0) {
+        ok = Fail(&message, "cannot rename " + temporary);
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    if(mFreeStorage.size() < (size_t)mOptions.maxPendingWrites) {
+        mFreeStorage.push_back(std::move(image.pixels));
+    }
+    if(ok) {
+        ++mFinishedWrites;
+    }
+    else {
+        mErrors.push_back(message);
+    }
+    if(error) {
+        *error = message;
+    }
+    return ok;
+}
+
+void FrameCapture::CollectResults() {
+    std::vector<std::string> errors;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mWritten = mFinishedWrites;
+        errors.swap(mErrors);
+    }
+    for(const std::string& error : errors) {
+        std::cout << "Frame capture failed: " << error << "\n";
+    }
+}
+
+bool ParseCaptureFormat(const char* name, CaptureFormat& format) {
+    if(std::strcmp(name, "png") == 0) {
+        format = CaptureFormat::Png;
+        return true;
+    }
+    if(std::strcmp(name, "ppm") == 0) {
+        format = CaptureFormat::Ppm;
+        return true;
+    }
+    if(std::strcmp(name, "y4m") == 0) {
+        format = CaptureFormat::Y4m;
+        return true;
+    }
+    if(std::strcmp(name, "ffmpeg") == 0) {
+        format = CaptureFormat::Ffmpeg;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+/*
+Frame capture without stalling the pipeline.
+
+A glReadPixels into client memory waits until the GPU finished the frame. Instead every captured frame is read
+into the next buffer of a small GL_PIXEL_PACK_BUFFER ring (the copy is queued like any other command) followed
+by a fence. Update() maps a buffer only once its fence signaled, typically a frame or two later, copies the
+pixels out and unmaps it right away, and a worker job encodes and writes the file. CPU, GPU and disk work on
+different frames at the same time.
+
+Nothing is dropped: if the ring is full (the GPU is that far behind) Capture() waits for the oldest readback,
+and if more files are being written than 'maxPendingWrites', for the oldest write. Both only happen when
+capturing is slower than rendering and keep the memory use bounded.
+
+Image formats write <path>/frame_000000.png (or .ppm), numbered in capture order. They appear atomically
+(written to a .tmp file and renamed), so a consumer polling the directory never sees a partial frame.
+Video formats send every frame to a VideoEncoder (video_encoder.hpp) writing the file <path>; its bounded queue
+throttles capturing the same way.
+*/
+
+#include <glad/glad.h>
+
+#include "job_system.hpp"
+#include "video_encoder.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum class CaptureFormat {
+    Png, // fast deflate (image_encoder.hpp)
+    Ppm, // binary PPM: no compression at all, cheapest to write
+    Y4m,    // one YUV 4:2:0 video file
+    Ffmpeg, // the same stream piped into ffmpeg, which compresses it (format from the file extension)
+};
+
+struct FrameCaptureOptions {
+    std::string path = "capture"; // directory for image formats, file for video formats
+    CaptureFormat format = CaptureFormat::Png;
+    int pngLevel = 1;           // 0 = stored .. 9, see EncodePng
+    int ringSize = 4;           // pack buffers, i.e. frames the readback may lag behind rendering
+    int maxPendingWrites = 0;   // frames being encoded/written at once; 0 = two per worker thread
+    int framesPerSecond = 60;   // video formats only
+};
+
+class FrameCapture {
+public:
+    FrameCapture(JobSystem& jobs, const FrameCaptureOptions& options); // needs a current GL context
+    ~FrameCapture(); // Finish()
+
+    FrameCapture(const FrameCapture&) = delete;
+    FrameCapture& operator=(const FrameCapture&) = delete;
+
+    // Called once the file is written (worker thread) or the frame failed: ok, error message
+    using CompletionCallback = std::function<void(bool, const std::string&)>;
+
+    // Queues a readback of the bottom-left width x height pixels of the bound read framebuffer.
+    // Call after the frame is complete and before swapping. Image formats write to 'path' instead of the next
+    // numbered file if one is given (.ppm, anything else is PNG). Without either path the frame is only read back.
+    void Capture(int width, int height, const std::string& path = std::string(), CompletionCallback done = nullptr);
+
+    // Hands finished readbacks to the writer jobs; call once per frame
+    void Update();
+
+    // Waits for every queued readback and file write
+    void Finish();
+
+    bool HasPendingWork() const { return mInFlight > 0 || !mWrites.empty(); }
+    uint64_t CapturedCount() const { return mNextFrame; }
+    uint64_t WrittenCount() const { return mVideo ? mVideo->WrittenCount() : mWritten; }
+
+private:
+    struct Slot {
+        GLuint buffer = 0;
+        size_t capacity = 0;
+        GLsync fence = nullptr;
+        int width = 0;
+        int height = 0;
+        uint64_t frame = 0;
+        std::string path;
+        CompletionCallback done;
+    };
+
+    void ResolveOldest(bool wait);                  // maps, copies out and starts the writer job
+    bool IsReady(const Slot& slot, bool wait) const;
+    void RetireWrites(size_t keep);                 // waits until at most 'keep' writes are in flight
+    std::vector<uint8_t> AcquireStorage(size_t size);
+    bool WriteFrame(uint64_t frame, const std::string& path, int width, int height, std::vector<uint8_t> pixels,
+                    std::string* error); // worker thread
+    void CollectResults();
+
+    JobSystem& mJobs;
+    FrameCaptureOptions mOptions;
+    std::vector<Slot> mSlots;
+    int mNext = 0;      // ring position of the next Capture
+    int mOldest = 0;    // ring position of the next Resolve
+    int mInFlight = 0;
+    uint64_t mNextFrame = 0;
+    uint64_t mWritten = 0;
+
+    std::deque<JobHandle> mWrites; // oldest first
+    std::unique_ptr<VideoEncoder> mVideo; // video formats
+
+    std::mutex mMutex; // guards the members below, shared with the writer jobs
+    std::vector<std::vector<uint8_t>> mFreeStorage; // pixel buffers of finished writes, reused
+    uint64_t mFinishedWrites = 0;
+    std::vector<std::string> mErrors;
+};
+
+bool ParseCaptureFormat(const char* name, CaptureFormat& format); // "png", "ppm", "y4m" or "ffmpeg"
@@ -0,0 +1,60 @@
+#include "frame_limiter.hpp"
+
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CPU_RELAX() _mm_pause()
+#else
+#define CPU_RELAX() std::this_thread::yield()
+#endif
+
+FrameLimiter::FrameLimiter(double maxFrameRate) {
+    SetMaxFrameRate(maxFrameRate);
+}
+
+void FrameLimiter::SetMaxFrameRate(double maxFrameRate) {
+    mMaxFrameRate = maxFrameRate;
+    if(maxFrameRate > 0.0) {
+        mFramePeriod = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / maxFrameRate));
+    }
+    else {
+        mFramePeriod = Clock::duration::zero();
+    }
+    Reset();
+}
+
+void FrameLimiter::Reset() {
+    mHasDeadline = false;
+}
+
+void FrameLimiter::Wait() {
+    if(mFramePeriod == Clock::duration::zero()) {
+        return;
+    }
+
+    Clock::time_point now = Clock::now();
+    if(!mHasDeadline) {
+        mNextDeadline = now + mFramePeriod;
+        mHasDeadline = true;
+    }
+
+    // 1) coarse sleep: hand the core back to the OS until ~1 ms before the deadline
+    Clock::time_point sleepUntil = mNextDeadline - mSpinThreshold;
+    if(now < sleepUntil) {
+        std::this_thread::sleep_for(sleepUntil - now);
+    }
+
+    // 2) fine spin: the last stretch is burned on the CPU so the deadline is hit precisely
+    while(Clock::now() < mNextDeadline) {
+        CPU_RELAX();
+    }
+
+    // Advance by whole periods so small overshoots do not accumulate into drift.
+    // If we fell more than a frame behind (e.g. a hitch), restart from now instead of trying to catch up.
+    mNextDeadline += mFramePeriod;
+    now = Clock::now();
+    if(now > mNextDeadline) {
+        mNextDeadline = now + mFramePeriod;
+    }
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+/*
+FrameLimiter caps how often the main loop runs. It sleeps for the bulk of the remaining frame time and
+spin-waits the last ~1 ms, because sleep_for() on a loaded host routinely overshoots by a millisecond or more.
+*/
+
+#include <chrono>
+
+class FrameLimiter {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // maxFrameRate <= 0 disables the cap (Wait() returns immediately)
+    explicit FrameLimiter(double maxFrameRate = 0.0);
+
+    void SetMaxFrameRate(double maxFrameRate);
+    double GetMaxFrameRate() const { return mMaxFrameRate; }
+
+    // Blocks until the next frame deadline. Call once per frame, after presenting.
+    void Wait();
+
+    // Forgets the deadline history, e.g. after the loop was blocked waiting for events
+    void Reset();
+
+private:
+    double mMaxFrameRate = 0.0;
+    Clock::duration mFramePeriod{};
+    Clock::duration mSpinThreshold = std::chrono::milliseconds(1);
+    Clock::time_point mNextDeadline{};
+    bool mHasDeadline = false;
+};
@@ -0,0 +1,420 @@
+#include "gpu_culler.hpp"
+
+#include <algorithm>
+
+static bool Fail(std::string* error, const std::string& message) {
+    if(error) {
+        *error = message;
+    }
+    return false;
+}
+
+// ------------------------------------------------------------------ shaders ------------------------------------------------------------------
+
+// One invocation per object. Objects beyond 65535 work groups continue in gl_GlobalInvocationID.y.
+static const char* CullComputeShaderSource = R"(#version 410 core
+#extension GL_ARB_compute_shader : require
+#extension GL_ARB_shader_storage_buffer_object : require
+layout(local_size_x = 64) in;
+
+struct DrawCommand {
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int baseVertex;
+    uint baseInstance;
+};
+
+layout(std430) readonly buffer WorldMatrices { mat4 worldMatrices[]; };
+layout(std430) writeonly buffer DrawCommands { DrawCommand commands[]; };
+layout(std430) buffer DrawCount { uint drawCount; };
+
+uniform mat4 u_ViewProjection;   // projection * view * u_ModelMatrix
+uniform vec4 u_FrustumPlanes[6]; // in the same space, normalized
+uniform vec3 u_LocalCenter;      // mesh AABB
+uniform vec3 u_LocalExtent;
+uniform uint u_ObjectCount;
+uniform uint u_IndexCount;
+uniform int u_HiZLevels;         // 0 = frustum only
+uniform sampler2D u_HiZ;         // max depth pyramid
+
+bool InsideFrustum(vec3 center, vec3 extent) {
+    for(int i = 0; i < 6; ++i) {
+        vec4 plane = u_FrustumPlanes[i];
+        if(dot(plane.xyz, center) + plane.w + dot(abs(plane.xyz), extent) < 0.0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool VisibleInHiZ(vec3 center, vec3 extent) {
+    vec2 minUv = vec2(1.0);
+    vec2 maxUv = vec2(0.0);
+    float nearest = 1.0;
+    for(int corner = 0; corner < 8; ++corner) {
+        vec3 side = vec3((corner & 1) != 0 ? 1.0 : -1.0, (corner & 2) != 0 ? 1.0 : -1.0, (corner & 4) != 0 ? 1.0 : -1.0);
+        vec4 clip = u_ViewProjection * vec4(center + side * extent, 1.0);
+        if(clip.w <= 0.0 || clip.z < -clip.w) {
+            return true; // reaches in front of the near plane
+        }
+        vec3 ndc = clip.xyz / clip.w;
+        minUv = min(minUv, ndc.xy * 0.5 + 0.5);
+        maxUv = max(maxUv, ndc.xy * 0.5 + 0.5);
+        nearest = min(nearest, ndc.z * 0.5 + 0.5);
+    }
+    minUv = clamp(minUv, 0.0, 1.0);
+    maxUv = clamp(maxUv, 0.0, 1.0);
+
+    // the level where the box covers at most 2x2 texels
+    vec2 size = (maxUv - minUv) * vec2(textureSize(u_HiZ, 0));
+    int level = clamp(int(ceil(log2(max(max(size.x, size.y), 1.0)))), 0, u_HiZLevels - 1);
+    ivec2 levelMax = textureSize(u_HiZ, level) - 1;
+    ivec2 a = min(ivec2(minUv * vec2(levelMax + 1)), levelMax);
+    ivec2 b = min(ivec2(maxUv * vec2(levelMax + 1)), levelMax);
+    float farthest = max(max(texelFetch(u_HiZ, a, level).r, texelFetch(u_HiZ, ivec2(b.x, a.y), level).r),
+                         max(texelFetch(u_HiZ, ivec2(a.x, b.y), level).r, texelFetch(u_HiZ, b, level).r));
+    return nearest <= farthest;
+}
+
+void main() {
+    uint object = gl_GlobalInvocationID.x + gl_GlobalInvocationID.y * gl_NumWorkGroups.x * gl_WorkGroupSize.x;
+    if(object >= u_ObjectCount) {
+        return;
+    }
+
+    // world AABB of the object: center transformed, extent through the absolute 3x3
+    mat4 world = worldMatrices[object];
+    vec3 center = (world * vec4(u_LocalCenter, 1.0)).xyz;
+    vec3 extent = abs(world[0].xyz) * u_LocalExtent.x + abs(world[1].xyz) * u_LocalExtent.y + abs(world[2].xyz) * u_LocalExtent.z;
+    if(!InsideFrustum(center, extent)) {
+        return;
+    }
+    if(u_HiZLevels > 0 && !VisibleInHiZ(center, extent)) {
+        return;
+    }
+
+    uint slot = atomicAdd(drawCount, 1u);
+    commands[slot] = DrawCommand(u_IndexCount, 1u, 0u, 0, object);
+}
+)";
+
+static const char* DepthVertexShaderSource = R"(#version 410 core
+layout(location = 3) in vec3 position;
+layout(location = 4) in mat4 instanceModel;
+uniform mat4 u_ViewProjection;
+void main()
+{
+   gl_Position = u_ViewProjection * instanceModel * vec4(position, 1.0);
+}
+)";
+
+static const char* DepthFragmentShaderSource = R"(#version 410 core
+void main()
+{
+}
+)";
+
+// Destination texel = max of the 2x2 source texels it covers (clamped at odd edges)
+static const char* ReduceComputeShaderSource = R"(#version 410 core
+#extension GL_ARB_compute_shader : require
+#extension GL_ARB_shader_image_load_store : require
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(r32f) writeonly uniform image2D u_Destination;
+uniform sampler2D u_Source;
+uniform int u_SourceLevel;
+uniform ivec2 u_DestinationSize;
+
+void main() {
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    if(texel.x >= u_DestinationSize.x || texel.y >= u_DestinationSize.y) {
+        return;
+    }
+    ivec2 sourceMax = textureSize(u_Source, u_SourceLevel) - 1;
+    ivec2 source = texel * 2;
+    float depth = max(max(texelFetch(u_Source, min(source, sourceMax), u_SourceLevel).r,
+                          texelFetch(u_Source, min(source + ivec2(1, 0), sourceMax), u_SourceLevel).r),
+                      max(texelFetch(u_Source, min(source + ivec2(0, 1), sourceMax), u_SourceLevel).r,
+                          texelFetch(u_Source, min(source + ivec2(1, 1), sourceMax), u_SourceLevel).r));
+    imageStore(u_Destination, texel, vec4(depth));
+}
+)";
+
+static GLuint CompileCullingShader(GLenum type, const char* source, std::string* error) {
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+    GLint compiled = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+    if(compiled != GL_TRUE) {
+        char log[1024];
+        glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+        Fail(error, std::string("culling shader failed to compile:\n") + log);
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+static GLuint LinkCullingProgram(const char* firstSource, GLenum firstType, const char* secondSource, std::string* error) {
+    GLuint shaders[2] = {CompileCullingShader(firstType, firstSource, error),
+                         secondSource ? CompileCullingShader(GL_FRAGMENT_SHADER, secondSource, error) : 0};
+    if(shaders[0] == 0 || (secondSource && shaders[1] == 0)) {
+        glDeleteShader(shaders[0]);
+        glDeleteShader(shaders[1]);
+        return 0;
+    }
+    GLuint program = glCreateProgram();
+    for(GLuint shader : shaders) {
+        if(shader != 0) {
+            glAttachShader(program, shader);
+        }
+    }
+    glLinkProgram(program);
+    for(GLuint shader : shaders) {
+        if(shader != 0) {
+            glDetachShader(program, shader);
+            glDeleteShader(shader);
+        }
+    }
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if(linked != GL_TRUE) {
+        char log[1024];
+        glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+        Fail(error, std::string("culling program failed to link:\n") + log);
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+// ------------------------------------------------------------------ GpuCuller ------------------------------------------------------------------
+
+bool GpuCuller::IsSupported(std::string* missing) {
+    const struct {
+        int available;
+        const char* name;
+    } extensions[] = {
+        {GLAD_GL_ARB_compute_shader, "GL_ARB_compute_shader"},
+        {GLAD_GL_ARB_shader_storage_buffer_object, "GL_ARB_shader_storage_buffer_object"},
+        {GLAD_GL_ARB_program_interface_query, "GL_ARB_program_interface_query"},
+        {GLAD_GL_ARB_shader_image_load_store, "GL_ARB_shader_image_load_store"},
+        {GLAD_GL_ARB_multi_draw_indirect, "GL_ARB_multi_draw_indirect"},
+        {GLAD_GL_ARB_base_instance, "GL_ARB_base_instance"},
+        {GLAD_GL_ARB_indirect_parameters, "GL_ARB_indirect_parameters"},
+    };
+    for(const auto& extension : extensions) {
+        if(!extension.available) {
+            return Fail(missing, extension.name);
+        }
+    }
+    return true;
+}
+
+GpuCuller::~GpuCuller() {
+    const GLuint buffers[] = {mMatrixBuffer, mUvRectBuffer, mCommandBuffer, mCountBuffer};
+    glDeleteBuffers(4, buffers);
+    glDeleteProgram(mCullProgram);
+    glDeleteProgram(mDepthProgram);
+    glDeleteProgram(mReduceProgram);
+    glDeleteFramebuffers(1, &mDepthFramebuffer);
+    const GLuint textures[] = {mDepthTexture, mPyramidTexture};
+    glDeleteTextures(2, textures);
+}
+
+bool GpuCuller::Initialize(size_t objectCount, bool hiZ, std::string* error) {
+    mObjectCount = objectCount;
+    mHiZ = hiZ;
+
+    mCullProgram = LinkCullingProgram(CullComputeShaderSource, GL_COMPUTE_SHADER, nullptr, error);
+    if(mCullProgram == 0) {
+        return false;
+    }
+    glShaderStorageBlockBinding(mCullProgram, glGetProgramResourceIndex(mCullProgram, GL_SHADER_STORAGE_BLOCK, "WorldMatrices"), 0);
+    glShaderStorageBlockBinding(mCullProgram, glGetProgramResourceIndex(mCullProgram, GL_SHADER_STORAGE_BLOCK, "DrawCommands"), 1);
+    glShaderStorageBlockBinding(mCullProgram, glGetProgramResourceIndex(mCullProgram, GL_SHADER_STORAGE_BLOCK, "DrawCount"), 2);
+    const char* const cullUniforms[8] = {"u_ViewProjection", "u_FrustumPlanes", "u_LocalCenter", "u_LocalExtent",
+                                         "u_ObjectCount", "u_IndexCount", "u_HiZLevels", "u_HiZ"};
+    for(int i = 0; i < 8; ++i) {
+        mCullLocations[i] = glGetUniformLocation(mCullProgram, cullUniforms[i]);
+    }
+
+    // per-object buffers: written by the CPU (matrices, rects) or by the cull shader (commands), never read back
+    glGenBuffers(1, &mMatrixBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, mMatrixBuffer);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)(objectCount * sizeof(glm::mat4)), nullptr, GL_DYNAMIC_DRAW);
+    glGenBuffers(1, &mUvRectBuffer); // filled once an atlas is loaded
+    glGenBuffers(1, &mCommandBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, mCommandBuffer);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)(objectCount * 5 * sizeof(GLuint)), nullptr, GL_DYNAMIC_COPY);
+    const GLuint zero = 0;
+    glGenBuffers(1, &mCountBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, mCountBuffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(GLuint), &zero, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    if(!hiZ) {
+        return true;
+    }
+
+    mDepthProgram = LinkCullingProgram(DepthVertexShaderSource, GL_VERTEX_SHADER, DepthFragmentShaderSource, error);
+    mReduceProgram = LinkCullingProgram(ReduceComputeShaderSource, GL_COMPUTE_SHADER, nullptr, error);
+    if(mDepthProgram == 0 || mReduceProgram == 0) {
+        return false;
+    }
+    mDepthViewProjectionLocation = glGetUniformLocation(mDepthProgram, "u_ViewProjection");
+    mReduceLocations[0] = glGetUniformLocation(mReduceProgram, "u_Source");
+    mReduceLocations[1] = glGetUniformLocation(mReduceProgram, "u_SourceLevel");
+    mReduceLocations[2] = glGetUniformLocation(mReduceProgram, "u_DestinationSize");
+    glUseProgram(mReduceProgram);
+    glUniform1i(mReduceLocations[0], 0);
+    glUniform1i(glGetUniformLocation(mReduceProgram, "u_Destination"), 0);
+    glUseProgram(0);
+
+    // depth-only target of the pre-pass, sampled with texelFetch (no comparison)
+    glGenTextures(1, &mDepthTexture);
+    glBindTexture(GL_TEXTURE_2D, mDepthTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, HiZWidth, HiZHeight, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+    // the pyramid: half the depth target down to 1x1
+    glGenTextures(1, &mPyramidTexture);
+    glBindTexture(GL_TEXTURE_2D, mPyramidTexture);
+    int width = HiZWidth / 2;
+    int height = HiZHeight / 2;
+    for(mPyramidLevels = 0; ; ++mPyramidLevels) {
+        glTexImage2D(GL_TEXTURE_2D, mPyramidLevels, GL_R32F, width, height, 0, GL_RED, GL_FLOAT, nullptr);
+        if(width == 1 && height == 1) {
+            break;
+        }
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+    ++mPyramidLevels;
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, mPyramidLevels - 1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &mDepthFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, mDepthFramebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, mDepthTexture, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    const bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if(!complete) {
+        return Fail(error, "the Hi-Z depth target is incomplete");
+    }
+    return true;
+}
+
+void GpuCuller::UploadMatrices(const glm::mat4* matrices, size_t count) {
+    glBindBuffer(GL_ARRAY_BUFFER, mMatrixBuffer);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr)(std::min(count, mObjectCount) * sizeof(glm::mat4)), matrices);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void GpuCuller::SetUvRects(const std::vector<glm::vec4>& materialRects) {
+    if(materialRects.empty()) {
+        return;
+    }
+    std::vector<glm::vec4> rects(mObjectCount);
+    for(size_t i = 0; i < mObjectCount; ++i) {
+        rects[i] = materialRects[i % materialRects.size()];
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, mUvRectBuffer);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)(rects.size() * sizeof(glm::vec4)), rects.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void GpuCuller::RenderHiZ(const glm::mat4& viewProjection, GLuint vertexArray) {
+    glBindFramebuffer(GL_FRAMEBUFFER, mDepthFramebuffer);
+    glViewport(0, 0, HiZWidth, HiZHeight);
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    if(mCommandIndexCount > 0) {
+        glUseProgram(mDepthProgram);
+        glUniformMatrix4fv(mDepthViewProjectionLocation, 1, GL_FALSE, &viewProjection[0][0]);
+        Draw(vertexArray);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0); // the reduction samples the depth texture
+
+    // level 0 from the depth target, every further level from the one above
+    glUseProgram(mReduceProgram);
+    glActiveTexture(GL_TEXTURE0);
+    int width = HiZWidth / 2;
+    int height = HiZHeight / 2;
+    for(int level = 0; level < mPyramidLevels; ++level) {
+        glBindTexture(GL_TEXTURE_2D, level == 0 ? mDepthTexture : mPyramidTexture);
+        glUniform1i(mReduceLocations[1], level == 0 ? 0 : level - 1);
+        glUniform2i(mReduceLocations[2], width, height);
+        glBindImageTexture(0, mPyramidTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        glDispatchCompute((GLuint)(width + 7) / 8, (GLuint)(height + 7) / 8, 1);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+    glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void GpuCuller::Cull(const glm::mat4& viewProjection, const MeshBounds& localBounds, GLsizei indexCount, GLuint vertexArray) {
+    if(mCommandIndexCount != indexCount) {
+        mCommandIndexCount = 0; // the mesh changed: last frame's commands would index past the new index buffer
+    }
+    if(mHiZ) {
+        RenderHiZ(viewProjection, vertexArray);
+    }
+
+    const GLuint zero = 0;
+    glBindBuffer(GL_ARRAY_BUFFER, mCountBuffer);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(GLuint), &zero);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    const Frustum frustum = Frustum::FromMatrix(viewProjection);
+    const glm::vec3 center = (localBounds.aabbMin + localBounds.aabbMax) * 0.5f;
+    const glm::vec3 extent = (localBounds.aabbMax - localBounds.aabbMin) * 0.5f;
+    glUseProgram(mCullProgram);
+    glUniformMatrix4fv(mCullLocations[0], 1, GL_FALSE, &viewProjection[0][0]);
+    glUniform4fv(mCullLocations[1], 6, &frustum.planes[0][0]);
+    glUniform3f(mCullLocations[2], center.x, center.y, center.z);
+    glUniform3f(mCullLocations[3], extent.x, extent.y, extent.z);
+    glUniform1ui(mCullLocations[4], (GLuint)mObjectCount);
+    glUniform1ui(mCullLocations[5], (GLuint)indexCount);
+    glUniform1i(mCullLocations[6], mHiZ ? mPyramidLevels : 0);
+    glUniform1i(mCullLocations[7], 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, mPyramidTexture);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, mMatrixBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, mCommandBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, mCountBuffer);
+
+    const GLuint groups = (GLuint)((mObjectCount + 63) / 64);
+    const GLuint groupsX = std::min<GLuint>(groups, 65535);
+    glDispatchCompute(groupsX, (groups + groupsX - 1) / groupsX, 1);
+    // the commands and the count are read by the indirect draw next
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glUseProgram(0);
+    mCommandIndexCount = indexCount;
+}
+
+void GpuCuller::Draw(GLuint vertexArray) const {
+    glBindVertexArray(vertexArray);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mCommandBuffer);
+    glBindBuffer(GL_PARAMETER_BUFFER_ARB, mCountBuffer);
+    glMultiDrawElementsIndirectCountARB(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, 0, (GLsizei)mObjectCount, 0);
+    glBindBuffer(GL_PARAMETER_BUFFER_ARB, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindVertexArray(0);
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+/*
+GPU-driven culling (--gpu-culling <frustum|hiz>): the world matrix of every object lives in a buffer on the GPU,
+a compute shader culls all of them and appends one draw command per surviving object to an indirect buffer,
+which a single glMultiDrawElementsIndirectCountARB consumes. The CPU neither walks objects nor knows how many
+are drawn; per frame it only uploads the matrices that changed (all of them, when any did) and issues a few
+commands.
+
+Needs GL_ARB_compute_shader, _shader_storage_buffer_object, _program_interface_query, _shader_image_load_store,
+_multi_draw_indirect, _base_instance and _indirect_parameters (core since GL 4.3 / 4.6; Mesa's llvmpipe has them
+all). IsSupported() tells which one is missing so the caller can stay on the CPU path.
+
+- Culling: the mesh's local AABB is transformed by each world matrix on the GPU and tested against the frustum
+  planes. Commands use baseInstance = object index, so the instanced attributes (world matrix, atlas UV rect)
+  are fetched from the full per-object buffers and nothing has to be compacted besides the commands.
+- Hi-Z (hiz): before culling, the objects the previous frame drew are rendered depth-only with this frame's
+  camera into a small target; a second compute shader reduces it into a max-depth mip chain. Everything in it is
+  real geometry seen from the current camera, so testing against it never hides a visible object; objects that
+  were culled last frame simply do not occlude yet.
+- Appended commands come in no particular order, so the scene is drawn with the depth test on.
+*/
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "culling.hpp"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class GpuCuller {
+public:
+    static const int HiZWidth = 512;   // depth target of the Hi-Z pre-pass
+    static const int HiZHeight = 256;  // (the pyramid starts at half of it)
+
+    // Needs a current GL context. False with the missing extension in 'missing'.
+    static bool IsSupported(std::string* missing);
+
+    GpuCuller() = default;
+    ~GpuCuller();
+
+    GpuCuller(const GpuCuller&) = delete;
+    GpuCuller& operator=(const GpuCuller&) = delete;
+
+    // Compiles the compute programs and allocates the buffers for 'objectCount' objects
+    bool Initialize(size_t objectCount, bool hiZ, std::string* error = nullptr);
+
+    // Instanced attribute sources for the scene VAO: world matrices (locations 4..7), atlas UV rects (location 8)
+    GLuint MatrixBuffer() const { return mMatrixBuffer; }
+    GLuint UvRectBuffer() const { return mUvRectBuffer; }
+
+    // World matrices of all objects, by object index
+    void UploadMatrices(const glm::mat4* matrices, size_t count);
+
+    // Object i uses material i % rects.size(); no rects = no atlas
+    void SetUvRects(const std::vector<glm::vec4>& materialRects);
+
+    // Hi-Z pre-pass (with the previous frame's commands) and the culling dispatch. 'viewProjection' is
+    // projection * view * u_ModelMatrix; 'vertexArray' is the scene VAO built on MatrixBuffer(). Changes the
+    // framebuffer binding, viewport and depth test, the caller binds the scene target afterwards.
+    void Cull(const glm::mat4& viewProjection, const MeshBounds& localBounds, GLsizei indexCount, GLuint vertexArray);
+
+    // Draws the commands written by the last Cull() with the currently bound program
+    void Draw(GLuint vertexArray) const;
+
+private:
+    void RenderHiZ(const glm::mat4& viewProjection, GLuint vertexArray);
+
+    size_t mObjectCount = 0;
+    bool mHiZ = false;
+    GLsizei mCommandIndexCount = 0; // index count the commands in mCommandBuffer were written with
+
+    GLuint mMatrixBuffer = 0;
+    GLuint mUvRectBuffer = 0;
+    GLuint mCommandBuffer = 0;      // DrawElementsIndirectCommand per object, only the first drawCount are valid
+    GLuint mCountBuffer = 0;        // drawCount, GL_PARAMETER_BUFFER_ARB
+
+    GLuint mCullProgram = 0;
+    GLint mCullLocations[8] = {};   // see Initialize()
+
+    GLuint mDepthProgram = 0;       // Hi-Z pre-pass: positions only, no fragment work
+    GLint mDepthViewProjectionLocation = -1;
+    GLuint mReduceProgram = 0;
+    GLint mReduceLocations[3] = {}; // u_Source, u_SourceLevel, u_DestinationSize
+    GLuint mDepthFramebuffer = 0;
+    GLuint mDepthTexture = 0;
+    GLuint mPyramidTexture = 0;     // R32F, max depth of each 2x2 of the level above
+    int mPyramidLevels = 0;
+};
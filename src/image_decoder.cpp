@@ -0,0 +1,685 @@
+#include "image_decoder.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+static bool Fail(std::string* error, const std::string& message) {
+    if(error) {
+        *error = message;
+    }
+    return false;
+}
+
+void FlipImageRows(Image& image) {
+    const size_t rowBytes = (size_t)image.width * 4;
+    std::vector<uint8_t> temp(rowBytes);
+    for(int top = 0, bottom = image.height - 1; top < bottom; ++top, --bottom) {
+        std::memcpy(temp.data(), image.Row(top), rowBytes);
+        std::memcpy(image.Row(top), image.Row(bottom), rowBytes);
+        std::memcpy(image.Row(bottom), temp.data(), rowBytes);
+    }
+}
+
+// vvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvv  Inflate (RFC 1951)  vvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvv
+// Canonical Huffman decoding in the style of zlib's "puff": codes are decoded by walking the code lengths, which
+// needs no lookup tables to build and is plenty fast for texture-sized inputs.
+
+namespace {
+
+struct BitReader {
+    const uint8_t* data;
+    size_t size;
+    size_t position = 0;
+    uint32_t bitBuffer = 0;
+    int bitCount = 0;
+    bool overrun = false;
+
+    BitReader(const uint8_t* d, size_t s) : data(d), size(s) {}
+
+    uint32_t Bits(int need) {
+        uint32_t value = bitBuffer;
+        while(bitCount < need) {
+            if(position >= size) {
+                overrun = true;
+                return 0;
+            }
+            value |= (uint32_t)data[position++] << bitCount;
+            bitCount += 8;
+        }
+        bitBuffer = value >> need;
+        bitCount -= need;
+        return value & ((1u << need) - 1);
+    }
+
+    void AlignToByte() {
+        bitBuffer = 0;
+        bitCount = 0;
+    }
+};
+
+struct Huffman {
+    uint16_t counts[16];   // number of codes of each length
+    uint16_t symbols[320]; // symbols ordered by code
+};
+
+const int MaxBits = 15;
+
+// returns 0 on success (complete or incomplete-but-usable code), < 0 on an over-subscribed code
+int BuildHuffman(Huffman& h, const uint8_t* lengths, int n) {
+    std::memset(h.counts, 0, sizeof(h.counts));
+    for(int symbol = 0; symbol < n; ++symbol) {
+        h.counts[lengths[symbol]]++;
+    }
+    if(h.counts[0] == n) {
+        return 0;
+    }
+    int left = 1;
+    for(int len = 1; len <= MaxBits; ++len) {
+        left <<= 1;
+        left -= h.counts[len];
+        if(left < 0) {
+            return -1;
+        }
+    }
+    uint16_t offsets[MaxBits + 1];
+    offsets[1] = 0;
+    for(int len = 1; len < MaxBits; ++len) {
+        offsets[len + 1] = offsets[len] + h.counts[len];
+    }
+    for(int symbol = 0; symbol < n; ++symbol) {
+        if(lengths[symbol] != 0) {
+            h.symbols[offsets[lengths[symbol]]++] = (uint16_t)symbol;
+        }
+    }
+    return left;
+}
+
+int DecodeSymbol(BitReader& in, const Huffman& h) {
+    int code = 0, first = 0, index = 0;
+    for(int len = 1; len <= MaxBits; ++len) {
+        code |= (int)in.Bits(1);
+        if(in.overrun) {
+            return -1;
+        }
+        int count = h.counts[len];
+        if(code - count < first) {
+            return h.symbols[index + (code - first)];
+        }
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+const uint16_t LengthBase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+const uint16_t LengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+const uint16_t DistanceBase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+const uint16_t DistanceExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+bool InflateCodes(BitReader& in, std::vector<uint8_t>& out, const Huffman& lengthCode, const Huffman& distanceCode) {
+    while(true) {
+        int symbol = DecodeSymbol(in, lengthCode);
+        if(symbol < 0) {
+            return false;
+        }
+        if(symbol < 256) {
+            out.push_back((uint8_t)symbol);
+            continue;
+        }
+        if(symbol == 256) {
+            return true; // end of block
+        }
+
+        symbol -= 257;
+        if(symbol >= 29) {
+            return false;
+        }
+        size_t length = LengthBase[symbol] + in.Bits(LengthExtra[symbol]);
+
+        int distanceSymbol = DecodeSymbol(in, distanceCode);
+        if(distanceSymbol < 0 || distanceSymbol >= 30) {
+            return false;
+        }
+        size_t distance = DistanceBase[distanceSymbol] + in.Bits(DistanceExtra[distanceSymbol]);
+        if(in.overrun || distance > out.size()) {
+            return false;
+        }
+
+        // byte by byte: source and destination may overlap (distance < length repeats a pattern)
+        size_t from = out.size() - distance;
+        for(size_t i = 0; i < length; ++i) {
+            out.push_back(out[from + i]);
+        }
+    }
+}
+
+bool InflateStored(BitReader& in, std::vector<uint8_t>& out) {
+    in.AlignToByte();
+    if(in.position + 4 > in.size) {
+        return false;
+    }
+    unsigned length = in.data[in.position] | (in.data[in.position + 1] << 8);
+    unsigned complement = in.data[in.position + 2] | (in.data[in.position + 3] << 8);
+    in.position += 4;
+    if(length != (~complement & 0xFFFFu) || in.position + length > in.size) {
+        return false;
+    }
+    out.insert(out.end(), in.data + in.position, in.data + in.position + length);
+    in.position += length;
+    return true;
+}
+
+bool InflateFixed(BitReader& in, std::vector<uint8_t>& out) {
+    static Huffman lengthCode, distanceCode;
+    static bool built = [] {
+        uint8_t lengths[288];
+        int symbol = 0;
+        for(; symbol < 144; ++symbol) { lengths[symbol] = 8; }
+        for(; symbol < 256; ++symbol) { lengths[symbol] = 9; }
+        for(; symbol < 280; ++symbol) { lengths[symbol] = 7; }
+        for(; symbol < 288; ++symbol) { lengths[symbol] = 8; }
+        BuildHuffman(lengthCode, lengths, 288);
+        for(symbol = 0; symbol < 30; ++symbol) { lengths[symbol] = 5; }
+        BuildHuffman(distanceCode, lengths, 30);
+        return true;
+    }();
+    (void)built;
+    return InflateCodes(in, out, lengthCode, distanceCode);
+}
+
+bool InflateDynamic(BitReader& in, std::vector<uint8_t>& out) {
+    static const uint8_t order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+    int lengthCount = (int)in.Bits(5) + 257;
+    int distanceCount = (int)in.Bits(5) + 1;
+    int codeCount = (int)in.Bits(4) + 4;
+    if(lengthCount > 286 || distanceCount > 30) {
+        return false;
+    }
+
+    uint8_t lengths[320] = {};
+    for(int i = 0; i < codeCount; ++i) {
+        lengths[order[i]] = (uint8_t)in.Bits(3);
+    }
+    Huffman codeLengthCode;
+    if(BuildHuffman(codeLengthCode, lengths, 19) != 0) {
+        return false; // must be complete
+    }
+
+    int index = 0;
+    while(index < lengthCount + distanceCount) {
+        int symbol = DecodeSymbol(in, codeLengthCode);
+        if(symbol < 0) {
+            return false;
+        }
+        if(symbol < 16) {
+            lengths[index++] = (uint8_t)symbol;
+            continue;
+        }
+        uint8_t repeatValue = 0;
+        int repeat = 0;
+        if(symbol == 16) {
+            if(index == 0) {
+                return false;
+            }
+            repeatValue = lengths[index - 1];
+            repeat = 3 + (int)in.Bits(2);
+        }
+        else if(symbol == 17) {
+            repeat = 3 + (int)in.Bits(3);
+        }
+        else {
+            repeat = 11 + (int)in.Bits(7);
+        }
+        if(index + repeat > lengthCount + distanceCount) {
+            return false;
+        }
+        while(repeat--) {
+            lengths[index++] = repeatValue;
+        }
+    }
+    if(lengths[256] == 0) {
+        return false; // no end-of-block code
+    }
+
+    Huffman lengthCode, distanceCode;
+    int lengthResult = BuildHuffman(lengthCode, lengths, lengthCount);
+    if(lengthResult < 0 || (lengthResult > 0 && lengthCount - lengthCode.counts[0] != 1)) {
+        return false;
+    }
+    int distanceResult = BuildHuffman(distanceCode, lengths + lengthCount, distanceCount);
+    if(distanceResult < 0 || (distanceResult > 0 && distanceCount - distanceCode.counts[0] != 1)) {
+        return false;
+    }
+    return InflateCodes(in, out, lengthCode, distanceCode);
+}
+
+} // namespace
+
+bool ZlibInflate(const uint8_t* data, size_t size, std::vector<uint8_t>& out, size_t expectedSize) {
+    if(size < 2) {
+        return false;
+    }
+    uint8_t cmf = data[0], flg = data[1];
+    if((cmf & 0x0F) != 8 || ((cmf << 8) | flg) % 31 != 0 || (flg & 0x20)) {
+        return false; // not deflate, bad header check, or preset dictionary
+    }
+
+    out.clear();
+    out.reserve(expectedSize);
+    BitReader in(data + 2, size - 2);
+
+    bool last = false;
+    while(!last) {
+        last = in.Bits(1) != 0;
+        uint32_t type = in.Bits(2);
+        bool ok = false;
+        if(type == 0)      { ok = InflateStored(in, out); }
+        else if(type == 1) { ok = InflateFixed(in, out); }
+        else if(type == 2) { ok = InflateDynamic(in, out); }
+        if(!ok || in.overrun) {
+            return false;
+        }
+    }
+    return true; // the Adler-32 trailer is not verified; PNG chunks carry their own CRC
+}
+// ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^  Inflate (RFC 1951)  ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^
+
+// vvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvv  PNG  vvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvv
+
+static uint32_t ReadBigEndian32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint8_t Paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+    if(pa <= pb && pa <= pc) { return (uint8_t)a; }
+    if(pb <= pc) { return (uint8_t)b; }
+    return (uint8_t)c;
+}
+
+bool DecodePng(const uint8_t* data, size_t size, Image& image, std::string* error) {
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    if(size < 8 || std::memcmp(data, signature, 8) != 0) {
+        return Fail(error, "not a PNG file");
+    }
+
+    uint32_t width = 0, height = 0;
+    int bitDepth = 0, colorType = -1, interlace = 0;
+    std::vector<uint8_t> compressed;
+    uint8_t palette[256][4];
+    for(int i = 0; i < 256; ++i) {
+        palette[i][0] = palette[i][1] = palette[i][2] = 0;
+        palette[i][3] = 255;
+    }
+    int transparentGray = -1;
+    int transparentRgb[3] = {-1, -1, -1};
+
+    size_t position = 8;
+    bool sawEnd = false;
+    while(position + 12 <= size && !sawEnd) {
+        uint32_t length = ReadBigEndian32(data + position);
+        const uint8_t* type = data + position + 4;
+        const uint8_t* chunk = data + position + 8;
+        if(length > size - position - 12) {
+            return Fail(error, "truncated PNG chunk");
+        }
+
+        if(std::memcmp(type, "IHDR", 4) == 0 && length >= 13) {
+            width = ReadBigEndian32(chunk);
+            height = ReadBigEndian32(chunk + 4);
+            bitDepth = chunk[8];
+            colorType = chunk[9];
+            interlace = chunk[12];
+        }
+        else if(std::memcmp(type, "PLTE", 4) == 0) {
+            for(uint32_t i = 0; i < length / 3 && i < 256; ++i) {
+                palette[i][0] = chunk[i * 3];
+                palette[i][1] = chunk[i * 3 + 1];
+                palette[i][2] = chunk[i * 3 + 2];
+            }
+        }
+        else if(std::memcmp(type, "tRNS", 4) == 0) {
+            if(colorType == 3) {
+                for(uint32_t i = 0; i < length && i < 256; ++i) {
+                    palette[i][3] = chunk[i];
+                }
+            }
+            else if(colorType == 0 && length >= 2) {
+                transparentGray = (chunk[0] << 8) | chunk[1];
+            }
+            else if(colorType == 2 && length >= 6) {
+                for(int c = 0; c < 3; ++c) {
+                    transparentRgb[c] = (chunk[c * 2] << 8) | chunk[c * 2 + 1];
+                }
+            }
+        }
+        else if(std::memcmp(type, "IDAT", 4) == 0) {
+            compressed.insert(compressed.end(), chunk, chunk + length);
+        }
+        else if(std::memcmp(type, "IEND", 4) == 0) {
+            sawEnd = true;
+        }
+        position += 12 + length;
+    }
+
+    if(width == 0 || height == 0 || width > 32768 || height > 32768) {
+        return Fail(error, "bad PNG dimensions");
+    }
+    if(interlace != 0) {
+        return Fail(error, "interlaced PNG is not supported");
+    }
+
+    int channels = 0;
+    switch(colorType) {
+        case 0: channels = 1; break; // gray
+        case 2: channels = 3; break; // RGB
+        case 3: channels = 1; break; // palette
+        case 4: channels = 2; break; // gray + alpha
+        case 6: channels = 4; break; // RGBA
+        default: return Fail(error, "bad PNG color type");
+    }
+    if(bitDepth != 1 && bitDepth != 2 && bitDepth != 4 && bitDepth != 8 && bitDepth != 16) {
+        return Fail(error, "bad PNG bit depth");
+    }
+
+    const size_t bitsPerPixel = (size_t)channels * bitDepth;
+    const size_t stride = (width * bitsPerPixel + 7) / 8;
+    const size_t filterBytes = std::max<size_t>(1, bitsPerPixel / 8); // distance to the "left" byte
+
+    std::vector<uint8_t> raw;
+    if(!ZlibInflate(compressed.data(), compressed.size(), raw, (stride + 1) * height)) {
+        return Fail(error, "corrupt PNG image data");
+    }
+    if(raw.size() < (stride + 1) * height) {
+        return Fail(error, "truncated PNG image data");
+    }
+
+    // ---- undo the per-row filters, in place ----
+    std::vector<uint8_t> zeroRow(stride, 0);
+    for(uint32_t y = 0; y < height; ++y) {
+        uint8_t* row = raw.data() + y * (stride + 1);
+        uint8_t filter = row[0];
+        uint8_t* current = row + 1;
+        const uint8_t* previous = y > 0 ? raw.data() + (y - 1) * (stride + 1) + 1 : zeroRow.data();
+
+        for(size_t x = 0; x < stride; ++x) {
+            int left = x >= filterBytes ? current[x - filterBytes] : 0;
+            int up = previous[x];
+            int upLeft = x >= filterBytes ? previous[x - filterBytes] : 0;
+            switch(filter) {
+                case 0: break;
+                case 1: current[x] = (uint8_t)(current[x] + left); break;
+                case 2: current[x] = (uint8_t)(current[x] + up); break;
+                case 3: current[x] = (uint8_t)(current[x] + ((left + up) >> 1)); break;
+                case 4: current[x] = (uint8_t)(current[x] + Paeth(left, up, upLeft)); break;
+                default: return Fail(error, "bad PNG filter type");
+            }
+        }
+    }
+
+    // ---- expand to RGBA8, writing bottom-up ----
+    image.width = (int)width;
+    image.height = (int)height;
+    image.pixels.assign(image.ByteSize(), 255);
+
+    auto sample = [&](const uint8_t* row, uint32_t x, int channel) -> int {
+        // returns the raw sample value at the file's bit depth
+        if(bitDepth == 8) {
+            return row[x * channels + channel];
+        }
+        if(bitDepth == 16) {
+            const uint8_t* p = row + (x * channels + channel) * 2;
+            return (p[0] << 8) | p[1];
+        }
+        size_t bit = (size_t)x * bitDepth; // sub-byte depths only occur with one channel
+        int shift = 8 - bitDepth - (int)(bit & 7);
+        return (row[bit >> 3] >> shift) & ((1 << bitDepth) - 1);
+    };
+    auto to8 = [&](int value) -> uint8_t {
+        if(bitDepth == 16) { return (uint8_t)(value >> 8); }
+        if(bitDepth == 8)  { return (uint8_t)value; }
+        return (uint8_t)(value * 255 / ((1 << bitDepth) - 1));
+    };
+
+    for(uint32_t y = 0; y < height; ++y) {
+        const uint8_t* row = raw.data() + y * (stride + 1) + 1;
+        uint8_t* dst = image.Row((int)(height - 1 - y));
+        for(uint32_t x = 0; x < width; ++x, dst += 4) {
+            switch(colorType) {
+                case 0: {
+                    int g = sample(row, x, 0);
+                    dst[0] = dst[1] = dst[2] = to8(g);
+                    dst[3] = (g == transparentGray) ? 0 : 255;
+                    break;
+                }
+                case 2: {
+                    int r = sample(row, x, 0), g = sample(row, x, 1), b = sample(row, x, 2);
+                    dst[0] = to8(r); dst[1] = to8(g); dst[2] = to8(b);
+                    dst[3] = (r == transparentRgb[0] && g == transparentRgb[1] && b == transparentRgb[2]) ? 0 : 255;
+                    break;
+                }
+                case 3: {
+                    const uint8_t* entry = palette[sample(row, x, 0) & 0xFF];
+                    dst[0] = entry[0]; dst[1] = entry[1]; dst[2] = entry[2]; dst[3] = entry[3];
+                    break;
+                }
+                case 4:
+                    dst[0] = dst[1] = dst[2] = to8(sample(row, x, 0));
+                    dst[3] = to8(sample(row, x, 1));
+                    break;
+                case 6:
+                    for(int c = 0; c < 4; ++c) {
+                        dst[c] = to8(sample(row, x, c));
+                    }
+                    break;
+            }
+        }
+    }
+    return true;
+}
+// ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^  PNG  ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^
+
+bool DecodeTga(const uint8_t* data, size_t size, Image& image, std::string* error) {
+    if(size < 18) {
+        return Fail(error, "truncated TGA header");
+    }
+    const uint8_t idLength = data[0];
+    const uint8_t colorMapType = data[1];
+    const uint8_t imageType = data[2];
+    const int width = data[12] | (data[13] << 8);
+    const int height = data[14] | (data[15] << 8);
+    const int bitsPerPixel = data[16];
+    const bool topDown = (data[17] & 0x20) != 0;
+
+    const bool rle = imageType == 10 || imageType == 11;
+    const bool gray = imageType == 3 || imageType == 11;
+    if(colorMapType != 0 || !(imageType == 2 || imageType == 3 || rle)) {
+        return Fail(error, "unsupported TGA type (color-mapped or unknown)");
+    }
+    const int bytesPerPixel = bitsPerPixel / 8;
+    if(width <= 0 || height <= 0 || (gray && bytesPerPixel != 1 && bytesPerPixel != 2) ||
+       (!gray && bytesPerPixel != 2 && bytesPerPixel != 3 && bytesPerPixel != 4)) {
+        return Fail(error, "unsupported TGA pixel format");
+    }
+
+    size_t position = 18 + idLength;
+
+    image.width = width;
+    image.height = height;
+    image.pixels.assign(image.ByteSize(), 255);
+
+    auto convert = [&](const uint8_t* p, uint8_t* dst) {
+        if(gray) {
+            dst[0] = dst[1] = dst[2] = p[0];
+            dst[3] = bytesPerPixel == 2 ? p[1] : 255;
+        }
+        else if(bytesPerPixel == 2) {
+            // A1 R5 G5 B5, little endian
+            unsigned v = p[0] | (p[1] << 8);
+            dst[0] = (uint8_t)(((v >> 10) & 31) * 255 / 31);
+            dst[1] = (uint8_t)(((v >> 5) & 31) * 255 / 31);
+            dst[2] = (uint8_t)((v & 31) * 255 / 31);
+            dst[3] = 255;
+        }
+        else {
+            dst[0] = p[2]; dst[1] = p[1]; dst[2] = p[0]; // stored as BGR(A)
+            dst[3] = bytesPerPixel == 4 ? p[3] : 255;
+        }
+    };
+
+    const size_t pixelCount = (size_t)width * height;
+    size_t pixel = 0;
+    auto destination = [&](size_t index) {
+        // file order is bottom-up unless the descriptor says top-down; we always store bottom-up
+        size_t fileRow = index / width, column = index % width;
+        size_t row = topDown ? (height - 1 - fileRow) : fileRow;
+        return image.pixels.data() + (row * width + column) * 4;
+    };
+
+    while(pixel < pixelCount) {
+        if(!rle) {
+            if(position + bytesPerPixel > size) {
+                return Fail(error, "truncated TGA data");
+            }
+            convert(data + position, destination(pixel++));
+            position += bytesPerPixel;
+            continue;
+        }
+
+        if(position >= size) {
+            return Fail(error, "truncated TGA data");
+        }
+        uint8_t header = data[position++];
+        size_t count = (header & 0x7F) + 1;
+        if(pixel + count > pixelCount) {
+            return Fail(error, "corrupt TGA run");
+        }
+        if(header & 0x80) {
+            // run: one pixel value repeated
+            if(position + bytesPerPixel > size) {
+                return Fail(error, "truncated TGA data");
+            }
+            uint8_t value[4];
+            convert(data + position, value);
+            position += bytesPerPixel;
+            while(count--) {
+                std::memcpy(destination(pixel++), value, 4);
+            }
+        }
+        else {
+            // raw packet
+            if(position + count * bytesPerPixel > size) {
+                return Fail(error, "truncated TGA data");
+            }
+            while(count--) {
+                convert(data + position, destination(pixel++));
+                position += bytesPerPixel;
+            }
+        }
+    }
+    return true;
+}
+
+bool DecodePpm(const uint8_t* data, size_t size, Image& image, std::string* error) {
+    if(size < 3 || data[0] != 'P' || (data[1] != '2' && data[1] != '3' && data[1] != '5' && data[1] != '6')) {
+        return Fail(error, "not a PPM/PGM file");
+    }
+    const bool ascii = data[1] == '2' || data[1] == '3';
+    const int channels = (data[1] == '3' || data[1] == '6') ? 3 : 1;
+
+    size_t position = 2;
+    auto readNumber = [&](long& value) -> bool {
+        // skip whitespace and '#' comments
+        while(position < size) {
+            if(data[position] == '#') {
+                while(position < size && data[position] != '\n') { ++position; }
+            }
+            else if(std::isspace(data[position])) {
+                ++position;
+            }
+            else {
+                break;
+            }
+        }
+        if(position >= size || !std::isdigit(data[position])) {
+            return false;
+        }
+        value = 0;
+        while(position < size && std::isdigit(data[position])) {
+            value = value * 10 + (data[position++] - '0');
+        }
+        return true;
+    };
+
+    long width = 0, height = 0, maxValue = 0;
+    if(!readNumber(width) || !readNumber(height) || !readNumber(maxValue) ||
+       width <= 0 || height <= 0 || maxValue <= 0 || maxValue > 65535) {
+        return Fail(error, "bad PPM header");
+    }
+    const int bytesPerSample = maxValue > 255 ? 2 : 1;
+    if(!ascii) {
+        ++position; // exactly one whitespace byte after maxval
+    }
+
+    image.width = (int)width;
+    image.height = (int)height;
+    image.pixels.assign(image.ByteSize(), 255);
+
+    for(long y = 0; y < height; ++y) {
+        uint8_t* dst = image.Row((int)(height - 1 - y)); // PPM is top-down
+        for(long x = 0; x < width; ++x, dst += 4) {
+            long samples[3] = {0, 0, 0};
+            for(int c = 0; c < channels; ++c) {
+                if(ascii) {
+                    if(!readNumber(samples[c])) {
+                        return Fail(error, "truncated PPM data");
+                    }
+                }
+                else {
+                    if(position + bytesPerSample > size) {
+                        return Fail(error, "truncated PPM data");
+                    }
+                    samples[c] = bytesPerSample == 2 ? (data[position] << 8) | data[position + 1] : data[position];
+                    position += bytesPerSample;
+                }
+            }
+            for(int c = 0; c < 3; ++c) {
+                long v = samples[channels == 3 ? c : 0];
+                dst[c] = (uint8_t)std::min(255L, v * 255 / maxValue);
+            }
+        }
+    }
+    return true;
+}
+
+bool DecodeImageMemory(const uint8_t* data, size_t size, const std::string& nameHint, Image& image, std::string* error) {
+    if(size >= 8 && data[0] == 0x89 && data[1] == 'P' && data[2] == 'N' && data[3] == 'G') {
+        return DecodePng(data, size, image, error);
+    }
+    if(size >= 2 && data[0] == 'P' && (data[1] == '2' || data[1] == '3' || data[1] == '5' || data[1] == '6')) {
+        return DecodePpm(data, size, image, error);
+    }
+    // TGA has no magic number; trust the extension
+    std::string extension = nameHint.size() >= 4 ? nameHint.substr(nameHint.size() - 4) : "";
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+    if(extension == ".tga") {
+        return DecodeTga(data, size, image, error);
+    }
+    return Fail(error, "unknown image format: " + nameHint);
+}
+
+bool DecodeImageFile(const std::string& path, Image& image, std::string* error) {
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if(!file.is_open()) {
+        return Fail(error, "could not open " + path);
+    }
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    return DecodeImageMemory(bytes.data(), bytes.size(), path, image, error);
+}
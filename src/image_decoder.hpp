@@ -0,0 +1,41 @@
+#pragma once
+
+/*
+Image file decoding for the texture pipeline (runs on worker threads, no GL calls).
+
+Supported:
+- PNG: all color types, bit depths 1-16, non-interlaced (zlib inflate is implemented in image_decoder.cpp)
+- TGA: uncompressed and RLE true-color / grayscale, 8/16/24/32 bits
+- PPM/PGM: binary (P5/P6) and ASCII (P2/P3), 8 or 16 bits per channel
+
+Every format is converted to 8-bit RGBA. Rows are stored bottom-up, the order glTexImage2D expects, so a
+texture coordinate of (0, 0) is the bottom-left corner of the picture.
+*/
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct Image {
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> pixels; // RGBA8, width * height * 4 bytes, bottom row first
+
+    size_t ByteSize() const { return (size_t)width * height * 4; }
+    uint8_t* Row(int y) { return pixels.data() + (size_t)y * width * 4; }
+    const uint8_t* Row(int y) const { return pixels.data() + (size_t)y * width * 4; }
+};
+
+// Picks the decoder from the file contents (magic bytes), falling back to the extension for TGA
+bool DecodeImageFile(const std::string& path, Image& image, std::string* error = nullptr);
+bool DecodeImageMemory(const uint8_t* data, size_t size, const std::string& nameHint, Image& image, std::string* error = nullptr);
+
+bool DecodePng(const uint8_t* data, size_t size, Image& image, std::string* error = nullptr);
+bool DecodeTga(const uint8_t* data, size_t size, Image& image, std::string* error = nullptr);
+bool DecodePpm(const uint8_t* data, size_t size, Image& image, std::string* error = nullptr);
+
+// zlib stream (RFC 1950 wrapper around RFC 1951 deflate) -> raw bytes. 'expectedSize' is a reserve hint.
+bool ZlibInflate(const uint8_t* data, size_t size, std::vector<uint8_t>& out, size_t expectedSize = 0);
+
+// Flips rows in place (top-down <-> bottom-up)
+void FlipImageRows(Image& image);
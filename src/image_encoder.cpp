@@ -0,0 +1,378 @@
+#include "image_encoder.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+static bool Fail(std::string* error, const std::string& message) {
+    if(error) {
+        *error = message;
+    }
+    return false;
+}
+
+// ------------------------------------------------------------------ checksums ------------------------------------------------------------------
+
+// slicing-by-8: eight table lookups per 8 input bytes instead of one per byte
+uint32_t Crc32(const uint8_t* data, size_t size, uint32_t crc) {
+    static uint32_t table[8][256];
+    static bool initialized = [] {
+        for(uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for(int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            table[0][i] = c;
+        }
+        for(uint32_t i = 0; i < 256; ++i) {
+            for(int slice = 1; slice < 8; ++slice) {
+                table[slice][i] = table[0][table[slice - 1][i] & 0xff] ^ (table[slice - 1][i] >> 8);
+            }
+        }
+        return true;
+    }();
+    (void)initialized;
+
+    crc = ~crc;
+    while(size >= 8) {
+        const uint32_t low = crc ^ ((uint32_t)data[0] | (uint32_t)data[1] << 8 | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24);
+        crc = table[7][low & 0xff] ^ table[6][(low >> 8) & 0xff] ^ table[5][(low >> 16) & 0xff] ^ table[4][low >> 24] ^
+              table[3][data[4]] ^ table[2][data[5]] ^ table[1][data[6]] ^ table[0][data[7]];
+        data += 8;
+        size -= 8;
+    }
+    for(size_t i = 0; i < size; ++i) {
+        crc = table[0][(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+uint32_t Adler32(const uint8_t* data, size_t size, uint32_t adler) {
+    uint32_t a = adler & 0xffff;
+    uint32_t b = adler >> 16;
+    while(size > 0) {
+        // 5552 bytes is the most that can be summed before b could overflow 32 bits
+        const size_t chunk = std::min(size, (size_t)5552);
+        for(size_t i = 0; i < chunk; ++i) {
+            a += data[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+        data += chunk;
+        size -= chunk;
+    }
+    return (b << 16) | a;
+}
+
+// ------------------------------------------------------------------ deflate ------------------------------------------------------------------
+
+namespace {
+
+// LSB-first bit packing, as deflate wants it
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<uint8_t>& out) : mOut(out) {}
+
+    void Write(uint32_t bits, int count) {
+        mBuffer |= (uint64_t)bits << mCount;
+        mCount += count;
+        while(mCount >= 8) {
+            mOut.push_back((uint8_t)mBuffer);
+            mBuffer >>= 8;
+            mCount -= 8;
+        }
+    }
+    // Huffman codes are defined MSB-first
+    void WriteReversed(uint32_t code, int length) {
+        uint32_t reversed = 0;
+        for(int i = 0; i < length; ++i) {
+            reversed |= ((code >> i) & 1u) << (length - 1 - i);
+        }
+        Write(reversed, length);
+    }
+    void Flush() {
+        if(mCount > 0) {
+            mOut.push_back((uint8_t)mBuffer);
+        }
+        mBuffer = 0;
+        mCount = 0;
+    }
+
+private:
+    std::vector<uint8_t>& mOut;
+    uint64_t mBuffer = 0;
+    int mCount = 0;
+};
+
+const uint16_t LengthBase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+const uint8_t LengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+const uint16_t DistanceBase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+                                   4097, 6145, 8193, 12289, 16385, 24577};
+const uint8_t DistanceExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+// fixed literal/length code (RFC 1951 3.2.6)
+void WriteLiteralLength(BitWriter& bits, int symbol) {
+    if(symbol < 144) {
+        bits.WriteReversed(0x30 + symbol, 8);
+    }
+    else if(symbol < 256) {
+        bits.WriteReversed(0x190 + symbol - 144, 9);
+    }
+    else if(symbol < 280) {
+        bits.WriteReversed(symbol - 256, 7);
+    }
+    else {
+        bits.WriteReversed(0xc0 + symbol - 280, 8);
+    }
+}
+
+void WriteMatch(BitWriter& bits, int length, int distance) {
+    int code = 28;
+    while(LengthBase[code] > length) {
+        --code;
+    }
+    WriteLiteralLength(bits, 257 + code);
+    bits.Write(length - LengthBase[code], LengthExtra[code]);
+
+    int distanceCode = 29;
+    while(DistanceBase[distanceCode] > distance) {
+        --distanceCode;
+    }
+    bits.WriteReversed(distanceCode, 5);
+    bits.Write(distance - DistanceBase[distanceCode], DistanceExtra[distanceCode]);
+}
+
+const int WindowSize = 32768;
+const int MinMatch = 3;
+const int MaxMatch = 258;
+const int HashBits = 15;
+
+inline uint32_t Hash3(const uint8_t* p) {
+    return ((uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2]) * 2654435761u >> (32 - HashBits);
+}
+
+void DeflateStored(const uint8_t* data, size_t size, std::vector<uint8_t>& out) {
+    size_t position = 0;
+    do {
+        const size_t chunk = std::min(size - position, (size_t)65535);
+        const bool last = position + chunk == size;
+        out.push_back(last ? 1 : 0); // BFINAL, BTYPE = 00, padded to the byte boundary
+        out.push_back((uint8_t)chunk);
+        out.push_back((uint8_t)(chunk >> 8));
+        out.push_back((uint8_t)~chunk);
+        out.push_back((uint8_t)(~chunk >> 8));
+        out.insert(out.end(), data + position, data + position + chunk);
+        position += chunk;
+    } while(position < size);
+}
+
+void DeflateFixed(const uint8_t* data, size_t size, std::vector<uint8_t>& out, int level) {
+    const int maxChain = 1 << std::min(std::max(level - 1, 0), 8); // 1 probe at level 1, 256 at level 9
+    std::vector<int32_t> head((size_t)1 << HashBits, -1);
+    std::vector<int32_t> previous(WindowSize, -1); // chain links, indexed by position % WindowSize
+
+    BitWriter bits(out);
+    bits.Write(1, 1); // BFINAL: everything is one block
+    bits.Write(1, 2); // BTYPE = 01, fixed codes
+
+    size_t position = 0;
+    while(position < size) {
+        int bestLength = 0;
+        int bestDistance = 0;
+        if(position + MinMatch <= size) {
+            const uint32_t hash = Hash3(data + position);
+            const size_t limit = std::min(size - position, (size_t)MaxMatch);
+            int32_t candidate = head[hash];
+            for(int chain = 0; chain < maxChain && candidate >= 0 && position - (size_t)candidate <= (size_t)WindowSize; ++chain) {
+                const uint8_t* a = data + candidate;
+                const uint8_t* b = data + position;
+                if(a[bestLength] == b[bestLength] || bestLength == 0) {
+                    size_t length = 0;
+                    while(length < limit && a[length] == b[length]) {
+                        ++length;
+                    }
+                    if((int)length > bestLength) {
+                        bestLength = (int)length;
+                        bestDistance = (int)(position - (size_t)candidate);
+                        if(length == limit) {
+                            break;
+                        }
+                    }
+                }
+                candidate = previous[candidate % WindowSize];
+            }
+            previous[position % WindowSize] = head[hash];
+            head[hash] = (int32_t)position;
+        }
+
+        if(bestLength >= MinMatch) {
+            WriteMatch(bits, bestLength, bestDistance);
+            // the skipped positions still go into the hash table, or later matches would miss them
+            const size_t end = position + bestLength;
+            for(++position; position < end; ++position) {
+                if(position + MinMatch <= size) {
+                    const uint32_t hash = Hash3(data + position);
+                    previous[position % WindowSize] = head[hash];
+                    head[hash] = (int32_t)position;
+                }
+            }
+        }
+        else {
+            WriteLiteralLength(bits, data[position]);
+            ++position;
+        }
+    }
+    WriteLiteralLength(bits, 256); // end of block
+    bits.Flush();
+}
+
+} // namespace
+
+void ZlibDeflate(const uint8_t* data, size_t size, std::vector<uint8_t>& out, int level) {
+    out.push_back(0x78); // CM = 8 (deflate), 32K window
+    out.push_back(0x01); // FLEVEL 0, FCHECK so that the header is a multiple of 31
+    if(level <= 0) {
+        DeflateStored(data, size, out);
+    }
+    else {
+        DeflateFixed(data, size, out, level);
+    }
+    const uint32_t adler = Adler32(data, size);
+    for(int shift = 24; shift >= 0; shift -= 8) {
+        out.push_back((uint8_t)(adler >> shift));
+    }
+}
+
+// ------------------------------------------------------------------ PNG ------------------------------------------------------------------
+
+static void AppendBigEndian32(std::vector<uint8_t>& out, uint32_t value) {
+    for(int shift = 24; shift >= 0; shift -= 8) {
+        out.push_back((uint8_t)(value >> shift));
+    }
+}
+
+static void AppendChunk(std::vector<uint8_t>& out, const char type[4], const uint8_t* data, size_t size) {
+    AppendBigEndian32(out, (uint32_t)size);
+    const size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    if(size > 0) {
+        out.insert(out.end(), data, data + size);
+    }
+    AppendBigEndian32(out, Crc32(out.data() + start, size + 4));
+}
+
+static inline uint8_t Paeth(int a, int b, int c) {
+    const int p = a + b - c;
+    const int pa = std::abs(p - a);
+    const int pb = std::abs(p - b);
+    const int pc = std::abs(p - c);
+    return (uint8_t)(pa <= pb && pa <= pc ? a : (pb <= pc ? b : c));
+}
+
+bool EncodePng(const Image& image, std::vector<uint8_t>& out, int level, bool alpha) {
+    if(image.width <= 0 || image.height <= 0 || image.pixels.size() < image.ByteSize()) {
+        return false;
+    }
+    const int channels = alpha ? 4 : 3;
+    const size_t rowBytes = (size_t)image.width * channels;
+
+    // filtered scanlines, top row first; a filter type byte in front of each.
+    // The working rows carry 'channels' zero bytes in front, the "pixel left of the image" of the spec,
+    // so the filter loops need no edge test.
+    std::vector<uint8_t> filtered((rowBytes + 1) * image.height);
+    std::vector<uint8_t> previousRow(rowBytes + channels, 0);
+    std::vector<uint8_t> currentRow(rowBytes + channels, 0);
+    std::vector<uint8_t> candidates[5];
+    for(std::vector<uint8_t>& candidate : candidates) {
+        candidate.resize(rowBytes);
+    }
+
+    for(int row = 0; row < image.height; ++row) {
+        const uint8_t* source = image.Row(image.height - 1 - row);
+        uint8_t* current = currentRow.data() + channels;
+        const uint8_t* previous = previousRow.data() + channels;
+        if(alpha) {
+            std::memcpy(current, source, rowBytes);
+        }
+        else {
+            for(int x = 0; x < image.width; ++x) {
+                current[x * 3 + 0] = source[x * 4 + 0];
+                current[x * 3 + 1] = source[x * 4 + 1];
+                current[x * 3 + 2] = source[x * 4 + 2];
+            }
+        }
+
+        uint64_t costs[5] = {};
+        for(size_t i = 0; i < rowBytes; ++i) {
+            const int left = current[(ptrdiff_t)i - channels];
+            const int up = previous[i];
+            const int upLeft = previous[(ptrdiff_t)i - channels];
+            const uint8_t residuals[5] = {
+                current[i],
+                (uint8_t)(current[i] - left),
+                (uint8_t)(current[i] - up),
+                (uint8_t)(current[i] - ((left + up) >> 1)),
+                (uint8_t)(current[i] - Paeth(left, up, upLeft)),
+            };
+            for(int filter = 0; filter < 5; ++filter) {
+                candidates[filter][i] = residuals[filter];
+                costs[filter] += (uint64_t)std::abs((int)(int8_t)residuals[filter]);
+            }
+        }
+        int best = 0;
+        for(int filter = 1; filter < 5; ++filter) {
+            if(costs[filter] < costs[best]) {
+                best = filter;
+            }
+        }
+
+        uint8_t* line = filtered.data() + (rowBytes + 1) * row;
+        line[0] = (uint8_t)best;
+        std::memcpy(line + 1, candidates[best].data(), rowBytes);
+        previousRow.swap(currentRow);
+    }
+
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    out.clear();
+    out.insert(out.end(), signature, signature + 8);
+
+    uint8_t header[13];
+    const uint32_t size[2] = {(uint32_t)image.width, (uint32_t)image.height};
+    for(int i = 0; i < 2; ++i) {
+        header[i * 4 + 0] = (uint8_t)(size[i] >> 24);
+        header[i * 4 + 1] = (uint8_t)(size[i] >> 16);
+        header[i * 4 + 2] = (uint8_t)(size[i] >> 8);
+        header[i * 4 + 3] = (uint8_t)size[i];
+    }
+    header[8] = 8;                 // bit depth
+    header[9] = alpha ? 6 : 2;     // color type: RGBA / RGB
+    header[10] = 0;                // deflate
+    header[11] = 0;                // adaptive filtering
+    header[12] = 0;                // no interlace
+    AppendChunk(out, "IHDR", header, sizeof(header));
+
+    std::vector<uint8_t> compressed;
+    compressed.reserve(filtered.size() / 2);
+    ZlibDeflate(filtered.data(), filtered.size(), compressed, level);
+    AppendChunk(out, "IDAT", compressed.data(), compressed.size());
+    AppendChunk(out, "IEND", nullptr, 0);
+    return true;
+}
+
+bool WritePngFile(const std::string& path, const Image& image, int level, bool alpha, std::string* error) {
+    std::vector<uint8_t> bytes;
+    if(!EncodePng(image, bytes, level, alpha)) {
+        return Fail(error, "invalid image");
+    }
+    std::ofstream file(path.c_str(), std::ios::binary | std::ios::trunc);
+    if(!file.is_open()) {
+        return Fail(error, "cannot write " + path);
+    }
+    file.write((const char*)bytes.data(), (std::streamsize)bytes.size());
+    if(!file.good()) {
+        return Fail(error, "cannot write " + path);
+    }
+    return true;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+/*
+Image file encoding for frame capture and tools (runs on worker threads, no GL calls). The counterpart of
+image_decoder.hpp and, like it, self-contained.
+
+PNG: 8-bit RGB or RGBA, non-interlaced. Every row gets the filter (None/Sub/Up/Average/Paeth) with the smallest
+sum of absolute residuals, the usual heuristic. The deflate stream is built for speed rather than size:
+LZ77 over a 32K window with a hash table of 3-byte prefixes (short hash chains) and the fixed Huffman codes,
+so there is no second pass to build per-block code tables. Level 0 writes stored blocks (no compression at all).
+
+Images are bottom-up (like Image everywhere else); the encoder writes the rows top-down as PNG expects.
+*/
+
+#include "image_decoder.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// level: 0 = stored, 1 = fastest .. 9 = longest hash chains
+bool EncodePng(const Image& image, std::vector<uint8_t>& out, int level = 1, bool alpha = true);
+bool WritePngFile(const std::string& path, const Image& image, int level = 1, bool alpha = true, std::string* error = nullptr);
+
+// zlib stream (RFC 1950) around a deflate stream (RFC 1951); appended to 'out'
+void ZlibDeflate(const uint8_t* data, size_t size, std::vector<uint8_t>& out, int level = 1);
+
+uint32_t Crc32(const uint8_t* data, size_t size, uint32_t crc = 0);
+uint32_t Adler32(const uint8_t* data, size_t size, uint32_t adler = 1);
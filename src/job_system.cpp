@@ -0,0 +1,425 @@
+#include "job_system.hpp"
+
+#include <algorithm>
+
+// ------------------------------------------------------------------------------------------------------------------
+// Job
+// ------------------------------------------------------------------------------------------------------------------
+
+struct Job {
+    std::function<void()> function;
+    JobHandle self;                            // keeps the job alive while it is queued or running
+
+    std::atomic<int> pendingDependencies{1};   // +1 held by Submit(), so the job cannot start before it is submitted
+    std::atomic<bool> started{false};
+    std::atomic<bool> finished{false};
+
+    std::mutex continuationMutex;
+    std::vector<JobHandle> continuations;      // jobs waiting for this one
+};
+
+// ------------------------------------------------------------------------------------------------------------------
+// Chase-Lev work-stealing deque (Le, Pop, Cohen, Zappa Nardelli, "Correct and Efficient Work-Stealing for Weak
+// Memory Models", 2013). Owner: Push/Pop at the bottom. Any thread: Steal from the top.
+// ------------------------------------------------------------------------------------------------------------------
+
+class WorkStealingDeque {
+public:
+    explicit WorkStealingDeque(size_t capacity = 1024) {
+        mArray.store(new RingBuffer(capacity), std::memory_order_relaxed);
+    }
+
+    ~WorkStealingDeque() {
+        delete mArray.load(std::memory_order_relaxed);
+        for(RingBuffer* old : mRetired) {
+            delete old;
+        }
+    }
+
+    void Push(Job* job) {
+        long bottom = mBottom.load(std::memory_order_relaxed);
+        long top = mTop.load(std::memory_order_acquire);
+        RingBuffer* array = mArray.load(std::memory_order_relaxed);
+        if(bottom - top > (long)array->capacity - 1) {
+            array = Grow(array, top, bottom);
+        }
+        array->Put(bottom, job);
+        std::atomic_thread_fence(std::memory_order_release);
+        mBottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+
+    Job* Pop() {
+        long bottom = mBottom.load(std::memory_order_relaxed) - 1;
+        RingBuffer* array = mArray.load(std::memory_order_relaxed);
+        mBottom.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        long top = mTop.load(std::memory_order_relaxed);
+
+        Job* job = nullptr;
+        if(top <= bottom) {
+            job = array->Get(bottom);
+            if(top == bottom) {
+                // last item: race against thieves for it
+                if(!mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                    job = nullptr;
+                }
+                mBottom.store(bottom + 1, std::memory_order_relaxed);
+            }
+        }
+        else {
+            mBottom.store(bottom + 1, std::memory_order_relaxed);
+        }
+        return job;
+    }
+
+    Job* Steal() {
+        long top = mTop.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        long bottom = mBottom.load(std::memory_order_acquire);
+
+        if(top < bottom) {
+            RingBuffer* array = mArray.load(std::memory_order_consume);
+            Job* job = array->Get(top);
+            if(!mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                return nullptr; // lost the race, caller will try elsewhere
+            }
+            return job;
+        }
+        return nullptr;
+    }
+
+    bool Empty() const {
+        return mBottom.load(std::memory_order_relaxed) <= mTop.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct RingBuffer {
+        explicit RingBuffer(size_t size) : capacity(size), mask(size - 1), items(new std::atomic<Job*>[size]) {}
+        ~RingBuffer() { delete[] items; }
+
+        Job* Get(long index) const { return items[index & mask].load(std::memory_order_relaxed); }
+        void Put(long index, Job* job) { items[index & mask].store(job, std::memory_order_relaxed); }
+
+        size_t capacity; // power of two
+        size_t mask;
+        std::atomic<Job*>* items;
+    };
+
+    RingBuffer* Grow(RingBuffer* old, long top, long bottom) {
+        RingBuffer* grown = new RingBuffer(old->capacity * 2);
+        for(long i = top; i < bottom; ++i) {
+            grown->Put(i, old->Get(i));
+        }
+        // thieves may still be reading the old buffer; it is only freed with the deque
+        mRetired.push_back(old);
+        mArray.store(grown, std::memory_order_release);
+        return grown;
+    }
+
+    alignas(64) std::atomic<long> mTop{0};
+    alignas(64) std::atomic<long> mBottom{0};
+    alignas(64) std::atomic<RingBuffer*> mArray{nullptr};
+    std::vector<RingBuffer*> mRetired;
+};
+
+// ------------------------------------------------------------------------------------------------------------------
+// JobSystem
+// ------------------------------------------------------------------------------------------------------------------
+
+// which deque the current thread owns, per JobSystem instance (-1: not a pool thread)
+static thread_local const JobSystem* tOwner = nullptr;
+static thread_local int tDequeIndex = -1;
+static thread_local unsigned tRandomState = 0x9E3779B9u;
+
+static unsigned NextRandom() {
+    // xorshift, only used to pick steal victims
+    unsigned x = tRandomState;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    tRandomState = x;
+    return x;
+}
+
+JobSystem::JobSystem(unsigned threadCount) {
+    if(threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    mThreadCount = threadCount;
+
+    // the creating thread is not a worker: it only runs its own ParallelFor chunks and the jobs it waits for
+    const unsigned workerCount = std::max(1u, threadCount - 1);
+    for(unsigned i = 0; i < workerCount; ++i) {
+        mDeques.push_back(std::make_unique<WorkStealingDeque>());
+    }
+    for(unsigned i = 0; i < workerCount; ++i) {
+        mWorkers.emplace_back(&JobSystem::WorkerMain, this, i);
+    }
+}
+
+JobSystem::~JobSystem() {
+    mQuit.store(true);
+    {
+        std::lock_guard<std::mutex> lock(mSleepMutex);
+        mSleepCondition.notify_all();
+    }
+    for(std::thread& worker : mWorkers) {
+        worker.join();
+    }
+}
+
+JobHandle JobSystem::CreateJob(std::function<void()> function) {
+    JobHandle job = std::make_shared<Job>();
+    job->function = std::move(function);
+    return job;
+}
+
+void JobSystem::AddDependency(const JobHandle& job, const JobHandle& prerequisite) {
+    std::lock_guard<std::mutex> lock(prerequisite->continuationMutex);
+    if(prerequisite->finished.load(std::memory_order_acquire)) {
+        return; // already done, nothing to wait for
+    }
+    job->pendingDependencies.fetch_add(1, std::memory_order_relaxed);
+    prerequisite->continuations.push_back(job);
+}
+
+void JobSystem::Submit(const JobHandle& job) {
+    job->self = job;
+    if(job->pendingDependencies.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        Enqueue(job.get());
+    }
+}
+
+JobHandle JobSystem::Run(std::function<void()> function) {
+    JobHandle job = CreateJob(std::move(function));
+    Submit(job);
+    return job;
+}
+
+bool JobSystem::IsFinished(const JobHandle& job) {
+    return job->finished.load(std::memory_order_acquire);
+}
+
+void JobSystem::Enqueue(Job* job, bool front) {
+    if(tOwner == this && tDequeIndex >= 0) {
+        mDeques[tDequeIndex]->Push(job);
+    }
+    else {
+        std::lock_guard<std::mutex> lock(mInjectionMutex);
+        if(front) {
+            mInjectionQueue.push_front(job);
+        }
+        else {
+            mInjectionQueue.push_back(job);
+        }
+    }
+    WakeWorkers();
+}
+
+void JobSystem::WakeWorkers() {
+    mWorkEpoch.fetch_add(1, std::memory_order_seq_cst);
+    if(mSleepingWorkers.load(std::memory_order_seq_cst) > 0) {
+        std::lock_guard<std::mutex> lock(mSleepMutex);
+        mSleepCondition.notify_one();
+    }
+}
+
+Job* JobSystem::FindJob(unsigned selfIndex) {
+    // 1) own deque, LIFO: hot in cache
+    if(Job* job = mDeques[selfIndex]->Pop()) {
+        return job;
+    }
+
+    // 2) jobs from outside the pool
+    {
+        std::unique_lock<std::mutex> lock(mInjectionMutex, std::try_to_lock);
+        if(lock.owns_lock() && !mInjectionQueue.empty()) {
+            Job* job = mInjectionQueue.front();
+            mInjectionQueue.pop_front();
+            return job;
+        }
+    }
+
+    // 3) steal, FIFO end of a random victim
+    const unsigned count = (unsigned)mDeques.size();
+    if(count > 1) {
+        unsigned start = NextRandom() % count;
+        for(unsigned i = 0; i < count; ++i) {
+            unsigned victim = (start + i) % count;
+            if(victim == selfIndex) {
+                continue;
+            }
+            if(Job* job = mDeques[victim]->Steal()) {
+                return job;
+            }
+        }
+    }
+    return nullptr;
+}
+
+void JobSystem::Execute(Job* job) {
+    job->started.store(true, std::memory_order_release);
+    job->function();
+    job->function = nullptr; // release captures early
+
+    std::vector<JobHandle> continuations;
+    {
+        std::lock_guard<std::mutex> lock(job->continuationMutex);
+        job->finished.store(true, std::memory_order_release);
+        continuations.swap(job->continuations);
+    }
+    for(const JobHandle& next : continuations) {
+        if(next->pendingDependencies.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            Enqueue(next.get());
+        }
+    }
+
+    job->self.reset(); // may delete the job
+}
+
+bool JobSystem::RunOneJob() {
+    Job* job = FindJob((unsigned)tDequeIndex);
+    if(job == nullptr) {
+        return false;
+    }
+    Execute(job);
+    return true;
+}
+
+bool JobSystem::TryRun(const JobHandle& job) {
+    {
+        std::lock_guard<std::mutex> lock(mInjectionMutex);
+        auto queued = std::find(mInjectionQueue.begin(), mInjectionQueue.end(), job.get());
+        if(queued == mInjectionQueue.end()) {
+            return false; // running, done, waiting for prerequisites, or on a worker's deque
+        }
+        mInjectionQueue.erase(queued);
+    }
+    Execute(job.get());
+    return true;
+}
+
+bool JobSystem::RunInjectedJob() {
+    Job* job = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mInjectionMutex);
+        if(mInjectionQueue.empty()) {
+            return false;
+        }
+        job = mInjectionQueue.front();
+        mInjectionQueue.pop_front();
+    }
+    Execute(job);
+    return true;
+}
+
+void JobSystem::Wait(const JobHandle& job) {
+    const bool poolThread = tOwner == this && tDequeIndex >= 0;
+    while(!IsFinished(job)) {
+        if(poolThread) {
+            if(!RunOneJob()) {
+                std::this_thread::yield();
+            }
+            continue;
+        }
+        if(TryRun(job)) {
+            continue;
+        }
+        // Not reachable yet: its prerequisites or the jobs ahead of it have to run first, and the workers may all
+        // be busy (with one core, the only worker and this thread share it). Once it started, helping would
+        // only make this thread return later.
+        if(job->started.load(std::memory_order_acquire) || !RunInjectedJob()) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void JobSystem::WorkerMain(unsigned index) {
+    tOwner = this;
+    tDequeIndex = (int)index;
+    tRandomState ^= index * 0x85EBCA6Bu;
+
+    while(!mQuit.load(std::memory_order_relaxed)) {
+        unsigned long long epoch = mWorkEpoch.load(std::memory_order_seq_cst);
+
+        if(Job* job = FindJob(index)) {
+            Execute(job);
+            continue;
+        }
+
+        // a short spin catches the next job of a burst without paying for a futex round trip
+        bool found = false;
+        for(int spin = 0; spin < 64 && !found; ++spin) {
+            std::this_thread::yield();
+            found = mWorkEpoch.load(std::memory_order_relaxed) != epoch;
+        }
+        if(found) {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mSleepMutex);
+        mSleepingWorkers.fetch_add(1, std::memory_order_seq_cst);
+        while(mWorkEpoch.load(std::memory_order_seq_cst) == epoch && !mQuit.load()) {
+            mSleepCondition.wait(lock);
+        }
+        mSleepingWorkers.fetch_sub(1, std::memory_order_seq_cst);
+    }
+}
+
+size_t JobSystem::AutomaticGrain(size_t count, size_t minGrain) const {
+    // ~4 chunks per thread balances uneven chunks without drowning in scheduling overhead
+    size_t chunks = (size_t)GetThreadCount() * 4;
+    return std::max(minGrain, (count + chunks - 1) / chunks);
+}
+
+void JobSystem::ParallelFor(size_t count, const std::function<void(size_t, size_t)>& function, size_t grain) {
+    if(count == 0) {
+        return;
+    }
+    if(grain == 0) {
+        grain = AutomaticGrain(count);
+    }
+    if(count <= grain || GetThreadCount() == 1) {
+        function(0, count);
+        return;
+    }
+
+    // Chunks are claimed from a shared counter by this thread and by a few helper jobs, so the caller only ever
+    // runs chunks of its own range. A helper that starts after every chunk was claimed leaves without touching
+    // 'function'; the counters live in a shared_ptr because such a helper may outlive this call.
+    struct Range {
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> remaining{0};
+    };
+    const size_t chunkCount = (count + grain - 1) / grain;
+    auto range = std::make_shared<Range>();
+    range->remaining.store(chunkCount, std::memory_order_relaxed);
+    const std::function<void(size_t, size_t)>* body = &function;
+
+    auto claimChunks = [range, body, count, grain, chunkCount] {
+        for(size_t chunk = range->next.fetch_add(1, std::memory_order_relaxed); chunk < chunkCount;
+            chunk = range->next.fetch_add(1, std::memory_order_relaxed)) {
+            const size_t begin = chunk * grain;
+            (*body)(begin, std::min(count, begin + grain));
+            range->remaining.fetch_sub(1, std::memory_order_acq_rel);
+        }
+    };
+
+    const size_t helperCount = std::min(chunkCount - 1, mWorkers.size());
+    for(size_t i = 0; i < helperCount; ++i) {
+        JobHandle helper = CreateJob(claimChunks);
+        helper->self = helper;
+        helper->pendingDependencies.store(0, std::memory_order_relaxed);
+        Enqueue(helper.get(), true);
+    }
+
+    claimChunks();
+
+    // the last chunks may still run on other threads
+    const bool poolThread = tOwner == this && tDequeIndex >= 0;
+    while(range->remaining.load(std::memory_order_acquire) > 0) {
+        if(!poolThread || !RunOneJob()) {
+            std::this_thread::yield();
+        }
+    }
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+/*
+JobSystem: a fiber-free task scheduler.
+
+- One worker thread per core minus the thread that creates the JobSystem, but at least one: background jobs
+  (decoding, file writes, ...) must make progress even on a single core while the main thread is busy
+- Each worker owns a Chase-Lev work-stealing deque: the owner pushes/pops at the bottom without locks,
+  idle workers steal from the top of a random victim
+- Threads that are not part of the pool (the main thread, asset loaders, SDL callbacks, ...) submit through a
+  small locked queue. ParallelFor() never hands them anything but chunks of their own range, so the main thread
+  cannot get stuck in a PNG encode or a tile read mid-frame. Wait() runs the awaited job itself when no worker
+  took it yet; while it has not started at all (prerequisites pending, or queued behind a backlog with every
+  worker busy) the waiting thread drains the queue too, which is what keeps a single core from starving
+- Jobs can depend on other jobs: a job becomes runnable when all of its prerequisites finished
+- ParallelFor() splits a range into chunks (grain size picked automatically unless given) and returns when
+  all chunks ran; the calling thread claims chunks of its own range too instead of blocking
+
+Typical use:
+    JobSystem jobs;                                   // hardware_concurrency() threads in total
+    jobs.ParallelFor(count, [&](size_t begin, size_t end) { ... });
+
+    JobHandle a = jobs.CreateJob([] { ... });
+    JobHandle b = jobs.CreateJob([] { ... });
+    jobs.AddDependency(b, a);                         // b runs after a
+    jobs.Submit(a); jobs.Submit(b);
+    jobs.Wait(b);
+*/
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct Job;
+using JobHandle = std::shared_ptr<Job>;
+
+class WorkStealingDeque;
+
+class JobSystem {
+public:
+    // threadCount = total threads doing work, including the creating thread; 0 = std::thread::hardware_concurrency().
+    // With 1 there is still one worker for background jobs, ParallelFor() then runs on the calling thread.
+    explicit JobSystem(unsigned threadCount = 0);
+    ~JobSystem();
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    unsigned GetThreadCount() const { return mThreadCount; }
+
+    // ---------------------------------- jobs with dependencies ----------------------------------
+    JobHandle CreateJob(std::function<void()> function);
+    // 'job' will not start before 'prerequisite' finished. Call before Submit(job).
+    void AddDependency(const JobHandle& job, const JobHandle& prerequisite);
+    void Submit(const JobHandle& job);
+    // Blocks until 'job' finished, running other jobs meanwhile. Threads outside the pool only take other jobs
+    // while 'job' has not started; once it runs they just wait for it.
+    void Wait(const JobHandle& job);
+    // Runs 'job' on this thread if it is still in the queue of threads outside the pool (no worker took it yet)
+    bool TryRun(const JobHandle& job);
+    static bool IsFinished(const JobHandle& job);
+
+    // Convenience: create + submit
+    JobHandle Run(std::function<void()> function);
+
+    // ---------------------------------- data parallel ----------------------------------
+    // Calls function(begin, end) over [0, count) in chunks of at least 'grain' items (0 = automatic).
+    void ParallelFor(size_t count, const std::function<void(size_t begin, size_t end)>& function, size_t grain = 0);
+
+    // Picks a chunk size giving every thread a few chunks (for load balancing) without making them tiny
+    size_t AutomaticGrain(size_t count, size_t minGrain = 64) const;
+
+private:
+    friend struct Job;
+
+    void WorkerMain(unsigned index);
+    void Enqueue(Job* job, bool front = false); // front: ahead of queued background work (ParallelFor helpers)
+    Job* FindJob(unsigned selfIndex);
+    void Execute(Job* job);
+    bool RunOneJob(); // pool threads only; returns false if nothing was runnable
+    bool RunInjectedJob(); // any thread: the oldest job of the injection queue, false if it is empty
+    void WakeWorkers();
+
+    unsigned mThreadCount = 1;
+    std::vector<std::unique_ptr<WorkStealingDeque>> mDeques; // one per worker
+    std::vector<std::thread> mWorkers;
+
+    std::mutex mInjectionMutex;    // queue for threads outside the pool
+    std::deque<Job*> mInjectionQueue;
+
+    std::mutex mSleepMutex;
+    std::condition_variable mSleepCondition;
+    std::atomic<unsigned> mSleepingWorkers{0};
+    std::atomic<unsigned long long> mWorkEpoch{0}; // bumped on every enqueue, lets sleepers detect missed work
+    std::atomic<bool> mQuit{false};
+};
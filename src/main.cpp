@@ -4,7 +4,8 @@ sets up vertex data for a triangle, and enters a main loop to handle input and r
 */
 
 /* Compilation on Linux:
-g++ src/main.cpp src/glad.c -o build/prog -I./include -I"../common/third party/glm-master" -g -lSDL2 -ldl
+g++ src/main.cpp src/frame_limiter.cpp src/camera.cpp src/cpu_features.cpp src/transform_store.cpp src/transform_hierarchy.cpp src/culling.cpp src/occlusion_culler.cpp src/gpu_culler.cpp src/bvh.cpp src/job_system.cpp src/mesh_loader.cpp src/mesh_simplifier.cpp src/meshlet_builder.cpp src/image_decoder.cpp src/mipmap_generator.cpp src/pixel_buffer_pool.cpp src/texture_compression.cpp src/texture_atlas.cpp src/virtual_texture.cpp src/render_target.cpp src/image_encoder.cpp src/video_encoder.cpp src/frame_capture.cpp src/render_server.cpp src/render_workers.cpp src/shader_watcher.cpp src/soft_rasterizer.cpp src/resource_manager.cpp src/glad.c -o build/prog -I./include -I"../common/third party/glm-master" -O2 -g -pthread -lSDL2 -ldl
+(or simply run make)
 */
 
 #include <SDL2/SDL.h>
@@ -13,10 +14,39 @@ g++ src/main.cpp src/glad.c -o build/prog -I./include -I"../common/third party/g
 #include <glm/vec3.hpp>
 #include <glm/mat4x4.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
 #include <iostream>
+#include <iomanip>
 #include <vector>
 #include <fstream>
 #include <string>
+#include <chrono>
+#include <deque>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+
+#include "frame_limiter.hpp"
+#include "camera.hpp"
+#include "cpu_features.hpp"
+#include "transform_hierarchy.hpp"
+#include "culling.hpp"
+#include "occlusion_culler.hpp"
+#include "gpu_culler.hpp"
+#include "bvh.hpp"
+#include "job_system.hpp"
+#include "resource_manager.hpp"
+#include "virtual_texture.hpp"
+#include "render_target.hpp"
+#include "frame_capture.hpp"
+#include "render_server.hpp"
+#include "render_workers.hpp"
+#include "shader_watcher.hpp"
+#include "soft_rasterizer.hpp"
 
 // Globals
 int gScreenHeight = 480;
@@ -25,11 +55,233 @@ SDL_Window* gGraphicsApplicationWindow = nullptr;
 SDL_GLContext gOpenglContext = nullptr;
 bool gQuit = false; // if true, quit the main loop
 
+// Worker threads for culling, transform updates, asset loading, ... (--threads, 0 = one per core)
+unsigned gThreadCount = 0;
+std::unique_ptr<JobSystem> gJobSystem;
+
 GLuint gVertexArrayObject = 0; // VAO for vertex attributes
 GLuint gVertexBufferObject = 0; // VBO for vertex positions
 GLuint gIndexBufferObject = 0;
+GLsizei gIndexCount = 0; // indices in gIndexBufferObject
+GLuint gInstanceBufferObject = 0; // per-object model matrices (mat4 at attribute locations 4..7, divisor 1)
+GLuint gInstanceMaterialBuffer = 0; // per-object atlas UV rect (vec4 at attribute location 8), only used with an atlas
 GLuint gGraphicsPipelineShaderProgram = 0; // shader program object
-
+GLint gModelMatrixLocation = -1; // looked up once after linking, not every frame
+GLuint gTexture = 0; // diffuse texture on unit 0 (u_Texture); 1x1 white until a streamed texture replaces it
+
+// Asset streaming: the quad and built-in shaders below are placeholders that render from the first frame,
+// real assets are read on worker threads, uploaded on a shared context and swapped in when their fence signals
+std::unique_ptr<ResourceManager> gResourceManager;
+std::string gMeshPath; // --mesh <file.obj>, empty = keep the quad
+std::string gTexturePath; // --texture <file.png|tga|ppm>, empty = untextured (white)
+TextureOptions gTextureOptions; // --compress <bc1|bc3|bc4|bc5|bc7> turns on block compression
+const char* gTextureCacheDirectory = "build/texture_cache"; // encoded block-compressed textures, reused across runs
+std::vector<std::string> gAtlasPaths;   // --atlas a.png,b.png,...: one material per image, packed into one texture
+std::vector<glm::vec4> gMaterialUvRects; // per material: atlas UV offset (xy) and scale (zw); empty = no atlas
+// Virtual texture (--virtual-texture <file.vtex|image>): streamed tile by tile, its shader replaces the material
+std::string gVirtualTexturePath;
+std::unique_ptr<VirtualTexture> gVirtualTexture;
+GLuint gVirtualTextureFeedbackProgram = 0; // scene drawn into the tile request target with this
+GLint gFeedbackUniformLocations[3] = {-1, -1, -1}; // u_ModelMatrix, u_View, u_Projection of the feedback program
+MeshHandle gPendingMesh;
+ProgramHandle gPendingProgram;
+TextureHandle gPendingTexture;
+
+// Scene shaders: gVertexShaderFile and gFragmentShaderFile in --shader-dir <directory> (default: shaders/ of the
+// working directory). With --watch-shaders a save to either one relinks the program in the background and swaps it
+// in between frames, on the render workers too (shader_watcher.hpp); a program that does not build is reported
+// and the running one stays, so long-running servers keep their caches while the shaders are being worked on.
+std::string gShaderDirectory = "shaders";
+const char* gVertexShaderFile = "vertex_shader.glsl";
+const char* gFragmentShaderFile = "fragment_shader.glsl";
+bool gWatchShaders = false;
+std::unique_ptr<ShaderWatcher> gShaderWatcher;
+ProgramHandle gReloadingProgram;  // linking on the upload context
+ProgramHandle gSceneProgram;      // the sources gGraphicsPipelineShaderProgram was linked from; null = placeholder
+bool gShaderReloadQueued = false; // saved again meanwhile, reload once more when it is done
+
+const char* gPlaceholderVertexShaderSource = R"(#version 410 core
+layout(location = 3) in vec3 position;
+layout(location = 1) in vec3 color;
+layout(location = 2) in vec2 texCoord;
+layout(location = 4) in mat4 instanceModel;
+layout(location = 8) in vec4 instanceUvRect;
+uniform mat4 u_ModelMatrix;
+uniform mat4 u_View;
+uniform mat4 u_Projection;
+out vec3 vColor;
+out vec2 vTexCoord;
+void main()
+{
+   gl_Position = u_Projection * u_View * u_ModelMatrix * instanceModel * vec4(position, 1.0f);
+   vColor = color;
+   vTexCoord = instanceUvRect.xy + texCoord * instanceUvRect.zw;
+}
+)";
+
+const char* gPlaceholderFragmentShaderSource = R"(#version 410 core
+in vec3 vColor;
+in vec2 vTexCoord;
+uniform sampler2D u_Texture;
+out vec4 fragColor;
+void main()
+{
+   fragColor = vec4(vColor, 1.0) * texture(u_Texture, vTexCoord);
+}
+)";
+
+Camera gCamera; // view/projection, rebuilt and re-uploaded only when they change
+
+// Scene objects: every object is an instance of the quad and owns the hierarchy node with the same index.
+// Object 0 is the root node and sits at the origin like before; extra objects (--objects N) are its
+// children, laid out on a grid behind it, so they all follow the arrow keys through their parent.
+size_t gObjectCount = 1;
+TransformHierarchy gSceneHierarchy; // flat, breadth-first parent/child transforms with dirty propagation
+bool gInstanceBufferValid = false;  // false until the instance buffer holds the matrices of the current draw list
+
+// Frustum culling: only objects whose bounds intersect the view frustum reach the draw list
+MeshBounds gMeshBounds;             // local-space sphere + AABB of the mesh every object instances
+BoundsSoA gObjectBounds;            // world-space bounds of every object, updated when its world matrix changes
+std::vector<uint32_t> gDrawList;    // indices of the objects to draw this frame
+bool gDrawListValid = false;        // false when objects moved since the last culling pass
+unsigned gCulledProjectionVersion = 0; // camera state the draw list was built with
+unsigned gCulledViewVersion = 0;
+
+// Occlusion culling (--occluders <count>): the objects closest to the eye are rasterized into a small CPU depth
+// buffer (occlusion_culler.hpp) and whatever hides behind them leaves the draw list before Draw(). Dropping an
+// object only changes nothing on screen when it would have lost the depth test, so the test is on while culling.
+size_t gOccluderCount = 0; // 0 = off
+std::unique_ptr<OcclusionCuller> gOcclusionCuller;
+
+// GPU-driven culling (--gpu-culling <frustum|hiz>): a compute shader culls every object and writes the indirect draws
+// (gpu_culler.hpp); gDrawList stays empty. Falls back to the CPU path above when the extensions are missing.
+enum class GpuCullingMode { Off, Frustum, HiZ };
+GpuCullingMode gGpuCullingMode = GpuCullingMode::Off;
+std::unique_ptr<GpuCuller> gGpuCuller;
+
+// Level of detail (--lod-error <pixels>, 0 = off): streamed meshes come with a chain of simplified index ranges
+// (mesh_simplifier.hpp). After culling, every object picks the coarsest level whose error projects to at most that
+// many pixels, and gDrawList is grouped by level so Draw() issues one instanced call per level.
+float gLodPixelError = 1.0f;
+const float gLodHysteresis = 0.75f;  // going coarser needs the error below this part of the budget, so objects
+                                     // right at the limit do not pop back and forth while the camera moves
+std::vector<MeshLod> gMeshLods;      // of the current mesh, [0] = the gIndexCount full-detail indices; empty for the quad
+std::vector<uint8_t> gObjectLods;    // level each object was drawn with last time
+std::vector<size_t> gLodDrawOffsets; // level k draws gDrawList[offsets[k], offsets[k + 1]); empty = all at level 0
+std::vector<uint32_t> gLodSortScratch;
+
+// Meshlet culling (--meshlets <frustum|cone>): streamed meshes are also split into clusters of at most 64 vertices
+// and 124 triangles (meshlet_builder.hpp). Every object drawn at level 0 has its clusters tested against the frustum,
+// with "cone" also against their normal cones. The cone test only runs for closed, consistently wound meshes and
+// objects the eye is outside of: there a cluster facing away always lies behind the object's own front faces, so
+// dropping it changes nothing on screen. Objects that keep only some clusters move to the end of gDrawList and are
+// drawn one by one, with one glMultiDrawElements over the surviving index ranges. That and the meshlet order of
+// the triangles change the draw order, so the depth test is on while meshlet culling runs.
+enum class MeshletCullingMode { Off, Frustum, Cone };
+MeshletCullingMode gMeshletCullingMode = MeshletCullingMode::Off;
+std::vector<Meshlet> gMeshlets;                  // of the current mesh; empty for the quad
+bool gMeshClosed = false;                        // the current mesh passed IsClosedMesh(), cone culling is safe
+size_t gPartialDrawStart = 0;                    // gDrawList[start, size) are drawn cluster by cluster
+std::vector<size_t> gPartialDrawRanges;          // partial object i draws ranges [ranges[i], ranges[i + 1])
+std::vector<GLsizei> gMeshletRangeCounts;        // glMultiDrawElements arguments of all partial objects, back to back
+std::vector<const GLvoid*> gMeshletRangeOffsets;
+std::vector<uint8_t> gMeshletVisibility;         // per meshlet of one batch of objects, scratch
+const size_t gMeshletVisibilityBudget = 256 * 1024; // bytes of it: objects are culled in batches that fit
+
+// CPU copies of the mesh, for the software backend and the occlusion culler
+std::vector<float> gCpuVertices;
+std::vector<uint32_t> gCpuIndices;
+
+// Bounding volume hierarchy over gObjectBounds, used for culling large scenes and for mouse picking
+Bvh gBvh;
+const size_t gBvhMinObjects = 1024; // below this a linear SIMD pass is faster than walking the tree
+glm::mat4 gSceneRootMatrix(1.0f); // u_ModelMatrix, applied on top of every instance matrix
+
+// Simulation runs at a fixed rate so movement does not depend on how fast frames are produced
+const double gFixedTimeStep = 1.0 / 60.0; // seconds per update step
+const double gMaxFrameDelta = 0.25;       // clamp for long hitches, avoids the "spiral of death"
+double gMaxFrameRate = 60.0;              // frame rate cap, <= 0 means uncapped (--fps)
+
+const float gMoveSpeed = 0.6f;    // units per second   (was 0.01 per frame at 60 fps)
+const float gRotateSpeed = 60.0f; // degrees per second (was 1.0 per frame at 60 fps)
+
+struct SimulationState {
+    float offset = 0.0f;
+    float rotate = 0.0f;
+};
+SimulationState gPreviousState; // state at the previous fixed step
+SimulationState gCurrentState;  // state at the latest fixed step
+
+// Redraw policy:
+// - Continuous: draw every iteration (interactive use)
+// - OnDemand:   block in SDL_WaitEventTimeout while idle, draw only when something changed (--on-demand)
+enum class RedrawMode { Continuous, OnDemand };
+RedrawMode gRedrawMode = RedrawMode::Continuous;
+const int gIdleWaitTimeoutMs = 500; // upper bound on how long an idle viewer sleeps before re-checking gSceneDirty
+bool gSceneDirty = true;            // set whenever what is on screen is out of date; the first frame always draws
+
+// Offscreen rendering (--resolution-scale <0.25..1|auto>, --upscale <bilinear|edge>): the scene is drawn into
+// gSceneTarget at a fraction of the window size and upscaled into the window. With "auto" the fraction follows
+// the measured GPU time of the scene. Without either option the scene goes straight to the window as before.
+float gResolutionScale = 1.0f;
+bool gDynamicResolution = false;
+UpscaleFilter gUpscaleFilter = UpscaleFilter::EdgeAware;
+std::unique_ptr<RenderTarget> gSceneTarget; // null = render into the default framebuffer
+std::unique_ptr<GpuTimer> gSceneTimer;
+std::unique_ptr<DynamicResolution> gDynamicResolutionController;
+std::unique_ptr<Upscaler> gUpscaler;
+int gRenderWidth = 640;  // size the scene is drawn at this frame
+int gRenderHeight = 480;
+
+// Software backend (--backend <gl|soft>): the scene is rasterized on the CPU (soft_rasterizer.hpp) and uploaded
+// into gSceneTarget, GL only presents it. The rasterizer keeps its own copy of the texture.
+enum class RenderBackend { GL, Soft };
+RenderBackend gBackend = RenderBackend::GL;
+std::unique_ptr<SoftRasterizer> gSoftRasterizer;
+std::vector<glm::mat4> gSoftInstanceMatrices; // world matrices of gDrawList
+std::vector<glm::vec4> gSoftInstanceUvRects;  // and their atlas UV rects, empty = no atlas
+
+// Frame capture (--capture <directory|file>, --capture-format <png|ppm|y4m|ffmpeg>, --capture-frames <count>): every
+// drawn frame is read back asynchronously and written as images into the directory, or encoded into one video file,
+// on worker threads. With a count the program quits once that many frames were captured (headless jobs; combine
+// with --fps 0 to run at full speed). Videos play at the --fps cap, 60 fps when uncapped.
+std::string gCapturePath; // empty = no capture
+FrameCaptureOptions gCaptureOptions;
+uint64_t gCaptureFrameLimit = 0;
+std::unique_ptr<FrameCapture> gFrameCapture;
+
+// Turntable (--turntable <frames>): the scene makes one full turn around the y axis in exactly that many drawn
+// frames, independent of time, so captured videos loop seamlessly. With --capture the program quits after one turn.
+int gTurntableFrames = 0;
+int gTurntableFrame = 0;
+
+// Batch render server (--serve <spool directory>, --serve-socket <path>): instead of the interactive loop the
+// process renders one job after another (render_server.hpp) into an offscreen target, keeping its context, the
+// compiled pipeline and a cache of resident meshes. Meshes of upcoming jobs load while earlier jobs render, and
+// each image is read back and written while the next job is already drawing. The window stays hidden.
+std::string gServeSpoolDirectory;
+std::string gServeSocketPath;
+std::unique_ptr<RenderServer> gRenderServer;
+size_t gMeshCacheBudget = (size_t)256 << 20; // bytes of vertex + index data kept on the GPU (--mesh-cache-mb)
+const size_t gServeLookahead = 16;            // jobs taken from the queue ahead of rendering, to prefetch meshes
+struct CachedMesh {
+    MeshHandle mesh;
+    size_t bytes = 0;      // 0 until Ready
+    uint64_t lastUse = 0;
+};
+std::unordered_map<std::string, CachedMesh> gMeshCache; // by path, "" = the built-in quad
+uint64_t gMeshCacheClock = 0;
+std::string gBoundMeshPath; // the cache entry in gVertexBufferObject / gIndexBufferObject
+// Several contexts (--serve-contexts <n>): jobs are spread over n GL contexts on n threads (render_workers.hpp),
+// which is what scales on a software renderer. --serve-benchmark <jobs> renders that many generated jobs without
+// writing them and reports the throughput; bench/llvmpipe_scaling.sh sweeps contexts against LP_NUM_THREADS.
+int gServeContexts = 1;
+std::unique_ptr<RenderWorkers> gRenderWorkers;
+GLuint gServerInstanceBuffer = 0;  // world matrices of every object with the root at the identity, read by the workers
+GLuint gServerMaterialBuffer = 0;  // their atlas UV rects, 0 = no atlas
+uint64_t gServeBenchmarkJobs = 0;
+
+// Values used for rendering, interpolated between gPreviousState and gCurrentState
 float gOffset = 0.0f; 
 float gRotate = 0.0f;
 
@@ -73,6 +325,27 @@ std::string LoadShaderAsString(const std::string& filename) {
 }   
 
 
+bool IsServing() {
+    return !gServeSpoolDirectory.empty() || !gServeSocketPath.empty() || gServeBenchmarkJobs > 0;
+}
+
+// Whether SelectLods() picks levels at all; meshes are only simplified when it does
+bool UsesLodSelection() {
+    return gLodPixelError > 0.0f && !gSoftRasterizer && !gGpuCuller && !IsServing();
+}
+
+// Whether CullObjectMeshlets() runs; meshes are only split into meshlets when it does
+bool UsesMeshletCulling() {
+    return gMeshletCullingMode != MeshletCullingMode::Off && !gSoftRasterizer && !gGpuCuller && !IsServing();
+}
+
+MeshOptions ViewerMeshOptions() {
+    MeshOptions options;
+    options.lods = UsesLodSelection();
+    options.meshlets = UsesMeshletCulling();
+    return options;
+}
+
 void InitializeProgram() {
     // 1) 初始化 SDL 的视频子系统（创建窗口、处理输入等都依赖它）
     if (SDL_Init(SDL_INIT_VIDEO) < 0 ) {
@@ -87,13 +360,14 @@ void InitializeProgram() {
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
     SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
     SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24);
+    SDL_GL_SetAttribute(SDL_GL_FRAMEBUFFER_SRGB_CAPABLE, 1); // 纹理以 sRGB 存储，着色在线性空间，写回时再编码为 sRGB
 
     // 3) 创建 SDL 窗口。
     //    这里传入 SDL_WINDOW_OPENGL 表示这个窗口将用于 OpenGL 渲染。
     gGraphicsApplicationWindow = SDL_CreateWindow("OpenGL Window",
                             0, 0,
                             gScreenWidth, gScreenHeight,
-                            SDL_WINDOW_OPENGL);
+                            SDL_WINDOW_OPENGL | (IsServing() ? SDL_WINDOW_HIDDEN : SDL_WINDOW_RESIZABLE));
     
     if(gGraphicsApplicationWindow == nullptr) {
         std::cout << "SDL Window was not able to be created\n";
@@ -114,10 +388,163 @@ void InitializeProgram() {
         std::cout << "Failed to initialize GLAD\n";
         exit(1);
     }
+
+    gCamera.SetViewport(gScreenWidth, gScreenHeight);
     
 }
 
 
+// A VAO over a mesh and the per-object instance buffers; materialBuffer 0 = no atlas.
+// VAOs are not shared between GL contexts, every context that draws builds its own.
+GLuint CreateVertexArray(GLuint vertexBuffer, GLuint indexBuffer, GLuint instanceBuffer, GLuint materialBuffer) {
+    // create vao 
+    GLuint vertexArray = 0;
+    glGenVertexArrays(1, &vertexArray);
+
+    glBindVertexArray(vertexArray);
+
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+
+    // Enable vertex attribute and Describe vertex attribute layout
+    // for position attribute
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * MeshData::FloatsPerVertex, (GLvoid*)0);
+
+    // for color attribute
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * MeshData::FloatsPerVertex, (GLvoid*)(sizeof(GLfloat) * 3));
+
+    // for texture coordinate attribute
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * MeshData::FloatsPerVertex, (GLvoid*)(sizeof(GLfloat) * 6));
+
+    // the element buffer binding is part of the VAO state
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+
+    // a mat4 attribute takes 4 consecutive locations, one column (vec4) each
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    for(GLuint column = 0; column < 4; ++column) {
+        glEnableVertexAttribArray(4 + column);
+        glVertexAttribPointer(4 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (GLvoid*)(sizeof(glm::vec4) * column));
+        glVertexAttribDivisor(4 + column, 1); // advance once per instance, not per vertex
+    }
+
+    // per-instance atlas UV rect; without an atlas the attribute array stays off and every instance reads the
+    // constant (0, 0, 1, 1), i.e. its UVs unchanged
+    if(materialBuffer != 0) {
+        glBindBuffer(GL_ARRAY_BUFFER, materialBuffer);
+        glEnableVertexAttribArray(8);
+        glVertexAttribPointer(8, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (GLvoid*)0);
+        glVertexAttribDivisor(8, 1);
+    }
+    glVertexAttrib4f(8, 0.0f, 0.0f, 1.0f, 1.0f);
+
+    // Unbind vao and vbo to prevent accidental modification 
+    glBindVertexArray(0); // 解绑vao
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return vertexArray;
+}
+
+// (Re)creates the VAO describing the current vertex, index and instance buffers, on the main context
+void BuildVertexArray() {
+    if(gVertexArrayObject != 0) {
+        glDeleteVertexArrays(1, &gVertexArrayObject);
+    }
+    // GPU-driven culling draws with baseInstance = object index out of buffers holding every object
+    const GLuint instanceBuffer = gGpuCuller ? gGpuCuller->MatrixBuffer() : gInstanceBufferObject;
+    const GLuint materialBuffer = gGpuCuller ? gGpuCuller->UvRectBuffer() : gInstanceMaterialBuffer;
+    gVertexArrayObject = CreateVertexArray(gVertexBufferObject, gIndexBufferObject, instanceBuffer,
+                                           gMaterialUvRects.empty() ? 0 : materialBuffer);
+}
+
+// Points the instanced attributes of the bound VAO at entry 'first' of the instance buffers; the CPU path's
+// stand-in for a base instance, which core 4.1 does not have
+void SetFirstInstance(size_t first) {
+    glBindBuffer(GL_ARRAY_BUFFER, gInstanceBufferObject);
+    for(GLuint column = 0; column < 4; ++column) {
+        glVertexAttribPointer(4 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                              (GLvoid*)(sizeof(glm::mat4) * first + sizeof(glm::vec4) * column));
+    }
+    if(!gMaterialUvRects.empty()) {
+        glBindBuffer(GL_ARRAY_BUFFER, gInstanceMaterialBuffer);
+        glVertexAttribPointer(8, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (GLvoid*)(sizeof(glm::vec4) * first));
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Reads the current mesh back from its buffers (the loaders upload it and keep no CPU copy)
+void RefreshCpuMesh() {
+    if(!gSoftRasterizer && !gOcclusionCuller) {
+        return;
+    }
+    GLint vertexBytes = 0;
+    GLint indexBytes = 0;
+    glBindBuffer(GL_COPY_READ_BUFFER, gVertexBufferObject);
+    glGetBufferParameteriv(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &vertexBytes);
+    gCpuVertices.resize((size_t)vertexBytes / sizeof(float));
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, (GLsizeiptr)(gCpuVertices.size() * sizeof(float)), gCpuVertices.data());
+    glBindBuffer(GL_COPY_READ_BUFFER, gIndexBufferObject);
+    glGetBufferParameteriv(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &indexBytes);
+    gCpuIndices.resize(std::min((size_t)indexBytes / sizeof(uint32_t), (size_t)gIndexCount));
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, (GLsizeiptr)(gCpuIndices.size() * sizeof(uint32_t)), gCpuIndices.data());
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+}
+
+// Software backend: level 0 of gTexture, sRGB bytes as stored (compressed textures come back decoded)
+void RefreshSoftwareTexture() {
+    if(!gSoftRasterizer) {
+        return;
+    }
+    Image image;
+    GLint wrap = GL_REPEAT;
+    glBindTexture(GL_TEXTURE_2D, gTexture);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &image.width);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &image.height);
+    glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, &wrap);
+    image.pixels.resize(image.ByteSize());
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+    gSoftRasterizer->SetTexture(&image, wrap == GL_CLAMP_TO_EDGE);
+}
+
+void RefreshAllBounds(); // the mesh changed, every object's world bounds must be rebuilt
+void MarkSceneDirty();
+
+// Main thread, once the streamed mesh's buffers are on the GPU: swap it in for the placeholder
+void OnMeshLoaded(const MeshHandle& mesh) {
+    if(mesh->state != ResourceState::Ready) {
+        std::cout << "Keeping the placeholder mesh\n";
+        return;
+    }
+
+    glDeleteBuffers(1, &gVertexBufferObject);
+    glDeleteBuffers(1, &gIndexBufferObject);
+    gVertexBufferObject = mesh->vertexBuffer;
+    gIndexBufferObject = mesh->indexBuffer;
+    gIndexCount = mesh->indexCount;
+    gMeshBounds = mesh->bounds;
+    gMeshLods = mesh->lods;
+    gMeshlets = mesh->meshlets;
+    gMeshClosed = mesh->closed;
+    gObjectLods.clear(); // levels of the old mesh mean nothing for this one
+
+    BuildVertexArray();
+    RefreshCpuMesh();
+    RefreshAllBounds();
+    MarkSceneDirty();
+    std::cout << "Mesh ready: " << mesh->path << " (" << gIndexCount / 3 << " triangles";
+    for(size_t lod = 1; lod < gMeshLods.size(); ++lod) {
+        std::cout << (lod == 1 ? ", LODs: " : " / ") << gMeshLods[lod].indexCount / 3;
+    }
+    if(!gMeshlets.empty()) {
+        std::cout << ", " << gMeshlets.size() << " meshlets";
+        if(gMeshletCullingMode == MeshletCullingMode::Cone && !gMeshClosed) {
+            std::cout << ", not closed: no cone culling";
+        }
+    }
+    std::cout << ")\n";
+}
+
 void VertexSpecification() {
     // lives on cpu
     const std::vector<GLfloat> vertexData{
@@ -125,26 +552,25 @@ void VertexSpecification() {
         /* 0 - Vertex */
         -0.5f, -0.5f, 0.0f,
         1.0f, 0.0f, 0.0f, 
+        0.0f, 0.0f,
         /* 1 - Vertex */
         0.5f, -0.5f, 0.0f,  
         0.0f, 1.0f, 0.0f,
+        1.0f, 0.0f,
         /* 2 - Vertex */  
         -0.5f,  0.5f, 0.0f,   
         0.0f, 0.0f, 1.0f,   
+        0.0f, 1.0f,
         /* 3 - Vertex */  
         0.5f, 0.5f, 0.0f,  
-        1.0f, 0.0f, 0.0f  
+        1.0f, 0.0f, 0.0f,
+        1.0f, 1.0f
 
     };
 
 
     /* -------------------- Start setting things on the GPU ----------------------------------------------------------*/
 
-    // create vao 
-    glGenVertexArrays(1, &gVertexArrayObject);
-
-    glBindVertexArray(gVertexArrayObject);
-
     // create vbo for vertexData, bind it to GL_ARRAY_BUFFER, and upload data
     glGenBuffers(1, &gVertexBufferObject);
 
@@ -153,33 +579,98 @@ void VertexSpecification() {
     glBufferData(GL_ARRAY_BUFFER,       vertexData.size() * sizeof(GLfloat), 
                  vertexData.data(), GL_STATIC_DRAW);
 
-    // Enable vertex attribute and Describe vertex attribute layout
-    // for position attribute
-    glEnableVertexAttribArray(3);
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 6, (GLvoid*)0);
-
-    // for color attribute
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(GL_FLOAT) * 6, (GLvoid*)(sizeof(GLfloat) * 3));
-
     // 按索引绘制的顶点索引数据（每三个索引构成一个三角形）
     const std::vector<GLuint> indexBufferData {2, 0, 1, 3, 2, 1}; 
+    gIndexCount = (GLsizei)indexBufferData.size();
 
     // create index buffer object (IBO) for indexed drawing 
     glGenBuffers(1, &gIndexBufferObject);
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gIndexBufferObject);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, gIndexBufferObject);
 
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBufferData.size() * sizeof(GLuint), 
+    glBufferData(GL_COPY_WRITE_BUFFER, indexBufferData.size() * sizeof(GLuint), 
                  indexBufferData.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
 
-
-    // Unbind vao and vbo to prevent accidental modification 
-    glBindVertexArray(0); // 解绑vao
+    // create instance buffer: one mat4 per object, refilled every frame through glMapBufferRange
+    glGenBuffers(1, &gInstanceBufferObject);
+    glBindBuffer(GL_ARRAY_BUFFER, gInstanceBufferObject);
+    glBufferData(GL_ARRAY_BUFFER, gObjectCount * sizeof(glm::mat4), nullptr, GL_STREAM_DRAW);
+    glGenBuffers(1, &gInstanceMaterialBuffer); // filled alongside the matrices once an atlas is loaded
     glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glDisableVertexAttribArray(3);
-    glDisableVertexAttribArray(1);
 
+    // local bounds for culling, computed from the same vertex data
+    gMeshBounds = MeshBounds::FromVertices(vertexData.data(), vertexData.size() / MeshData::FloatsPerVertex, MeshData::FloatsPerVertex);
+
+    BuildVertexArray();
+    RefreshCpuMesh();
+
+    // the real mesh streams in while the quad is on screen (the server loads meshes per job instead)
+    if(!gMeshPath.empty() && !IsServing()) {
+        gPendingMesh = gResourceManager->LoadMeshAsync(gMeshPath, ViewerMeshOptions(), OnMeshLoaded);
+    }
+}
+
+// Main thread: the streamed texture is on the GPU, replace the white placeholder
+void OnTextureLoaded(const TextureHandle& texture) {
+    if(texture->state != ResourceState::Ready) {
+        std::cout << "Keeping the placeholder texture\n";
+        return;
+    }
+
+    glDeleteTextures(1, &gTexture);
+    gTexture = texture->texture;
+    RefreshSoftwareTexture();
+    MarkSceneDirty();
+    std::cout << "Texture ready: " << texture->path << " (" << texture->width << "x" << texture->height
+              << ", " << texture->levels << " mip levels"
+              << (texture->options.compress ? std::string(", ") + BlockFormatName(texture->options.blockFormat) : std::string())
+              << ")\n";
+}
+
+// Main thread: the atlas is uploaded; objects cycle through its materials, all in the same draw call
+void OnAtlasLoaded(const TextureHandle& atlas) {
+    if(atlas->state != ResourceState::Ready) {
+        std::cout << "Keeping the placeholder texture\n";
+        return;
+    }
+
+    glDeleteTextures(1, &gTexture);
+    gTexture = atlas->texture;
+    gMaterialUvRects.clear();
+    for(const AtlasRegion& region : atlas->regions) {
+        gMaterialUvRects.push_back(glm::vec4(region.uvOffset[0], region.uvOffset[1], region.uvScale[0], region.uvScale[1]));
+    }
+
+    if(gGpuCuller) {
+        gGpuCuller->SetUvRects(gMaterialUvRects);
+    }
+    BuildVertexArray();            // turns on the per-instance UV rect attribute
+    RefreshSoftwareTexture();
+    gInstanceBufferValid = false;  // the rects are gathered with the matrices
+    MarkSceneDirty();
+    std::cout << "Atlas ready: " << atlas->regions.size() << " textures in " << atlas->width << "x" << atlas->height
+              << " (" << atlas->levels << " mip levels)\n";
+}
+
+void TextureSpecification() {
+    // 1x1 white: multiplying by it leaves the vertex colors unchanged, so untextured meshes look as before
+    const GLubyte white[4] = {255, 255, 255, 255};
+    glGenTextures(1, &gTexture);
+    glBindTexture(GL_TEXTURE_2D, gTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8_ALPHA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    RefreshSoftwareTexture();
+
+    // decoded and mipmapped on a worker, uploaded on the shared context
+    if(!gAtlasPaths.empty()) {
+        gPendingTexture = gResourceManager->LoadTextureAtlasAsync(gAtlasPaths, gTextureOptions, AtlasOptions(), OnAtlasLoaded);
+    }
+    else if(!gTexturePath.empty()) {
+        gPendingTexture = gResourceManager->LoadTextureAsync(gTexturePath, gTextureOptions, OnTextureLoaded);
+    }
 }
 
 GLuint CompileShader(GLuint shaderType, const std::string& shadersource) {
@@ -223,51 +714,778 @@ GLuint CreateShaderProgram(const std::string& vertexshadersource, const std::str
     return programObject;
 }
 
+// Makes 'program' the scene program (the old one is deleted); false, leaving everything as it was, when it lacks
+// a uniform the renderer sets every frame
+bool SwapSceneProgram(GLuint program) {
+    if(glGetUniformLocation(program, "u_ModelMatrix") < 0 || glGetUniformLocation(program, "u_View") < 0 ||
+       glGetUniformLocation(program, "u_Projection") < 0) {
+        std::cout << "The program lacks u_ModelMatrix, u_View or u_Projection\n";
+        return false;
+    }
+    glDeleteProgram(gGraphicsPipelineShaderProgram);
+    gGraphicsPipelineShaderProgram = program;
+    gModelMatrixLocation = glGetUniformLocation(gGraphicsPipelineShaderProgram, "u_ModelMatrix");
+    MarkSceneDirty();
+    return true;
+}
+
+// Main thread: the streamed program is linked, replace the placeholder
+void OnProgramLoaded(const ProgramHandle& program) {
+    if(program->state != ResourceState::Ready) {
+        std::cout << "Keeping the placeholder shaders\n";
+        return;
+    }
+    if(gVirtualTexture || !SwapSceneProgram(program->program)) {
+        glDeleteProgram(program->program); // the virtual texture material stays
+        return;
+    }
+    gSceneProgram = program;
+}
+
+std::string ShaderPath(const char* file) {
+    return gShaderDirectory + "/" + file;
+}
+
 void CreateGraphicsPipeline() {
 
-    std::string vertexShaderSource = LoadShaderAsString("/home/summer/openglLearning/shaders/vertex_shader.glsl");
-    std::string fragmentShaderSource = LoadShaderAsString("/home/summer/openglLearning/shaders/fragment_shader.glsl");
+    // the built-in placeholder is tiny and compiles in a few milliseconds, so the first frame does not wait for disk
+    gGraphicsPipelineShaderProgram = CreateShaderProgram(gPlaceholderVertexShaderSource, gPlaceholderFragmentShaderSource);
+
+    // Retrieve the location of the uniform variable "u_ModelMatrix" once; it does not change until the program is relinked
+    gModelMatrixLocation = glGetUniformLocation(gGraphicsPipelineShaderProgram, "u_ModelMatrix");
+
+    // the real shaders are read on a worker and compiled/linked on the upload context
+    gPendingProgram = gResourceManager->LoadProgramAsync(ShaderPath(gVertexShaderFile), ShaderPath(gFragmentShaderFile),
+                                                         OnProgramLoaded);
+
+    if(gWatchShaders) {
+        gShaderWatcher = std::make_unique<ShaderWatcher>();
+        std::string error;
+        const Uint32 changedEvent = SDL_RegisterEvents(1);
+        auto wake = [changedEvent] {
+            // wakes an on-demand viewer idling in SDL_WaitEventTimeout; the frame it starts finds the change
+            if(changedEvent != (Uint32)-1) {
+                SDL_Event event = {};
+                event.type = changedEvent;
+                SDL_PushEvent(&event);
+            }
+        };
+        if(gShaderWatcher->Start(gShaderDirectory, wake, &error)) {
+            std::cout << "Watching " << gShaderDirectory << " for shader changes\n";
+        }
+        else {
+            std::cout << "Shader hot reload off: " << error << "\n";
+            gShaderWatcher.reset();
+        }
+    }
+}
+
+void ReloadShaders();
+
+// Main thread: a saved shader finished linking. Nothing changes unless it built.
+void OnProgramReloaded(const ProgramHandle& program) {
+    gReloadingProgram.reset();
+    if(program->state != ResourceState::Ready) {
+        std::cout << "Shader reload failed, keeping the running program\n"; // the log was printed with the failure
+    }
+    else if(gVirtualTexture) {
+        glDeleteProgram(program->program); // its material replaces the scene program
+    }
+    else if(!SwapSceneProgram(program->program)) {
+        glDeleteProgram(program->program);
+        std::cout << "Shader reload rejected, keeping the running program\n";
+    }
+    else {
+        gSceneProgram = program;
+        if(gRenderWorkers) {
+            // every worker links its own copy of the sources that were just proven to build
+            const std::string vertexSource = program->vertexSource;
+            const std::string fragmentSource = program->fragmentSource;
+            gRenderWorkers->ReloadProgram([vertexSource, fragmentSource] { return CreateShaderProgram(vertexSource, fragmentSource); });
+        }
+        std::cout << "Shaders reloaded\n";
+    }
+
+    if(gShaderReloadQueued) {
+        gShaderReloadQueued = false;
+        ReloadShaders();
+    }
+}
+
+// Relinks the scene program from the shader files; a reload already linking is followed by one more
+void ReloadShaders() {
+    if(gReloadingProgram) {
+        gShaderReloadQueued = true;
+        return;
+    }
+    gReloadingProgram = gResourceManager->LoadProgramAsync(ShaderPath(gVertexShaderFile), ShaderPath(gFragmentShaderFile),
+                                                           OnProgramReloaded);
+}
+
+// Main thread, once per frame
+void CheckShaderChanges() {
+    if(!gShaderWatcher) {
+        return;
+    }
+    for(const std::string& file : gShaderWatcher->TakeChanges()) {
+        if(file == gVertexShaderFile || file == gFragmentShaderFile) {
+            ReloadShaders();
+            return;
+        }
+    }
+}
+
+// Main thread: opens a .vtex file and switches the material to the virtual texture shaders
+void OnVirtualTextureFile(const std::string& path) {
+    std::unique_ptr<VirtualTexture> texture = std::make_unique<VirtualTexture>(*gJobSystem, gResourceManager->GetPixelBufferPool());
+    std::string error;
+    if(!texture->Open(path, &error)) {
+        std::cout << "Virtual texture failed: " << error << "\n";
+        return;
+    }
+
+    // linked before the old program is deleted, so the name cannot be reused and confuse Camera::Upload
+    GLuint program = CreateShaderProgram(gPlaceholderVertexShaderSource, texture->FragmentShaderSource());
+    glDeleteProgram(gGraphicsPipelineShaderProgram);
+    gGraphicsPipelineShaderProgram = program;
+    gModelMatrixLocation = glGetUniformLocation(gGraphicsPipelineShaderProgram, "u_ModelMatrix");
+
+    gVirtualTextureFeedbackProgram = CreateShaderProgram(gPlaceholderVertexShaderSource, VirtualTexture::FeedbackShaderSource());
+    gFeedbackUniformLocations[0] = glGetUniformLocation(gVirtualTextureFeedbackProgram, "u_ModelMatrix");
+    gFeedbackUniformLocations[1] = glGetUniformLocation(gVirtualTextureFeedbackProgram, "u_View");
+    gFeedbackUniformLocations[2] = glGetUniformLocation(gVirtualTextureFeedbackProgram, "u_Projection");
+
+    gVirtualTexture = std::move(texture);
+    MarkSceneDirty();
+}
+
+void VirtualTextureSpecification() {
+    if(gVirtualTexturePath.empty()) {
+        return;
+    }
+    const std::string path = gVirtualTexturePath;
+    if(path.size() > 5 && path.compare(path.size() - 5, 5, ".vtex") == 0) {
+        OnVirtualTextureFile(path);
+        return;
+    }
+
+    // a plain image: tiled once on a worker and cached next to the compressed textures
+    const bool srgb = gTextureOptions.srgb;
+    const std::string cacheDirectory = gTextureCacheDirectory;
+    gResourceManager->RunDecodeJob([path, srgb, cacheDirectory] {
+        std::vector<uint8_t> bytes;
+        if(!ResourceManager::ReadBinaryFile(path, bytes)) {
+            std::cout << "Virtual texture failed: cannot read " << path << "\n";
+            return;
+        }
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.vtex", (unsigned long long)HashBytes(bytes.data(), bytes.size(), srgb ? 1 : 0));
+        const std::string tiled = cacheDirectory + "/" + name;
+
+        if(!std::ifstream(tiled.c_str()).is_open()) {
+            Image image;
+            std::string error;
+            if(!DecodeImageMemory(bytes.data(), bytes.size(), path, image, &error) ||
+               !BuildVirtualTextureFile(image, srgb, tiled, 128, 4, &error)) {
+                std::cout << "Virtual texture failed: " << path << ": " << error << "\n";
+                return;
+            }
+        }
+        gResourceManager->QueueUpload(nullptr, [tiled] { OnVirtualTextureFile(tiled); });
+    });
+}
+
+void SceneSpecification() {
+    gSceneHierarchy.Clear();
+    gSceneHierarchy.Reserve(gObjectCount);
+
+    // object 0: the original quad at the origin, root of the scene
+    const uint32_t root = gSceneHierarchy.AddNode(TransformHierarchy::InvalidNode);
+
+    // the rest: a roughly cubic grid starting a few units in front of the camera, relative to the root
+    size_t side = 1;
+    while(side * side * side < gObjectCount) {
+        ++side;
+    }
+    const float spacing = 1.2f;
+    for(size_t i = 1; i < gObjectCount; ++i) {
+        size_t x = i % side;
+        size_t y = (i / side) % side;
+        size_t z = i / (side * side);
+        gSceneHierarchy.AddNode(root, glm::vec3(((float)x - side * 0.5f) * spacing,
+                                                ((float)y - side * 0.5f) * spacing,
+                                                -3.0f - (float)z * spacing));
+    }
+
+    // already breadth-first here (root, then its children), but scenes built in other orders rely on this
+    gSceneHierarchy.SortBreadthFirst();
+    gObjectBounds.Resize(gObjectCount);
+    gBvh = Bvh(); // rebuilt lazily once the bounds are known
+    gDrawListValid = false;
+    gInstanceBufferValid = false;
+
+    std::cout << "Scene: " << gObjectCount << " objects, transform kernel: " << SimdLevelName(GetSimdLevel()) << "\n";
+}
 
+// Applies the interpolated gOffset / gRotate to the root; children inherit it through the hierarchy
+void UpdateObjectTransforms() {
+    // 先平移，再绕 y 轴旋转
+    gSceneHierarchy.SetLocalPosition(0, glm::vec3(0.0f, 0.0f, gOffset));
+    gSceneHierarchy.SetLocalRotation(0, glm::angleAxis(glm::radians(gRotate), glm::vec3(0.0f, 1.0f, 0.0f)));
+
+    if(gSceneHierarchy.UpdateWorldMatrices(gJobSystem.get()) > 0) {
+        // world bounds follow the world matrices; untouched objects keep theirs
+        gJobSystem->ParallelFor(gObjectCount, [](size_t begin, size_t end) {
+            for(size_t i = begin; i < end; ++i) {
+                if(gSceneHierarchy.WorldChangedLastUpdate((uint32_t)i)) {
+                    gObjectBounds.SetFromLocal(i, gMeshBounds, gSceneHierarchy.GetWorldMatrix((uint32_t)i));
+                }
+            }
+        });
+        // the BVH dirty flags are shared between objects, mark them on this thread
+        if(gBvh.IsBuilt()) {
+            for(uint32_t i = 0; i < gObjectCount; ++i) {
+                if(gSceneHierarchy.WorldChangedLastUpdate(i)) {
+                    gBvh.MarkObjectChanged(i);
+                }
+            }
+        }
+        gDrawListValid = false;
+    }
+}
 
-    gGraphicsPipelineShaderProgram = CreateShaderProgram(vertexShaderSource, fragmentShaderSource);
+void RefreshAllBounds() {
+    gJobSystem->ParallelFor(gObjectCount, [](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; ++i) {
+            gObjectBounds.SetFromLocal(i, gMeshBounds, gSceneHierarchy.GetWorldMatrix((uint32_t)i));
+        }
+    });
+    gBvh = Bvh(); // every leaf changed, a fresh build beats refitting all of it
+    gDrawListValid = false;
 }
 
+// Builds the BVH on first use, afterwards only refits the nodes above objects that moved
+void UpdateBvh() {
+    if(!gBvh.IsBuilt()) {
+        gBvh.Build(gObjectBounds, gObjectCount);
+    }
+    else {
+        gBvh.Refit(gObjectBounds);
+    }
+}
+
+// Rasterizes the objects of the draw list closest to the eye as occluders and drops the ones hidden behind them
+void CullOccludedObjects(const glm::mat4& viewProjection) {
+    if(gDrawList.size() <= gOccluderCount || gCpuIndices.empty()) {
+        return; // everything would be an occluder
+    }
+
+    // distance to the nearest point of each bounding sphere, in the space the bounds live in
+    const glm::vec3 eye = glm::vec3(glm::inverse(gSceneRootMatrix) * glm::vec4(gCamera.GetEye(), 1.0f));
+    std::vector<uint32_t> nearest(gDrawList);
+    std::partial_sort(nearest.begin(), nearest.begin() + gOccluderCount, nearest.end(), [&eye](uint32_t a, uint32_t b) {
+        return glm::distance(eye, gObjectBounds.GetCenter(a)) - gObjectBounds.GetRadius(a) <
+               glm::distance(eye, gObjectBounds.GetCenter(b)) - gObjectBounds.GetRadius(b);
+    });
+    std::vector<glm::mat4> occluders(gOccluderCount);
+    for(size_t i = 0; i < gOccluderCount; ++i) {
+        occluders[i] = gSceneHierarchy.GetWorldMatrix(nearest[i]);
+    }
+
+    gOcclusionCuller->Begin(viewProjection);
+    gOcclusionCuller->RasterizeOccluders(gCpuVertices.data(), gCpuVertices.size() / MeshData::FloatsPerVertex, MeshData::FloatsPerVertex,
+                                         gCpuIndices.data(), gCpuIndices.size(), occluders.data(), occluders.size());
+    gOcclusionCuller->BuildPyramid();
+    gOcclusionCuller->Filter(gObjectBounds, gDrawList);
+}
+
+// Picks the level of detail of every object in gDrawList from how many pixels its mesh error covers on screen,
+// then groups the draw list by level (stable, objects keep their culling order within a level)
+void SelectLods() {
+    gLodDrawOffsets.clear();
+    if(gMeshLods.size() < 2 || !UsesLodSelection() || gDrawList.empty()) {
+        return; // the software backend draws gCpuIndices, i.e. level 0
+    }
+    if(gObjectLods.size() != gObjectCount) {
+        gObjectLods.assign(gObjectCount, 0);
+    }
+
+    // an error of e at distance d covers e * pixelsPerUnit / d pixels; [1][1] of the projection is cot(fovy / 2)
+    const float pixelsPerUnit = gCamera.GetProjection()[1][1] * 0.5f * (float)gRenderHeight;
+    const glm::vec3 eye = glm::vec3(glm::inverse(gSceneRootMatrix) * glm::vec4(gCamera.GetEye(), 1.0f));
+    const float meshRadius = gMeshBounds.radius;
+    const int lodCount = (int)gMeshLods.size();
+    gJobSystem->ParallelFor(gDrawList.size(), [&](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; ++i) {
+            const uint32_t object = gDrawList[i];
+            const float radius = gObjectBounds.GetRadius(object);
+            // nearest point of the bounding sphere; inside it everything stays at full detail
+            const float distance = glm::distance(eye, gObjectBounds.GetCenter(object)) - radius;
+            int lod = 0;
+            if(distance > 0.0f && meshRadius > 0.0f) {
+                const float pixelsPerMeshUnit = radius / meshRadius * pixelsPerUnit / distance; // object scale included
+                const int current = gObjectLods[object];
+                for(int level = lodCount - 1; level > 0; --level) {
+                    const float budget = level > current ? gLodPixelError * gLodHysteresis : gLodPixelError;
+                    if(gMeshLods[level].error * pixelsPerMeshUnit <= budget) {
+                        lod = level;
+                        break;
+                    }
+                }
+            }
+            gObjectLods[object] = (uint8_t)lod;
+        }
+    }, 4096);
 
+    gLodDrawOffsets.assign(lodCount + 1, 0);
+    for(uint32_t object : gDrawList) {
+        ++gLodDrawOffsets[gObjectLods[object] + 1];
+    }
+    for(int level = 0; level < lodCount; ++level) {
+        gLodDrawOffsets[level + 1] += gLodDrawOffsets[level];
+    }
+    std::vector<size_t> next(gLodDrawOffsets.begin(), gLodDrawOffsets.end() - 1);
+    gLodSortScratch.resize(gDrawList.size());
+    for(uint32_t object : gDrawList) {
+        gLodSortScratch[next[gObjectLods[object]]++] = object;
+    }
+    gDrawList.swap(gLodSortScratch);
+}
+
+// Tests the clusters of every object drawn at full detail. Whole objects stay where they are, objects without a
+// visible cluster leave the draw list, the rest move to its end with the index ranges they still need.
+void CullObjectMeshlets(const Frustum& frustum) {
+    gPartialDrawStart = gDrawList.size();
+    gPartialDrawRanges.assign(1, 0);
+    gMeshletRangeCounts.clear();
+    gMeshletRangeOffsets.clear();
+    if(gMeshlets.size() < 2 || !UsesMeshletCulling() || gDrawList.empty()) {
+        return;
+    }
+
+    // level 0 is the first group of the draw list when LODs are on
+    const size_t fullDetail = gLodDrawOffsets.empty() ? gDrawList.size() : gLodDrawOffsets[1];
+    const size_t meshletCount = gMeshlets.size();
+    const size_t batchSize = std::max<size_t>(64, gMeshletVisibilityBudget / meshletCount);
+    gMeshletVisibility.resize(std::min(fullDetail, batchSize) * meshletCount);
+    const glm::vec3 eye = glm::vec3(glm::inverse(gSceneRootMatrix) * glm::vec4(gCamera.GetEye(), 1.0f));
+    const bool cone = gMeshletCullingMode == MeshletCullingMode::Cone && gMeshClosed;
+    const float meshRadius = gMeshBounds.radius;
+
+    std::vector<uint32_t> partial;
+    size_t kept = 0; // never passes the batch being culled, so compacting does not touch objects still to come
+    for(size_t batch = 0; batch < fullDetail; batch += batchSize) {
+        const size_t batchEnd = std::min(fullDetail, batch + batchSize);
+        gJobSystem->ParallelFor(batchEnd - batch, [&](size_t begin, size_t end) {
+            for(size_t i = begin; i < end; ++i) {
+                const uint32_t object = gDrawList[batch + i];
+                const float scale = meshRadius > 0.0f ? gObjectBounds.GetRadius(object) / meshRadius : 1.0f;
+                // from inside the object its back faces are what can be seen
+                const bool outside = glm::length(gObjectBounds.GetCenter(object) - eye) > gObjectBounds.GetRadius(object);
+                CullMeshlets(gMeshlets, gSceneHierarchy.GetWorldMatrix(object), scale, frustum, eye, cone && outside,
+                             &gMeshletVisibility[i * meshletCount]);
+            }
+        }, 64);
+
+        for(size_t i = batch; i < batchEnd; ++i) {
+            const uint8_t* visible = &gMeshletVisibility[(i - batch) * meshletCount];
+            const size_t visibleCount = (size_t)std::count(visible, visible + meshletCount, 1);
+            if(visibleCount == meshletCount) {
+                gDrawList[kept++] = gDrawList[i];
+                continue;
+            }
+            if(visibleCount == 0) {
+                continue;
+            }
+            partial.push_back(gDrawList[i]);
+            for(size_t m = 0; m < meshletCount;) {
+                if(!visible[m]) {
+                    ++m;
+                    continue;
+                }
+                // consecutive meshlets are consecutive index ranges, one draw covers a run of them
+                const size_t firstIndex = gMeshlets[m].firstIndex;
+                size_t indexCount = 0;
+                for(; m < meshletCount && visible[m]; ++m) {
+                    indexCount += gMeshlets[m].indexCount;
+                }
+                gMeshletRangeCounts.push_back((GLsizei)indexCount);
+                gMeshletRangeOffsets.push_back((const GLvoid*)(firstIndex * sizeof(GLuint)));
+            }
+            gPartialDrawRanges.push_back(gMeshletRangeCounts.size());
+        }
+    }
+
+    const size_t removed = fullDetail - kept;
+    gDrawList.erase(gDrawList.begin() + kept, gDrawList.begin() + fullDetail);
+    for(size_t level = 1; level < gLodDrawOffsets.size(); ++level) {
+        gLodDrawOffsets[level] -= removed;
+    }
+    gPartialDrawStart = gDrawList.size();
+    gDrawList.insert(gDrawList.end(), partial.begin(), partial.end());
+}
+
+// GPU-driven path: uploads the world matrices when any changed and lets the compute pass write this frame's draws
+void CullObjectsOnGpu() {
+    if(!gDrawListValid) {
+        gGpuCuller->UploadMatrices(gSceneHierarchy.WorldMatrices(), gObjectCount);
+        gDrawListValid = true; // here: the matrix buffer is up to date
+    }
+    gGpuCuller->Cull(gCamera.GetViewProjection() * gSceneRootMatrix, gMeshBounds, gIndexCount, gVertexArrayObject);
+}
+
+// Rebuilds gDrawList when objects or the camera moved since the last pass
+void CullObjects() {
+    if(gDrawListValid &&
+       gCulledProjectionVersion == gCamera.GetProjectionVersion() &&
+       gCulledViewVersion == gCamera.GetViewVersion()) {
+        return;
+    }
+
+    // planes in the space the bounds live in: the scene root transform is applied on top of each instance
+    const glm::mat4 viewProjection = gCamera.GetViewProjection() * gSceneRootMatrix;
+    Frustum frustum = Frustum::FromMatrix(viewProjection);
+
+    gDrawList.clear();
+    if(gObjectCount >= gBvhMinObjects) {
+        UpdateBvh();
+        gBvh.QueryFrustum(frustum, gObjectBounds, gDrawList);
+    }
+    else {
+        CullFrustum(frustum, gObjectBounds, 0, gObjectCount, gDrawList);
+    }
+    if(gOcclusionCuller) {
+        CullOccludedObjects(viewProjection);
+    }
+    SelectLods();
+    CullObjectMeshlets(frustum);
+
+    gDrawListValid = true;
+    gCulledProjectionVersion = gCamera.GetProjectionVersion();
+    gCulledViewVersion = gCamera.GetViewVersion();
+    gInstanceBufferValid = false;
+}
+
+// Copies the world matrices of the visible objects into the (orphaned) instance buffer, only when the draw list changed
+void UploadInstanceMatrices() {
+    if(gInstanceBufferValid || gDrawList.empty()) {
+        return;
+    }
+
+    const GLsizeiptr size = gDrawList.size() * sizeof(glm::mat4);
+
+    glBindBuffer(GL_ARRAY_BUFFER, gInstanceBufferObject);
+    // orphan the old storage so we never wait for the GPU to finish reading last frame's matrices
+    glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
+    float* matrices = (float*)glMapBufferRange(GL_ARRAY_BUFFER, 0, size,
+                                               GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if(matrices == nullptr) {
+        std::cout << "Could not map the instance buffer\n";
+        exit(EXIT_FAILURE);
+    }
+
+    // gather visible matrices; the mapped pointer stays valid for every thread until glUnmapBuffer
+    const glm::mat4* world = gSceneHierarchy.WorldMatrices();
+    glm::vec4* uvRects = nullptr;
+    if(!gMaterialUvRects.empty()) {
+        glBindBuffer(GL_ARRAY_BUFFER, gInstanceMaterialBuffer);
+        glBufferData(GL_ARRAY_BUFFER, gDrawList.size() * sizeof(glm::vec4), nullptr, GL_STREAM_DRAW);
+        uvRects = (glm::vec4*)glMapBufferRange(GL_ARRAY_BUFFER, 0, gDrawList.size() * sizeof(glm::vec4),
+                                               GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if(uvRects == nullptr) {
+            std::cout << "Could not map the instance material buffer\n";
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    gJobSystem->ParallelFor(gDrawList.size(), [matrices, world, uvRects](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; ++i) {
+            std::memcpy(matrices + i * 16, &world[gDrawList[i]][0][0], sizeof(glm::mat4));
+        }
+        if(uvRects != nullptr) {
+            // object i uses material i % count
+            for(size_t i = begin; i < end; ++i) {
+                uvRects[i] = gMaterialUvRects[gDrawList[i] % gMaterialUvRects.size()];
+            }
+        }
+    }, 4096);
+
+    if(uvRects != nullptr) {
+        glUnmapBuffer(GL_ARRAY_BUFFER); // the material buffer is still bound
+        glBindBuffer(GL_ARRAY_BUFFER, gInstanceBufferObject);
+    }
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    gInstanceBufferValid = true;
+}
+
+// Casts a ray from the camera through window pixel (x, y) and reports the closest object it hits
+void PickObject(int x, int y) {
+    // window -> normalized device coordinates (SDL's y axis points down)
+    float ndcX = 2.0f * (float)x / (float)gScreenWidth - 1.0f;
+    float ndcY = 1.0f - 2.0f * (float)y / (float)gScreenHeight;
+
+    // unproject the near and far points into the space the object bounds live in
+    glm::mat4 inverse = glm::inverse(gCamera.GetViewProjection() * gSceneRootMatrix);
+    glm::vec4 nearPoint = inverse * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+    glm::vec4 farPoint = inverse * glm::vec4(ndcX, ndcY, 1.0f, 1.0f);
+    glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+    glm::vec3 direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - origin);
+
+    UpdateBvh();
+    uint32_t object = 0;
+    float distance = 0.0f;
+    if(gBvh.Raycast(origin, direction, gObjectBounds, object, distance)) {
+        std::cout << "Picked object " << object << " at distance " << distance << "\n";
+    }
+    else {
+        std::cout << "Picked nothing\n";
+    }
+}
+
+void RenderTargetSpecification() {
+    if(IsServing()) {
+        gSceneTarget = std::make_unique<RenderTarget>(); // jobs render offscreen at their own size, nothing is shown
+        return;
+    }
+    if(gSoftRasterizer) {
+        // the target receives the CPU-drawn frame; the GPU timer would only see the upload, nothing to adapt to
+        if(gDynamicResolution) {
+            std::cout << "Dynamic resolution is not available with --backend soft, using full size\n";
+            gDynamicResolution = false;
+        }
+    }
+    else if(!gDynamicResolution && gResolutionScale >= 1.0f) {
+        return;
+    }
+    gSceneTarget = std::make_unique<RenderTarget>();
+    gSceneTimer = std::make_unique<GpuTimer>();
+    gUpscaler = std::make_unique<Upscaler>();
+    if(gDynamicResolution) {
+        // the frame rate cap is the budget; uncapped aims for 60 fps
+        const double targetMs = 1000.0 / (gMaxFrameRate > 0.0 ? gMaxFrameRate : 60.0);
+        gDynamicResolutionController = std::make_unique<DynamicResolution>(targetMs, 0.5f, gResolutionScale);
+    }
+}
 
-void Input() {
+// Picks this frame's render size: the window, or a fraction of it when rendering offscreen
+void UpdateRenderSize() {
+    if(gRenderServer) {
+        // the job set gRenderWidth x gRenderHeight; the target only grows, so jobs of mixed sizes do not reallocate it
+        gSceneTarget->Resize(std::max(gSceneTarget->Width(), gRenderWidth), std::max(gSceneTarget->Height(), gRenderHeight));
+        return;
+    }
+    float scale = 1.0f;
+    if(gSceneTarget) {
+        const double gpuMs = gSceneTimer->Poll();
+        if(gDynamicResolutionController && gDynamicResolutionController->AddSample(gpuMs)) {
+            std::cout << "Render scale " << gDynamicResolutionController->Scale() << " (scene "
+                      << gDynamicResolutionController->SmoothedMilliseconds() << " ms on the GPU)\n";
+        }
+        scale = gDynamicResolutionController ? gDynamicResolutionController->Scale() : gResolutionScale;
+        gSceneTarget->Resize(gScreenWidth, gScreenHeight); // no-op unless the window changed size
+    }
+    gRenderWidth = std::max(1, (int)(gScreenWidth * scale + 0.5f));
+    gRenderHeight = std::max(1, (int)(gScreenHeight * scale + 0.5f));
+}
+
+void BindSceneFramebuffer() {
+    if(gSceneTarget) {
+        gSceneTarget->Bind(gRenderWidth, gRenderHeight);
+    }
+    else {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, gRenderWidth, gRenderHeight);
+    }
+}
+
+void FrameCaptureSpecification() {
+    if(gCapturePath.empty() && !IsServing()) {
+        return;
+    }
+    gCaptureOptions.path = gCapturePath;
+    gCaptureOptions.framesPerSecond = gMaxFrameRate > 0.0 ? (int)std::lround(gMaxFrameRate) : 60;
+    if(gTurntableFrames > 0 && gCaptureFrameLimit == 0) {
+        gCaptureFrameLimit = (uint64_t)gTurntableFrames;
+    }
+    gFrameCapture = std::make_unique<FrameCapture>(*gJobSystem, gCaptureOptions);
+    std::cout << "Capturing frames to " << gCapturePath << "\n";
+}
+
+// Queues the readback of the finished window contents; the files are written a few frames later
+void CaptureFrame() {
+    if(!gFrameCapture) {
+        return;
+    }
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    gFrameCapture->Capture(gScreenWidth, gScreenHeight);
+    if(gCaptureFrameLimit > 0 && gFrameCapture->CapturedCount() >= gCaptureFrameLimit) {
+        gQuit = true;
+    }
+}
+
+// CPU culling: draws gDrawList with the bound program and VAO, per level of detail, then the meshlet ranges of
+// objects that are only partly visible. The feedback pass uses it too, so it requests tiles for what is drawn.
+void DrawVisibleObjects() {
+    if(!gLodDrawOffsets.empty()) {
+        // one call per level of detail, each starting at its part of the instance buffer
+        for(size_t lod = 0; lod + 1 < gLodDrawOffsets.size(); ++lod) {
+            const size_t first = gLodDrawOffsets[lod];
+            const size_t count = gLodDrawOffsets[lod + 1] - first;
+            if(count == 0) {
+                continue;
+            }
+            SetFirstInstance(first);
+            glDrawElementsInstanced(GL_TRIANGLES, (GLsizei)gMeshLods[lod].indexCount, GL_UNSIGNED_INT,
+                                    (GLvoid*)(gMeshLods[lod].firstIndex * sizeof(GLuint)), (GLsizei)count);
+        }
+    }
+    else if(gPartialDrawStart > 0) {
+        glDrawElementsInstanced(GL_TRIANGLES, 
+                       gIndexCount, // 这里是索引的数量，不是顶点数量。占位的四边形有 6 个索引（2 个三角形）。
+                       GL_UNSIGNED_INT, 
+                       0, // 索引绘制：从当前绑定的 GL_ELEMENT_ARRAY_BUFFER 里读取索引数据，每三个索引构成一个三角形，绘制两组三角形（共六个顶点）
+                       (GLsizei)gPartialDrawStart); // 每个可见物体一个实例，模型矩阵来自实例缓冲
+    }
+
+    // objects that kept only some meshlets: a non-instanced draw reads instance 0 of the per-instance
+    // attributes, so pointing them at the object's entry is enough
+    for(size_t i = 0; i + 1 < gPartialDrawRanges.size(); ++i) {
+        const size_t first = gPartialDrawRanges[i];
+        SetFirstInstance(gPartialDrawStart + i);
+        glMultiDrawElements(GL_TRIANGLES, &gMeshletRangeCounts[first], GL_UNSIGNED_INT, &gMeshletRangeOffsets[first],
+                            (GLsizei)(gPartialDrawRanges[i + 1] - first));
+    }
+    if(!gLodDrawOffsets.empty() || gPartialDrawRanges.size() > 1) {
+        SetFirstInstance(0); // the next pass and the next frame expect the VAO as built
+    }
+}
+
+// Draws the visible objects with the feedback shader into the virtual texture's tile request target
+void RenderVirtualTextureFeedback() {
+    if(!gVirtualTexture || gDrawList.empty() || !gVirtualTexture->BeginFeedback(gRenderWidth, gRenderHeight)) {
+        return;
+    }
+
+    glUseProgram(gVirtualTextureFeedbackProgram);
+    gVirtualTexture->Bind(gVirtualTextureFeedbackProgram);
+    glUniformMatrix4fv(gFeedbackUniformLocations[0], 1, GL_FALSE, &gSceneRootMatrix[0][0]);
+    glUniformMatrix4fv(gFeedbackUniformLocations[1], 1, GL_FALSE, &gCamera.GetView()[0][0]);
+    glUniformMatrix4fv(gFeedbackUniformLocations[2], 1, GL_FALSE, &gCamera.GetProjection()[0][0]);
+
+    glBindVertexArray(gVertexArrayObject);
+    DrawVisibleObjects(); // never GPU culled: the feedback pass and --gpu-culling exclude each other
+
+    gVirtualTexture->EndFeedback();
+    BindSceneFramebuffer();
+    glUseProgram(gGraphicsPipelineShaderProgram);
+}
+
+// Anything that changes what ends up on screen should call this (also safe to set from outside the loop)
+void MarkSceneDirty() {
+    gSceneDirty = true;
+}
+
+// True while the simulation is still moving: a movement key is held, or the last step changed the state
+bool IsAnimating() {
+    const Uint8 *keyState = SDL_GetKeyboardState(NULL);
+    bool keyHeld = keyState[SDL_SCANCODE_UP] || keyState[SDL_SCANCODE_DOWN] ||
+                   keyState[SDL_SCANCODE_LEFT] || keyState[SDL_SCANCODE_RIGHT];
+
+    return keyHeld || gTurntableFrames > 0 ||
+           gPreviousState.offset != gCurrentState.offset ||
+           gPreviousState.rotate != gCurrentState.rotate;
+}
+
+void HandleEvent(const SDL_Event& e) {
+    // SDL_QUIT：用户点击窗口关闭按钮/系统请求退出等。
+    if(e.type == SDL_QUIT) {
+        std::cout << "Goodbye!\n";
+        gQuit = true;
+    }
+    else if(e.type == SDL_WINDOWEVENT) {
+        if(e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+            // 窗口大小变化：更新视口尺寸，相机据此重新计算投影矩阵（仅此一次）
+            gScreenWidth = e.window.data1;
+            gScreenHeight = e.window.data2;
+            gCamera.SetViewport(gScreenWidth, gScreenHeight);
+        }
+        // exposed / resized / shown etc. - the window contents have to be produced again
+        MarkSceneDirty();
+    }
+    else if(e.type == SDL_KEYDOWN) {
+        MarkSceneDirty();
+    }
+    else if(e.type == SDL_MOUSEBUTTONDOWN && e.button.button == SDL_BUTTON_LEFT) {
+        PickObject(e.button.x, e.button.y);
+    }
+}
+
+// Returns true if we blocked waiting for events (the caller should then restart its frame timing)
+bool Input() {
     // SDL_Event 是一个联合体，用于承载“事件队列”里取出的各种事件（窗口/键盘/鼠标等）。
     SDL_Event e;
-    // SDL_PollEvent：非阻塞轮询。
-    // 返回非 0 表示取到一个事件并写入 e；返回 0 表示当前队列为空。
-    while(SDL_PollEvent(&e) != 0) {
-        // SDL_QUIT：用户点击窗口关闭按钮/系统请求退出等。
-        if(e.type == SDL_QUIT) {
-            std::cout << "Goodbye!\n";
-            gQuit = true;
-        }
-        
+    bool waited = false;
+    bool haveEvent = false;
+
+    if(gRedrawMode == RedrawMode::OnDemand && !gSceneDirty && !IsAnimating()) {
+        // SDL_WaitEventTimeout：阻塞等待，直到有事件或超时，空闲时几乎不占用 CPU。
+        // While assets are streaming we wake up often enough to swap them in promptly.
+        bool streaming = gResourceManager->PendingCount() > 0 || (gVirtualTexture && gVirtualTexture->HasPendingWork()) ||
+                         (gFrameCapture && gFrameCapture->HasPendingWork());
+        int timeout = streaming ? 5 : gIdleWaitTimeoutMs;
+        haveEvent = SDL_WaitEventTimeout(&e, timeout) != 0;
+        waited = true;
     }
+    else {
+        // SDL_PollEvent：非阻塞轮询。
+        // 返回非 0 表示取到一个事件并写入 e；返回 0 表示当前队列为空。
+        haveEvent = SDL_PollEvent(&e) != 0;
+    }
+
+    while(haveEvent) {
+        HandleEvent(e);
+        haveEvent = SDL_PollEvent(&e) != 0;
+    }
+
+    return waited;
+}
 
+// Advances the simulation by exactly dt seconds. Only ever called with gFixedTimeStep,
+// so the result is the same no matter how fast frames are rendered.
+void Update(SimulationState& state, float dt) {
     // Retrieve keyboard state
-    const Uint8 *state = SDL_GetKeyboardState(NULL);
-    if(state[SDL_SCANCODE_UP]) {
-        gOffset += 0.01f;
-        std::cout << "g_uOffset: " << gOffset << std::endl;
+    const Uint8 *keyState = SDL_GetKeyboardState(NULL);
+    if(keyState[SDL_SCANCODE_UP]) {
+        state.offset += gMoveSpeed * dt;
+        std::cout << "g_uOffset: " << state.offset << std::endl;
     }
-    if(state[SDL_SCANCODE_DOWN]) {
-        gOffset -= 0.01f;
-        std::cout << "g_uOffset: " << gOffset << std::endl;
+    if(keyState[SDL_SCANCODE_DOWN]) {
+        state.offset -= gMoveSpeed * dt;
+        std::cout << "g_uOffset: " << state.offset << std::endl;
     }
-    if(state[SDL_SCANCODE_LEFT]) {
-        gRotate -= 1.0f;
-        std::cout << "g_uRotate: " << gRotate << std::endl;
+    if(keyState[SDL_SCANCODE_LEFT]) {
+        state.rotate -= gRotateSpeed * dt;
+        std::cout << "g_uRotate: " << state.rotate << std::endl;
     }
-    if(state[SDL_SCANCODE_RIGHT]) {
-        gRotate += 1.0f;
-        std::cout << "g_uRotate: " << gRotate << std::endl;
+    if(keyState[SDL_SCANCODE_RIGHT]) {
+        state.rotate += gRotateSpeed * dt;
+        std::cout << "g_uRotate: " << state.rotate << std::endl;
     }
 
+    if(state.offset != gPreviousState.offset || state.rotate != gPreviousState.rotate) {
+        MarkSceneDirty();
+    }
+}
 
+// alpha in [0, 1): how far we are between the last two fixed steps
+void InterpolateState(float alpha) {
+    gOffset = gPreviousState.offset + (gCurrentState.offset - gPreviousState.offset) * alpha;
+    gRotate = gPreviousState.rotate + (gCurrentState.rotate - gPreviousState.rotate) * alpha;
+    if(gTurntableFrames > 0) {
+        // the angle follows the frame number, not the clock; the arrow keys still add to it
+        gRotate += 360.0f * (float)(gTurntableFrame % gTurntableFrames) / (float)gTurntableFrames;
+    }
 }
 
 void PreDraw() {
@@ -276,28 +1494,62 @@ void PreDraw() {
     // - 设置 OpenGL 状态（深度测试/混合/剔除等）
     glDisable(GL_DEPTH_TEST);
     glDisable(GL_CULL_FACE);
+    glEnable(GL_FRAMEBUFFER_SRGB); // 片段着色器输出线性颜色，由硬件编码为 sRGB
+    if(gOcclusionCuller) {
+        glEnable(GL_DEPTH_TEST); // without it a hidden object drawn later would paint over its occluder
+    }
+    if(UsesMeshletCulling()) {
+        glEnable(GL_DEPTH_TEST); // partial objects go last and the triangles are in meshlet order
+    }
+
+    // 离屏渲染时场景画到 gSceneTarget 左下角 gRenderWidth x gRenderHeight 的区域，之后再放大到窗口
+    UpdateRenderSize();
+    if(gSceneTimer) {
+        gSceneTimer->Begin();
+    }
+    if(gGpuCuller) {
+        // the compute pass (and the Hi-Z pre-pass into a target of its own) runs before the scene target is bound
+        UpdateObjectTransforms();
+        CullObjectsOnGpu();
+        glEnable(GL_DEPTH_TEST); // the appended draws come in no particular order
+    }
+    BindSceneFramebuffer();
 
-    glViewport(0, 0, gScreenWidth, gScreenHeight);
     glClearColor(1.f, 1.f, 0.f, 1.f); // 黄色背景
+    if(gSceneTarget) {
+        // only the part that gets rendered: at 70% scale that halves the fill of the clear
+        glEnable(GL_SCISSOR_TEST);
+        glScissor(0, 0, gRenderWidth, gRenderHeight);
+    }
     glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT); // 清除深度缓冲和颜色缓冲
+    glDisable(GL_SCISSOR_TEST);
 
     // - 绑定 shader program
     glUseProgram(gGraphicsPipelineShaderProgram);
 
-    // 构造一个模型变换矩阵：先平移，再旋转
-    glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, gOffset));
+    // - 绑定纹理：u_Texture 默认就是纹理单元 0，不需要设置 uniform
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, gTexture);
+    if(gVirtualTexture) {
+        gVirtualTexture->Bind(gGraphicsPipelineShaderProgram); // page table / cache on units 1 and 2
+    }
 
-    // 围绕 y 轴旋转 45 度
-    model           = glm::rotate(model, glm::radians(gRotate), glm::vec3(0.0f, 1.0f, 0.0f));
+    // 每个物体的模型矩阵由层级变换系统计算（只重算变化的子树），
+    // 视锥剔除后只有可见物体的矩阵写入实例缓冲（有变化时才重新写入）
+    if(!gGpuCuller) {
+        UpdateObjectTransforms();
+        CullObjects();
+        UploadInstanceMatrices();
+    }
 
-    // Retrieve the location of the uniform variable "u_ModelMatrix" in the shader program, and set it to the translation matrix
-    GLint u_ModelMatrixLocation = glGetUniformLocation(gGraphicsPipelineShaderProgram, "u_ModelMatrix");
+    // 虚拟纹理：先用 feedback shader 画一遍低分辨率的“需要哪些 tile”，结果异步读回
+    RenderVirtualTextureFeedback();
 
-    if(u_ModelMatrixLocation >= 0) { 
-        glUniformMatrix4fv(u_ModelMatrixLocation, // location of the uniform variable
+    if(gModelMatrixLocation >= 0) { 
+        glUniformMatrix4fv(gModelMatrixLocation, // location of the uniform variable
                            1, // count: how many matrices we are sending (1 in this case)
                            GL_FALSE, // whether to transpose the matrix (OpenGL expects column-major order, and glm::mat4 is already in that format, so we pass GL_FALSE)
-                           &model[0][0] // glm::mat4 在内存中是列主序存储的，所以传地址时直接传第一列的地址即可
+                           &gSceneRootMatrix[0][0] // glm::mat4 在内存中是列主序存储的，所以传地址时直接传第一列的地址即可
                          );
     }
     else {
@@ -305,25 +1557,8 @@ void PreDraw() {
         exit(EXIT_FAILURE);
     }
 
-    // 构造一个透视投影矩阵
-    glm::mat4 perspective = glm::perspective(glm::radians(45.0f), 
-                                             (float)gScreenWidth / (float)gScreenHeight,
-                                             0.1f,
-                                             10.0f
-                                            );
-
-    // Retrieve the location of the uniform variable "u_Perspective" 
-    GLint u_ProjectionLocation = glGetUniformLocation(gGraphicsPipelineShaderProgram, "u_Projection");
-
-    if(u_ProjectionLocation >= 0) { 
-        glUniformMatrix4fv(u_ProjectionLocation, // location of the uniform variable
-                           1, // count: how many matrices we are sending (1 in this case)
-                           GL_FALSE, // whether to transpose the matrix (OpenGL expects column-major order, and glm::mat4 is already in that format, so we pass GL_FALSE)
-                           &perspective[0][0] // glm::mat4 在内存中是列主序存储的，所以传地址时直接传第一列的地址即可
-                         );
-    }
-    else {
-        std::cout << "Could not find u_ProjectionLocation\n";
+    // 透视投影矩阵和观察矩阵由相机维护：只有在窗口大小/FOV/相机位置变化时才重新计算并上传
+    if(!gCamera.Upload(gGraphicsPipelineShaderProgram)) {
         exit(EXIT_FAILURE);
     }
 
@@ -336,56 +1571,691 @@ void Draw() {
     glBindVertexArray(gVertexArrayObject);
     glBindBuffer(GL_ARRAY_BUFFER, gVertexBufferObject);
 
-    // Render data
-    glDrawElements(GL_TRIANGLES, 
-                   6, // 这里是索引的数量，不是顶点数量。我们有 6 个索引（2 个三角形），所以传 6。  
-                   GL_UNSIGNED_INT, 
-                   0); // 索引绘制：从当前绑定的 GL_ELEMENT_ARRAY_BUFFER 里读取索引数据，每三个索引构成一个三角形，绘制两组三角形（共六个顶点）
+    // Render data (only what survived culling)
+    if(gGpuCuller) {
+        gGpuCuller->Draw(gVertexArrayObject); // one indirect command per object the compute pass kept
+    }
+    else {
+        DrawVisibleObjects();
+    }
     
     glUseProgram(0); // unbind shader program
 }
 
+// Offscreen only: stops the scene timer and upscales the rendered part of the target into the window
+void PostDraw() {
+    if(!gSceneTarget) {
+        return;
+    }
+    gSceneTimer->End();
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, gScreenWidth, gScreenHeight);
+    gUpscaler->Draw(*gSceneTarget, gRenderWidth, gRenderHeight, gUpscaleFilter);
+}
+
+// --backend soft: replaces PreDraw() and Draw(). Same culling, same uniforms, the frame ends up in gSceneTarget.
+void DrawSoftware() {
+    UpdateRenderSize();
+    UpdateObjectTransforms();
+    CullObjects();
+
+    // gInstanceBufferValid plays the same role for the CPU copies as for the instance buffer
+    if(!gInstanceBufferValid) {
+        const glm::mat4* world = gSceneHierarchy.WorldMatrices();
+        gSoftInstanceMatrices.resize(gDrawList.size());
+        gSoftInstanceUvRects.resize(gMaterialUvRects.empty() ? 0 : gDrawList.size());
+        gJobSystem->ParallelFor(gDrawList.size(), [world](size_t begin, size_t end) {
+            for(size_t i = begin; i < end; ++i) {
+                gSoftInstanceMatrices[i] = world[gDrawList[i]];
+            }
+            if(!gSoftInstanceUvRects.empty()) {
+                for(size_t i = begin; i < end; ++i) {
+                    gSoftInstanceUvRects[i] = gMaterialUvRects[gDrawList[i] % gMaterialUvRects.size()];
+                }
+            }
+        }, 4096);
+        gInstanceBufferValid = true;
+    }
+
+    gSoftRasterizer->Resize(gRenderWidth, gRenderHeight);
+    gSoftRasterizer->Clear(glm::vec4(1.0f, 1.0f, 0.0f, 1.0f)); // 黄色背景
+    if(!gDrawList.empty()) {
+        SoftDrawCall draw;
+        draw.vertices = gCpuVertices.data();
+        draw.vertexCount = gCpuVertices.size() / MeshData::FloatsPerVertex;
+        draw.indices = gCpuIndices.data();
+        draw.indexCount = gCpuIndices.size();
+        draw.instanceMatrices = gSoftInstanceMatrices.data();
+        draw.instanceUvRects = gSoftInstanceUvRects.empty() ? nullptr : gSoftInstanceUvRects.data();
+        draw.instanceCount = gSoftInstanceMatrices.size();
+        draw.modelMatrix = gSceneRootMatrix;
+        draw.view = gCamera.GetView();
+        draw.projection = gCamera.GetProjection();
+        draw.depthTest = gOcclusionCuller != nullptr; // like PreDraw()
+        gSoftRasterizer->Draw(draw);
+    }
+
+    // the bytes are already sRGB encoded, the target stores them as they are
+    gSceneTimer->Begin();
+    const Image& color = gSoftRasterizer->ColorBuffer();
+    glBindTexture(GL_TEXTURE_2D, gSceneTarget->ColorTexture());
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, color.width, color.height, GL_RGBA, GL_UNSIGNED_BYTE, color.pixels.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
 void MainLoop() {
     // 主循环：
     // 1) 处理输入事件
-    // 2) 每帧渲染前准备
-    // 3) 发出绘制指令
-    // 4) 交换前后缓冲，把画面显示到窗口上
+    // 2) 以固定步长推进模拟（accumulator 累积真实经过的时间）
+    // 3) 在两次模拟状态之间插值，每帧渲染前准备
+    // 4) 发出绘制指令
+    // 5) 交换前后缓冲，把画面显示到窗口上，并按帧率上限等待
+    using Clock = std::chrono::steady_clock;
+
+    FrameLimiter limiter(gMaxFrameRate);
+    double accumulator = 0.0;
+    Clock::time_point previousTime = Clock::now();
+    bool showingInBetween = false; // the last frame drawn is an interpolated pose, not the state the simulation settled in
+
     while(!gQuit) {
-        Input();
+        if(Input()) {
+            // We were asleep in SDL_WaitEventTimeout; that time must not be fed to the simulation
+            previousTime = Clock::now();
+            accumulator = 0.0;
+            limiter.Reset();
+        }
+
+        Clock::time_point currentTime = Clock::now();
+        double frameTime = std::chrono::duration<double>(currentTime - previousTime).count();
+        previousTime = currentTime;
+        accumulator += std::min(frameTime, gMaxFrameDelta);
+
+        // swap in assets whose upload finished (marks the scene dirty)
+        CheckShaderChanges();
+        gResourceManager->Update();
+        if(gVirtualTexture && gVirtualTexture->Update()) {
+            MarkSceneDirty(); // sharper tiles arrived
+        }
+        if(gFrameCapture) {
+            gFrameCapture->Update(); // hands finished readbacks to the writer jobs
+        }
 
-        PreDraw();
+        while(accumulator >= gFixedTimeStep) {
+            gPreviousState = gCurrentState;
+            Update(gCurrentState, (float)gFixedTimeStep);
+            accumulator -= gFixedTimeStep;
+        }
+
+        // once the simulation settled, snap to its final state instead of the last in-between pose
+        const bool animating = IsAnimating();
+        InterpolateState(animating ? (float)(accumulator / gFixedTimeStep) : 1.0f);
+
+        if(gRedrawMode == RedrawMode::OnDemand && !gSceneDirty && !animating && !showingInBetween) {
+            continue; // nothing changed, keep showing the last frame
+        }
+        gSceneDirty = false;
+        showingInBetween = animating;
 
-        Draw();
+        if(gSoftRasterizer) {
+            DrawSoftware();
+        }
+        else {
+            PreDraw();
+
+            Draw();
+        }
+
+        PostDraw();
+
+        CaptureFrame();
+        ++gTurntableFrame;
 
         // 双缓冲交换：把“后缓冲”呈现到屏幕（前缓冲）
         SDL_GL_SwapWindow(gGraphicsApplicationWindow);
 
+        limiter.Wait();
+    }
+}
+
+// vvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvv  Batch render server  vvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvv
 
+// Jobs must not render with the placeholder program or texture, so the server starts once they are streamed in
+void WaitForStreamedAssets() {
+    auto loading = [](ResourceState state) { return state == ResourceState::Loading || state == ResourceState::Uploading; };
+    while((gPendingProgram && loading(gPendingProgram->state)) || (gPendingTexture && loading(gPendingTexture->state))) {
+        const size_t ran = gResourceManager->RunQueuedDecodeJobs();
+        if(gResourceManager->Update() == 0 && ran == 0) {
+            SDL_Delay(1);
+        }
     }
 }
 
+// Worker contexts draw the scene with the root at the identity and apply each job's rotation through
+// u_ModelMatrix, so the instance data never changes and all of them read the same buffers
+void RenderWorkersSpecification() {
+    if(gVirtualTexture) {
+        std::cout << "The virtual texture is streamed through the main context, serving on one context\n";
+        return;
+    }
+
+    gPreviousState = gCurrentState = SimulationState{};
+    InterpolateState(0.0f);
+    UpdateObjectTransforms();
+    glGenBuffers(1, &gServerInstanceBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, gServerInstanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, gObjectCount * sizeof(glm::mat4), gSceneHierarchy.WorldMatrices(), GL_STATIC_DRAW);
+    if(!gMaterialUvRects.empty()) {
+        std::vector<glm::vec4> uvRects(gObjectCount);
+        for(size_t i = 0; i < gObjectCount; ++i) {
+            uvRects[i] = gMaterialUvRects[i % gMaterialUvRects.size()]; // object i uses material i % count
+        }
+        glGenBuffers(1, &gServerMaterialBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, gServerMaterialBuffer);
+        glBufferData(GL_ARRAY_BUFFER, uvRects.size() * sizeof(glm::vec4), uvRects.data(), GL_STATIC_DRAW);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // each context links its own copy of the program the main context ended up with
+    std::string vertexSource = gPlaceholderVertexShaderSource;
+    std::string fragmentSource = gPlaceholderFragmentShaderSource;
+    if(gSceneProgram) {
+        vertexSource = gSceneProgram->vertexSource;
+        fragmentSource = gSceneProgram->fragmentSource;
+    }
+
+    RenderWorkerScene scene;
+    scene.texture = gTexture;
+    scene.instanceBuffer = gServerInstanceBuffer;
+    scene.materialBuffer = gServerMaterialBuffer;
+    scene.instanceCount = (GLsizei)gObjectCount;
+    scene.rootMatrix = gSceneRootMatrix;
+    scene.createProgram = [vertexSource, fragmentSource] { return CreateShaderProgram(vertexSource, fragmentSource); };
+    scene.createVertexArray = CreateVertexArray;
+    gRenderWorkers = std::make_unique<RenderWorkers>(*gJobSystem, gGraphicsApplicationWindow, gOpenglContext, scene, gCaptureOptions,
+                                                     gServeContexts, [](const RenderJob& job, bool ok, const std::string& error) {
+        gRenderServer->Complete(job, ok, error);
+    });
+    if(gRenderWorkers->Count() == 0) {
+        std::cout << "No render contexts could be created, serving on the main context\n";
+        gRenderWorkers.reset();
+    }
+}
+
+void ServerSpecification() {
+    gRenderServer = std::make_unique<RenderServer>(gServeSpoolDirectory, gServeSocketPath);
+    std::string error;
+    if((!gServeSpoolDirectory.empty() || !gServeSocketPath.empty()) && !gRenderServer->Start(&error)) {
+        std::cout << "Render server could not start: " << error << "\n";
+        exit(1);
+    }
+
+    // the placeholder quad becomes the cache entry for jobs without a mesh
+    MeshHandle quad = std::make_shared<MeshResource>();
+    quad->state = ResourceState::Ready;
+    quad->vertexBuffer = gVertexBufferObject;
+    quad->indexBuffer = gIndexBufferObject;
+    quad->indexCount = gIndexCount;
+    quad->bounds = gMeshBounds;
+    gMeshCache[""].mesh = quad;
+
+    WaitForStreamedAssets();
+    if(gServeContexts > 1) {
+        RenderWorkersSpecification();
+    }
+
+    // benchmark jobs: the --mesh (or the quad) from all around, read back but not written
+    for(uint64_t i = 0; i < gServeBenchmarkJobs; ++i) {
+        RenderJob job;
+        job.id = "benchmark" + std::to_string(i);
+        job.mesh = gMeshPath;
+        job.rotate = (float)(i * 7 % 360);
+        gRenderServer->Enqueue(std::move(job));
+    }
+
+    std::cout << "Serving render jobs from" << (gServeSpoolDirectory.empty() ? "" : " " + gServeSpoolDirectory + "/*.job")
+              << (gServeSocketPath.empty() ? "" : " " + gServeSocketPath) << (gServeBenchmarkJobs > 0 ? " the benchmark" : "")
+              << " on " << (gRenderWorkers ? gRenderWorkers->Count() : 1) << " context(s)\n";
+}
+
+// The cache entry for 'path'; starts loading the mesh if it is not resident yet
+const MeshHandle& RequestMesh(const std::string& path) {
+    CachedMesh& entry = gMeshCache[path];
+    if(!entry.mesh) {
+        MeshOptions options; // jobs draw whole meshes at full detail
+        options.lods = false;
+        options.meshlets = false;
+        entry.mesh = gResourceManager->LoadMeshAsync(path, options);
+    }
+    entry.lastUse = ++gMeshCacheClock;
+    return entry.mesh;
+}
+
+static size_t BufferSize(GLuint buffer) {
+    GLint size = 0;
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+    glGetBufferParameteriv(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &size);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    return (size_t)size;
+}
+
+// Evicts the least recently used meshes beyond the budget. Failed loads are forgotten once no queued job
+// refers to them any more, so a fixed file is picked up by later jobs.
+void TrimMeshCache(bool dropFailed) {
+    size_t total = 0;
+    for(auto it = gMeshCache.begin(); it != gMeshCache.end(); ) {
+        CachedMesh& entry = it->second;
+        if(entry.mesh->state == ResourceState::Failed && dropFailed) {
+            it = gMeshCache.erase(it);
+            continue;
+        }
+        if(entry.mesh->state == ResourceState::Ready && entry.bytes == 0) {
+            entry.bytes = BufferSize(entry.mesh->vertexBuffer) + BufferSize(entry.mesh->indexBuffer);
+        }
+        total += entry.bytes;
+        ++it;
+    }
+
+    while(total > gMeshCacheBudget) {
+        auto victim = gMeshCache.end();
+        for(auto it = gMeshCache.begin(); it != gMeshCache.end(); ++it) {
+            // the quad and the bound mesh stay, loading meshes belong to the resource manager until Ready,
+            // meshes held by render workers are in use
+            if(it->first.empty() || it->first == gBoundMeshPath || it->second.bytes == 0 || it->second.mesh.use_count() > 1) {
+                continue;
+            }
+            if(victim == gMeshCache.end() || it->second.lastUse < victim->second.lastUse) {
+                victim = it;
+            }
+        }
+        if(victim == gMeshCache.end()) {
+            break;
+        }
+        glDeleteBuffers(1, &victim->second.mesh->vertexBuffer);
+        glDeleteBuffers(1, &victim->second.mesh->indexBuffer);
+        total -= victim->second.bytes;
+        gMeshCache.erase(victim);
+    }
+}
+
+// Points the vertex/index buffer globals at a cached mesh (the cache keeps owning the buffers)
+void BindServerMesh(const std::string& path, const MeshResource& mesh) {
+    if(path == gBoundMeshPath) {
+        return;
+    }
+    gVertexBufferObject = mesh.vertexBuffer;
+    gIndexBufferObject = mesh.indexBuffer;
+    gIndexCount = mesh.indexCount;
+    gMeshBounds = mesh.bounds;
+    gMeshLods = mesh.lods;
+    gMeshlets = mesh.meshlets;
+    gMeshClosed = mesh.closed;
+    gBoundMeshPath = path;
+    BuildVertexArray();
+    RefreshAllBounds();
+}
+
+// Draws one job offscreen and queues its readback; the image is written on a worker a few jobs later
+void ServeJob(const RenderJob& job, const MeshHandle& mesh) {
+    BindServerMesh(job.mesh, *mesh);
+    gObjectLods.clear(); // every job is a still image of its own, no hysteresis from the job before
+
+    gRenderWidth = job.width;
+    gRenderHeight = job.height;
+    gCamera.SetViewport(job.width, job.height);
+    gCamera.SetPerspective(job.fov, job.nearPlane, job.farPlane);
+    gCamera.LookAt(job.eye, job.target);
+    gPreviousState = gCurrentState = SimulationState{0.0f, job.rotate};
+    InterpolateState(0.0f);
+
+    PreDraw();
+    Draw();
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, gSceneTarget->Framebuffer());
+    gFrameCapture->Capture(job.width, job.height, job.output, [job](bool ok, const std::string& error) {
+        gRenderServer->Complete(job, ok, error);
+    });
+}
+
+void ServerLoop() {
+    using Clock = std::chrono::steady_clock;
+    std::deque<RenderJob> upcoming; // taken from the queue, their meshes may still be loading
+    const Clock::time_point start = Clock::now();
+    Clock::time_point lastReport = start;
+    uint64_t reported = 0;
+
+    while(!gQuit) {
+        SDL_Event e;
+        while(SDL_PollEvent(&e) != 0) {
+            if(e.type == SDL_QUIT) {
+                gQuit = true; // also SIGINT / SIGTERM
+            }
+        }
+
+        CheckShaderChanges();
+        gResourceManager->Update();   // meshes whose upload finished become Ready, reloaded shaders swap in
+        gFrameCapture->Update();      // readbacks of earlier jobs go to the writers
+
+        // block in PopJob for long only when nothing at all is in flight; with only writes or loads in flight a short
+        // wait still keeps this loop from spinning on the core the workers need
+        const bool idle = upcoming.empty() && !gFrameCapture->HasPendingWork() && gResourceManager->PendingCount() == 0 &&
+                          (!gRenderWorkers || gRenderWorkers->Outstanding() == 0);
+        RenderJob job;
+        while(upcoming.size() < gServeLookahead && gRenderServer->PopJob(job, !upcoming.empty() ? 0 : idle ? 100 : 1)) {
+            RequestMesh(job.mesh); // prefetch
+            upcoming.push_back(std::move(job));
+        }
+
+        // arrival order; a mesh still loading holds up the jobs behind it
+        bool rendered = false;
+        while(!upcoming.empty()) {
+            const RenderJob& next = upcoming.front();
+            const MeshHandle mesh = RequestMesh(next.mesh);
+            if(mesh->state == ResourceState::Loading || mesh->state == ResourceState::Uploading) {
+                break;
+            }
+            if(mesh->state == ResourceState::Failed) {
+                gRenderServer->Complete(next, false, "cannot load mesh " + next.mesh);
+            }
+            else if(gRenderWorkers) {
+                if(!gRenderWorkers->Submit(next, mesh)) {
+                    break; // every context has enough queued
+                }
+                rendered = true;
+            }
+            else {
+                ServeJob(next, mesh);
+                rendered = true;
+            }
+            upcoming.pop_front();
+        }
+        TrimMeshCache(upcoming.empty());
+        if(!rendered && !upcoming.empty()) {
+            SDL_Delay(1); // waiting for a mesh upload or a free context
+        }
+
+        const uint64_t finished = gRenderServer->CompletedCount() + gRenderServer->FailedCount();
+        const Clock::time_point now = Clock::now();
+        if(finished != reported && now - lastReport >= std::chrono::seconds(5)) {
+            const double seconds = std::chrono::duration<double>(now - start).count();
+            std::cout << "Served " << finished << " jobs (" << gRenderServer->FailedCount() << " failed), "
+                      << finished / seconds << " jobs/s\n";
+            reported = finished;
+            lastReport = now;
+        }
+        if(gServeBenchmarkJobs > 0 && finished == gServeBenchmarkJobs) {
+            gQuit = true;
+        }
+    }
+
+    if(gRenderWorkers) {
+        gRenderWorkers->Finish();
+    }
+    gFrameCapture->Finish(); // answers every job that was drawn
+    for(const RenderJob& job : upcoming) {
+        gRenderServer->Complete(job, false, "server shutting down");
+    }
+    std::cout << "Served " << gRenderServer->CompletedCount() << " jobs (" << gRenderServer->FailedCount() << " failed)\n";
+
+    if(gServeBenchmarkJobs > 0) {
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        const char* rasterizerThreads = std::getenv("LP_NUM_THREADS");
+        std::cout << "benchmark: " << (gRenderWorkers ? gRenderWorkers->Count() : 1) << " context(s), LP_NUM_THREADS="
+                  << (rasterizerThreads ? rasterizerThreads : "default") << ", " << gServeBenchmarkJobs << " jobs of "
+                  << RenderJob().width << "x" << RenderJob().height << std::fixed << std::setprecision(3) << " in " << seconds
+                  << " s, " << std::setprecision(1) << (double)gServeBenchmarkJobs / seconds << " frames/s\n"
+                  << std::defaultfloat << std::setprecision(6);
+        if(gRenderWorkers) {
+            std::cout << "jobs per context:";
+            for(uint64_t count : gRenderWorkers->RenderedCounts()) {
+                std::cout << " " << count;
+            }
+            std::cout << "\n";
+        }
+    }
+}
+
+// Creates gGpuCuller when asked for and possible; otherwise the CPU culls as before
+void GpuCullingSpecification() {
+    if(gGpuCullingMode == GpuCullingMode::Off) {
+        return;
+    }
+    if(IsServing() || gSoftRasterizer || !gVirtualTexturePath.empty()) {
+        // the server workers, the software backend and the tile feedback pass all work from gDrawList
+        std::cout << "GPU culling is not available with --serve, --backend soft or --virtual-texture, culling on the CPU\n";
+        return;
+    }
+    std::string reason;
+    if(!GpuCuller::IsSupported(&reason)) {
+        std::cout << "GPU culling needs " << reason << ", culling on the CPU\n";
+        return;
+    }
+    std::unique_ptr<GpuCuller> culler = std::make_unique<GpuCuller>();
+    if(!culler->Initialize(gObjectCount, gGpuCullingMode == GpuCullingMode::HiZ, &reason)) {
+        std::cout << "GPU culling unavailable (" << reason << "), culling on the CPU\n";
+        return;
+    }
+    gGpuCuller = std::move(culler);
+    gOcclusionCuller.reset(); // the CPU draw list it thins out is not built any more
+    std::cout << "GPU culling: " << (gGpuCullingMode == GpuCullingMode::HiZ ? "frustum + Hi-Z" : "frustum") << "\n";
+}
+
 void CleanUp() {
-    // 按“创建的逆序”回收资源：先销毁窗口，再关闭 SDL。
+    // 按“创建的逆序”回收资源：先停止资源流送和工作线程，再销毁窗口，最后关闭 SDL。
+    if(gFrameCapture) {
+        gFrameCapture->Finish(); // the last frames are still on their way to the disk
+        if(!gCapturePath.empty()) {
+            std::cout << "Captured " << gFrameCapture->WrittenCount() << " frames to " << gCapturePath << "\n";
+        }
+        gFrameCapture.reset();
+    }
+    gShaderWatcher.reset();
+    gRenderWorkers.reset(); // their contexts go before the main one
+    gRenderServer.reset(); // after the capture and the workers: their write callbacks report to the server
+    gMeshCache.clear();
+    gSoftRasterizer.reset();
+    gOcclusionCuller.reset();
+    gGpuCuller.reset();
+    gUpscaler.reset();
+    gSceneTimer.reset();
+    gSceneTarget.reset();
+    gVirtualTexture.reset();
+    gResourceManager.reset();
+    gJobSystem.reset();
     SDL_DestroyWindow(gGraphicsApplicationWindow);
     SDL_Quit();
 }
 
 
 
+void ParseCommandLine(int argc, char* args[]) {
+    for(int i = 1; i < argc; ++i) {
+        if(std::strcmp(args[i], "--fps") == 0 && i + 1 < argc) {
+            gMaxFrameRate = std::atof(args[++i]);
+        }
+        else if(std::strcmp(args[i], "--on-demand") == 0) {
+            gRedrawMode = RedrawMode::OnDemand;
+        }
+        else if(std::strcmp(args[i], "--threads") == 0 && i + 1 < argc) {
+            gThreadCount = (unsigned)std::max(0, std::atoi(args[++i]));
+        }
+        else if(std::strcmp(args[i], "--mesh") == 0 && i + 1 < argc) {
+            gMeshPath = args[++i];
+        }
+        else if(std::strcmp(args[i], "--texture") == 0 && i + 1 < argc) {
+            gTexturePath = args[++i];
+        }
+        else if(std::strcmp(args[i], "--shader-dir") == 0 && i + 1 < argc) {
+            gShaderDirectory = args[++i];
+        }
+        else if(std::strcmp(args[i], "--watch-shaders") == 0) {
+            gWatchShaders = true;
+        }
+        else if(std::strcmp(args[i], "--atlas") == 0 && i + 1 < argc) {
+            // comma separated list
+            std::string list = args[++i];
+            for(size_t start = 0; start <= list.size(); ) {
+                size_t comma = std::min(list.find(',', start), list.size());
+                if(comma > start) {
+                    gAtlasPaths.push_back(list.substr(start, comma - start));
+                }
+                start = comma + 1;
+            }
+        }
+        else if(std::strcmp(args[i], "--virtual-texture") == 0 && i + 1 < argc) {
+            gVirtualTexturePath = args[++i];
+        }
+        else if(std::strcmp(args[i], "--resolution-scale") == 0 && i + 1 < argc) {
+            // a fixed fraction of the window size, or "auto" (starts at full size)
+            ++i;
+            gDynamicResolution = std::strcmp(args[i], "auto") == 0;
+            if(!gDynamicResolution) {
+                gResolutionScale = std::min(1.0f, std::max(0.25f, (float)std::atof(args[i])));
+            }
+        }
+        else if(std::strcmp(args[i], "--upscale") == 0 && i + 1 < argc) {
+            if(!ParseUpscaleFilter(args[++i], gUpscaleFilter)) {
+                std::cout << "Unknown upscale filter: " << args[i] << " (bilinear or edge)\n";
+                exit(1);
+            }
+        }
+        else if(std::strcmp(args[i], "--capture") == 0 && i + 1 < argc) {
+            gCapturePath = args[++i];
+        }
+        else if(std::strcmp(args[i], "--capture-format") == 0 && i + 1 < argc) {
+            if(!ParseCaptureFormat(args[++i], gCaptureOptions.format)) {
+                std::cout << "Unknown capture format: " << args[i] << " (png, ppm, y4m or ffmpeg)\n";
+                exit(1);
+            }
+        }
+        else if(std::strcmp(args[i], "--capture-frames") == 0 && i + 1 < argc) {
+            gCaptureFrameLimit = (uint64_t)std::max(0, std::atoi(args[++i]));
+        }
+        else if(std::strcmp(args[i], "--turntable") == 0 && i + 1 < argc) {
+            gTurntableFrames = std::max(0, std::atoi(args[++i]));
+        }
+        else if(std::strcmp(args[i], "--serve") == 0 && i + 1 < argc) {
+            gServeSpoolDirectory = args[++i];
+        }
+        else if(std::strcmp(args[i], "--serve-socket") == 0 && i + 1 < argc) {
+            gServeSocketPath = args[++i];
+        }
+        else if(std::strcmp(args[i], "--serve-contexts") == 0 && i + 1 < argc) {
+            gServeContexts = std::max(1, std::atoi(args[++i]));
+        }
+        else if(std::strcmp(args[i], "--serve-benchmark") == 0 && i + 1 < argc) {
+            gServeBenchmarkJobs = (uint64_t)std::max(0, std::atoi(args[++i]));
+        }
+        else if(std::strcmp(args[i], "--mesh-cache-mb") == 0 && i + 1 < argc) {
+            gMeshCacheBudget = (size_t)std::max(0, std::atoi(args[++i])) << 20;
+        }
+        else if(std::strcmp(args[i], "--compress") == 0 && i + 1 < argc) {
+            gTextureOptions.compress = ParseBlockFormat(args[++i], gTextureOptions.blockFormat);
+            if(!gTextureOptions.compress) {
+                std::cout << "Unknown block format: " << args[i] << " (bc1, bc3, bc4, bc5 or bc7)\n";
+                exit(1);
+            }
+        }
+        else if(std::strcmp(args[i], "--occluders") == 0 && i + 1 < argc) {
+            gOccluderCount = (size_t)std::max(0, std::atoi(args[++i]));
+        }
+        else if(std::strcmp(args[i], "--meshlets") == 0 && i + 1 < argc) {
+            ++i;
+            if(std::strcmp(args[i], "frustum") == 0) {
+                gMeshletCullingMode = MeshletCullingMode::Frustum;
+            }
+            else if(std::strcmp(args[i], "cone") == 0) {
+                gMeshletCullingMode = MeshletCullingMode::Cone;
+            }
+            else {
+                std::cout << "Unknown meshlet culling mode: " << args[i] << " (frustum or cone)\n";
+                exit(1);
+            }
+        }
+        else if(std::strcmp(args[i], "--lod-error") == 0 && i + 1 < argc) {
+            gLodPixelError = std::max(0.0f, (float)std::atof(args[++i]));
+        }
+        else if(std::strcmp(args[i], "--gpu-culling") == 0 && i + 1 < argc) {
+            ++i;
+            if(std::strcmp(args[i], "frustum") == 0) {
+                gGpuCullingMode = GpuCullingMode::Frustum;
+            }
+            else if(std::strcmp(args[i], "hiz") == 0) {
+                gGpuCullingMode = GpuCullingMode::HiZ;
+            }
+            else {
+                std::cout << "Unknown GPU culling mode: " << args[i] << " (frustum or hiz)\n";
+                exit(1);
+            }
+        }
+        else if(std::strcmp(args[i], "--backend") == 0 && i + 1 < argc) {
+            ++i;
+            if(std::strcmp(args[i], "gl") == 0) {
+                gBackend = RenderBackend::GL;
+            }
+            else if(std::strcmp(args[i], "soft") == 0) {
+                gBackend = RenderBackend::Soft;
+            }
+            else {
+                std::cout << "Unknown backend: " << args[i] << " (gl or soft)\n";
+                exit(1);
+            }
+        }
+        else if(std::strcmp(args[i], "--objects") == 0 && i + 1 < argc) {
+            gObjectCount = std::max(1, std::atoi(args[++i]));
+        }
+        else {
+            std::cout << "Unknown argument: " << args[i] << "\n"
+                      << "Usage: prog [--fps <max frame rate, 0 = uncapped>] [--on-demand] [--objects <count>] [--threads <count, 0 = one per core>] [--mesh <file.obj>] [--texture <file.png|tga|ppm>] [--shader-dir <directory>] [--watch-shaders] [--atlas <a.png,b.png,...>] [--virtual-texture <file.vtex|image>] [--resolution-scale <0.25..1|auto>] [--upscale <bilinear|edge>] [--capture <directory|file>] [--capture-format <png|ppm|y4m|ffmpeg>] [--capture-frames <count>] [--turntable <frames>] [--serve <spool directory>] [--serve-socket <path>] [--serve-contexts <count>] [--serve-benchmark <jobs>] [--mesh-cache-mb <size>] [--compress <bc1|bc3|bc4|bc5|bc7>] [--backend <gl|soft>] [--occluders <count>] [--gpu-culling <frustum|hiz>] [--lod-error <pixels, 0 = full detail>] [--meshlets <frustum|cone>]\n";
+            exit(1);
+        }
+    }
+    if(gBackend == RenderBackend::Soft && (IsServing() || !gVirtualTexturePath.empty())) {
+        std::cout << "--backend soft draws the viewer's scene only, it cannot be combined with --serve or --virtual-texture\n";
+        exit(1);
+    }
+}
+
 int main(int argc, char* args[]) {
 
-    // 1. 初始化 SDL2 和 OpenGL context
+    // 0. 解析命令行参数，启动工作线程
+    ParseCommandLine(argc, args);
+    gJobSystem = std::make_unique<JobSystem>(gThreadCount);
+    if(gBackend == RenderBackend::Soft) {
+        gSoftRasterizer = std::make_unique<SoftRasterizer>(*gJobSystem);
+    }
+    if(gOccluderCount > 0 && !IsServing()) {
+        // server jobs draw whole meshes per job without culling, only the viewer has a draw list to thin out
+        gOcclusionCuller = std::make_unique<OcclusionCuller>(*gJobSystem);
+        std::cout << "Occlusion culling: " << gOccluderCount << " occluders into " << gOcclusionCuller->Width() << "x"
+                  << gOcclusionCuller->Height() << " depth, kernel: " << SimdLevelName(GetSimdLevel()) << "\n";
+    }
+
+    // 1. 初始化 SDL2 和 OpenGL context，以及用于后台上传的共享 context
     InitializeProgram();
+    gResourceManager = std::make_unique<ResourceManager>(*gJobSystem, gGraphicsApplicationWindow, gOpenglContext);
+    gResourceManager->SetTextureCacheDirectory(gTextureCacheDirectory);
 
-    // 2. 设置顶点数据和属性
+    // 2. 设置场景物体、顶点数据和属性
+    SceneSpecification();
+    GpuCullingSpecification(); // before the VAO is built: it decides which buffers feed the instance attributes
     VertexSpecification();
+    TextureSpecification();
 
     // 3. 创建图形管线（编译/链接 shader 等）
     CreateGraphicsPipeline();
+    VirtualTextureSpecification();
+    RenderTargetSpecification();
+    FrameCaptureSpecification();
 
     // 4. 进入主循环
-    MainLoop();
+    if(IsServing()) {
+        ServerSpecification();
+        ServerLoop();
+    }
+    else {
+        MainLoop();
+    }
 
     // 5. 清理资源并退出
     CleanUp();
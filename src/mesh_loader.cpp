@@ -0,0 +1,99 @@
+#include "mesh_loader.hpp"
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+
+// "12/5/7" -> 12, converting negative (relative) indices; returns -1 if invalid
+static long ParseIndex(const char* token, long vertexCount) {
+    long index = std::strtol(token, nullptr, 10);
+    if(index < 0) {
+        index = vertexCount + index; // -1 is the last vertex
+    }
+    else {
+        index -= 1;                  // OBJ indices are 1-based
+    }
+    return (index >= 0 && index < vertexCount) ? index : -1;
+}
+
+bool LoadObjMesh(const std::string& path, MeshData& mesh, std::string* error) {
+    mesh.vertices.clear();
+    mesh.indices.clear();
+
+    std::ifstream file(path.c_str());
+    if(!file.is_open()) {
+        if(error) { *error = "could not open " + path; }
+        return false;
+    }
+
+    std::vector<float> positions; // x y z r g b, as read
+    std::vector<float> texcoords; // u v, as read
+    std::unordered_map<uint64_t, GLuint> vertexLookup; // (position index, texcoord index + 1) -> output vertex
+
+    std::string line;
+    std::vector<GLuint> polygon;
+    while(std::getline(file, line)) {
+        std::istringstream stream(line);
+        std::string keyword;
+        stream >> keyword;
+
+        if(keyword == "v") {
+            float x = 0, y = 0, z = 0, r = 1, g = 1, b = 1;
+            stream >> x >> y >> z;
+            if(!(stream >> r >> g >> b)) {
+                r = g = b = 1.0f;
+            }
+            positions.insert(positions.end(), {x, y, z, r, g, b});
+        }
+        else if(keyword == "vt") {
+            float u = 0, v = 0;
+            stream >> u >> v;
+            texcoords.insert(texcoords.end(), {u, v});
+        }
+        else if(keyword == "f") {
+            polygon.clear();
+            std::string corner;
+            const long positionCount = (long)(positions.size() / 6);
+            const long texcoordCount = (long)(texcoords.size() / 2);
+            while(stream >> corner) {
+                long index = ParseIndex(corner.c_str(), positionCount);
+                long texcoord = -1;
+                size_t slash = corner.find('/');
+                if(slash != std::string::npos && slash + 1 < corner.size() && corner[slash + 1] != '/') {
+                    texcoord = ParseIndex(corner.c_str() + slash + 1, texcoordCount);
+                    if(texcoord < 0) {
+                        index = -1;
+                    }
+                }
+                if(index < 0) {
+                    if(error) { *error = "bad face index in " + path + ": " + line; }
+                    mesh.vertices.clear();
+                    mesh.indices.clear();
+                    return false;
+                }
+
+                const uint64_t key = ((uint64_t)index << 32) | (uint64_t)(texcoord + 1);
+                auto found = vertexLookup.find(key);
+                if(found == vertexLookup.end()) {
+                    const float* p = &positions[index * 6];
+                    float u = texcoord >= 0 ? texcoords[texcoord * 2] : 0.0f;
+                    float v = texcoord >= 0 ? texcoords[texcoord * 2 + 1] : 0.0f;
+                    found = vertexLookup.emplace(key, (GLuint)mesh.VertexCount()).first;
+                    mesh.vertices.insert(mesh.vertices.end(), {p[0], p[1], p[2], p[3], p[4], p[5], u, v});
+                }
+                polygon.push_back(found->second);
+            }
+            for(size_t i = 1; i + 1 < polygon.size(); ++i) {
+                mesh.indices.insert(mesh.indices.end(), {polygon[0], polygon[i], polygon[i + 1]});
+            }
+        }
+    }
+
+    if(mesh.indices.empty()) {
+        if(error) { *error = "no triangles in " + path; }
+        mesh.vertices.clear();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+/*
+Minimal Wavefront OBJ reader producing the interleaved vertex layout used by VertexSpecification():
+    position (x, y, z), color (r, g, b), texcoord (u, v)   - 8 floats per vertex
+
+Supported: "v x y z [r g b]" (the common vertex-color extension, white if missing), "vt u v" and "f" with any
+number of corners ("a", "a/b", "a/b/c", "a//c"; negative indices count from the end). Polygons are
+fan-triangulated. OBJ indexes positions and texcoords separately, so every distinct position/texcoord pair
+becomes one output vertex. Everything else (normals, materials, groups) is ignored.
+*/
+
+#include <glad/glad.h>
+#include <string>
+#include <vector>
+
+struct MeshData {
+    std::vector<GLfloat> vertices; // interleaved, FloatsPerVertex floats each
+    std::vector<GLuint> indices;   // triangle list
+
+    static const size_t FloatsPerVertex = 8;
+    size_t VertexCount() const { return vertices.size() / FloatsPerVertex; }
+};
+
+// Returns false (and leaves 'mesh' empty) if the file cannot be read or has no triangles
+bool LoadObjMesh(const std::string& path, MeshData& mesh, std::string* error = nullptr);
@@ -0,0 +1,361 @@
+#include "mesh_simplifier.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+
+namespace {
+
+const int Dimensions = 8; // x y z, r g b, u v
+
+// Q(v) = (v^T A v + 2 b.v + c) / weight over the first N coordinates of a point; A is symmetric, its upper
+// triangle is stored row by row. N = 8 drives the collapses, N = 3 measures the geometric error alone.
+template<int N>
+struct Quadric {
+    float a[N * (N + 1) / 2] = {};
+    float b[N] = {};
+    float c = 0.0f;
+    float weight = 0.0f;
+
+    void Add(const Quadric& other) {
+        for(int i = 0; i < N * (N + 1) / 2; ++i) {
+            a[i] += other.a[i];
+        }
+        for(int i = 0; i < N; ++i) {
+            b[i] += other.b[i];
+        }
+        c += other.c;
+        weight += other.weight;
+    }
+
+    // mean squared distance of 'v' to the planes summed into this quadric
+    float Evaluate(const float* v) const {
+        if(weight <= 0.0f) {
+            return 0.0f;
+        }
+        float result = c;
+        int k = 0;
+        for(int i = 0; i < N; ++i) {
+            float row = a[k++] * v[i];
+            for(int j = i + 1; j < N; ++j) {
+                row += 2.0f * a[k++] * v[j];
+            }
+            result += v[i] * row + 2.0f * b[i] * v[i];
+        }
+        return std::max(result, 0.0f) / weight; // rounding can push it slightly below 0
+    }
+};
+
+template<int N>
+float Dot(const float* x, const float* y) {
+    float sum = 0.0f;
+    for(int i = 0; i < N; ++i) {
+        sum += x[i] * y[i];
+    }
+    return sum;
+}
+
+// 3D cross product of the position parts of (q - p) and (r - p)
+void Normal(const float* p, const float* q, const float* r, float* n) {
+    const float e1[3] = {q[0] - p[0], q[1] - p[1], q[2] - p[2]};
+    const float e2[3] = {r[0] - p[0], r[1] - p[1], r[2] - p[2]};
+    n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+// Squared distance to the plane through the triangle (Garland & Heckbert 1998): with an orthonormal basis e1, e2
+// of the plane, A = I - e1 e1^T - e2 e2^T, b = (p.e1) e1 + (p.e2) e2 - p, c = p.p - (p.e1)^2 - (p.e2)^2.
+// Weighted by the triangle's area; false when the triangle is degenerate.
+template<int N>
+bool TriangleQuadric(const float* p, const float* q, const float* r, Quadric<N>& quadric) {
+    float n[3];
+    Normal(p, q, r, n);
+    const float area = 0.5f * std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if(area <= 0.0f) {
+        return false;
+    }
+
+    float e1[N];
+    float e2[N];
+    for(int i = 0; i < N; ++i) {
+        e1[i] = q[i] - p[i];
+        e2[i] = r[i] - p[i];
+    }
+    const float length1 = std::sqrt(Dot<N>(e1, e1));
+    if(length1 <= 0.0f) {
+        return false;
+    }
+    for(float& x : e1) {
+        x /= length1;
+    }
+    const float projection = Dot<N>(e2, e1);
+    for(int i = 0; i < N; ++i) {
+        e2[i] -= projection * e1[i];
+    }
+    const float length2 = std::sqrt(Dot<N>(e2, e2));
+    if(length2 <= 0.0f) {
+        return false;
+    }
+    for(float& x : e2) {
+        x /= length2;
+    }
+
+    const float p1 = Dot<N>(p, e1);
+    const float p2 = Dot<N>(p, e2);
+    int k = 0;
+    for(int i = 0; i < N; ++i) {
+        for(int j = i; j < N; ++j) {
+            quadric.a[k++] = area * ((i == j ? 1.0f : 0.0f) - e1[i] * e1[j] - e2[i] * e2[j]);
+        }
+        quadric.b[i] = area * (p1 * e1[i] + p2 * e2[i] - p[i]);
+    }
+    quadric.c = area * (Dot<N>(p, p) - p1 * p1 - p2 * p2);
+    quadric.weight = area;
+    return true;
+}
+
+struct Collapse {
+    GLuint from;
+    GLuint to;
+    float cost;
+};
+
+} // namespace
+
+float SimplifyMesh(const MeshData& mesh, const std::vector<GLuint>& indices, size_t targetIndexCount,
+                   std::vector<GLuint>& out, const SimplifyOptions& options) {
+    out = indices;
+    const size_t vertexCount = mesh.VertexCount();
+    if(indices.size() <= targetIndexCount || vertexCount == 0) {
+        return 0.0f;
+    }
+    const float* vertices = mesh.vertices.data();
+    const size_t stride = MeshData::FloatsPerVertex;
+
+    // points in the quadric space: positions scaled into a unit box, so the error limit and the attribute weights
+    // mean the same for every mesh
+    float minimum[3] = {vertices[0], vertices[1], vertices[2]};
+    float maximum[3] = {vertices[0], vertices[1], vertices[2]};
+    for(size_t v = 1; v < vertexCount; ++v) {
+        for(int i = 0; i < 3; ++i) {
+            minimum[i] = std::min(minimum[i], vertices[v * stride + i]);
+            maximum[i] = std::max(maximum[i], vertices[v * stride + i]);
+        }
+    }
+    const float extent = std::max(maximum[0] - minimum[0], std::max(maximum[1] - minimum[1], maximum[2] - minimum[2]));
+    const float scale = extent > 0.0f ? 1.0f / extent : 1.0f;
+    std::vector<float> points(vertexCount * Dimensions);
+    for(size_t v = 0; v < vertexCount; ++v) {
+        const float* vertex = vertices + v * stride;
+        float* point = points.data() + v * Dimensions;
+        for(int i = 0; i < 3; ++i) {
+            point[i] = (vertex[i] - minimum[i]) * scale;
+            point[3 + i] = vertex[3 + i] * options.colorWeight;
+        }
+        point[6] = vertex[6] * options.uvWeight;
+        point[7] = vertex[7] * options.uvWeight;
+    }
+
+    // seams: sort the vertices by position, equal neighbours share one
+    std::vector<uint8_t> locked(vertexCount, 0);
+    std::vector<GLuint> position(vertexCount); // first vertex with the same position
+    {
+        std::vector<GLuint> order(vertexCount);
+        std::iota(order.begin(), order.end(), 0);
+        auto less = [vertices, stride](GLuint x, GLuint y) {
+            return std::lexicographical_compare(vertices + x * stride, vertices + x * stride + 3,
+                                                vertices + y * stride, vertices + y * stride + 3);
+        };
+        std::sort(order.begin(), order.end(), less);
+        for(size_t i = 0; i < vertexCount; ++i) {
+            const bool same = i > 0 && !less(order[i - 1], order[i]);
+            position[order[i]] = same ? position[order[i - 1]] : order[i];
+            if(same) {
+                locked[order[i]] = 1;
+                locked[order[i - 1]] = 1;
+            }
+        }
+    }
+
+    // borders: edges (between positions) used by a single triangle
+    {
+        std::vector<uint64_t> edges;
+        edges.reserve(indices.size());
+        for(size_t i = 0; i < indices.size(); i += 3) {
+            for(int e = 0; e < 3; ++e) {
+                const uint64_t x = position[indices[i + e]];
+                const uint64_t y = position[indices[i + (e + 1) % 3]];
+                edges.push_back(x < y ? (x << 32) | y : (y << 32) | x);
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+        for(size_t i = 0; i < edges.size();) {
+            size_t run = i + 1;
+            while(run < edges.size() && edges[run] == edges[i]) {
+                ++run;
+            }
+            if(run - i == 1) {
+                locked[edges[i] >> 32] = 1;
+                locked[edges[i] & 0xffffffffu] = 1;
+            }
+            i = run;
+        }
+    }
+
+    // the attribute quadric ranks the collapses, the position one reports how far the surface moved
+    std::vector<Quadric<Dimensions>> quadrics(vertexCount);
+    std::vector<Quadric<3>> positionQuadrics(vertexCount);
+    for(size_t i = 0; i < indices.size(); i += 3) {
+        const float* corners[3] = {&points[indices[i] * Dimensions], &points[indices[i + 1] * Dimensions],
+                                   &points[indices[i + 2] * Dimensions]};
+        Quadric<Dimensions> quadric;
+        Quadric<3> positionQuadric;
+        if(TriangleQuadric(corners[0], corners[1], corners[2], quadric) &&
+           TriangleQuadric(corners[0], corners[1], corners[2], positionQuadric)) {
+            for(int corner = 0; corner < 3; ++corner) {
+                quadrics[indices[i + corner]].Add(quadric);
+                positionQuadrics[indices[i + corner]].Add(positionQuadric);
+            }
+        }
+    }
+
+    const float maxCost = options.maxError * options.maxError;
+    float error = 0.0f;
+    std::vector<GLuint> triangleOffsets(vertexCount + 1);
+    std::vector<GLuint> vertexTriangles;
+    std::vector<Collapse> collapses;
+    std::vector<uint8_t> touched(vertexCount);
+    std::vector<GLuint> remap(vertexCount);
+
+    while(out.size() > targetIndexCount) {
+        const size_t triangleCount = out.size() / 3;
+
+        // triangles around each vertex
+        std::fill(triangleOffsets.begin(), triangleOffsets.end(), 0);
+        for(GLuint index : out) {
+            ++triangleOffsets[index + 1];
+        }
+        for(size_t v = 0; v < vertexCount; ++v) {
+            triangleOffsets[v + 1] += triangleOffsets[v];
+        }
+        vertexTriangles.resize(out.size());
+        std::vector<GLuint> fill(triangleOffsets.begin(), triangleOffsets.end() - 1);
+        for(size_t i = 0; i < out.size(); ++i) {
+            vertexTriangles[fill[out[i]]++] = (GLuint)(i / 3);
+        }
+
+        // every edge in both directions, where the moving end is free
+        collapses.clear();
+        for(size_t i = 0; i < out.size(); i += 3) {
+            for(int e = 0; e < 3; ++e) {
+                const GLuint x = out[i + e];
+                const GLuint y = out[i + (e + 1) % 3];
+                if(!locked[x]) {
+                    collapses.push_back({x, y, quadrics[x].Evaluate(&points[y * Dimensions])});
+                }
+                if(!locked[y]) {
+                    collapses.push_back({y, x, quadrics[y].Evaluate(&points[x * Dimensions])});
+                }
+            }
+        }
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) { return x.cost < y.cost; });
+
+        std::fill(touched.begin(), touched.end(), 0);
+        std::iota(remap.begin(), remap.end(), 0);
+        const size_t toRemove = triangleCount - targetIndexCount / 3;
+        size_t removed = 0;
+        size_t collapsed = 0;
+        for(const Collapse& collapse : collapses) {
+            if(removed >= toRemove || collapse.cost > maxCost) {
+                break;
+            }
+            if(touched[collapse.from] || touched[collapse.to]) {
+                continue;
+            }
+
+            // the triangles that keep their area must keep facing the same way
+            bool flips = false;
+            size_t dropped = 0;
+            for(GLuint t = triangleOffsets[collapse.from]; t < triangleOffsets[collapse.from + 1] && !flips; ++t) {
+                const GLuint* corners = &out[vertexTriangles[t] * 3];
+                if(corners[0] == collapse.to || corners[1] == collapse.to || corners[2] == collapse.to) {
+                    ++dropped;
+                    continue;
+                }
+                const float* before[3];
+                const float* after[3];
+                for(int corner = 0; corner < 3; ++corner) {
+                    before[corner] = &points[corners[corner] * Dimensions];
+                    after[corner] = corners[corner] == collapse.from ? &points[collapse.to * Dimensions] : before[corner];
+                }
+                float n0[3];
+                float n1[3];
+                Normal(before[0], before[1], before[2], n0);
+                Normal(after[0], after[1], after[2], n1);
+                flips = n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2] <= 0.0f;
+            }
+            if(flips) {
+                continue;
+            }
+
+            // everything around the collapse is final for this pass, later candidates see unchanged triangles
+            for(GLuint t = triangleOffsets[collapse.from]; t < triangleOffsets[collapse.from + 1]; ++t) {
+                const GLuint* corners = &out[vertexTriangles[t] * 3];
+                touched[corners[0]] = touched[corners[1]] = touched[corners[2]] = 1;
+            }
+            remap[collapse.from] = collapse.to;
+            quadrics[collapse.to].Add(quadrics[collapse.from]);
+            positionQuadrics[collapse.to].Add(positionQuadrics[collapse.from]);
+            error = std::max(error, positionQuadrics[collapse.to].Evaluate(&points[collapse.to * Dimensions]));
+            removed += dropped;
+            ++collapsed;
+        }
+        if(collapsed == 0) {
+            break; // everything left is locked, would flip or costs too much
+        }
+
+        size_t kept = 0;
+        for(size_t i = 0; i < out.size(); i += 3) {
+            const GLuint x = remap[out[i]];
+            const GLuint y = remap[out[i + 1]];
+            const GLuint z = remap[out[i + 2]];
+            if(x != y && y != z && z != x) {
+                out[kept++] = x;
+                out[kept++] = y;
+                out[kept++] = z;
+            }
+        }
+        out.resize(kept);
+    }
+    return std::sqrt(error) * extent;
+}
+
+std::vector<MeshLod> BuildLodChain(MeshData& mesh, size_t maxLods, float ratio, const SimplifyOptions& options) {
+    std::vector<MeshLod> lods(1);
+    lods[0].indexCount = mesh.indices.size();
+
+    // every level starts from the full-detail triangles, so its error is measured against the original surface
+    const std::vector<GLuint> original(mesh.indices);
+    std::vector<GLuint> simplified;
+    while(lods.size() < maxLods) {
+        const size_t previous = lods.back().indexCount;
+        const size_t target = (size_t)(previous / 3 * ratio) * 3;
+        if(target < 3) {
+            break;
+        }
+        const float error = SimplifyMesh(mesh, original, target, simplified, options);
+        // a level that saves less than half of what was asked for only costs memory
+        if(simplified.empty() || simplified.size() > previous - (previous - target) / 2) {
+            break;
+        }
+        MeshLod lod;
+        lod.firstIndex = mesh.indices.size();
+        lod.indexCount = simplified.size();
+        lod.error = std::max(error, lods.back().error);
+        lods.push_back(lod);
+        mesh.indices.insert(mesh.indices.end(), simplified.begin(), simplified.end());
+    }
+    return lods;
+}
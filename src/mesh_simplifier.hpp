@@ -0,0 +1,49 @@
+#pragma once
+
+/*
+Mesh simplification for discrete levels of detail: quadric error metrics (Garland & Heckbert) extended to the
+vertex attributes, so a LOD keeps the colors and texture layout of the mesh and not just its shape.
+
+- Every vertex gets the sum of the quadrics of its triangles in an 8-dimensional space: the position (normalized
+  to the mesh's extent), then color and texcoord scaled by their weights. A quadric measures the squared distance
+  to the triangles' planes in that space, area-weighted and divided by the total area, so smearing a color or
+  stretching the UVs costs like moving the surface.
+- Edges collapse onto one of their endpoints; vertices are never moved or created. Every level is only a new
+  index list over the same vertex buffer, so a whole chain fits in one index buffer behind the full-detail
+  triangles and the vertex data is not duplicated.
+- Vertices that share their position with another one (UV / color seams) and vertices on open borders never
+  move: collapsing them would tear the seam or shrink the outline.
+- Collapses run in passes: all candidate edges sorted by cost, taken cheapest first as long as the triangles
+  around them were not touched earlier in the pass and none of them would flip over; then the degenerate
+  triangles are dropped and the next pass starts from the result, until the target is reached or every
+  remaining collapse costs more than the allowed error.
+*/
+
+#include "mesh_loader.hpp"
+
+#include <cstddef>
+#include <vector>
+
+struct SimplifyOptions {
+    float colorWeight = 0.5f; // attribute scale relative to the normalized position
+    float uvWeight = 0.5f;
+    float maxError = 0.05f;   // no collapse may cost more, as a fraction of the mesh's extent
+};
+
+// One level of a LOD chain: a range of MeshData::indices
+struct MeshLod {
+    size_t firstIndex = 0;
+    size_t indexCount = 0;
+    float error = 0.0f; // object-space distance the level may be off from the full-detail mesh
+};
+
+// Simplifies the triangle list 'indices' over mesh.vertices towards 'targetIndexCount' indices into 'out' and
+// returns the error of the result in object-space units. 'out' ends up larger when the error limit is hit first.
+float SimplifyMesh(const MeshData& mesh, const std::vector<GLuint>& indices, size_t targetIndexCount,
+                   std::vector<GLuint>& out, const SimplifyOptions& options = SimplifyOptions());
+
+// Appends coarser versions of mesh.indices behind the original triangles, each with about 'ratio' of the triangles
+// of the one before, and returns the chain ([0] = the original triangles). Stops after 'maxLods' levels or once a
+// level would barely remove anything. Errors never decrease along the chain.
+std::vector<MeshLod> BuildLodChain(MeshData& mesh, size_t maxLods = 4, float ratio = 0.5f,
+                                   const SimplifyOptions& options = SimplifyOptions());
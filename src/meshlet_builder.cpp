@@ -0,0 +1,254 @@
+#include "meshlet_builder.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+
+namespace {
+
+glm::vec3 Position(const MeshData& mesh, GLuint vertex) {
+    const float* v = &mesh.vertices[vertex * MeshData::FloatsPerVertex];
+    return glm::vec3(v[0], v[1], v[2]);
+}
+
+// Unit normal of a triangle, 0 when it is degenerate
+glm::vec3 TriangleNormal(const MeshData& mesh, const GLuint* corners) {
+    const glm::vec3 a = Position(mesh, corners[0]);
+    const glm::vec3 n = glm::cross(Position(mesh, corners[1]) - a, Position(mesh, corners[2]) - a);
+    const float length = glm::length(n);
+    return length > 0.0f ? n / length : glm::vec3(0.0f);
+}
+
+// Sphere around the center of the AABB; cone around the mean of the triangle normals
+void ComputeBounds(const MeshData& mesh, const GLuint* indices, size_t indexCount, Meshlet& meshlet) {
+    glm::vec3 minimum = Position(mesh, indices[0]);
+    glm::vec3 maximum = minimum;
+    for(size_t i = 1; i < indexCount; ++i) {
+        minimum = glm::min(minimum, Position(mesh, indices[i]));
+        maximum = glm::max(maximum, Position(mesh, indices[i]));
+    }
+    meshlet.center = (minimum + maximum) * 0.5f;
+    meshlet.radius = 0.0f;
+    for(size_t i = 0; i < indexCount; ++i) {
+        meshlet.radius = std::max(meshlet.radius, glm::length(Position(mesh, indices[i]) - meshlet.center));
+    }
+
+    glm::vec3 axis(0.0f);
+    for(size_t i = 0; i < indexCount; i += 3) {
+        axis += TriangleNormal(mesh, indices + i);
+    }
+    const float length = glm::length(axis);
+    meshlet.coneAxis = length > 0.0f ? axis / length : glm::vec3(0.0f, 0.0f, 1.0f);
+    meshlet.coneCutoff = 1.0f;
+    if(length <= 0.0f) {
+        return;
+    }
+    float minimumDot = 1.0f;
+    for(size_t i = 0; i < indexCount; i += 3) {
+        const glm::vec3 normal = TriangleNormal(mesh, indices + i);
+        if(glm::dot(normal, normal) > 0.0f) {
+            minimumDot = std::min(minimumDot, glm::dot(normal, meshlet.coneAxis));
+        }
+    }
+    // sin of the half-angle; a nearly flat-open cone would never cull anything useful
+    if(minimumDot > 0.1f) {
+        meshlet.coneCutoff = std::sqrt(1.0f - minimumDot * minimumDot);
+    }
+}
+
+} // namespace
+
+std::vector<Meshlet> BuildMeshlets(MeshData& mesh, size_t firstIndex, size_t indexCount) {
+    std::vector<Meshlet> meshlets;
+    const GLuint* indices = mesh.indices.data() + firstIndex;
+    const size_t triangleCount = indexCount / 3;
+    const size_t vertexCount = mesh.VertexCount();
+    if(triangleCount == 0) {
+        return meshlets;
+    }
+
+    // triangles around each vertex
+    std::vector<uint32_t> triangleOffsets(vertexCount + 1, 0);
+    for(size_t i = 0; i < triangleCount * 3; ++i) {
+        ++triangleOffsets[indices[i] + 1];
+    }
+    for(size_t v = 0; v < vertexCount; ++v) {
+        triangleOffsets[v + 1] += triangleOffsets[v];
+    }
+    std::vector<uint32_t> vertexTriangles(triangleCount * 3);
+    {
+        std::vector<uint32_t> fill(triangleOffsets.begin(), triangleOffsets.end() - 1);
+        for(size_t i = 0; i < triangleCount * 3; ++i) {
+            vertexTriangles[fill[indices[i]]++] = (uint32_t)(i / 3);
+        }
+    }
+    std::vector<glm::vec3> normals(triangleCount);
+    for(size_t t = 0; t < triangleCount; ++t) {
+        normals[t] = TriangleNormal(mesh, indices + t * 3);
+    }
+
+    std::vector<uint8_t> used(triangleCount, 0);
+    std::vector<uint32_t> owner(vertexCount, UINT32_MAX); // meshlet the vertex was last added to
+    std::vector<GLuint> reordered;
+    reordered.reserve(triangleCount * 3);
+    std::vector<uint32_t> candidates;
+    size_t seed = 0;
+
+    while(true) {
+        while(seed < triangleCount && used[seed]) {
+            ++seed;
+        }
+        if(seed == triangleCount) {
+            break;
+        }
+        const uint32_t id = (uint32_t)meshlets.size();
+        Meshlet meshlet;
+        meshlet.firstIndex = (uint32_t)(firstIndex + reordered.size());
+        size_t vertices = 0;
+        size_t triangles = 0;
+        glm::vec3 normalSum(0.0f);
+        candidates.assign(1, (uint32_t)seed);
+
+        while(triangles < Meshlet::MaxTriangles) {
+            // fewest new vertices first, then the normal closest to the cluster's
+            const float normalLength = glm::length(normalSum);
+            uint32_t best = UINT32_MAX;
+            float bestScore = 0.0f;
+            for(size_t c = 0; c < candidates.size();) {
+                const uint32_t t = candidates[c];
+                if(used[t]) {
+                    candidates[c] = candidates.back();
+                    candidates.pop_back();
+                    continue;
+                }
+                const GLuint* corners = indices + t * 3;
+                size_t fresh = 0;
+                for(int corner = 0; corner < 3; ++corner) {
+                    const bool repeated = (corner > 0 && corners[corner] == corners[0]) || (corner > 1 && corners[corner] == corners[1]);
+                    fresh += owner[corners[corner]] != id && !repeated;
+                }
+                if(vertices + fresh <= Meshlet::MaxVertices) {
+                    const float agreement = normalLength > 0.0f ? glm::dot(normals[t], normalSum) / normalLength : 1.0f;
+                    const float score = (float)fresh + 0.5f * (1.0f - agreement);
+                    if(best == UINT32_MAX || score < bestScore) {
+                        best = t;
+                        bestScore = score;
+                    }
+                }
+                ++c;
+            }
+            if(best == UINT32_MAX) {
+                break; // no neighbour left, or none fits in the vertex limit
+            }
+
+            const uint32_t t = best;
+            used[t] = 1;
+            const GLuint* corners = indices + t * 3;
+            for(int corner = 0; corner < 3; ++corner) {
+                const GLuint vertex = corners[corner];
+                if(owner[vertex] == id) {
+                    continue;
+                }
+                owner[vertex] = id;
+                ++vertices;
+                // a new vertex brings its triangles within reach
+                for(uint32_t n = triangleOffsets[vertex]; n < triangleOffsets[vertex + 1]; ++n) {
+                    if(!used[vertexTriangles[n]]) {
+                        candidates.push_back(vertexTriangles[n]);
+                    }
+                }
+            }
+            reordered.insert(reordered.end(), corners, corners + 3);
+            normalSum += normals[t];
+            ++triangles;
+        }
+
+        meshlet.indexCount = (uint32_t)(triangles * 3);
+        ComputeBounds(mesh, reordered.data() + (meshlet.firstIndex - firstIndex), meshlet.indexCount, meshlet);
+        meshlets.push_back(meshlet);
+    }
+
+    std::copy(reordered.begin(), reordered.end(), mesh.indices.begin() + firstIndex);
+    return meshlets;
+}
+
+bool IsClosedMesh(const MeshData& mesh, size_t firstIndex, size_t indexCount) {
+    const GLuint* indices = mesh.indices.data() + firstIndex;
+    const size_t vertexCount = mesh.VertexCount();
+    if(indexCount < 3) {
+        return false;
+    }
+
+    // seams: sort the vertices by position, equal neighbours share one
+    std::vector<GLuint> position(vertexCount); // first vertex with the same position
+    {
+        std::vector<GLuint> order(vertexCount);
+        std::iota(order.begin(), order.end(), 0);
+        const float* vertices = mesh.vertices.data();
+        auto less = [vertices](GLuint x, GLuint y) {
+            return std::lexicographical_compare(vertices + x * MeshData::FloatsPerVertex, vertices + x * MeshData::FloatsPerVertex + 3,
+                                                vertices + y * MeshData::FloatsPerVertex, vertices + y * MeshData::FloatsPerVertex + 3);
+        };
+        std::sort(order.begin(), order.end(), less);
+        for(size_t i = 0; i < vertexCount; ++i) {
+            const bool same = i > 0 && !less(order[i - 1], order[i]);
+            position[order[i]] = same ? position[order[i - 1]] : order[i];
+        }
+    }
+
+    // directed edges between positions; degenerate triangles cover nothing and are left out
+    std::vector<uint64_t> edges;
+    edges.reserve(indexCount);
+    for(size_t i = 0; i + 2 < indexCount; i += 3) {
+        const GLuint corners[3] = {position[indices[i]], position[indices[i + 1]], position[indices[i + 2]]};
+        if(corners[0] == corners[1] || corners[1] == corners[2] || corners[2] == corners[0]) {
+            continue;
+        }
+        for(int e = 0; e < 3; ++e) {
+            edges.push_back((uint64_t)corners[e] << 32 | corners[(e + 1) % 3]);
+        }
+    }
+    if(edges.empty()) {
+        return false;
+    }
+    std::sort(edges.begin(), edges.end());
+
+    for(size_t i = 0; i < edges.size(); ++i) {
+        if(i + 1 < edges.size() && edges[i + 1] == edges[i]) {
+            return false; // two triangles run the edge the same way, or more than two share it
+        }
+        const uint64_t reverse = edges[i] << 32 | edges[i] >> 32;
+        if(!std::binary_search(edges.begin(), edges.end(), reverse)) {
+            return false; // a border
+        }
+    }
+    return true;
+}
+
+void CullMeshlets(const std::vector<Meshlet>& meshlets, const glm::mat4& world, float worldScale, const Frustum& frustum,
+                  const glm::vec3& eye, bool cone, uint8_t* visible) {
+    // dot(p, world * x) = dot(transpose(world) * p, x): the planes in mesh space still measure distances in
+    // world units, so only the radii are scaled
+    glm::vec4 planes[6];
+    const glm::mat4 transposed = glm::transpose(world);
+    for(int p = 0; p < 6; ++p) {
+        planes[p] = transposed * frustum.planes[p];
+    }
+    const glm::vec3 localEye = glm::vec3(glm::inverse(world) * glm::vec4(eye, 1.0f));
+
+    for(size_t m = 0; m < meshlets.size(); ++m) {
+        const Meshlet& meshlet = meshlets[m];
+        const float radius = meshlet.radius * worldScale;
+        bool inside = true;
+        for(int p = 0; p < 6 && inside; ++p) {
+            inside = glm::dot(glm::vec3(planes[p]), meshlet.center) + planes[p].w >= -radius;
+        }
+        if(inside && cone) {
+            // angles and length ratios are the same in mesh space
+            const glm::vec3 toCenter = meshlet.center - localEye;
+            inside = glm::dot(toCenter, meshlet.coneAxis) < meshlet.coneCutoff * glm::length(toCenter) + meshlet.radius;
+        }
+        visible[m] = inside ? 1 : 0;
+    }
+}
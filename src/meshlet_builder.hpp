@@ -0,0 +1,55 @@
+#pragma once
+
+/*
+Meshlets: a mesh's triangle list split into small clusters (at most 64 vertices, 124 triangles) that are culled
+one by one, so a large object that is only partly on screen draws only the parts that can be seen.
+
+- BuildMeshlets() reorders the triangles of an index range in place so every meshlet is one contiguous range of
+  it; the triangles themselves and the vertex buffer stay as they are, any other user of the range still sees
+  the same mesh.
+- Clusters grow greedily from a seed triangle: the next triangle is the neighbour that adds the fewest new
+  vertices, ties go to the one whose normal agrees best with the cluster so far (tighter normal cones). A
+  cluster ends at either limit or when it has no neighbours left; the next seed is the first unused triangle.
+- Each meshlet stores a bounding sphere and a normal cone (axis and cutoff = sine of its half-angle). With the
+  eye at e, all its triangles face away when dot(center - e, axis) >= cutoff * |center - e| + radius. Cones
+  wider than about 84 degrees get cutoff 1, which never passes.
+- The cone test alone is only safe for a closed, consistently wound surface seen from outside: there every
+  triangle facing away lies behind one of the surface's own front faces. IsClosedMesh() checks that every edge
+  (vertices matched by position, so UV seams count as joined) is used by exactly two triangles running it in
+  opposite directions.
+- CullMeshlets() moves the frustum planes and the eye into mesh space once per object instead of moving every
+  sphere and cone out of it. That holds for rotations, translations and uniform scale, which is all the scene
+  hierarchy builds.
+*/
+
+#include "culling.hpp"
+#include "mesh_loader.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct Meshlet {
+    static const size_t MaxVertices = 64;
+    static const size_t MaxTriangles = 124;
+
+    uint32_t firstIndex = 0;  // into the index buffer
+    uint32_t indexCount = 0;  // 3 per triangle
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = 0.0f;
+    glm::vec3 coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+    float coneCutoff = 1.0f;
+};
+
+// Splits mesh.indices[firstIndex, firstIndex + indexCount) into meshlets, reordering its triangles
+std::vector<Meshlet> BuildMeshlets(MeshData& mesh, size_t firstIndex, size_t indexCount);
+
+// Whether mesh.indices[firstIndex, firstIndex + indexCount) is closed and consistently wound (see above)
+bool IsClosedMesh(const MeshData& mesh, size_t firstIndex, size_t indexCount);
+
+// One flag per meshlet into 'visible': 0 when its sphere is outside 'frustum' or, with 'cone', every triangle faces
+// away from 'eye'. 'world' maps mesh space into the space of the frustum and the eye; 'worldScale' is its scale.
+void CullMeshlets(const std::vector<Meshlet>& meshlets, const glm::mat4& world, float worldScale, const Frustum& frustum,
+                  const glm::vec3& eye, bool cone, uint8_t* visible);
@@ -0,0 +1,383 @@
+#include "mipmap_generator.hpp"
+#include "cpu_features.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if LEARNGL_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// RGBA float image in linear space, 4 floats per pixel
+struct LinearImage {
+    int width = 0;
+    int height = 0;
+    std::vector<float> texels;
+
+    float* Row(int y) { return texels.data() + (size_t)y * width * 4; }
+    const float* Row(int y) const { return texels.data() + (size_t)y * width * 4; }
+};
+
+const int LinearToSrgbTableSize = 16384;
+
+struct ColorTables {
+    float srgbToLinear[256];
+    float unormToFloat[256];
+    uint8_t linearToSrgb[LinearToSrgbTableSize];
+
+    ColorTables() {
+        for(int i = 0; i < 256; ++i) {
+            float c = i / 255.0f;
+            srgbToLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+            unormToFloat[i] = c;
+        }
+        for(int i = 0; i < LinearToSrgbTableSize; ++i) {
+            float l = i / (float)(LinearToSrgbTableSize - 1);
+            float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+            linearToSrgb[i] = (uint8_t)std::lround(std::min(1.0f, std::max(0.0f, c)) * 255.0f);
+        }
+    }
+};
+
+const ColorTables& Tables() {
+    static const ColorTables tables;
+    return tables;
+}
+
+void ToLinear(const Image& image, bool srgb, LinearImage& out) {
+    const ColorTables& tables = Tables();
+    const float* colorTable = srgb ? tables.srgbToLinear : tables.unormToFloat;
+
+    out.width = image.width;
+    out.height = image.height;
+    out.texels.resize((size_t)image.width * image.height * 4);
+    const uint8_t* src = image.pixels.data();
+    float* dst = out.texels.data();
+    for(size_t i = 0, n = (size_t)image.width * image.height; i < n; ++i, src += 4, dst += 4) {
+        dst[0] = colorTable[src[0]];
+        dst[1] = colorTable[src[1]];
+        dst[2] = colorTable[src[2]];
+        dst[3] = tables.unormToFloat[src[3]];
+    }
+}
+
+void FromLinear(const LinearImage& linear, bool srgb, Image& out) {
+    const ColorTables& tables = Tables();
+    out.width = linear.width;
+    out.height = linear.height;
+    out.pixels.resize(out.ByteSize());
+
+    const float* src = linear.texels.data();
+    uint8_t* dst = out.pixels.data();
+    const size_t count = (size_t)linear.width * linear.height;
+    size_t i = 0;
+
+#if LEARNGL_X86
+    // clamp + scale + round four channels at once; the table lookups themselves stay scalar (SSE2 has no gather)
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 scale = srgb ? _mm_setr_ps(LinearToSrgbTableSize - 1.0f, LinearToSrgbTableSize - 1.0f, LinearToSrgbTableSize - 1.0f, 255.0f)
+                              : _mm_set1_ps(255.0f);
+    alignas(16) int32_t index[4];
+    for(; i < count; ++i, src += 4, dst += 4) {
+        __m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src), zero), one);
+        _mm_store_si128((__m128i*)index, _mm_cvtps_epi32(_mm_mul_ps(v, scale)));
+        if(srgb) {
+            dst[0] = tables.linearToSrgb[index[0]];
+            dst[1] = tables.linearToSrgb[index[1]];
+            dst[2] = tables.linearToSrgb[index[2]];
+        }
+        else {
+            dst[0] = (uint8_t)index[0];
+            dst[1] = (uint8_t)index[1];
+            dst[2] = (uint8_t)index[2];
+        }
+        dst[3] = (uint8_t)index[3];
+    }
+#endif
+
+    for(; i < count; ++i, src += 4, dst += 4) {
+        for(int c = 0; c < 4; ++c) {
+            float v = std::min(1.0f, std::max(0.0f, src[c]));
+            if(srgb && c < 3) {
+                dst[c] = tables.linearToSrgb[(int)std::lround(v * (LinearToSrgbTableSize - 1))];
+            }
+            else {
+                dst[c] = (uint8_t)std::lround(v * 255.0f);
+            }
+        }
+    }
+}
+
+// ---- Box 2x2 --------------------------------------------------------------------------------------------------------
+
+void BoxRowScalar(const float* row0, const float* row1, int srcWidth, float* out, int dstWidth, int first) {
+    for(int x = first; x < dstWidth; ++x) {
+        const int x0 = 2 * x, x1 = std::min(2 * x + 1, srcWidth - 1);
+        for(int c = 0; c < 4; ++c) {
+            out[x * 4 + c] = 0.25f * (row0[x0 * 4 + c] + row0[x1 * 4 + c] + row1[x0 * 4 + c] + row1[x1 * 4 + c]);
+        }
+    }
+}
+
+#if LEARNGL_X86
+void BoxRowSse2(const float* row0, const float* row1, int srcWidth, float* out, int dstWidth) {
+    const __m128 quarter = _mm_set1_ps(0.25f);
+    const int pairs = srcWidth / 2; // output pixels whose two source columns both exist
+    for(int x = 0; x < pairs; ++x) {
+        __m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(row0 + x * 8), _mm_loadu_ps(row0 + x * 8 + 4)),
+                                _mm_add_ps(_mm_loadu_ps(row1 + x * 8), _mm_loadu_ps(row1 + x * 8 + 4)));
+        _mm_storeu_ps(out + x * 4, _mm_mul_ps(sum, quarter));
+    }
+    BoxRowScalar(row0, row1, srcWidth, out, dstWidth, pairs);
+}
+
+LEARNGL_TARGET_AVX2
+void BoxRowAvx2(const float* row0, const float* row1, int srcWidth, float* out, int dstWidth) {
+    const __m256 quarter = _mm256_set1_ps(0.25f);
+    const int pairs = srcWidth / 2;
+    int x = 0;
+    for(; x + 2 <= pairs; x += 2) {
+        // a = source pixels 0,1 and b = pixels 2,3 of this group, both rows summed
+        __m256 a = _mm256_add_ps(_mm256_loadu_ps(row0 + x * 8), _mm256_loadu_ps(row1 + x * 8));
+        __m256 b = _mm256_add_ps(_mm256_loadu_ps(row0 + x * 8 + 8), _mm256_loadu_ps(row1 + x * 8 + 8));
+        // [a.lo b.lo] + [a.hi b.hi] = the two horizontal pair sums
+        __m256 sum = _mm256_add_ps(_mm256_permute2f128_ps(a, b, 0x20), _mm256_permute2f128_ps(a, b, 0x31));
+        _mm256_storeu_ps(out + x * 4, _mm256_mul_ps(sum, quarter));
+    }
+    BoxRowScalar(row0, row1, srcWidth, out, dstWidth, x);
+}
+#endif
+
+void DownsampleBox(const LinearImage& src, LinearImage& dst, SimdLevel level) {
+    for(int y = 0; y < dst.height; ++y) {
+        const float* row0 = src.Row(std::min(2 * y, src.height - 1));
+        const float* row1 = src.Row(std::min(2 * y + 1, src.height - 1));
+        float* out = dst.Row(y);
+        switch(level) {
+#if LEARNGL_X86
+            case SimdLevel::AVX2: BoxRowAvx2(row0, row1, src.width, out, dst.width); break;
+            case SimdLevel::SSE2: BoxRowSse2(row0, row1, src.width, out, dst.width); break;
+#endif
+            default: BoxRowScalar(row0, row1, src.width, out, dst.width, 0); break;
+        }
+    }
+}
+
+// ---- Kaiser-windowed sinc, separable --------------------------------------------------------------------------------
+
+const int KaiserTaps = 6; // source offsets -2..+3 around 2x, i.e. distances +-0.5, +-1.5, +-2.5 from the new center
+
+double BesselI0(double x) {
+    // power series, converges quickly for the small arguments used here
+    double sum = 1.0, term = 1.0;
+    for(int k = 1; k < 32; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+struct KaiserKernel {
+    float weights[KaiserTaps];
+
+    KaiserKernel() {
+        const double pi = 3.14159265358979323846;
+        const double beta = 4.0;
+        const double radius = 3.0;
+        double total = 0.0;
+        double w[KaiserTaps];
+        for(int k = 0; k < KaiserTaps; ++k) {
+            double d = k - 2.5;                    // distance in source pixels
+            double x = d * 0.5;                    // halve the bandwidth for a 2x reduction
+            double sinc = std::sin(pi * x) / (pi * x);
+            double r = d / radius;
+            double window = BesselI0(beta * std::sqrt(std::max(0.0, 1.0 - r * r))) / BesselI0(beta);
+            w[k] = sinc * window;
+            total += w[k];
+        }
+        for(int k = 0; k < KaiserTaps; ++k) {
+            weights[k] = (float)(w[k] / total);
+        }
+    }
+};
+
+const KaiserKernel& Kernel() {
+    static const KaiserKernel kernel;
+    return kernel;
+}
+
+// horizontal pass: srcWidth -> dstWidth pixels, one row
+void KaiserRowScalar(const float* in, int srcWidth, float* out, int dstWidth) {
+    const float* w = Kernel().weights;
+    for(int x = 0; x < dstWidth; ++x) {
+        float sum[4] = {0, 0, 0, 0};
+        for(int k = 0; k < KaiserTaps; ++k) {
+            int sx = std::min(std::max(2 * x - 2 + k, 0), srcWidth - 1);
+            for(int c = 0; c < 4; ++c) {
+                sum[c] += w[k] * in[sx * 4 + c];
+            }
+        }
+        for(int c = 0; c < 4; ++c) {
+            out[x * 4 + c] = sum[c];
+        }
+    }
+}
+
+#if LEARNGL_X86
+void KaiserRowSse2(const float* in, int srcWidth, float* out, int dstWidth) {
+    const float* w = Kernel().weights;
+    __m128 weight[KaiserTaps];
+    for(int k = 0; k < KaiserTaps; ++k) {
+        weight[k] = _mm_set1_ps(w[k]);
+    }
+    for(int x = 0; x < dstWidth; ++x) {
+        const int start = 2 * x - 2;
+        __m128 sum = _mm_setzero_ps();
+        if(start >= 0 && start + KaiserTaps <= srcWidth) {
+            const float* p = in + start * 4;
+            for(int k = 0; k < KaiserTaps; ++k) {
+                sum = _mm_add_ps(sum, _mm_mul_ps(weight[k], _mm_loadu_ps(p + k * 4)));
+            }
+        }
+        else {
+            for(int k = 0; k < KaiserTaps; ++k) {
+                int sx = std::min(std::max(start + k, 0), srcWidth - 1);
+                sum = _mm_add_ps(sum, _mm_mul_ps(weight[k], _mm_loadu_ps(in + sx * 4)));
+            }
+        }
+        _mm_storeu_ps(out + x * 4, sum);
+    }
+}
+#endif
+
+// vertical pass: out = sum_k w[k] * rows[k], over 'floats' contiguous values
+void KaiserColumnScalar(const float* const* rows, float* out, size_t floats, size_t first) {
+    const float* w = Kernel().weights;
+    for(size_t i = first; i < floats; ++i) {
+        float sum = 0.0f;
+        for(int k = 0; k < KaiserTaps; ++k) {
+            sum += w[k] * rows[k][i];
+        }
+        out[i] = sum;
+    }
+}
+
+#if LEARNGL_X86
+void KaiserColumnSse2(const float* const* rows, float* out, size_t floats) {
+    const float* w = Kernel().weights;
+    size_t i = 0;
+    for(; i + 4 <= floats; i += 4) {
+        __m128 sum = _mm_setzero_ps();
+        for(int k = 0; k < KaiserTaps; ++k) {
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(w[k]), _mm_loadu_ps(rows[k] + i)));
+        }
+        _mm_storeu_ps(out + i, sum);
+    }
+    KaiserColumnScalar(rows, out, floats, i);
+}
+
+LEARNGL_TARGET_AVX2
+void KaiserColumnAvx2(const float* const* rows, float* out, size_t floats) {
+    const float* w = Kernel().weights;
+    __m256 weight[KaiserTaps];
+    for(int k = 0; k < KaiserTaps; ++k) {
+        weight[k] = _mm256_set1_ps(w[k]);
+    }
+    size_t i = 0;
+    for(; i + 8 <= floats; i += 8) {
+        __m256 sum = _mm256_mul_ps(weight[0], _mm256_loadu_ps(rows[0] + i));
+        for(int k = 1; k < KaiserTaps; ++k) {
+            sum = _mm256_fmadd_ps(weight[k], _mm256_loadu_ps(rows[k] + i), sum);
+        }
+        _mm256_storeu_ps(out + i, sum);
+    }
+    KaiserColumnScalar(rows, out, floats, i);
+}
+#endif
+
+void DownsampleKaiser(const LinearImage& src, LinearImage& dst, LinearImage& scratch, SimdLevel level) {
+    // horizontal: src.width x src.height -> dst.width x src.height
+    scratch.width = dst.width;
+    scratch.height = src.height;
+    scratch.texels.resize((size_t)scratch.width * scratch.height * 4);
+    for(int y = 0; y < src.height; ++y) {
+#if LEARNGL_X86
+        if(level != SimdLevel::Scalar) {
+            KaiserRowSse2(src.Row(y), src.width, scratch.Row(y), dst.width);
+            continue;
+        }
+#endif
+        KaiserRowScalar(src.Row(y), src.width, scratch.Row(y), dst.width);
+    }
+
+    // vertical: -> dst.width x dst.height
+    const size_t floats = (size_t)dst.width * 4;
+    for(int y = 0; y < dst.height; ++y) {
+        const float* rows[KaiserTaps];
+        for(int k = 0; k < KaiserTaps; ++k) {
+            rows[k] = scratch.Row(std::min(std::max(2 * y - 2 + k, 0), src.height - 1));
+        }
+        switch(level) {
+#if LEARNGL_X86
+            case SimdLevel::AVX2: KaiserColumnAvx2(rows, dst.Row(y), floats); break;
+            case SimdLevel::SSE2: KaiserColumnSse2(rows, dst.Row(y), floats); break;
+#endif
+            default: KaiserColumnScalar(rows, dst.Row(y), floats, 0); break;
+        }
+    }
+
+    // the negative lobes overshoot at hard edges; clamp before the next level is filtered from this one, so the
+    // ringing does not build up down the chain (a plain loop, vectorized by the compiler)
+    for(float& value : dst.texels) {
+        value = std::min(1.0f, std::max(0.0f, value));
+    }
+}
+
+} // namespace
+
+int MipLevelCount(int width, int height) {
+    int size = std::max(width, height);
+    int levels = 1;
+    while(size > 1) {
+        size >>= 1;
+        ++levels;
+    }
+    return levels;
+}
+
+std::vector<Image> GenerateMipChain(Image base, MipFilter filter, bool srgb) {
+    std::vector<Image> levels;
+    const int count = MipLevelCount(base.width, base.height);
+    levels.reserve(count);
+    if(base.width <= 0 || base.height <= 0) {
+        levels.push_back(std::move(base));
+        return levels;
+    }
+
+    const SimdLevel simd = GetSimdLevel();
+    LinearImage current, next, scratch;
+    ToLinear(base, srgb, current);
+    levels.push_back(std::move(base));
+
+    for(int level = 1; level < count; ++level) {
+        next.width = std::max(1, current.width / 2);
+        next.height = std::max(1, current.height / 2);
+        next.texels.resize((size_t)next.width * next.height * 4);
+
+        if(filter == MipFilter::Kaiser) {
+            DownsampleKaiser(current, next, scratch, simd);
+        }
+        else {
+            DownsampleBox(current, next, simd);
+        }
+
+        Image image;
+        FromLinear(next, srgb, image);
+        levels.push_back(std::move(image));
+        std::swap(current, next);
+    }
+    return levels;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+/*
+CPU mipmap generation for streamed textures (runs on the decode worker, next to the image decoder).
+
+Filtering happens in linear light: sRGB color channels are expanded through a 256-entry table, filtered as
+floats and re-encoded through a 16K-entry table, so dark/bright edges do not shift brightness the way
+averaging sRGB bytes does. Alpha is always treated as linear. Every level is computed from the float image
+of the level above, so rounding does not accumulate down the chain.
+
+Filters:
+- Box:    2x2 average. Cheap, slightly blurry, the classic glGenerateMipmap result.
+- Kaiser: separable 6-tap windowed sinc (Kaiser window, beta = 4). Keeps more detail; can ring slightly
+          on hard edges, so every level's floats are clamped to [0, 1] before the next level is filtered
+          from them.
+
+Odd sizes round down (e.g. 5x3 -> 2x1), matching the GL mip size rule; the last row/column of an odd level is
+folded into the edge clamp rather than weighted separately.
+
+The inner loops work on whole RGBA pixels (4 floats) and pick SSE2 / AVX2 at runtime through GetSimdLevel().
+*/
+
+#include "image_decoder.hpp"
+
+#include <vector>
+
+enum class MipFilter {
+    Box,
+    Kaiser,
+};
+
+// floor(log2(max(width, height))) + 1
+int MipLevelCount(int width, int height);
+
+// Returns every level, level 0 first (the base image itself, moved in). 'srgb' selects gamma-correct filtering
+// of the color channels; pass false for data textures (normal maps, masks).
+std::vector<Image> GenerateMipChain(Image base, MipFilter filter, bool srgb);
@@ -0,0 +1,309 @@
+#include "occlusion_culler.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if LEARNGL_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+const size_t SetupChunkSize = 1024; // triangles per setup job
+
+// Both kernels evaluate E = A * px + (B * py + C) and z = a * px + (b * py + c). The AVX2 one is compiled with
+// FMA, which may fuse the multiply-add: depths can differ from the scalar ones in the last bit, nothing more.
+
+void RasterizeRowScalar(const float edgeA[3], const float rowEdge[3], float depthA, float rowDepth,
+                        int minX, int maxX, float* depth) {
+    for(int x = minX; x <= maxX; ++x) {
+        const float px = (float)x + 0.5f;
+        const float e0 = edgeA[0] * px + rowEdge[0];
+        const float e1 = edgeA[1] * px + rowEdge[1];
+        const float e2 = edgeA[2] * px + rowEdge[2];
+        if(e0 >= 0.0f && e1 >= 0.0f && e2 >= 0.0f) {
+            depth[x] = std::min(depth[x], depthA * px + rowDepth);
+        }
+    }
+}
+
+#if LEARNGL_X86
+LEARNGL_TARGET_AVX2
+void RasterizeRowAvx2(const float edgeA[3], const float rowEdge[3], float depthA, float rowDepth,
+                      int minX, int maxX, float* depth) {
+    const __m256 lanes = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+    const __m256 a0 = _mm256_set1_ps(edgeA[0]), c0 = _mm256_set1_ps(rowEdge[0]);
+    const __m256 a1 = _mm256_set1_ps(edgeA[1]), c1 = _mm256_set1_ps(rowEdge[1]);
+    const __m256 a2 = _mm256_set1_ps(edgeA[2]), c2 = _mm256_set1_ps(rowEdge[2]);
+    const __m256 za = _mm256_set1_ps(depthA), zc = _mm256_set1_ps(rowDepth);
+    const __m256 zero = _mm256_setzero_ps();
+    // the row is a whole number of 8-pixel blocks, lanes left or right of the bounds fail an edge test anyway
+    for(int x = minX & ~7; x <= maxX; x += 8) {
+        const __m256 px = _mm256_add_ps(_mm256_set1_ps((float)x), lanes);
+        const __m256 e0 = _mm256_add_ps(_mm256_mul_ps(a0, px), c0);
+        const __m256 e1 = _mm256_add_ps(_mm256_mul_ps(a1, px), c1);
+        const __m256 e2 = _mm256_add_ps(_mm256_mul_ps(a2, px), c2);
+        const __m256 inside = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(e0, zero, _CMP_GE_OQ), _mm256_cmp_ps(e1, zero, _CMP_GE_OQ)),
+                                            _mm256_cmp_ps(e2, zero, _CMP_GE_OQ));
+        if(_mm256_movemask_ps(inside) == 0) {
+            continue;
+        }
+        const __m256 z = _mm256_add_ps(_mm256_mul_ps(za, px), zc);
+        const __m256 old = _mm256_loadu_ps(depth + x);
+        _mm256_storeu_ps(depth + x, _mm256_blendv_ps(old, _mm256_min_ps(old, z), inside));
+    }
+}
+#endif
+
+} // namespace
+
+OcclusionCuller::OcclusionCuller(JobSystem& jobs, int width, int height)
+    : mJobs(jobs), mSimd(GetSimdLevel()), mWidth((std::max(8, width) + 7) & ~7), mHeight(std::max(1, height)) {
+    Level level;
+    level.width = mWidth;
+    level.height = mHeight;
+    level.maxDepth.assign((size_t)mWidth * mHeight, 1.0f);
+    mLevels.push_back(std::move(level));
+    while(mLevels.back().width > 1 || mLevels.back().height > 1) {
+        Level next;
+        next.width = (mLevels.back().width + 1) / 2;
+        next.height = (mLevels.back().height + 1) / 2;
+        next.minDepth.assign((size_t)next.width * next.height, 1.0f);
+        next.maxDepth.assign((size_t)next.width * next.height, 1.0f);
+        mLevels.push_back(std::move(next));
+    }
+}
+
+void OcclusionCuller::Begin(const glm::mat4& viewProjection) {
+    mViewProjection = viewProjection;
+    std::fill(mLevels[0].maxDepth.begin(), mLevels[0].maxDepth.end(), 1.0f);
+}
+
+void OcclusionCuller::RasterizeOccluders(const float* vertices, size_t vertexCount, size_t strideFloats, const uint32_t* indices,
+                                         size_t indexCount, const glm::mat4* instanceMatrices, size_t instanceCount) {
+    if(vertexCount == 0 || indexCount < 3 || instanceCount == 0) {
+        return;
+    }
+
+    // 1. every vertex of every occluder to window coordinates; w <= 0 marks vertices behind the eye
+    mScreenVertices.resize(vertexCount * instanceCount);
+    const float halfWidth = 0.5f * (float)mWidth;
+    const float halfHeight = 0.5f * (float)mHeight;
+    mJobs.ParallelFor(mScreenVertices.size(), [&](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; ++i) {
+            const float* v = vertices + (i % vertexCount) * strideFloats;
+            const glm::vec4 clip = mViewProjection * (instanceMatrices[i / vertexCount] * glm::vec4(v[0], v[1], v[2], 1.0f));
+            if(clip.w <= 0.0f || clip.z < -clip.w) {
+                mScreenVertices[i] = glm::vec4(0.0f, 0.0f, 0.0f, -1.0f); // in front of the near plane
+                continue;
+            }
+            const float inverseW = 1.0f / clip.w;
+            mScreenVertices[i] = glm::vec4((clip.x * inverseW + 1.0f) * halfWidth, (clip.y * inverseW + 1.0f) * halfHeight,
+                                           clip.z * inverseW * 0.5f + 0.5f, clip.w);
+        }
+    });
+
+    // 2. triangle setup in chunks, each with a list of its own
+    const size_t trianglesPerInstance = indexCount / 3;
+    const size_t triangleCount = trianglesPerInstance * instanceCount;
+    const size_t chunkCount = (triangleCount + SetupChunkSize - 1) / SetupChunkSize;
+    if(mSetup.size() < chunkCount) {
+        mSetup.resize(chunkCount);
+    }
+    mJobs.ParallelFor(chunkCount, [&](size_t begin, size_t end) {
+        for(size_t chunk = begin; chunk < end; ++chunk) {
+            std::vector<Triangle>& out = mSetup[chunk];
+            out.clear();
+            const size_t last = std::min(triangleCount, (chunk + 1) * SetupChunkSize);
+            for(size_t t = chunk * SetupChunkSize; t < last; ++t) {
+                const glm::vec4* instance = mScreenVertices.data() + (t / trianglesPerInstance) * vertexCount;
+                const uint32_t* triangle = indices + (t % trianglesPerInstance) * 3;
+                if(triangle[0] >= vertexCount || triangle[1] >= vertexCount || triangle[2] >= vertexCount) {
+                    continue;
+                }
+                SetupTriangle(instance[triangle[0]], instance[triangle[1]], instance[triangle[2]], out);
+            }
+        }
+    }, 1);
+
+    // 3. bands of rows: every band owns its part of the depth buffer, no two jobs write the same pixel
+    const int bandCount = (mHeight + BandHeight - 1) / BandHeight;
+    float* depth = mLevels[0].maxDepth.data();
+#if LEARNGL_X86
+    const bool avx2 = mSimd >= SimdLevel::AVX2;
+#endif
+    mJobs.ParallelFor((size_t)bandCount, [&](size_t begin, size_t end) {
+        for(size_t band = begin; band < end; ++band) {
+            const int bandMinY = (int)band * BandHeight;
+            const int bandMaxY = std::min(mHeight, bandMinY + BandHeight) - 1;
+            for(size_t chunk = 0; chunk < chunkCount; ++chunk) {
+                for(const Triangle& t : mSetup[chunk]) {
+                    const int minY = std::max(bandMinY, t.minY);
+                    const int maxY = std::min(bandMaxY, t.maxY);
+                    for(int y = minY; y <= maxY; ++y) {
+                        const float py = (float)y + 0.5f;
+                        const float rowEdge[3] = {t.edgeB[0] * py + t.edgeC[0], t.edgeB[1] * py + t.edgeC[1], t.edgeB[2] * py + t.edgeC[2]};
+                        const float rowDepth = t.depthB * py + t.depthC;
+                        float* row = depth + (size_t)y * mWidth;
+#if LEARNGL_X86
+                        if(avx2) {
+                            RasterizeRowAvx2(t.edgeA, rowEdge, t.depthA, rowDepth, t.minX, t.maxX, row);
+                            continue;
+                        }
+#endif
+                        RasterizeRowScalar(t.edgeA, rowEdge, t.depthA, rowDepth, t.minX, t.maxX, row);
+                    }
+                }
+            }
+        }
+    }, 1);
+}
+
+void OcclusionCuller::SetupTriangle(const glm::vec4& v0, const glm::vec4& in1, const glm::vec4& in2, std::vector<Triangle>& out) const {
+    if(v0.w <= 0.0f || in1.w <= 0.0f || in2.w <= 0.0f) {
+        return; // crosses the near plane: leaving it out is conservative
+    }
+    // counter-clockwise in window space, so all three edge functions are positive inside
+    float area = (in1.x - v0.x) * (in2.y - v0.y) - (in2.x - v0.x) * (in1.y - v0.y);
+    const bool flip = area < 0.0f;
+    const glm::vec4& v1 = flip ? in2 : in1;
+    const glm::vec4& v2 = flip ? in1 : in2;
+    area = std::fabs(area);
+    if(!(area > 1e-6f)) {
+        return;
+    }
+
+    Triangle t;
+    t.minX = std::max(0, (int)std::ceil(std::min(v0.x, std::min(v1.x, v2.x)) - 0.5f));
+    t.maxX = std::min(mWidth - 1, (int)std::floor(std::max(v0.x, std::max(v1.x, v2.x)) - 0.5f));
+    t.minY = std::max(0, (int)std::ceil(std::min(v0.y, std::min(v1.y, v2.y)) - 0.5f));
+    t.maxY = std::min(mHeight - 1, (int)std::floor(std::max(v0.y, std::max(v1.y, v2.y)) - 0.5f));
+    if(t.minX > t.maxX || t.minY > t.maxY) {
+        return; // off screen or between pixel centers
+    }
+
+    // edge i is opposite vertex i
+    const glm::vec4* const vertices[3] = {&v0, &v1, &v2};
+    const float inverseArea = 1.0f / area;
+    t.depthA = t.depthB = t.depthC = 0.0f;
+    for(int i = 0; i < 3; ++i) {
+        const glm::vec4& a = *vertices[(i + 1) % 3];
+        const glm::vec4& b = *vertices[(i + 2) % 3];
+        t.edgeA[i] = a.y - b.y;
+        t.edgeB[i] = b.x - a.x;
+        t.edgeC[i] = a.x * b.y - b.x * a.y;
+        // depth is linear in window space: z = sum of E_i / area * z_i
+        const float z = vertices[i]->z * inverseArea;
+        t.depthA += t.edgeA[i] * z;
+        t.depthB += t.edgeB[i] * z;
+        t.depthC += t.edgeC[i] * z;
+    }
+    // Conservative coverage: over a pixel the functions vary by +-(|A| + |B|) / 2 around the center value, so
+    // testing the center against the lowest value over the pixel accepts only pixels that lie fully inside, and the
+    // depth at the center is raised to the highest value the plane reaches over the pixel.
+    for(int i = 0; i < 3; ++i) {
+        t.edgeC[i] -= 0.5f * (std::fabs(t.edgeA[i]) + std::fabs(t.edgeB[i]));
+    }
+    t.depthC += 0.5f * (std::fabs(t.depthA) + std::fabs(t.depthB));
+    out.push_back(t);
+}
+
+void OcclusionCuller::BuildPyramid() {
+    for(size_t i = 1; i < mLevels.size(); ++i) {
+        const Level& source = mLevels[i - 1];
+        Level& level = mLevels[i];
+        // level 1 reduces the depth buffer, whose minimum is the value itself
+        const std::vector<float>& sourceMin = i == 1 ? source.maxDepth : source.minDepth;
+        for(int y = 0; y < level.height; ++y) {
+            const size_t row0 = (size_t)std::min(2 * y, source.height - 1) * source.width;
+            const size_t row1 = (size_t)std::min(2 * y + 1, source.height - 1) * source.width;
+            for(int x = 0; x < level.width; ++x) {
+                const size_t x0 = (size_t)(2 * x);
+                const size_t x1 = (size_t)std::min(2 * x + 1, source.width - 1);
+                level.minDepth[(size_t)y * level.width + x] =
+                    std::min(std::min(sourceMin[row0 + x0], sourceMin[row0 + x1]), std::min(sourceMin[row1 + x0], sourceMin[row1 + x1]));
+                level.maxDepth[(size_t)y * level.width + x] =
+                    std::max(std::max(source.maxDepth[row0 + x0], source.maxDepth[row0 + x1]),
+                             std::max(source.maxDepth[row1 + x0], source.maxDepth[row1 + x1]));
+            }
+        }
+    }
+}
+
+bool OcclusionCuller::IsVisible(const glm::vec3& aabbMin, const glm::vec3& aabbMax) const {
+    float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f;
+    float nearest = 1.0f;
+    for(int corner = 0; corner < 8; ++corner) {
+        const glm::vec4 position((corner & 1) ? aabbMax.x : aabbMin.x, (corner & 2) ? aabbMax.y : aabbMin.y,
+                                 (corner & 4) ? aabbMax.z : aabbMin.z, 1.0f);
+        const glm::vec4 clip = mViewProjection * position;
+        if(clip.w <= 0.0f || clip.z < -clip.w) {
+            return true; // reaches in front of the near plane, nothing can be in front of it
+        }
+        const float inverseW = 1.0f / clip.w;
+        const float x = (clip.x * inverseW + 1.0f) * 0.5f * (float)mWidth;
+        const float y = (clip.y * inverseW + 1.0f) * 0.5f * (float)mHeight;
+        minX = std::min(minX, x);
+        maxX = std::max(maxX, x);
+        minY = std::min(minY, y);
+        maxY = std::max(maxY, y);
+        nearest = std::min(nearest, clip.z * inverseW * 0.5f + 0.5f);
+    }
+    if(maxX < 0.0f || maxY < 0.0f || minX >= (float)mWidth || minY >= (float)mHeight) {
+        return true; // off screen: the frustum test decides about those
+    }
+
+    // every pixel the box touches, not only those whose centers it covers
+    const int x0 = std::max(0, (int)minX);
+    const int y0 = std::max(0, (int)minY);
+    const int x1 = std::min(mWidth - 1, (int)maxX);
+    const int y1 = std::min(mHeight - 1, (int)maxY);
+
+    int level = 0;
+    while(level + 1 < (int)mLevels.size() && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1)) {
+        ++level;
+    }
+    for(;;) {
+        const Level& texels = mLevels[level];
+        const std::vector<float>& minDepth = level == 0 ? texels.maxDepth : texels.minDepth;
+        float regionMin = 1.0f;
+        float regionMax = 0.0f;
+        for(int y = y0 >> level; y <= (y1 >> level); ++y) {
+            for(int x = x0 >> level; x <= (x1 >> level); ++x) {
+                const size_t i = (size_t)y * texels.width + x;
+                regionMin = std::min(regionMin, minDepth[i]);
+                regionMax = std::max(regionMax, texels.maxDepth[i]);
+            }
+        }
+        if(nearest > regionMax) {
+            return false; // behind the farthest occluder depth everywhere it covers
+        }
+        if(nearest <= regionMin || level == 0) {
+            return true;
+        }
+        --level;
+        const int reads = ((x1 >> level) - (x0 >> level) + 1) * ((y1 >> level) - (y0 >> level) + 1);
+        if(reads > MaxRefineTexels) {
+            return true;
+        }
+    }
+}
+
+size_t OcclusionCuller::Filter(const BoundsSoA& bounds, std::vector<uint32_t>& drawList) {
+    mVisible.resize(drawList.size());
+    mJobs.ParallelFor(drawList.size(), [this, &bounds, &drawList](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; ++i) {
+            mVisible[i] = IsVisible(bounds.GetMin(drawList[i]), bounds.GetMax(drawList[i])) ? 1 : 0;
+        }
+    }, 1024);
+
+    size_t kept = 0;
+    for(size_t i = 0; i < drawList.size(); ++i) {
+        if(mVisible[i]) {
+            drawList[kept++] = drawList[i];
+        }
+    }
+    const size_t removed = drawList.size() - kept;
+    drawList.resize(kept);
+    return removed;
+}
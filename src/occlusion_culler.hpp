@@ -0,0 +1,96 @@
+#pragma once
+
+/*
+Software occlusion culling with a hierarchical depth buffer (--occluders <count>).
+
+After frustum culling, a few occluders (the objects closest to the eye) are rasterized on the CPU into a small
+depth buffer; every other object in the draw list is then tested against it and dropped when its bounding box
+lies behind the occluders everywhere it covers on screen.
+
+- Depth is window depth in [0, 1] (z / w of OpenGL clip space remapped); the buffer starts at 1 (far) and each
+  occluder pixel keeps the nearest value. Triangles crossing the near plane are skipped: an occluder that is left
+  out only hides less, it never hides something visible.
+- Occluders are rasterized conservatively: a pixel only takes a triangle that covers all of it (the edge functions
+  are shifted inwards by half a pixel), at the triangle's farthest depth over the pixel. The buffer is much coarser
+  than the screen, so sampling pixel centers would let an occluder claim pixels it only partly covers and hide
+  boxes that show around its silhouette.
+- Rasterization runs on the job system in bands of rows; the AVX2 kernel covers 8 pixels of a row per op with
+  the three edge functions and the depth plane, the scalar one does the same per pixel.
+- BuildPyramid() reduces the buffer into a min/max pyramid (level k texel = min and max of its 2x2 children).
+- A box test projects the 8 corners, takes their nearest depth and the pixel rectangle they cover, starts at
+  the level where that rectangle is at most 2x2 texels and refines: behind the farthest occluder depth of the
+  region = hidden, in front of the nearest one = visible, otherwise one level finer.
+*/
+
+#include "culling.hpp"
+#include "job_system.hpp"
+#include "cpu_features.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class OcclusionCuller {
+public:
+    static const int DefaultWidth = 256;
+    static const int DefaultHeight = 128;
+
+    // 'width' is rounded up to a multiple of 8 (one AVX2 register per 8 pixels)
+    OcclusionCuller(JobSystem& jobs, int width = DefaultWidth, int height = DefaultHeight);
+
+    OcclusionCuller(const OcclusionCuller&) = delete;
+    OcclusionCuller& operator=(const OcclusionCuller&) = delete;
+
+    // Clears the depth buffer. 'viewProjection' maps the space of the bounds and of the occluder instance
+    // matrices to clip space (for the scene: projection * view * u_ModelMatrix).
+    void Begin(const glm::mat4& viewProjection);
+
+    // Rasterizes one copy of the triangle list per instance matrix; positions are the first 3 floats of each vertex
+    void RasterizeOccluders(const float* vertices, size_t vertexCount, size_t strideFloats, const uint32_t* indices,
+                            size_t indexCount, const glm::mat4* instanceMatrices, size_t instanceCount);
+
+    // Call after the occluders, before testing
+    void BuildPyramid();
+
+    // False only when the box is certainly hidden behind the occluders
+    bool IsVisible(const glm::vec3& aabbMin, const glm::vec3& aabbMax) const;
+
+    // Removes the hidden objects from 'drawList', keeping the order of the rest. Returns how many were removed.
+    size_t Filter(const BoundsSoA& bounds, std::vector<uint32_t>& drawList);
+
+    int Width() const { return mWidth; }
+    int Height() const { return mHeight; }
+    const std::vector<float>& Depth() const { return mLevels[0].maxDepth; } // bottom row first
+
+private:
+    struct Level {
+        int width = 0;
+        int height = 0;
+        std::vector<float> minDepth; // nearest occluder depth in the texel's region
+        std::vector<float> maxDepth; // farthest one, 1 where any pixel has no occluder
+    };
+
+    // A screen-space triangle after setup: E(x, y) = A x + B y + C >= 0 inside, depth z = a x + b y + c
+    struct Triangle {
+        float edgeA[3], edgeB[3], edgeC[3];
+        float depthA, depthB, depthC;
+        int minX, minY, maxX, maxY;
+    };
+
+    static const int BandHeight = 8;
+    static const int MaxRefineTexels = 64; // stop refining once a level would need more texel reads than this
+
+    void SetupTriangle(const glm::vec4& v0, const glm::vec4& v1, const glm::vec4& v2, std::vector<Triangle>& out) const;
+
+    JobSystem& mJobs;
+    SimdLevel mSimd;
+    int mWidth;
+    int mHeight;
+    glm::mat4 mViewProjection = glm::mat4(1.0f);
+    std::vector<Level> mLevels;               // [0] is the depth buffer itself, kept in maxDepth only
+    std::vector<glm::vec4> mScreenVertices;   // window x, y, depth and w of every occluder vertex
+    std::vector<std::vector<Triangle>> mSetup; // per setup chunk, reused between frames
+    std::vector<uint8_t> mVisible;            // Filter() scratch
+};
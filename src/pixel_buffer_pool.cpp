@@ -0,0 +1,182 @@
+#include "pixel_buffer_pool.hpp"
+
+#include <iostream>
+
+PixelBufferPool::PixelBufferPool(size_t capacity) : mCapacity(capacity) {
+    glGenBuffers(1, &mBuffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mBuffer);
+
+    if(GLAD_GL_ARB_buffer_storage) {
+        // client storage: staging memory should live in system RAM, the GPU pulls from it during the copy
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)mCapacity, nullptr, flags | GL_CLIENT_STORAGE_BIT);
+        mMapped = (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr)mCapacity, flags);
+        if(mMapped == nullptr) {
+            std::cout << "Persistent mapping of the staging buffer failed, falling back to glMapBufferRange\n";
+            // immutable storage cannot be respecified, start over with a mutable buffer
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            glDeleteBuffers(1, &mBuffer);
+            glGenBuffers(1, &mBuffer);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mBuffer);
+        }
+    }
+    if(mMapped == nullptr) {
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)mCapacity, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+PixelBufferPool::~PixelBufferPool() {
+    for(InFlight& block : mInFlight) {
+        if(block.fence != nullptr) {
+            glDeleteSync(block.fence);
+        }
+    }
+    if(mMapped != nullptr) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mBuffer);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+    glDeleteBuffers(1, &mBuffer);
+}
+
+bool PixelBufferPool::AllocateLocked(size_t size, StagingBlock& block) {
+    size = (size + Alignment - 1) / Alignment * Alignment;
+    if(size == 0 || size > mCapacity) {
+        return false;
+    }
+
+    size_t offset = 0;
+    if(mInFlight.empty()) {
+        offset = 0;
+    }
+    else {
+        const size_t tail = mInFlight.front().offset; // oldest live byte
+        if(mHead > tail) {
+            // live range is [tail, head): free at the end, or wrap to the start
+            if(mCapacity - mHead >= size) {
+                offset = mHead;
+            }
+            else if(tail >= size) {
+                offset = 0;
+            }
+            else {
+                return false;
+            }
+        }
+        else {
+            // wrapped: free range is [head, tail); head == tail means full
+            if(tail - mHead >= size && mHead != tail) {
+                offset = mHead;
+            }
+            else {
+                return false;
+            }
+        }
+    }
+
+    mHead = offset + size;
+    block.buffer = mBuffer;
+    block.offset = offset;
+    block.size = size;
+    block.data = mMapped != nullptr ? mMapped + offset : nullptr;
+    block.id = mNextId++;
+    mInFlight.push_back(InFlight{block.id, offset, size, nullptr, false});
+    return true;
+}
+
+void PixelBufferPool::RetireLocked(bool wait) {
+    while(!mInFlight.empty()) {
+        InFlight& front = mInFlight.front();
+        if(!front.abandoned) {
+            if(front.fence == nullptr) {
+                return; // acquired but not used yet
+            }
+            GLbitfield flags = wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0;
+            GLuint64 timeout = wait ? 1000000000ull : 0; // 1 s, never wait forever on a lost context
+            GLenum result = glClientWaitSync(front.fence, flags, timeout);
+            if(result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED) {
+                return;
+            }
+            glDeleteSync(front.fence);
+            wait = false; // one successful wait per call is enough to make progress
+        }
+        mInFlight.pop_front();
+    }
+}
+
+bool PixelBufferPool::TryAcquire(size_t size, StagingBlock& block) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return AllocateLocked(size, block);
+}
+
+bool PixelBufferPool::Acquire(size_t size, StagingBlock& block) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    RetireLocked(false);
+    while(!AllocateLocked(size, block)) {
+        size_t before = mInFlight.size();
+        if(before == 0 || size > mCapacity) {
+            return false;
+        }
+        RetireLocked(true);
+        if(mInFlight.size() == before) {
+            return false; // the oldest block is still being filled (or its fence timed out)
+        }
+    }
+    return true;
+}
+
+uint8_t* PixelBufferPool::Map(StagingBlock& block) {
+    if(block.data != nullptr) {
+        return block.data;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, block.buffer);
+    block.data = (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, (GLintptr)block.offset, (GLsizeiptr)block.size,
+                                            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return block.data;
+}
+
+void PixelBufferPool::Unmap(StagingBlock& block) {
+    if(mMapped != nullptr || block.data == nullptr) {
+        return; // persistent mappings stay mapped
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, block.buffer);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    block.data = nullptr;
+}
+
+void PixelBufferPool::Release(StagingBlock& block) {
+    if(!block.IsValid()) {
+        return;
+    }
+    GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    std::lock_guard<std::mutex> lock(mMutex);
+    for(InFlight& entry : mInFlight) {
+        if(entry.id == block.id) {
+            entry.fence = fence;
+            break;
+        }
+    }
+    block = StagingBlock();
+}
+
+void PixelBufferPool::Abandon(StagingBlock& block) {
+    if(!block.IsValid()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mMutex);
+    for(InFlight& entry : mInFlight) {
+        if(entry.id == block.id) {
+            entry.abandoned = true;
+            break;
+        }
+    }
+    block = StagingBlock();
+}
+
+void PixelBufferPool::Retire() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    RetireLocked(false);
+}
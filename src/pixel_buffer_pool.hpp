@@ -0,0 +1,91 @@
+#pragma once
+
+/*
+Staging memory for texture uploads: one large GL_PIXEL_UNPACK_BUFFER used as a ring.
+
+    worker thread                         GL thread (upload thread)
+    TryAcquire(size) -> block.data        bind GL_PIXEL_UNPACK_BUFFER
+    write decoded pixels into it          glTexSubImage2D(..., offset)   <- DMA from the buffer, no client copy
+                                          Release(block)                 <- fence; space is reused once it signals
+
+With ARB_buffer_storage the buffer is mapped once, persistently and coherently, so worker threads write
+straight into memory the GPU reads from. Without it the buffer cannot stay mapped while GL uses it; blocks then
+have no CPU pointer and the GL thread fills them through Map()/Unmap() (glMapBufferRange, unsynchronized:
+the fences already guarantee the range is idle).
+
+Blocks are handed out in ring order and their space comes back in the same order, so a block that is still
+being filled holds back the ones acquired after it. Keep blocks short-lived: acquire right before writing.
+Requests larger than the whole ring fail; callers fall back to uploading from client memory.
+*/
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+
+struct StagingBlock {
+    GLuint buffer = 0;
+    size_t offset = 0;       // byte offset in 'buffer', pass as the pixel pointer while it is bound
+    size_t size = 0;
+    uint8_t* data = nullptr; // CPU pointer to the block when persistently mapped, else null until Map()
+    uint64_t id = 0;         // 0 = no block
+
+    bool IsValid() const { return id != 0; }
+    const void* PixelOffset(size_t byteOffset = 0) const { return (const void*)(uintptr_t)(offset + byteOffset); }
+};
+
+class PixelBufferPool {
+public:
+    // GL thread (any context sharing objects with the one that will upload)
+    explicit PixelBufferPool(size_t capacity);
+    ~PixelBufferPool();
+
+    PixelBufferPool(const PixelBufferPool&) = delete;
+    PixelBufferPool& operator=(const PixelBufferPool&) = delete;
+
+    bool IsPersistent() const { return mMapped != nullptr; }
+    size_t Capacity() const { return mCapacity; }
+
+    // Any thread, never blocks: reserves ring space that is free right now
+    bool TryAcquire(size_t size, StagingBlock& block);
+
+    // GL thread: like TryAcquire, but waits for the GPU to finish with older blocks if needed.
+    // Fails if the size exceeds the ring, or if the space is held by a block that was not released yet.
+    bool Acquire(size_t size, StagingBlock& block);
+
+    // GL thread: CPU pointer for writing the block (persistent: block.data; otherwise maps the range)
+    uint8_t* Map(StagingBlock& block);
+    void Unmap(StagingBlock& block);
+
+    // GL thread, after the commands that read the block: fences it
+    void Release(StagingBlock& block);
+    // Any thread: returns a block that was never used by GL (e.g. the decode failed)
+    void Abandon(StagingBlock& block);
+
+    // GL thread: frees the space of blocks whose fence signaled
+    void Retire();
+
+    static const size_t Alignment = 256; // keeps every block aligned for any pixel format / SIMD copy
+
+private:
+    struct InFlight {
+        uint64_t id;
+        size_t offset;
+        size_t size;
+        GLsync fence;   // set by Release
+        bool abandoned;
+    };
+
+    bool AllocateLocked(size_t size, StagingBlock& block);
+    void RetireLocked(bool wait);
+
+    GLuint mBuffer = 0;
+    size_t mCapacity = 0;
+    uint8_t* mMapped = nullptr;
+
+    std::mutex mMutex;
+    std::deque<InFlight> mInFlight; // acquisition (= ring) order
+    size_t mHead = 0;               // next free byte
+    uint64_t mNextId = 1;
+};
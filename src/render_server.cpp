@@ -0,0 +1,444 @@
+#include "render_server.hpp"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+static bool Fail(std::string* error, const std::string& message) {
+    if(error) {
+        *error = message;
+    }
+    return false;
+}
+
+static bool ParseFloat(const std::string& text, float& value) {
+    char* end = nullptr;
+    value = std::strtof(text.c_str(), &end);
+    return !text.empty() && *end == '\0';
+}
+
+static bool ParseInt(const std::string& text, int& value) {
+    char* end = nullptr;
+    const long parsed = std::strtol(text.c_str(), &end, 10);
+    value = (int)parsed;
+    return !text.empty() && *end == '\0';
+}
+
+static bool ParseVec3(const std::string& text, glm::vec3& value) {
+    std::string parts[3];
+    size_t start = 0;
+    for(int i = 0; i < 3; ++i) {
+        const size_t comma = i < 2 ? text.find(',', start) : text.size();
+        if(comma == std::string::npos) {
+            return false;
+        }
+        parts[i] = text.substr(start, comma - start);
+        start = comma + 1;
+    }
+    return ParseFloat(parts[0], value.x) && ParseFloat(parts[1], value.y) && ParseFloat(parts[2], value.z);
+}
+
+bool ParseRenderJob(const std::string& text, RenderJob& job, std::string* error) {
+    std::istringstream stream(text);
+    std::string token;
+    while(stream >> token) {
+        if(token[0] == '#') {
+            // comment until the end of the line
+            std::string rest;
+            std::getline(stream, rest);
+            continue;
+        }
+        const size_t equals = token.find('=');
+        if(equals == std::string::npos) {
+            return Fail(error, "expected key=value, got '" + token + "'");
+        }
+        const std::string key = token.substr(0, equals);
+        const std::string value = token.substr(equals + 1);
+        bool ok = true;
+        if(key == "id") {
+            job.id = value;
+        }
+        else if(key == "mesh") {
+            job.mesh = value;
+        }
+        else if(key == "output") {
+            job.output = value;
+        }
+        else if(key == "width") {
+            ok = ParseInt(value, job.width) && job.width > 0 && job.width <= 16384;
+        }
+        else if(key == "height") {
+            ok = ParseInt(value, job.height) && job.height > 0 && job.height <= 16384;
+        }
+        else if(key == "fov") {
+            ok = ParseFloat(value, job.fov) && job.fov > 0.0f && job.fov < 180.0f;
+        }
+        else if(key == "near") {
+            ok = ParseFloat(value, job.nearPlane) && job.nearPlane > 0.0f;
+        }
+        else if(key == "far") {
+            ok = ParseFloat(value, job.farPlane);
+        }
+        else if(key == "rotate") {
+            ok = ParseFloat(value, job.rotate);
+        }
+        else if(key == "eye") {
+            ok = ParseVec3(value, job.eye);
+        }
+        else if(key == "target") {
+            ok = ParseVec3(value, job.target);
+        }
+        else {
+            return Fail(error, "unknown key '" + key + "'");
+        }
+        if(!ok) {
+            return Fail(error, "bad value for " + key + ": '" + value + "'");
+        }
+    }
+    if(job.output.empty()) {
+        return Fail(error, "no output");
+    }
+    if(job.farPlane <= job.nearPlane) {
+        return Fail(error, "far must be larger than near");
+    }
+    return true;
+}
+
+// ------------------------------------------------------------------ RenderServer ------------------------------------------------------------------
+
+RenderServer::RenderServer(const std::string& spoolDirectory, const std::string& socketPath)
+    : mSpoolDirectory(spoolDirectory), mSocketPath(socketPath) {
+}
+
+RenderServer::~RenderServer() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mQuit = true;
+    }
+    mJobAvailable.notify_all();
+    if(mIoThread.joinable()) {
+        Wake();
+        mIoThread.join();
+    }
+    for(auto& entry : mConnections) {
+        close(entry.second.fd);
+    }
+    if(mListenSocket >= 0) {
+        close(mListenSocket);
+        unlink(mSocketPath.c_str());
+    }
+    for(int fd : mWakePipe) {
+        if(fd >= 0) {
+            close(fd);
+        }
+    }
+}
+
+bool RenderServer::Start(std::string* error) {
+    if(mSpoolDirectory.empty() && mSocketPath.empty()) {
+        return Fail(error, "neither a spool directory nor a socket");
+    }
+    if(pipe2(mWakePipe, O_CLOEXEC | O_NONBLOCK) != 0) {
+        return Fail(error, "cannot create a pipe");
+    }
+
+    if(!mSocketPath.empty()) {
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        if(mSocketPath.size() >= sizeof(address.sun_path)) {
+            return Fail(error, "socket path too long: " + mSocketPath);
+        }
+        std::strcpy(address.sun_path, mSocketPath.c_str());
+        mListenSocket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        unlink(mSocketPath.c_str()); // left over from a server that did not shut down cleanly
+        if(mListenSocket < 0 || bind(mListenSocket, (const sockaddr*)&address, sizeof(address)) != 0 || listen(mListenSocket, 16) != 0) {
+            return Fail(error, "cannot listen on " + mSocketPath + ": " + std::strerror(errno));
+        }
+    }
+    if(!mSpoolDirectory.empty()) {
+        mkdir(mSpoolDirectory.c_str(), 0755);
+    }
+
+    mIoThread = std::thread(&RenderServer::IoThreadMain, this);
+    return true;
+}
+
+bool RenderServer::PopJob(RenderJob& job, int timeoutMs) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    if(mJobs.empty() && timeoutMs > 0) {
+        mJobAvailable.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this] { return !mJobs.empty() || mQuit; });
+    }
+    if(mJobs.empty()) {
+        return false;
+    }
+    job = std::move(mJobs.front());
+    mJobs.pop_front();
+    return true;
+}
+
+void RenderServer::Complete(const RenderJob& job, bool ok, const std::string& message) {
+    if(job.connection != 0) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mReplies.emplace_back(job.connection, (ok ? "done " : "failed ") + job.id + " " + (ok ? job.output : message) + "\n");
+    }
+    else if(!job.spoolFile.empty()) {
+        // "x.job.working" -> "x.job.done" / "x.job.failed"
+        const std::string base = job.spoolFile.substr(0, job.spoolFile.size() - std::strlen(".working"));
+        const std::string finished = base + (ok ? ".done" : ".failed");
+        if(!ok) {
+            std::ofstream file(job.spoolFile.c_str(), std::ios::app);
+            file << "\n# error: " << message << "\n";
+        }
+        std::rename(job.spoolFile.c_str(), finished.c_str());
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        ++(ok ? mCompleted : mFailed);
+    }
+    if(job.connection != 0) {
+        Wake();
+    }
+}
+
+uint64_t RenderServer::CompletedCount() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mCompleted;
+}
+
+uint64_t RenderServer::FailedCount() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mFailed;
+}
+
+void RenderServer::Wake() {
+    const char byte = 1;
+    (void)!write(mWakePipe[1], &byte, 1); // a full pipe already means "wake up"
+}
+
+void RenderServer::Enqueue(RenderJob job) {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mJobs.push_back(std::move(job));
+    }
+    mJobAvailable.notify_one();
+}
+
+void RenderServer::IoThreadMain() {
+    using Clock = std::chrono::steady_clock;
+    const auto spoolInterval = std::chrono::milliseconds(100);
+    Clock::time_point lastScan = Clock::now() - spoolInterval;
+
+    std::vector<pollfd> descriptors;
+    std::vector<uint64_t> connectionIds;
+    for(;;) {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if(mQuit) {
+                break;
+            }
+        }
+
+        descriptors.clear();
+        connectionIds.clear();
+        descriptors.push_back({mWakePipe[0], POLLIN, 0});
+        if(mListenSocket >= 0) {
+            descriptors.push_back({mListenSocket, POLLIN, 0});
+        }
+        const size_t firstConnection = descriptors.size();
+        for(auto& entry : mConnections) {
+            const short events = POLLIN | (entry.second.output.empty() ? 0 : POLLOUT);
+            descriptors.push_back({entry.second.fd, events, 0});
+            connectionIds.push_back(entry.first);
+        }
+
+        int timeout = -1;
+        if(!mSpoolDirectory.empty()) {
+            const auto untilScan = std::chrono::duration_cast<std::chrono::milliseconds>(lastScan + spoolInterval - Clock::now()).count();
+            timeout = (int)std::max<long long>(0, untilScan);
+        }
+        poll(descriptors.data(), descriptors.size(), timeout);
+
+        if(descriptors[0].revents & POLLIN) {
+            char buffer[64];
+            while(read(mWakePipe[0], buffer, sizeof(buffer)) > 0) {
+            }
+        }
+        FlushReplies(); // new replies and whatever POLLOUT made room for
+
+        if(mListenSocket >= 0 && (descriptors[1].revents & POLLIN)) {
+            const int fd = accept4(mListenSocket, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+            if(fd >= 0) {
+                mConnections[mNextConnection++].fd = fd;
+            }
+        }
+        for(size_t i = firstConnection; i < descriptors.size(); ++i) {
+            if(descriptors[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+                const uint64_t id = connectionIds[i - firstConnection];
+                auto connection = mConnections.find(id);
+                if(connection != mConnections.end()) { // FlushReplies() may have dropped it
+                    ReadConnection(id, connection->second);
+                }
+            }
+        }
+        FlushReplies(); // parse errors of what was just read
+
+        if(!mSpoolDirectory.empty() && Clock::now() - lastScan >= spoolInterval) {
+            ScanSpool();
+            lastScan = Clock::now();
+        }
+    }
+}
+
+void RenderServer::ReadConnection(uint64_t id, Connection& connection) {
+    char buffer[65536];
+    const ssize_t received = recv(connection.fd, buffer, sizeof(buffer), 0);
+    if(received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return;
+    }
+    if(received <= 0) {
+        // closed: jobs already queued still render, their replies are dropped
+        close(connection.fd);
+        mConnections.erase(id);
+        return;
+    }
+    connection.pending.append(buffer, (size_t)received);
+
+    size_t newline;
+    while((newline = connection.pending.find('\n')) != std::string::npos) {
+        std::string line = connection.pending.substr(0, newline);
+        connection.pending.erase(0, newline + 1);
+        if(!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if(line.find_first_not_of(" \t") == std::string::npos) {
+            continue;
+        }
+
+        RenderJob job;
+        job.connection = id;
+        std::string error;
+        const bool ok = ParseRenderJob(line, job, &error);
+        if(job.id.empty()) {
+            job.id = "job" + std::to_string(mNextJobNumber);
+        }
+        ++mNextJobNumber;
+        if(ok) {
+            Enqueue(std::move(job));
+        }
+        else {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mReplies.emplace_back(id, "failed " + job.id + " " + error + "\n");
+            ++mFailed;
+        }
+    }
+}
+
+void RenderServer::FlushReplies() {
+    std::vector<std::pair<uint64_t, std::string>> replies;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        replies.swap(mReplies);
+    }
+    for(const auto& reply : replies) {
+        auto connection = mConnections.find(reply.first);
+        if(connection == mConnections.end()) {
+            continue; // the client went away
+        }
+        connection->second.output += reply.second;
+    }
+
+    // send what each socket takes right now; the rest waits for POLLOUT
+    for(auto connection = mConnections.begin(); connection != mConnections.end();) {
+        if(!connection->second.output.empty() && !WriteConnection(connection->second)) {
+            close(connection->second.fd);
+            connection = mConnections.erase(connection);
+        }
+        else {
+            ++connection;
+        }
+    }
+}
+
+bool RenderServer::WriteConnection(Connection& connection) {
+    size_t sent = 0;
+    while(sent < connection.output.size()) {
+        const ssize_t written = send(connection.fd, connection.output.data() + sent, connection.output.size() - sent, MSG_NOSIGNAL);
+        if(written < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            if(errno != EAGAIN && errno != EWOULDBLOCK) {
+                return false; // broken connection
+            }
+            break; // socket buffer full
+        }
+        sent += (size_t)written;
+    }
+    connection.output.erase(0, sent);
+    return true;
+}
+
+void RenderServer::ScanSpool() {
+    {
+        // leave files for other servers sharing the directory while we have plenty to do
+        std::lock_guard<std::mutex> lock(mMutex);
+        if(mJobs.size() >= 64) {
+            return;
+        }
+    }
+
+    DIR* directory = opendir(mSpoolDirectory.c_str());
+    if(!directory) {
+        return;
+    }
+    std::vector<std::string> names;
+    while(dirent* entry = readdir(directory)) {
+        const std::string name = entry->d_name;
+        // anything else (hidden, "*.tmp", ...) is still being written, see the header
+        if(name.size() > 4 && name[0] != '.' && name.compare(name.size() - 4, 4, ".job") == 0) {
+            names.push_back(name);
+        }
+    }
+    closedir(directory);
+    std::sort(names.begin(), names.end()); // arrival order for the usual timestamped / numbered names
+
+    for(const std::string& name : names) {
+        const std::string path = mSpoolDirectory + "/" + name;
+        const std::string working = path + ".working";
+        if(std::rename(path.c_str(), working.c_str()) != 0) {
+            continue; // another server claimed it first
+        }
+
+        RenderJob job;
+        job.spoolFile = working;
+        std::ifstream file(working.c_str());
+        std::stringstream text;
+        text << file.rdbuf();
+        std::string error;
+        const bool ok = ParseRenderJob(text.str(), job, &error);
+        if(job.id.empty()) {
+            job.id = name.substr(0, name.size() - 4);
+        }
+        ++mNextJobNumber;
+        if(ok) {
+            Enqueue(std::move(job));
+        }
+        else {
+            Complete(job, false, error);
+        }
+    }
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+/*
+Job intake for the batch render server (--serve): many small renders (thumbnails, previews) in one long-running
+process that keeps its GL context, compiled programs and resident meshes between jobs.
+
+A job is a line of whitespace separated key=value pairs:
+
+    mesh=models/chair.obj output=thumbs/chair.png width=256 height=256 eye=0,0.5,2.5 target=0,0,0 fov=45 rotate=30
+
+    id       name used in replies (default: the spool file name or "job<n>")
+    mesh     .obj file, empty/absent = the built-in quad
+    output   .png or .ppm file to write (required)
+    width, height, fov, near, far, rotate (degrees around y), eye, target (x,y,z)
+
+Jobs arrive from
+- a spool directory: every "*.job" file holds one job. It is claimed by renaming it to "*.job.working" (so
+  several servers can share a directory) and renamed to "*.job.done" or "*.job.failed" (with the error
+  appended) once its image is written.
+  The server reads a "*.job" file as soon as it sees the name, so writers must create it under another name
+  (e.g. "x.job.tmp" or ".x.job") and rename() it into place once it is complete; hidden names are skipped.
+- a UNIX stream socket: one job per line; the server answers each with "done <id> <output>" or
+  "failed <id> <error>" when the image is written, so clients can pipeline many requests on one connection.
+
+An I/O thread does all the socket and directory work; the render loop only pops parsed jobs. Its sockets are
+non-blocking: replies a slow client does not read yet wait in that connection's output buffer and never stall
+the other connections or the spool. Complete() may be
+called from any thread (the image writers run on job workers).
+*/
+
+#include <glm/glm.hpp>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct RenderJob {
+    std::string id;
+    std::string mesh;
+    std::string output;
+    int width = 256;
+    int height = 256;
+    float fov = 45.0f;
+    float nearPlane = 0.1f;
+    float farPlane = 100.0f;
+    float rotate = 0.0f;
+    glm::vec3 eye = glm::vec3(0.0f, 0.0f, 3.0f);
+    glm::vec3 target = glm::vec3(0.0f);
+
+    // where the reply goes
+    uint64_t connection = 0;  // socket connection, 0 = spool file
+    std::string spoolFile;    // the claimed "*.job.working" file
+};
+
+bool ParseRenderJob(const std::string& text, RenderJob& job, std::string* error = nullptr);
+
+class RenderServer {
+public:
+    // Either may be empty. With both empty only Enqueue() supplies jobs and Start() is not needed.
+    RenderServer(const std::string& spoolDirectory, const std::string& socketPath);
+    ~RenderServer();
+
+    RenderServer(const RenderServer&) = delete;
+    RenderServer& operator=(const RenderServer&) = delete;
+
+    bool Start(std::string* error = nullptr);
+
+    // Adds a job from inside the process (benchmarks); Complete() only counts it
+    void Enqueue(RenderJob job);
+
+    // Next job in arrival order; waits up to timeoutMs for one
+    bool PopJob(RenderJob& job, int timeoutMs);
+
+    // Reports a finished job to whoever sent it. Any thread.
+    void Complete(const RenderJob& job, bool ok, const std::string& message);
+
+    uint64_t CompletedCount() const;
+    uint64_t FailedCount() const;
+
+private:
+    struct Connection {
+        int fd = -1;         // non-blocking
+        std::string pending; // received bytes without a newline yet
+        std::string output;  // replies the socket has not taken yet, sent on POLLOUT
+    };
+
+    void IoThreadMain();
+    void ScanSpool();
+    void ReadConnection(uint64_t id, Connection& connection);
+    void FlushReplies();
+    bool WriteConnection(Connection& connection);
+    void Wake();
+
+    std::string mSpoolDirectory;
+    std::string mSocketPath;
+    int mListenSocket = -1;
+    int mWakePipe[2] = {-1, -1};
+    std::thread mIoThread;
+
+    // I/O thread only
+    std::map<uint64_t, Connection> mConnections;
+    uint64_t mNextConnection = 1;
+    uint64_t mNextJobNumber = 0;
+
+    mutable std::mutex mMutex; // guards everything below
+    std::condition_variable mJobAvailable;
+    std::deque<RenderJob> mJobs;
+    std::vector<std::pair<uint64_t, std::string>> mReplies; // connection, line
+    uint64_t mCompleted = 0;
+    uint64_t mFailed = 0;
+    bool mQuit = false;
+};
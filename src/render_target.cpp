@@ -0,0 +1,305 @@
+#include "render_target.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+// ------------------------------------------------------------------ RenderTarget ------------------------------------------------------------------
+
+RenderTarget::~RenderTarget() {
+    glDeleteFramebuffers(1, &mFramebuffer);
+    glDeleteTextures(1, &mColor);
+    glDeleteRenderbuffers(1, &mDepth);
+}
+
+bool RenderTarget::Resize(int width, int height) {
+    width = std::max(width, 1);
+    height = std::max(height, 1);
+    if(width == mWidth && height == mHeight) {
+        return true;
+    }
+    mWidth = width;
+    mHeight = height;
+
+    if(mFramebuffer == 0) {
+        glGenFramebuffers(1, &mFramebuffer);
+        glGenTextures(1, &mColor);
+        glGenRenderbuffers(1, &mDepth);
+    }
+
+    // mutable storage: it is reallocated whenever the window size changes
+    glBindTexture(GL_TEXTURE_2D, mColor);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8_ALPHA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindRenderbuffer(GL_RENDERBUFFER, mDepth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mColor, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, mDepth);
+    const bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if(!complete) {
+        std::cout << "Render target " << width << "x" << height << " is incomplete\n";
+    }
+    return complete;
+}
+
+void RenderTarget::Bind(int viewportWidth, int viewportHeight) const {
+    glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+    glViewport(0, 0, viewportWidth, viewportHeight);
+}
+
+// ------------------------------------------------------------------ GpuTimer ------------------------------------------------------------------
+
+GpuTimer::GpuTimer() {
+    glGenQueries(QueryCount, mQueries);
+}
+
+GpuTimer::~GpuTimer() {
+    glDeleteQueries(QueryCount, mQueries);
+}
+
+void GpuTimer::Begin() {
+    mActive = mInFlight < QueryCount;
+    if(mActive) {
+        glBeginQuery(GL_TIME_ELAPSED, mQueries[mNext]);
+    }
+}
+
+void GpuTimer::End() {
+    if(!mActive) {
+        return;
+    }
+    glEndQuery(GL_TIME_ELAPSED);
+    mNext = (mNext + 1) % QueryCount;
+    ++mInFlight;
+    mActive = false;
+}
+
+double GpuTimer::Poll() {
+    double newest = -1.0;
+    while(mInFlight > 0) {
+        GLint available = 0;
+        glGetQueryObjectiv(mQueries[mOldest], GL_QUERY_RESULT_AVAILABLE, &available);
+        if(!available) {
+            break;
+        }
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(mQueries[mOldest], GL_QUERY_RESULT, &nanoseconds);
+        newest = (double)nanoseconds * 1e-6;
+        mOldest = (mOldest + 1) % QueryCount;
+        --mInFlight;
+    }
+    return newest;
+}
+
+// ------------------------------------------------------------------ DynamicResolution ------------------------------------------------------------------
+
+DynamicResolution::DynamicResolution(double targetMilliseconds, float minScale, float maxScale, float step)
+    : mTarget(targetMilliseconds), mMinScale(minScale), mMaxScale(maxScale), mStep(step), mScale(maxScale) {
+}
+
+bool DynamicResolution::AddSample(double gpuMilliseconds) {
+    if(gpuMilliseconds <= 0.0) {
+        return false;
+    }
+    mSmoothed = mSmoothed < 0.0 ? gpuMilliseconds : mSmoothed + (gpuMilliseconds - mSmoothed) * 0.2;
+    if(mHold > 0) {
+        --mHold;
+        return false;
+    }
+
+    // aim a little below the budget so a single slow frame does not miss it. Cost ~ pixels ~ scale^2.
+    const double budget = mTarget * 0.9;
+    float wanted = mScale;
+    if(mSmoothed > budget) {
+        wanted = mScale * (float)std::sqrt(budget / mSmoothed);
+    }
+    else if(mSmoothed < budget * 0.7) {
+        wanted = mScale + mStep; // grow one step at a time, overshooting costs a dropped frame
+    }
+    wanted = std::floor(wanted / mStep + 0.5f) * mStep;
+    wanted = std::min(std::max(wanted, mMinScale), mMaxScale);
+    if(std::fabs(wanted - mScale) < mStep * 0.5f) {
+        return false;
+    }
+
+    // the next samples still come from frames rendered at the old scale; rescale the average instead of
+    // waiting for it to catch up
+    mSmoothed *= (double)(wanted * wanted) / (double)(mScale * mScale);
+    mScale = wanted;
+    mHold = 8;
+    return true;
+}
+
+// ------------------------------------------------------------------ Upscaler ------------------------------------------------------------------
+
+static const char* UpscaleVertexShaderSource = R"(#version 410 core
+uniform vec2 u_UvScale; // rendered part of the source texture
+out vec2 vUv;
+void main()
+{
+    // one triangle covering the viewport: (0, 0), (2, 0), (0, 2)
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    vUv = corner * u_UvScale;
+    gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
+)";
+
+static const char* BilinearFragmentShaderSource = R"(#version 410 core
+in vec2 vUv;
+uniform sampler2D u_Source;
+uniform vec2 u_UvMin; // half a texel inside the rendered part, so nothing outside it bleeds in
+uniform vec2 u_UvMax;
+out vec4 fragColor;
+void main()
+{
+    fragColor = texture(u_Source, clamp(vUv, u_UvMin, u_UvMax));
+}
+)";
+
+static const char* EdgeAwareFragmentShaderSource = R"(#version 410 core
+in vec2 vUv;
+uniform sampler2D u_Source;
+uniform vec2 u_UvMin;
+uniform vec2 u_UvMax;
+uniform vec2 u_TexelSize;
+uniform ivec2 u_SourceMax;  // last rendered texel
+uniform float u_Sharpness;
+out vec4 fragColor;
+
+float Luma(vec3 color) {
+    return dot(color, vec3(0.299, 0.587, 0.114));
+}
+
+void main()
+{
+    vec2 uv = clamp(vUv, u_UvMin, u_UvMax);
+    ivec2 center = ivec2(uv / u_TexelSize);
+
+    // 3x3 neighbourhood of the source texel under this pixel
+    vec3 taps[9];
+    float luma[9];
+    vec3 low = vec3(1.0);
+    vec3 high = vec3(0.0);
+    vec3 mean = vec3(0.0);
+    for(int i = 0; i < 9; ++i) {
+        ivec2 texel = clamp(center + ivec2(i % 3 - 1, i / 3 - 1), ivec2(0), u_SourceMax);
+        taps[i] = texelFetch(u_Source, texel, 0).rgb;
+        luma[i] = Luma(taps[i]);
+        low = min(low, taps[i]);
+        high = max(high, taps[i]);
+        mean += taps[i];
+    }
+    mean /= 9.0;
+
+    // Sobel gradient; the edge runs perpendicular to it
+    float gx = (luma[2] + 2.0 * luma[5] + luma[8]) - (luma[0] + 2.0 * luma[3] + luma[6]);
+    float gy = (luma[6] + 2.0 * luma[7] + luma[8]) - (luma[0] + 2.0 * luma[1] + luma[2]);
+    float strength = length(vec2(gx, gy));
+
+    vec4 bilinear = texture(u_Source, uv);
+    vec3 color = bilinear.rgb;
+    if(strength > 0.02) {
+        // average along the edge: smooths the stair steps of the low resolution without blurring across it
+        vec2 along = vec2(-gy, gx) / strength * u_TexelSize * 0.75;
+        vec3 a = texture(u_Source, clamp(uv + along, u_UvMin, u_UvMax)).rgb;
+        vec3 b = texture(u_Source, clamp(uv - along, u_UvMin, u_UvMax)).rgb;
+        color = mix(color, (a + b + color) / 3.0, clamp(strength * 2.0, 0.0, 1.0));
+    }
+
+    // sharpen, limited to the neighbourhood range so it cannot ring
+    color = clamp(color + (color - mean) * u_Sharpness, low, high);
+    fragColor = vec4(color, bilinear.a);
+}
+)";
+
+static GLuint CompileUpscaleShader(GLenum type, const char* source) {
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+    GLint compiled = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+    if(compiled != GL_TRUE) {
+        char log[1024];
+        glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+        std::cout << "Upscale shader failed to compile:\n" << log << "\n";
+    }
+    return shader;
+}
+
+static GLuint LinkUpscaleProgram(const char* fragmentSource) {
+    GLuint vertexShader = CompileUpscaleShader(GL_VERTEX_SHADER, UpscaleVertexShaderSource);
+    GLuint fragmentShader = CompileUpscaleShader(GL_FRAGMENT_SHADER, fragmentSource);
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    glLinkProgram(program);
+    glDetachShader(program, vertexShader);
+    glDetachShader(program, fragmentShader);
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+    return program;
+}
+
+Upscaler::Upscaler() {
+    glGenVertexArrays(1, &mVertexArray);
+    mPrograms[(int)UpscaleFilter::Bilinear] = LinkUpscaleProgram(BilinearFragmentShaderSource);
+    mPrograms[(int)UpscaleFilter::EdgeAware] = LinkUpscaleProgram(EdgeAwareFragmentShaderSource);
+}
+
+Upscaler::~Upscaler() {
+    for(GLuint program : mPrograms) {
+        glDeleteProgram(program);
+    }
+    glDeleteVertexArrays(1, &mVertexArray);
+}
+
+void Upscaler::Draw(const RenderTarget& source, int sourceWidth, int sourceHeight, UpscaleFilter filter, float sharpness) {
+    const GLuint program = mPrograms[(int)filter];
+    const float texelX = 1.0f / (float)source.Width();
+    const float texelY = 1.0f / (float)source.Height();
+
+    glDisable(GL_DEPTH_TEST);
+    glUseProgram(program);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, source.ColorTexture());
+
+    // a handful of uniforms per frame; the scale changes with the dynamic resolution anyway
+    glUniform1i(glGetUniformLocation(program, "u_Source"), 0);
+    glUniform2f(glGetUniformLocation(program, "u_UvScale"), sourceWidth * texelX, sourceHeight * texelY);
+    glUniform2f(glGetUniformLocation(program, "u_UvMin"), 0.5f * texelX, 0.5f * texelY);
+    glUniform2f(glGetUniformLocation(program, "u_UvMax"), (sourceWidth - 0.5f) * texelX, (sourceHeight - 0.5f) * texelY);
+    if(filter == UpscaleFilter::EdgeAware) {
+        glUniform2f(glGetUniformLocation(program, "u_TexelSize"), texelX, texelY);
+        glUniform2i(glGetUniformLocation(program, "u_SourceMax"), sourceWidth - 1, sourceHeight - 1);
+        glUniform1f(glGetUniformLocation(program, "u_Sharpness"), sharpness);
+    }
+
+    glBindVertexArray(mVertexArray);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+    glUseProgram(0);
+}
+
+bool ParseUpscaleFilter(const char* name, UpscaleFilter& filter) {
+    if(std::strcmp(name, "bilinear") == 0) {
+        filter = UpscaleFilter::Bilinear;
+        return true;
+    }
+    if(std::strcmp(name, "edge") == 0) {
+        filter = UpscaleFilter::EdgeAware;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+/*
+Offscreen rendering and dynamic resolution.
+
+- RenderTarget: a framebuffer object with an sRGB color texture and a depth renderbuffer. It is allocated at the
+  window size; rendering at a lower resolution only shrinks the viewport, so changing the scale never
+  reallocates anything.
+- GpuTimer: GL_TIME_ELAPSED queries in a small ring. Results are picked up a few frames later, once the GPU
+  reports them available, so measuring never stalls the pipeline.
+- DynamicResolution: picks the render scale from the measured GPU time. The scene cost is roughly proportional
+  to the number of pixels (fill rate bound, e.g. llvmpipe), so the scale moves by sqrt(target / measured),
+  smoothed, quantized to steps and held for a few frames after every change so it does not oscillate.
+- Upscaler: draws the rendered part of a target over the bound framebuffer with a fullscreen triangle.
+  Bilinear, or edge-aware: a 3x3 luma gradient gives the local edge direction, the color is averaged along
+  the edge (not across it) and then sharpened within the neighbourhood min/max, so edges stay crisp without
+  stair steps or halos.
+
+Filtering happens in linear light: the color texture is sRGB, GL decodes it when sampling and
+GL_FRAMEBUFFER_SRGB encodes the result again.
+*/
+
+#include <glad/glad.h>
+
+class RenderTarget {
+public:
+    RenderTarget() = default;
+    ~RenderTarget();
+
+    RenderTarget(const RenderTarget&) = delete;
+    RenderTarget& operator=(const RenderTarget&) = delete;
+
+    // (Re)allocates the attachments when the size changed. False if the framebuffer is incomplete.
+    bool Resize(int width, int height);
+
+    // Binds the framebuffer and sets the viewport to its bottom-left viewportWidth x viewportHeight texels
+    void Bind(int viewportWidth, int viewportHeight) const;
+
+    GLuint Framebuffer() const { return mFramebuffer; }
+    GLuint ColorTexture() const { return mColor; }
+    int Width() const { return mWidth; }
+    int Height() const { return mHeight; }
+
+private:
+    GLuint mFramebuffer = 0;
+    GLuint mColor = 0;
+    GLuint mDepth = 0;
+    int mWidth = 0;
+    int mHeight = 0;
+};
+
+class GpuTimer {
+public:
+    GpuTimer(); // needs a current GL context
+    ~GpuTimer();
+
+    GpuTimer(const GpuTimer&) = delete;
+    GpuTimer& operator=(const GpuTimer&) = delete;
+
+    // Brackets the commands to measure; at most one Begin/End pair per frame (time queries cannot nest).
+    // Skipped silently while every query is still waiting for its result.
+    void Begin();
+    void End();
+
+    // Newest measurement that became available since the last call, in milliseconds; negative if none
+    double Poll();
+
+private:
+    static const int QueryCount = 4;
+    GLuint mQueries[QueryCount] = {};
+    int mNext = 0;      // ring position of the next Begin
+    int mOldest = 0;    // ring position of the next result
+    int mInFlight = 0;
+    bool mActive = false;
+};
+
+class DynamicResolution {
+public:
+    DynamicResolution(double targetMilliseconds, float minScale = 0.5f, float maxScale = 1.0f, float step = 0.05f);
+
+    // Feeds one GPU time; returns true if Scale() changed
+    bool AddSample(double gpuMilliseconds);
+
+    float Scale() const { return mScale; }
+    double SmoothedMilliseconds() const { return mSmoothed; }
+
+private:
+    double mTarget;
+    float mMinScale;
+    float mMaxScale;
+    float mStep;
+    float mScale;
+    double mSmoothed = -1.0;
+    int mHold = 0; // samples to ignore after a change, the queued frames still ran at the old scale
+};
+
+enum class UpscaleFilter {
+    Bilinear,
+    EdgeAware,
+};
+
+class Upscaler {
+public:
+    Upscaler(); // compiles its shaders, needs a current GL context
+    ~Upscaler();
+
+    Upscaler(const Upscaler&) = delete;
+    Upscaler& operator=(const Upscaler&) = delete;
+
+    // Stretches the bottom-left sourceWidth x sourceHeight texels of 'source' over the current viewport
+    void Draw(const RenderTarget& source, int sourceWidth, int sourceHeight, UpscaleFilter filter, float sharpness = 0.35f);
+
+private:
+    GLuint mVertexArray = 0; // empty, the triangle comes from gl_VertexID
+    GLuint mPrograms[2] = {};
+};
+
+bool ParseUpscaleFilter(const char* name, UpscaleFilter& filter); // "bilinear" or "edge"
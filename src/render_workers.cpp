@@ -0,0 +1,233 @@
+#include "render_workers.hpp"
+
+#include "camera.hpp"
+#include "render_target.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+RenderWorkers::RenderWorkers(JobSystem& jobs, SDL_Window* mainWindow, SDL_GLContext mainContext, const RenderWorkerScene& scene,
+                             const FrameCaptureOptions& capture, int count, CompletionCallback done)
+    : mJobs(jobs), mMainWindow(mainWindow), mMainContext(mainContext), mScene(scene), mCapture(capture), mDone(std::move(done)) {
+
+    for(int i = 0; i < count; ++i) {
+        // like the upload context: a hidden window of its own, so no two threads ever bind the same drawable
+        std::unique_ptr<Worker> worker = std::make_unique<Worker>();
+        worker->window = SDL_CreateWindow("render worker", 0, 0, 1, 1, SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+        if(worker->window != nullptr) {
+            SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 1);
+            worker->context = SDL_GL_CreateContext(worker->window); // also makes it current on this thread
+            SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 0);
+            SDL_GL_MakeCurrent(mMainWindow, mMainContext);
+        }
+        if(worker->context == nullptr) {
+            std::cout << "Render context " << i << " not available (" << SDL_GetError() << ")\n";
+            if(worker->window != nullptr) {
+                SDL_DestroyWindow(worker->window);
+            }
+            break;
+        }
+        mWorkers.push_back(std::move(worker));
+    }
+
+    // shared objects the main context created must be complete before another context uses them
+    glFinish();
+    for(std::unique_ptr<Worker>& worker : mWorkers) {
+        worker->thread = std::thread(&RenderWorkers::WorkerMain, this, std::ref(*worker));
+    }
+}
+
+RenderWorkers::~RenderWorkers() {
+    Finish();
+    for(std::unique_ptr<Worker>& worker : mWorkers) {
+        SDL_GL_DeleteContext(worker->context);
+        SDL_DestroyWindow(worker->window);
+    }
+}
+
+bool RenderWorkers::Submit(const RenderJob& job, const MeshHandle& mesh) {
+    Worker* best = nullptr;
+    size_t bestQueued = MaxQueuedJobs;
+    for(std::unique_ptr<Worker>& worker : mWorkers) {
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        if(worker->tasks.size() < bestQueued) {
+            best = worker.get();
+            bestQueued = worker->tasks.size();
+        }
+    }
+    if(best == nullptr) {
+        return false;
+    }
+
+    ++mOutstanding;
+    {
+        std::lock_guard<std::mutex> lock(best->mutex);
+        best->tasks.push_back(Task{job, mesh});
+    }
+    best->wake.notify_one();
+    return true;
+}
+
+std::vector<uint64_t> RenderWorkers::RenderedCounts() const {
+    std::vector<uint64_t> counts;
+    for(const std::unique_ptr<Worker>& worker : mWorkers) {
+        counts.push_back(worker->rendered.load());
+    }
+    return counts;
+}
+
+void RenderWorkers::Finish() {
+    for(std::unique_ptr<Worker>& worker : mWorkers) {
+        {
+            std::lock_guard<std::mutex> lock(worker->mutex);
+            worker->quit = true;
+        }
+        worker->wake.notify_one();
+    }
+    for(std::unique_ptr<Worker>& worker : mWorkers) {
+        if(worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+}
+
+void RenderWorkers::ReloadProgram(std::function<GLuint()> createProgram) {
+    std::lock_guard<std::mutex> lock(mProgramMutex);
+    mScene.createProgram = std::move(createProgram);
+    ++mProgramVersion;
+}
+
+void RenderWorkers::Complete(const RenderJob& job, bool ok, const std::string& message) {
+    mDone(job, ok, message);
+    --mOutstanding;
+}
+
+void RenderWorkers::WorkerMain(Worker& worker) {
+    SDL_GL_MakeCurrent(worker.window, worker.context);
+
+    // everything below belongs to this context and goes away before it is released
+    {
+        uint64_t programVersion = 0;
+        GLuint program = 0;
+        {
+            std::lock_guard<std::mutex> lock(mProgramMutex);
+            programVersion = mProgramVersion.load();
+            program = mScene.createProgram();
+        }
+        GLint modelMatrixLocation = glGetUniformLocation(program, "u_ModelMatrix");
+        Camera camera;      // uploads u_View / u_Projection only when the job's camera differs from the last one
+        RenderTarget target; // grows to the largest job, smaller jobs use its bottom-left corner
+        FrameCapture capture(mJobs, mCapture);
+        GLuint vertexArray = 0;
+        MeshHandle boundMesh; // keeps the mesh (and the buffers the VAO points at) out of the server's eviction
+
+        for(;;) {
+            Task task;
+            bool haveTask = false;
+            {
+                std::unique_lock<std::mutex> lock(worker.mutex);
+                auto woken = [&worker] { return worker.quit || !worker.tasks.empty(); };
+                if(capture.HasPendingWork()) {
+                    worker.wake.wait_for(lock, std::chrono::milliseconds(1), woken); // the readback fences need polling
+                }
+                else {
+                    worker.wake.wait(lock, woken);
+                }
+                if(!worker.tasks.empty()) {
+                    task = std::move(worker.tasks.front());
+                    worker.tasks.pop_front();
+                    haveTask = true;
+                }
+                else if(worker.quit) {
+                    break;
+                }
+            }
+
+            if(haveTask && programVersion != mProgramVersion.load()) {
+                std::function<GLuint()> createProgram;
+                {
+                    std::lock_guard<std::mutex> lock(mProgramMutex);
+                    programVersion = mProgramVersion.load();
+                    createProgram = mScene.createProgram;
+                }
+                const GLuint replacement = createProgram();
+                GLint linked = GL_FALSE;
+                glGetProgramiv(replacement, GL_LINK_STATUS, &linked);
+                if(linked == GL_TRUE) {
+                    glDeleteProgram(program);
+                    program = replacement;
+                    modelMatrixLocation = glGetUniformLocation(program, "u_ModelMatrix"); // the camera notices the new name
+                }
+                else {
+                    glDeleteProgram(replacement);
+                }
+            }
+
+            if(haveTask) {
+                const RenderJob& job = task.job;
+                if(task.mesh != boundMesh) {
+                    if(vertexArray != 0) {
+                        glDeleteVertexArrays(1, &vertexArray);
+                    }
+                    vertexArray = mScene.createVertexArray(task.mesh->vertexBuffer, task.mesh->indexBuffer,
+                                                           mScene.instanceBuffer, mScene.materialBuffer);
+                    boundMesh = task.mesh;
+                }
+
+                if(!target.Resize(std::max(target.Width(), job.width), std::max(target.Height(), job.height))) {
+                    Complete(job, false, "framebuffer incomplete");
+                    continue;
+                }
+                target.Bind(job.width, job.height);
+                glDisable(GL_DEPTH_TEST);
+                glDisable(GL_CULL_FACE);
+                glEnable(GL_FRAMEBUFFER_SRGB);
+                glClearColor(mScene.clearColor.x, mScene.clearColor.y, mScene.clearColor.z, mScene.clearColor.w);
+                glEnable(GL_SCISSOR_TEST);
+                glScissor(0, 0, job.width, job.height);
+                glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
+                glDisable(GL_SCISSOR_TEST);
+
+                glUseProgram(program);
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D, mScene.texture);
+
+                // the rotation of the scene root, which every object inherits
+                const glm::mat4 model = mScene.rootMatrix * glm::rotate(glm::mat4(1.0f), glm::radians(job.rotate), glm::vec3(0.0f, 1.0f, 0.0f));
+                glUniformMatrix4fv(modelMatrixLocation, 1, GL_FALSE, &model[0][0]);
+                camera.SetViewport(job.width, job.height);
+                camera.SetPerspective(job.fov, job.nearPlane, job.farPlane);
+                camera.LookAt(job.eye, job.target);
+                if(modelMatrixLocation < 0 || !camera.Upload(program)) {
+                    glUseProgram(0);
+                    Complete(job, false, "the scene program is missing a uniform");
+                    continue;
+                }
+
+                // no culling here: every object goes to the GPU, which clips what is off screen
+                glBindVertexArray(vertexArray);
+                glDrawElementsInstanced(GL_TRIANGLES, task.mesh->indexCount, GL_UNSIGNED_INT, 0, mScene.instanceCount);
+                glBindVertexArray(0);
+                glUseProgram(0);
+
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, target.Framebuffer());
+                capture.Capture(job.width, job.height, job.output, [this, job](bool ok, const std::string& error) {
+                    Complete(job, ok, error);
+                });
+                ++worker.rendered;
+            }
+            capture.Update();
+        }
+
+        capture.Finish();
+        if(vertexArray != 0) {
+            glDeleteVertexArrays(1, &vertexArray);
+        }
+        glDeleteProgram(program);
+    }
+
+    SDL_GL_MakeCurrent(worker.window, nullptr);
+}
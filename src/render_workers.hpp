@@ -0,0 +1,123 @@
+#pragma once
+
+/*
+Batch rendering on several GL contexts at once (--serve-contexts <n>).
+
+Without a GPU every context is a software renderer (llvmpipe). Its rasterizer threads (LP_NUM_THREADS) only
+cover the fragment work inside a draw; vertex processing, state validation, the readback and everything the
+application does between draws run on the one thread that owns the context. Small jobs (thumbnails) are
+dominated by exactly that part, so N contexts driven by N threads render N jobs at the same time.
+
+- Every worker thread owns a context created with SDL_GL_SHARE_WITH_CURRENT_CONTEXT on its own hidden window,
+  in the share group of the main and upload contexts. With SDL's offscreen, Wayland or KMSDRM video drivers it
+  is an EGL context, on X11 a GLX one; the window surface is never drawn to either way.
+- Shared and read-only: mesh buffers, the texture and the instance buffers of the scene.
+- Per context: the framebuffer (RenderTarget), the VAO (container objects are never shared), a FrameCapture
+  ring and a link of the scene program - uniform values live in the program object, so two contexts drawing
+  different cameras at the same time cannot use the same one. ReloadProgram() (shader hot reload) has every
+  worker relink its copy before its next job; a worker whose link fails keeps drawing with the old one.
+- Submit() hands a job to the worker with the fewest queued jobs. Each worker queues only a few; the rest wait
+  on the main thread, which keeps prefetching their meshes.
+*/
+
+#include <SDL2/SDL.h>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "frame_capture.hpp"
+#include "job_system.hpp"
+#include "render_server.hpp"
+#include "resource_manager.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// What the workers draw: the scene instanced over 'instanceCount' objects, with the job's mesh and camera
+struct RenderWorkerScene {
+    GLuint texture = 0;          // unit 0
+    GLuint instanceBuffer = 0;   // world matrix of every object with the scene root at the identity
+    GLuint materialBuffer = 0;   // per-object atlas UV rect, 0 = no atlas
+    GLsizei instanceCount = 1;
+    glm::mat4 rootMatrix = glm::mat4(1.0f); // u_ModelMatrix = rootMatrix * the job's rotation
+    glm::vec4 clearColor = glm::vec4(1.0f, 1.0f, 0.0f, 1.0f);
+
+    // Called on each worker thread with its context current
+    std::function<GLuint()> createProgram;
+    std::function<GLuint(GLuint vertexBuffer, GLuint indexBuffer, GLuint instanceBuffer, GLuint materialBuffer)> createVertexArray;
+};
+
+class RenderWorkers {
+public:
+    // Called once the job's image is written or the job failed, on a worker or job thread
+    using CompletionCallback = std::function<void(const RenderJob&, bool, const std::string&)>;
+
+    // Main thread with the main context current: SDL creates contexts there, they are handed to the workers.
+    // Contexts the driver refuses are skipped, Count() tells how many run.
+    RenderWorkers(JobSystem& jobs, SDL_Window* mainWindow, SDL_GLContext mainContext, const RenderWorkerScene& scene,
+                  const FrameCaptureOptions& capture, int count, CompletionCallback done);
+    ~RenderWorkers(); // Finish()
+
+    RenderWorkers(const RenderWorkers&) = delete;
+    RenderWorkers& operator=(const RenderWorkers&) = delete;
+
+    int Count() const { return (int)mWorkers.size(); }
+
+    // Queues the job on the least busy worker. False if every worker already has MaxQueuedJobs waiting.
+    // 'mesh' must be Ready; the worker holds on to it until it draws with another mesh.
+    bool Submit(const RenderJob& job, const MeshHandle& mesh);
+
+    // Submitted and not completed yet
+    size_t Outstanding() const { return mOutstanding.load(); }
+
+    // Replaces RenderWorkerScene::createProgram; each worker calls it before its next job
+    void ReloadProgram(std::function<GLuint()> createProgram);
+
+    // Jobs drawn by each worker so far
+    std::vector<uint64_t> RenderedCounts() const;
+
+    // Draws and writes everything submitted, then stops the threads
+    void Finish();
+
+private:
+    struct Task {
+        RenderJob job;
+        MeshHandle mesh;
+    };
+
+    struct Worker {
+        SDL_Window* window = nullptr;
+        SDL_GLContext context = nullptr;
+        std::thread thread;
+        std::atomic<uint64_t> rendered{0};
+
+        std::mutex mutex; // guards the members below
+        std::condition_variable wake;
+        std::deque<Task> tasks;
+        bool quit = false;
+    };
+
+    static const size_t MaxQueuedJobs = 2;
+
+    void WorkerMain(Worker& worker);
+    void Complete(const RenderJob& job, bool ok, const std::string& message);
+
+    JobSystem& mJobs;
+    SDL_Window* mMainWindow;
+    SDL_GLContext mMainContext;
+    RenderWorkerScene mScene;
+    FrameCaptureOptions mCapture;
+    CompletionCallback mDone;
+    std::vector<std::unique_ptr<Worker>> mWorkers;
+    std::atomic<size_t> mOutstanding{0};
+
+    std::mutex mProgramMutex;                // guards mScene.createProgram once the workers run
+    std::atomic<uint64_t> mProgramVersion{0}; // incremented by ReloadProgram()
+};
@@ -0,0 +1,788 @@
+#include "resource_manager.hpp"
+#include "job_system.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+
+// fits a 4096x4096 RGBA8 texture with its full mip chain (~85 MiB)
+static const size_t StagingBufferBytes = 96u << 20;
+
+// ------------------------------------------------------------------------------------------------------------------
+// helpers that run with a GL context current (upload thread or main thread)
+// ------------------------------------------------------------------------------------------------------------------
+
+static GLuint CompileShaderChecked(GLenum type, const std::string& source, std::string& log) {
+    GLuint shader = glCreateShader(type);
+    const char* src = source.c_str();
+    glShaderSource(shader, 1, &src, nullptr);
+    glCompileShader(shader);
+
+    GLint status = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if(status != GL_TRUE) {
+        GLint length = 0;
+        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+        std::string message(length > 0 ? length : 1, '\0');
+        glGetShaderInfoLog(shader, (GLsizei)message.size(), nullptr, &message[0]);
+        log += message;
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+static GLuint LinkProgramChecked(const std::string& vertexSource, const std::string& fragmentSource, std::string& log) {
+    GLuint vertexShader = CompileShaderChecked(GL_VERTEX_SHADER, vertexSource, log);
+    GLuint fragmentShader = CompileShaderChecked(GL_FRAGMENT_SHADER, fragmentSource, log);
+    if(vertexShader == 0 || fragmentShader == 0) {
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    glLinkProgram(program);
+    glDetachShader(program, vertexShader);
+    glDetachShader(program, fragmentShader);
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+
+    GLint status = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if(status != GL_TRUE) {
+        GLint length = 0;
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+        std::string message(length > 0 ? length : 1, '\0');
+        glGetProgramInfoLog(program, (GLsizei)message.size(), nullptr, &message[0]);
+        log += message;
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+// Texture level payloads: RGBA8 pixels or compressed blocks, uploaded the same way
+static const std::vector<uint8_t>& LevelBytes(const Image& image) { return image.pixels; }
+static const std::vector<uint8_t>& LevelBytes(const CompressedLevel& level) { return level.blocks; }
+
+// Sizes come from the dimensions for RGBA8, so they survive ReleaseLevel(); compressed levels keep their blocks
+// (a quarter to an eighth of the pixels, and their size is the only record of the level's size)
+static size_t LevelSize(const Image& image) { return image.ByteSize(); }
+static size_t LevelSize(const CompressedLevel& level) { return level.ByteSize(); }
+static void ReleaseLevel(Image& image) { std::vector<uint8_t>().swap(image.pixels); }
+static void ReleaseLevel(CompressedLevel&) {}
+
+template<typename Level>
+static size_t MipChainBytes(const std::vector<Level>& levels) {
+    size_t bytes = 0;
+    for(const Level& level : levels) {
+        bytes += LevelSize(level);
+    }
+    return bytes;
+}
+
+// Copies the chain level after level into 'destination'; the levels' CPU copies of the pixels are released
+template<typename Level>
+static void CopyMipChain(std::vector<Level>& levels, uint8_t* destination) {
+    for(Level& level : levels) {
+        const std::vector<uint8_t>& bytes = LevelBytes(level);
+        std::memcpy(destination, bytes.data(), bytes.size());
+        destination += bytes.size();
+        ReleaseLevel(level);
+    }
+}
+
+// GL thread: if the worker could not get staging space (ring was busy, or not persistently mapped), copy here.
+// Leaves 'staging' invalid if even that fails; the upload then reads client memory.
+template<typename Level>
+static void StageMipChain(PixelBufferPool& pool, std::vector<Level>& levels, StagingBlock& staging) {
+    if(staging.IsValid() || !pool.Acquire(MipChainBytes(levels), staging)) {
+        return;
+    }
+    uint8_t* destination = pool.Map(staging);
+    if(destination != nullptr) {
+        CopyMipChain(levels, destination);
+        pool.Unmap(staging);
+    }
+    else {
+        pool.Abandon(staging);
+    }
+}
+
+// Source "pointer" of every level: a byte offset into the bound GL_PIXEL_UNPACK_BUFFER, or client memory
+template<typename Level>
+static std::vector<const void*> LevelSources(const std::vector<Level>& levels, const StagingBlock& staging) {
+    std::vector<const void*> sources;
+    size_t offset = 0;
+    for(const Level& level : levels) {
+        sources.push_back(staging.IsValid() ? staging.PixelOffset(offset) : (const void*)LevelBytes(level).data());
+        offset += LevelSize(level);
+    }
+    return sources;
+}
+
+static void SetTextureSampling(GLenum target, size_t levelCount, GLenum wrap) {
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, levelCount > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, wrap);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, wrap);
+}
+
+// Creates the texture object and fills every level. With a staging block the pixels come from the bound
+// GL_PIXEL_UNPACK_BUFFER, otherwise from client memory.
+static void UploadTexture(TextureResource& texture, std::vector<Image>& levels, PixelBufferPool& pool, StagingBlock& staging) {
+    const GLenum internalFormat = texture.options.srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+
+    StageMipChain(pool, levels, staging);
+    const std::vector<const void*> sources = LevelSources(levels, staging);
+
+    glGenTextures(1, &texture.texture);
+    glBindTexture(GL_TEXTURE_2D, texture.texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4); // RGBA8 rows are always 4-byte aligned
+    if(staging.IsValid()) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging.buffer);
+    }
+
+    if(GLAD_GL_ARB_texture_storage) {
+        // immutable storage: allocated once, the driver does not have to validate the chain at draw time
+        glTexStorage2D(GL_TEXTURE_2D, (GLsizei)levels.size(), internalFormat, texture.width, texture.height);
+        for(size_t level = 0; level < levels.size(); ++level) {
+            const Image& image = levels[level];
+            glTexSubImage2D(GL_TEXTURE_2D, (GLint)level, 0, 0, image.width, image.height, GL_RGBA, GL_UNSIGNED_BYTE, sources[level]);
+        }
+    }
+    else {
+        for(size_t level = 0; level < levels.size(); ++level) {
+            const Image& image = levels[level];
+            glTexImage2D(GL_TEXTURE_2D, (GLint)level, internalFormat, image.width, image.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, sources[level]);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levels.size() - 1);
+    }
+
+    // an atlas must not wrap into its neighbours' padding at the edges
+    SetTextureSampling(GL_TEXTURE_2D, levels.size(), texture.regions.empty() ? GL_REPEAT : GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    if(staging.IsValid()) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        pool.Release(staging); // reusable once the GPU has pulled the pixels
+    }
+}
+
+// Same for block-compressed data: the driver copies the blocks as they are, no conversion on any thread
+static void UploadCompressedTexture(TextureResource& texture, CompressedTexture& compressed, PixelBufferPool& pool, StagingBlock& staging) {
+    const GLenum internalFormat = CompressedInternalFormat(compressed.format, compressed.srgb);
+
+    StageMipChain(pool, compressed.levels, staging);
+    const std::vector<const void*> sources = LevelSources(compressed.levels, staging);
+
+    glGenTextures(1, &texture.texture);
+    glBindTexture(GL_TEXTURE_2D, texture.texture);
+    if(staging.IsValid()) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging.buffer);
+    }
+
+    for(size_t level = 0; level < compressed.levels.size(); ++level) {
+        const CompressedLevel& data = compressed.levels[level];
+        glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)level, internalFormat, data.width, data.height, 0,
+                               (GLsizei)data.ByteSize(), sources[level]);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)compressed.levels.size() - 1);
+
+    SetTextureSampling(GL_TEXTURE_2D, compressed.levels.size(), GL_REPEAT);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    if(staging.IsValid()) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        pool.Release(staging);
+    }
+}
+
+// Array textures: 'levels' holds every layer's chain, layer after layer (levelCount images each)
+static void UploadTextureArray(TextureResource& texture, std::vector<Image>& levels, size_t levelCount,
+                               PixelBufferPool& pool, StagingBlock& staging) {
+    const GLenum internalFormat = texture.options.srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+
+    StageMipChain(pool, levels, staging);
+    const std::vector<const void*> sources = LevelSources(levels, staging);
+
+    glGenTextures(1, &texture.texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture.texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    // allocate every level first, while no unpack buffer is bound (a null pointer would read from it)
+    if(GLAD_GL_ARB_texture_storage) {
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, (GLsizei)levelCount, internalFormat, texture.width, texture.height, texture.layers);
+    }
+    else {
+        for(size_t level = 0; level < levelCount; ++level) {
+            const Image& image = levels[level];
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, (GLint)level, internalFormat, image.width, image.height, texture.layers, 0,
+                         GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        }
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, (GLint)levelCount - 1);
+    }
+
+    if(staging.IsValid()) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging.buffer);
+    }
+    for(int layer = 0; layer < texture.layers; ++layer) {
+        for(size_t level = 0; level < levelCount; ++level) {
+            const size_t index = layer * levelCount + level;
+            const Image& image = levels[index];
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, (GLint)level, 0, 0, layer, image.width, image.height, 1,
+                            GL_RGBA, GL_UNSIGNED_BYTE, sources[index]);
+        }
+    }
+
+    SetTextureSampling(GL_TEXTURE_2D_ARRAY, levelCount, GL_REPEAT);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    if(staging.IsValid()) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        pool.Release(staging);
+    }
+}
+
+// ------------------------------------------------------------------------------------------------------------------
+// ResourceManager
+// ------------------------------------------------------------------------------------------------------------------
+
+ResourceManager::ResourceManager(JobSystem& jobs, SDL_Window* mainWindow, SDL_GLContext mainContext)
+    : mJobs(jobs), mMainWindow(mainWindow), mMainContext(mainContext) {
+
+    // The upload context gets its own hidden window so the two threads never bind the same drawable
+    mUploadWindow = SDL_CreateWindow("upload", 0, 0, 1, 1, SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+    if(mUploadWindow != nullptr) {
+        SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 1);
+        mUploadContext = SDL_GL_CreateContext(mUploadWindow); // also makes it current on this thread
+        SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 0);
+        SDL_GL_MakeCurrent(mMainWindow, mMainContext);
+    }
+
+    if(mUploadContext == nullptr) {
+        std::cout << "Shared upload context not available (" << SDL_GetError() << "), uploading on the main thread\n";
+        if(mUploadWindow != nullptr) {
+            SDL_DestroyWindow(mUploadWindow);
+            mUploadWindow = nullptr;
+        }
+        return;
+    }
+
+    mUploadThread = std::thread(&ResourceManager::UploadThreadMain, this);
+}
+
+ResourceManager::~ResourceManager() {
+    // decode jobs still in flight would call back into us; they may queue more while we wait, so take the list
+    // under the lock until it stays empty
+    for(;;) {
+        std::vector<JobHandle> jobs;
+        {
+            std::lock_guard<std::mutex> lock(mDecodeJobsMutex);
+            jobs.swap(mDecodeJobs);
+        }
+        if(jobs.empty()) {
+            break;
+        }
+        for(const JobHandle& job : jobs) {
+            mJobs.Wait(job);
+        }
+    }
+
+    if(mUploadThread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mUploadMutex);
+            mQuit = true;
+        }
+        mUploadCondition.notify_one();
+        mUploadThread.join();
+    }
+
+    for(FencedTask& task : mFenced) {
+        glDeleteSync(task.fence);
+    }
+    mPixelPool.reset(); // main context is current again
+
+    if(mUploadContext != nullptr) {
+        SDL_GL_DeleteContext(mUploadContext);
+    }
+    if(mUploadWindow != nullptr) {
+        SDL_DestroyWindow(mUploadWindow);
+    }
+}
+
+bool ResourceManager::ReadBinaryFile(const std::string& path, std::vector<uint8_t>& bytes) {
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if(!file.is_open()) {
+        return false;
+    }
+    bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+std::string ResourceManager::ReadTextFile(const std::string& path) {
+    std::ifstream file(path.c_str());
+    if(!file.is_open()) {
+        return "";
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    return buffer.str();
+}
+
+void ResourceManager::CreatePixelPool() {
+    // buffer objects are shared, so the pool can be created on the main context and used from the upload
+    // context; the workers only see it through jobs queued after this
+    if(!mPixelPool) {
+        mPixelPool = std::make_unique<PixelBufferPool>(StagingBufferBytes);
+    }
+}
+
+PixelBufferPool& ResourceManager::GetPixelBufferPool() {
+    CreatePixelPool();
+    return *mPixelPool;
+}
+
+void ResourceManager::RunDecodeJob(std::function<void()> job) {
+    std::lock_guard<std::mutex> lock(mDecodeJobsMutex);
+    mDecodeJobs.push_back(mJobs.Run(std::move(job)));
+}
+
+size_t ResourceManager::RunQueuedDecodeJobs() {
+    // a copy: the jobs may queue further decode jobs
+    std::vector<JobHandle> jobs;
+    {
+        std::lock_guard<std::mutex> lock(mDecodeJobsMutex);
+        jobs = mDecodeJobs;
+    }
+    size_t ran = 0;
+    for(const JobHandle& job : jobs) {
+        ran += mJobs.TryRun(job) ? 1 : 0;
+    }
+    return ran;
+}
+
+void ResourceManager::QueueUpload(std::function<void()> upload, std::function<void()> onReady) {
+    UploadTask task{std::move(upload), std::move(onReady)};
+    if(mUploadContext == nullptr) {
+        std::lock_guard<std::mutex> lock(mMainQueueMutex);
+        mMainQueue.push_back(std::move(task));
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mUploadMutex);
+        mUploadQueue.push_back(std::move(task));
+    }
+    mUploadCondition.notify_one();
+}
+
+void ResourceManager::FinishUpload(UploadTask& task) {
+    // the fence lands in the command stream right after the upload; glFlush makes sure it reaches the GPU so
+    // the main context can wait on it without the flush bit
+    GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+
+    std::lock_guard<std::mutex> lock(mFencedMutex);
+    mFenced.push_back(FencedTask{fence, std::move(task.onReady)});
+}
+
+void ResourceManager::UploadThreadMain() {
+    SDL_GL_MakeCurrent(mUploadWindow, mUploadContext);
+
+    while(true) {
+        UploadTask task;
+        {
+            std::unique_lock<std::mutex> lock(mUploadMutex);
+            mUploadCondition.wait(lock, [this] { return mQuit || !mUploadQueue.empty(); });
+            if(mQuit) {
+                break;
+            }
+            task = std::move(mUploadQueue.front());
+            mUploadQueue.pop_front();
+        }
+
+        if(task.upload) {
+            task.upload();
+        }
+        FinishUpload(task);
+    }
+
+    SDL_GL_MakeCurrent(mUploadWindow, nullptr);
+}
+
+size_t ResourceManager::Update() {
+    // fallback path: do the GL work here
+    std::deque<UploadTask> mainTasks;
+    {
+        std::lock_guard<std::mutex> lock(mMainQueueMutex);
+        mainTasks.swap(mMainQueue);
+    }
+    for(UploadTask& task : mainTasks) {
+        if(task.upload) {
+            task.upload();
+        }
+        FinishUpload(task);
+    }
+
+    // staging space of finished texture uploads becomes available to the decode workers again
+    if(mPixelPool) {
+        mPixelPool->Retire();
+    }
+
+    // collect signaled fences without blocking (timeout 0)
+    std::vector<std::function<void()>> ready;
+    {
+        std::lock_guard<std::mutex> lock(mFencedMutex);
+        for(size_t i = 0; i < mFenced.size(); ) {
+            GLenum result = glClientWaitSync(mFenced[i].fence, 0, 0);
+            if(result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED) {
+                glDeleteSync(mFenced[i].fence);
+                ready.push_back(std::move(mFenced[i].onReady));
+                mFenced[i] = std::move(mFenced.back());
+                mFenced.pop_back();
+            }
+            else {
+                ++i;
+            }
+        }
+    }
+
+    for(std::function<void()>& onReady : ready) {
+        if(onReady) {
+            onReady();
+        }
+        mPending.fetch_sub(1);
+    }
+
+    // forget decode jobs that are done
+    {
+        std::lock_guard<std::mutex> lock(mDecodeJobsMutex);
+        for(size_t i = 0; i < mDecodeJobs.size(); ) {
+            if(JobSystem::IsFinished(mDecodeJobs[i])) {
+                mDecodeJobs[i] = mDecodeJobs.back();
+                mDecodeJobs.pop_back();
+            }
+            else {
+                ++i;
+            }
+        }
+    }
+
+    return ready.size();
+}
+
+MeshHandle ResourceManager::LoadMeshAsync(const std::string& path, const MeshOptions& options,
+                                          std::function<void(const MeshHandle&)> onReady) {
+    MeshHandle mesh = std::make_shared<MeshResource>();
+    mesh->path = path;
+    mPending.fetch_add(1);
+
+    RunDecodeJob([this, mesh, options, onReady] {
+        // worker thread: parse, simplify into the LOD chain, cluster the full-detail triangles into meshlets
+        std::shared_ptr<MeshData> data = std::make_shared<MeshData>();
+        std::string error;
+        if(!LoadObjMesh(mesh->path, *data, &error)) {
+            std::cout << "Mesh load failed: " << error << "\n";
+            mesh->state = ResourceState::Failed;
+            QueueUpload(nullptr, [mesh, onReady] {
+                if(onReady) { onReady(mesh); }
+            });
+            return;
+        }
+        mesh->bounds = MeshBounds::FromVertices(data->vertices.data(), data->VertexCount(), MeshData::FloatsPerVertex);
+        mesh->indexCount = (GLsizei)data->indices.size();
+        if(options.lods) {
+            mesh->lods = BuildLodChain(*data);
+        }
+        if(options.meshlets) {
+            mesh->meshlets = BuildMeshlets(*data, 0, (size_t)mesh->indexCount);
+            mesh->closed = IsClosedMesh(*data, 0, (size_t)mesh->indexCount);
+        }
+        mesh->state = ResourceState::Uploading;
+
+        QueueUpload([mesh, data] {
+            // upload thread: GL_COPY_WRITE_BUFFER is a neutral target, no VAO needed to fill an index buffer
+            glGenBuffers(1, &mesh->vertexBuffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, mesh->vertexBuffer);
+            glBufferData(GL_COPY_WRITE_BUFFER, data->vertices.size() * sizeof(GLfloat), data->vertices.data(), GL_STATIC_DRAW);
+
+            glGenBuffers(1, &mesh->indexBuffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, mesh->indexBuffer);
+            glBufferData(GL_COPY_WRITE_BUFFER, data->indices.size() * sizeof(GLuint), data->indices.data(), GL_STATIC_DRAW);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }, [mesh, onReady] {
+            // main thread: the fence signaled, the buffers hold their data
+            mesh->state = ResourceState::Ready;
+            if(onReady) { onReady(mesh); }
+        });
+    });
+    return mesh;
+}
+
+ProgramHandle ResourceManager::LoadProgramAsync(const std::string& vertexPath, const std::string& fragmentPath,
+                                                std::function<void(const ProgramHandle&)> onReady) {
+    ProgramHandle program = std::make_shared<ProgramResource>();
+    program->vertexPath = vertexPath;
+    program->fragmentPath = fragmentPath;
+    mPending.fetch_add(1);
+
+    RunDecodeJob([this, program, onReady] {
+        program->vertexSource = ReadTextFile(program->vertexPath);
+        program->fragmentSource = ReadTextFile(program->fragmentPath);
+        program->state = ResourceState::Uploading;
+
+        QueueUpload([program] {
+            if(program->vertexSource.empty() || program->fragmentSource.empty()) {
+                program->log = "could not read " + program->vertexPath + " or " + program->fragmentPath;
+                return;
+            }
+            program->program = LinkProgramChecked(program->vertexSource, program->fragmentSource, program->log);
+        }, [program, onReady] {
+            program->state = program->program != 0 ? ResourceState::Ready : ResourceState::Failed;
+            if(program->state == ResourceState::Failed) {
+                std::cout << "Program load failed: " << program->log << "\n";
+            }
+            if(onReady) { onReady(program); }
+        });
+    });
+    return program;
+}
+
+TextureHandle ResourceManager::LoadTextureAsync(const std::string& path, const TextureOptions& options,
+                                                std::function<void(const TextureHandle&)> onReady) {
+    TextureHandle texture = std::make_shared<TextureResource>();
+    texture->path = path;
+    texture->options = options;
+    CreatePixelPool();
+    mPending.fetch_add(1);
+
+    RunDecodeJob([this, texture, onReady] {
+        const TextureOptions& options = texture->options;
+        auto fail = [this, texture, onReady](const std::string& error) {
+            std::cout << "Texture load failed: " << error << "\n";
+            texture->state = ResourceState::Failed;
+            QueueUpload(nullptr, [texture, onReady] {
+                if(onReady) { onReady(texture); }
+            });
+        };
+
+        // worker thread: read, decode, build the mip chain and (optionally) compress it, the expensive part
+        std::vector<uint8_t> fileBytes;
+        if(!ReadBinaryFile(texture->path, fileBytes)) {
+            fail("could not open " + texture->path);
+            return;
+        }
+
+        bool compress = options.compress && IsBlockFormatSupported(options.blockFormat, options.srgb);
+        if(options.compress && !compress) {
+            std::cout << "Texture: " << BlockFormatName(options.blockFormat) << " not supported by the driver, keeping "
+                      << texture->path << " uncompressed\n";
+        }
+
+        std::shared_ptr<CompressedTexture> compressed;
+        std::string cachePath;
+        uint64_t cacheKey = 0;
+        if(compress) {
+            // everything that changes the encoded result goes into the key
+            const uint32_t settings[4] = {(uint32_t)options.blockFormat, options.srgb ? 1u : 0u,
+                                          options.mipmaps ? 1u : 0u, (uint32_t)options.filter};
+            cacheKey = HashBytes(settings, sizeof(settings), HashBytes(fileBytes.data(), fileBytes.size()));
+            compressed = std::make_shared<CompressedTexture>();
+            if(!mTextureCacheDirectory.empty()) {
+                cachePath = CompressedCachePath(mTextureCacheDirectory, cacheKey);
+                if(!ReadCompressedCache(cachePath, cacheKey, *compressed)) {
+                    compressed->levels.clear(); // miss (or stale/corrupt entry): encode below
+                }
+            }
+        }
+
+        std::shared_ptr<std::vector<Image>> levels = std::make_shared<std::vector<Image>>();
+        if(compressed == nullptr || compressed->levels.empty()) {
+            Image image;
+            std::string error;
+            if(!DecodeImageMemory(fileBytes.data(), fileBytes.size(), texture->path, image, &error)) {
+                fail(error);
+                return;
+            }
+            if(options.mipmaps) {
+                *levels = GenerateMipChain(std::move(image), options.filter, options.srgb);
+            }
+            else {
+                levels->push_back(std::move(image));
+            }
+
+            if(compressed != nullptr) {
+                CompressMipChain(*levels, options.blockFormat, options.srgb, *compressed, &mJobs);
+                levels->clear();
+                if(!cachePath.empty() && !WriteCompressedCache(cachePath, cacheKey, *compressed)) {
+                    std::cout << "Texture cache: could not write " << cachePath << "\n";
+                }
+            }
+        }
+
+        std::shared_ptr<StagingBlock> staging = std::make_shared<StagingBlock>();
+        if(compressed != nullptr) {
+            texture->width = compressed->levels[0].width;
+            texture->height = compressed->levels[0].height;
+            texture->levels = (int)compressed->levels.size();
+            if(mPixelPool->IsPersistent() && mPixelPool->TryAcquire(MipChainBytes(compressed->levels), *staging)) {
+                CopyMipChain(compressed->levels, staging->data);
+            }
+        }
+        else {
+            texture->width = (*levels)[0].width;
+            texture->height = (*levels)[0].height;
+            texture->levels = (int)levels->size();
+            // write the pixels straight into mapped staging memory while we are still on the worker
+            if(mPixelPool->IsPersistent() && mPixelPool->TryAcquire(MipChainBytes(*levels), *staging)) {
+                CopyMipChain(*levels, staging->data);
+            }
+        }
+        texture->state = ResourceState::Uploading;
+
+        QueueUpload([this, texture, levels, compressed, staging] {
+            if(compressed != nullptr) {
+                UploadCompressedTexture(*texture, *compressed, *mPixelPool, *staging);
+            }
+            else {
+                UploadTexture(*texture, *levels, *mPixelPool, *staging);
+            }
+        }, [texture, onReady] {
+            texture->state = ResourceState::Ready;
+            if(onReady) { onReady(texture); }
+        });
+    });
+    return texture;
+}
+
+bool ResourceManager::DecodeImages(const std::vector<std::string>& paths, std::vector<Image>& images, std::string& error) {
+    images.assign(paths.size(), Image());
+    std::vector<std::string> errors(paths.size());
+    mJobs.ParallelFor(paths.size(), [&](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; ++i) {
+            DecodeImageFile(paths[i], images[i], &errors[i]);
+        }
+    }, 1);
+    for(size_t i = 0; i < paths.size(); ++i) {
+        if(images[i].pixels.empty()) {
+            error = errors[i];
+            return false;
+        }
+    }
+    return true;
+}
+
+TextureHandle ResourceManager::LoadTextureAtlasAsync(const std::vector<std::string>& paths, const TextureOptions& options,
+                                                     const AtlasOptions& atlasOptions, std::function<void(const TextureHandle&)> onReady) {
+    TextureHandle texture = std::make_shared<TextureResource>();
+    for(const std::string& path : paths) {
+        texture->path += (texture->path.empty() ? "" : ",") + path;
+    }
+    texture->options = options;
+    CreatePixelPool();
+    mPending.fetch_add(1);
+
+    RunDecodeJob([this, texture, paths, atlasOptions, onReady] {
+        std::vector<Image> images;
+        Image atlas;
+        std::string error;
+        if(!DecodeImages(paths, images, error) || !BuildTextureAtlas(images, atlasOptions, atlas, texture->regions, &error)) {
+            std::cout << "Texture atlas failed: " << error << "\n";
+            texture->state = ResourceState::Failed;
+            QueueUpload(nullptr, [texture, onReady] {
+                if(onReady) { onReady(texture); }
+            });
+            return;
+        }
+        images.clear();
+        texture->width = atlas.width;
+        texture->height = atlas.height;
+
+        std::shared_ptr<std::vector<Image>> levels = std::make_shared<std::vector<Image>>();
+        if(texture->options.mipmaps) {
+            *levels = GenerateMipChain(std::move(atlas), texture->options.filter, texture->options.srgb);
+            // beyond this level the padding is gone and neighbours would blend into each other
+            levels->resize(std::min(levels->size(), (size_t)AtlasMipLevelLimit(atlasOptions.padding)));
+        }
+        else {
+            levels->push_back(std::move(atlas));
+        }
+        texture->levels = (int)levels->size();
+
+        std::shared_ptr<StagingBlock> staging = std::make_shared<StagingBlock>();
+        if(mPixelPool->IsPersistent() && mPixelPool->TryAcquire(MipChainBytes(*levels), *staging)) {
+            CopyMipChain(*levels, staging->data);
+        }
+        texture->state = ResourceState::Uploading;
+
+        QueueUpload([this, texture, levels, staging] {
+            UploadTexture(*texture, *levels, *mPixelPool, *staging);
+        }, [texture, onReady] {
+            texture->state = ResourceState::Ready;
+            if(onReady) { onReady(texture); }
+        });
+    });
+    return texture;
+}
+
+TextureHandle ResourceManager::LoadTextureArrayAsync(const std::vector<std::string>& paths, const TextureOptions& options,
+                                                     std::function<void(const TextureHandle&)> onReady) {
+    TextureHandle texture = std::make_shared<TextureResource>();
+    for(const std::string& path : paths) {
+        texture->path += (texture->path.empty() ? "" : ",") + path;
+    }
+    texture->options = options;
+    texture->target = GL_TEXTURE_2D_ARRAY;
+    CreatePixelPool();
+    mPending.fetch_add(1);
+
+    RunDecodeJob([this, texture, paths, onReady] {
+        std::vector<Image> images;
+        std::string error;
+        if(!DecodeImages(paths, images, error) || !BuildTextureArrayRegions(images, texture->regions, &error)) {
+            std::cout << "Texture array failed: " << error << "\n";
+            texture->state = ResourceState::Failed;
+            QueueUpload(nullptr, [texture, onReady] {
+                if(onReady) { onReady(texture); }
+            });
+            return;
+        }
+        texture->width = images[0].width;
+        texture->height = images[0].height;
+        texture->layers = (int)images.size();
+
+        // every layer's chain, one layer after the other
+        const size_t levelCount = texture->options.mipmaps ? (size_t)MipLevelCount(texture->width, texture->height) : 1;
+        std::shared_ptr<std::vector<Image>> levels = std::make_shared<std::vector<Image>>(images.size() * levelCount);
+        mJobs.ParallelFor(images.size(), [&](size_t begin, size_t end) {
+            for(size_t layer = begin; layer < end; ++layer) {
+                if(levelCount == 1) {
+                    (*levels)[layer] = std::move(images[layer]);
+                    continue;
+                }
+                std::vector<Image> chain = GenerateMipChain(std::move(images[layer]), texture->options.filter, texture->options.srgb);
+                std::move(chain.begin(), chain.end(), levels->begin() + layer * levelCount);
+            }
+        }, 1);
+        texture->levels = (int)levelCount;
+
+        std::shared_ptr<StagingBlock> staging = std::make_shared<StagingBlock>();
+        if(mPixelPool->IsPersistent() && mPixelPool->TryAcquire(MipChainBytes(*levels), *staging)) {
+            CopyMipChain(*levels, staging->data);
+        }
+        texture->state = ResourceState::Uploading;
+
+        QueueUpload([this, texture, levels, levelCount, staging] {
+            UploadTextureArray(*texture, *levels, levelCount, *mPixelPool, *staging);
+        }, [texture, onReady] {
+            texture->state = ResourceState::Ready;
+            if(onReady) { onReady(texture); }
+        });
+    });
+    return texture;
+}
@@ -0,0 +1,206 @@
+#pragma once
+
+/*
+ResourceManager streams assets in the background so the first frame does not wait for them.
+
+    worker threads (JobSystem)        upload thread (shared GL context)         main thread
+    read + decode file         ->     glBufferData / glTexImage / link   ->     Update(): fence signaled?
+                                      glFenceSync + glFlush                     -> resource becomes Ready
+
+The upload thread owns a second GL context created with SDL_GL_SHARE_WITH_CURRENT_CONTEXT, so buffers,
+textures and programs it creates are visible to the main context. Container objects (VAOs, FBOs) are not
+shared between contexts; the main thread builds those in the onReady callback.
+
+If the shared context cannot be created, uploads run on the main thread inside Update() instead (decoding
+still happens on the workers).
+
+Texture pixels travel through a PixelBufferPool: the decode worker copies the finished mip chain into
+persistently mapped staging memory and the upload thread only issues glTexSubImage2D from the bound
+GL_PIXEL_UNPACK_BUFFER, so the GL thread never copies pixel data itself. The pool (96 MiB) is created by the
+first texture load or GetPixelBufferPool() call, a run that only streams meshes never allocates it.
+
+Until a resource is Ready the renderer keeps drawing its placeholder.
+*/
+
+#include "culling.hpp"
+#include "job_system.hpp"
+#include "mesh_loader.hpp"
+#include "mesh_simplifier.hpp"
+#include "meshlet_builder.hpp"
+#include "mipmap_generator.hpp"
+#include "pixel_buffer_pool.hpp"
+#include "texture_atlas.hpp"
+#include "texture_compression.hpp"
+
+#include <SDL2/SDL.h>
+#include <glad/glad.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class ResourceState {
+    Loading,   // being read/decoded on a worker
+    Uploading, // waiting for / running on the upload thread, or waiting for its fence
+    Ready,     // GPU objects usable from the main context
+    Failed,
+};
+
+struct MeshResource {
+    std::string path;
+    std::atomic<ResourceState> state{ResourceState::Loading};
+
+    // valid once Ready
+    GLuint vertexBuffer = 0;
+    GLuint indexBuffer = 0;
+    GLsizei indexCount = 0;  // full detail; the simplified levels follow it in indexBuffer
+    MeshBounds bounds;
+    std::vector<MeshLod> lods; // [0] = the first indexCount indices; empty when loaded without LODs
+    std::vector<Meshlet> meshlets; // clusters of lods[0], its triangles are stored in meshlet order
+    bool closed = false;           // IsClosedMesh() of the full-detail triangles, only computed with meshlets
+};
+
+struct ProgramResource {
+    std::string vertexPath;
+    std::string fragmentPath;
+    std::atomic<ResourceState> state{ResourceState::Loading};
+
+    GLuint program = 0; // valid once Ready
+    std::string log;    // compile/link errors if Failed
+    std::string vertexSource;   // exactly what was compiled, for other contexts that link their own copy
+    std::string fragmentSource;
+};
+
+struct MeshOptions {
+    bool lods = true;     // simplify into a LOD chain behind the full-detail triangles
+    bool meshlets = true; // reorder the full-detail triangles into meshlets; the draw order changes with it
+};
+
+struct TextureOptions {
+    bool srgb = true;                  // color textures; false for normal maps and other data
+    bool mipmaps = true;               // full chain generated on the worker
+    MipFilter filter = MipFilter::Kaiser;
+    bool compress = false;             // encode to 'blockFormat' on the workers (skipped if the driver lacks it)
+    BlockFormat blockFormat = BlockFormat::BC7;
+};
+
+struct TextureResource {
+    std::string path;
+    TextureOptions options;
+    std::atomic<ResourceState> state{ResourceState::Loading};
+
+    // valid once Ready
+    GLuint texture = 0;
+    GLenum target = GL_TEXTURE_2D; // GL_TEXTURE_2D_ARRAY for arrays
+    int width = 0;
+    int height = 0;
+    int levels = 0;
+    int layers = 1;
+
+    // atlases and arrays: where every source image ended up (UV remap table), in load order
+    std::vector<AtlasRegion> regions;
+};
+
+using MeshHandle = std::shared_ptr<MeshResource>;
+using ProgramHandle = std::shared_ptr<ProgramResource>;
+using TextureHandle = std::shared_ptr<TextureResource>;
+
+class ResourceManager {
+public:
+    // Call on the main thread with the main context current
+    ResourceManager(JobSystem& jobs, SDL_Window* mainWindow, SDL_GLContext mainContext);
+    ~ResourceManager();
+
+    ResourceManager(const ResourceManager&) = delete;
+    ResourceManager& operator=(const ResourceManager&) = delete;
+
+    // 'onReady' (optional) runs on the main thread inside Update() when the resource became Ready or Failed.
+    // Leave out the LODs and meshlets nothing is going to select or cull.
+    MeshHandle LoadMeshAsync(const std::string& path, const MeshOptions& options = MeshOptions(),
+                             std::function<void(const MeshHandle&)> onReady = nullptr);
+    ProgramHandle LoadProgramAsync(const std::string& vertexPath, const std::string& fragmentPath,
+                                   std::function<void(const ProgramHandle&)> onReady = nullptr);
+    // PNG / TGA / PPM; decoding, mip generation and block compression run on workers, the upload uses immutable
+    // storage (glTexStorage2D) when ARB_texture_storage is available. Compressed chains are cached on disk.
+    TextureHandle LoadTextureAsync(const std::string& path, const TextureOptions& options = TextureOptions(),
+                                   std::function<void(const TextureHandle&)> onReady = nullptr);
+    // Several images in one bind: packed into a padded atlas (mip chain limited by the padding), or as the layers
+    // of a GL_TEXTURE_2D_ARRAY (same size required). TextureResource::regions holds the UV remap table.
+    // Block compression is not applied to these.
+    TextureHandle LoadTextureAtlasAsync(const std::vector<std::string>& paths, const TextureOptions& options = TextureOptions(),
+                                        const AtlasOptions& atlasOptions = AtlasOptions(),
+                                        std::function<void(const TextureHandle&)> onReady = nullptr);
+    TextureHandle LoadTextureArrayAsync(const std::vector<std::string>& paths, const TextureOptions& options = TextureOptions(),
+                                        std::function<void(const TextureHandle&)> onReady = nullptr);
+
+    // Generic hook for other resource types: 'upload' runs with a GL context current (upload thread, or the main
+    // thread as a fallback), 'onReady' runs on the main thread after the GPU finished executing the upload.
+    void QueueUpload(std::function<void()> upload, std::function<void()> onReady);
+
+    // Runs a CPU job on the worker threads (file reads, decoding)
+    void RunDecodeJob(std::function<void()> job);
+    // For a thread that blocks until assets streamed in: runs the decode jobs no worker started yet right here
+    // instead of sleeping next to them. Returns how many ran.
+    size_t RunQueuedDecodeJobs();
+
+    // Main thread, once per frame: retires signaled fences and fires onReady callbacks. Returns how many fired.
+    size_t Update();
+
+    bool HasSharedContext() const { return mUploadContext != nullptr; }
+    // Main thread; creates the pool on first use
+    PixelBufferPool& GetPixelBufferPool();
+
+    // Where encoded block-compressed textures are cached; empty disables the cache. Set before loading.
+    void SetTextureCacheDirectory(const std::string& directory) { mTextureCacheDirectory = directory; }
+    size_t PendingCount() const { return mPending.load(); }
+
+    // Reads a whole text file (used for shader sources); empty string if it cannot be opened
+    static std::string ReadTextFile(const std::string& path);
+    static bool ReadBinaryFile(const std::string& path, std::vector<uint8_t>& bytes);
+
+private:
+    struct UploadTask {
+        std::function<void()> upload;
+        std::function<void()> onReady;
+    };
+    struct FencedTask {
+        GLsync fence;
+        std::function<void()> onReady;
+    };
+
+    void UploadThreadMain();
+    bool DecodeImages(const std::vector<std::string>& paths, std::vector<Image>& images, std::string& error); // in parallel
+    void FinishUpload(UploadTask& task); // fence + hand over to the main thread
+    void CreatePixelPool(); // main thread, before queueing work that uses mPixelPool on a worker
+
+    JobSystem& mJobs;
+    SDL_Window* mMainWindow = nullptr;
+    SDL_GLContext mMainContext = nullptr;
+    SDL_Window* mUploadWindow = nullptr;   // hidden 1x1 window the upload context is made current on
+    SDL_GLContext mUploadContext = nullptr;
+
+    std::thread mUploadThread;
+    std::mutex mUploadMutex;
+    std::condition_variable mUploadCondition;
+    std::deque<UploadTask> mUploadQueue;
+    bool mQuit = false;
+
+    std::mutex mFencedMutex;
+    std::vector<FencedTask> mFenced;       // uploaded, waiting for the GPU
+
+    std::mutex mMainQueueMutex;
+    std::deque<UploadTask> mMainQueue;     // fallback when there is no shared context
+
+    std::unique_ptr<PixelBufferPool> mPixelPool; // staging memory for texture uploads
+    std::string mTextureCacheDirectory;
+
+    std::mutex mDecodeJobsMutex;
+    std::vector<JobHandle> mDecodeJobs; // waited for on destruction
+
+    std::atomic<size_t> mPending{0};
+};
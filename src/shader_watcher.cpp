@@ -0,0 +1,113 @@
+#include "shader_watcher.hpp"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+const int ShaderWatcher::QuietMs; // bound to a reference by std::chrono
+
+static bool Fail(std::string* error, const std::string& message) {
+    if(error) {
+        *error = message;
+    }
+    return false;
+}
+
+ShaderWatcher::~ShaderWatcher() {
+    if(mThread.joinable()) {
+        const char byte = 1;
+        (void)!write(mWakePipe[1], &byte, 1);
+        mThread.join();
+    }
+    if(mInotify >= 0) {
+        close(mInotify);
+    }
+    for(int fd : mWakePipe) {
+        if(fd >= 0) {
+            close(fd);
+        }
+    }
+}
+
+bool ShaderWatcher::Start(const std::string& directory, std::function<void()> onChanges, std::string* error) {
+    mDirectory = directory;
+    mOnChanges = std::move(onChanges);
+    mInotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(mInotify < 0) {
+        return Fail(error, std::string("inotify unavailable: ") + std::strerror(errno));
+    }
+    if(inotify_add_watch(mInotify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_ONLYDIR) < 0) {
+        return Fail(error, "cannot watch " + directory + ": " + std::strerror(errno));
+    }
+    if(pipe2(mWakePipe, O_CLOEXEC | O_NONBLOCK) != 0) {
+        return Fail(error, "cannot create a pipe");
+    }
+
+    mThread = std::thread(&ShaderWatcher::ThreadMain, this);
+    return true;
+}
+
+std::vector<std::string> ShaderWatcher::TakeChanges() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if(mChanged.empty() || std::chrono::steady_clock::now() - mLastChange < std::chrono::milliseconds(QuietMs)) {
+        return {};
+    }
+    std::vector<std::string> changed(mChanged.begin(), mChanged.end());
+    mChanged.clear();
+    return changed;
+}
+
+void ShaderWatcher::ThreadMain() {
+    // events are variable length: the header, then a NUL-padded name of 'len' bytes
+    alignas(inotify_event) char buffer[4096];
+    bool announce = false; // changes arrived that onChanges was not told about yet
+    for(;;) {
+        int timeout = -1;
+        if(announce) {
+            std::chrono::steady_clock::duration quiet;
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                quiet = std::chrono::steady_clock::now() - mLastChange;
+            }
+            const long long remaining = QuietMs - std::chrono::duration_cast<std::chrono::milliseconds>(quiet).count();
+            if(remaining <= 0) {
+                announce = false;
+                if(mOnChanges) {
+                    mOnChanges();
+                }
+                continue;
+            }
+            timeout = (int)remaining;
+        }
+
+        pollfd descriptors[2] = {{mWakePipe[0], POLLIN, 0}, {mInotify, POLLIN, 0}};
+        if(poll(descriptors, 2, timeout) < 0 && errno != EINTR) {
+            break;
+        }
+        if(descriptors[0].revents & POLLIN) {
+            break; // the destructor wants us gone
+        }
+        if(!(descriptors[1].revents & POLLIN)) {
+            continue;
+        }
+
+        const ssize_t length = read(mInotify, buffer, sizeof(buffer));
+        if(length <= 0) {
+            continue;
+        }
+        std::lock_guard<std::mutex> lock(mMutex);
+        for(ssize_t offset = 0; offset < length;) {
+            const inotify_event* event = (const inotify_event*)(buffer + offset);
+            if(event->len > 0) {
+                mChanged.insert(event->name);
+            }
+            offset += sizeof(inotify_event) + event->len;
+        }
+        mLastChange = std::chrono::steady_clock::now();
+        announce = true;
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+/*
+Shader hot reload (--watch-shaders): ShaderWatcher follows one directory with inotify on a thread of its own and
+reports which files in it were saved. It compiles nothing itself; the caller relinks through
+ResourceManager::LoadProgramAsync() (files read on a worker, linked on the upload context) and swaps the program
+in from the onReady callback, i.e. between two frames, keeping the running one when the new one does not build.
+
+- Watched events: IN_CLOSE_WRITE (written in place) and IN_MOVED_TO (editors and VCS checkouts that write a
+  temporary file and rename it over the original). Subdirectories are not followed.
+- One save often means several events, sometimes spread over a few milliseconds; TakeChanges() hands the names
+  out only once the directory was quiet for QuietMs, so a save triggers one reload.
+- The thread sleeps in poll() on the inotify descriptor and a wake pipe, it costs nothing while nobody edits.
+  Once a burst of events went quiet it calls the optional onChanges callback (on its own thread), so a caller
+  that sleeps between frames can wake up instead of finding the change at its next timeout.
+*/
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+class ShaderWatcher {
+public:
+    static const int QuietMs = 100;
+
+    ShaderWatcher() = default;
+    ~ShaderWatcher(); // stops the thread
+
+    ShaderWatcher(const ShaderWatcher&) = delete;
+    ShaderWatcher& operator=(const ShaderWatcher&) = delete;
+
+    // Starts watching 'directory'. False (with the reason) if it does not exist or inotify is unavailable.
+    // 'onChanges' runs on the watcher thread whenever TakeChanges() has something new to hand out.
+    bool Start(const std::string& directory, std::function<void()> onChanges = nullptr, std::string* error = nullptr);
+
+    // Main thread, once per frame: file names (without the directory) saved since the last call that returned
+    // any; empty while nothing changed or edits are still arriving
+    std::vector<std::string> TakeChanges();
+
+    const std::string& Directory() const { return mDirectory; }
+
+private:
+    void ThreadMain();
+
+    std::string mDirectory;
+    std::function<void()> mOnChanges;
+    int mInotify = -1;
+    int mWakePipe[2] = {-1, -1};
+    std::thread mThread;
+
+    std::mutex mMutex; // guards the members below
+    std::set<std::string> mChanged;
+    std::chrono::steady_clock::time_point mLastChange;
+};
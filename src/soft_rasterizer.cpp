@@ -0,0 +1,601 @@
+#include "soft_rasterizer.hpp"
+
+#include "mesh_loader.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if LEARNGL_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+const int LinearToSrgbTableSize = 4096;
+
+struct ColorTables {
+    float srgbToLinear[256];
+    uint8_t linearToSrgb[LinearToSrgbTableSize];
+
+    ColorTables() {
+        for(int i = 0; i < 256; ++i) {
+            const float c = i / 255.0f;
+            srgbToLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        for(int i = 0; i < LinearToSrgbTableSize; ++i) {
+            const float l = (float)i / (LinearToSrgbTableSize - 1);
+            const float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+            linearToSrgb[i] = (uint8_t)std::lround(c * 255.0f);
+        }
+    }
+};
+
+const ColorTables& Tables() {
+    static const ColorTables tables;
+    return tables;
+}
+
+uint8_t EncodeSrgb(const ColorTables& tables, float linear) {
+    linear = std::min(1.0f, std::max(0.0f, linear));
+    return tables.linearToSrgb[(int)(linear * (LinearToSrgbTableSize - 1) + 0.5f)];
+}
+
+uint8_t EncodeUnorm(float value) {
+    return (uint8_t)(std::min(1.0f, std::max(0.0f, value)) * 255.0f + 0.5f);
+}
+
+// The four texels of a bilinear sample of level 0 and their weights
+struct BilinearTaps {
+    const float* texels[4]; // RGBA
+    float weights[4];
+};
+
+void BilinearTapsAt(const float* texels, int width, int height, bool clampToEdge, float u, float v, BilinearTaps& taps) {
+    if(!(std::fabs(u) < 1e6f) || !(std::fabs(v) < 1e6f)) {
+        u = v = 0.0f; // NaN or far out: any texel will do, but never one outside the texture
+    }
+    if(clampToEdge) {
+        u = std::min(std::max(u, 0.0f), 1.0f);
+        v = std::min(std::max(v, 0.0f), 1.0f);
+    }
+    else {
+        u -= std::floor(u);
+        v -= std::floor(v);
+    }
+    const float fx = u * width - 0.5f;
+    const float fy = v * height - 0.5f;
+    const float floorX = std::floor(fx);
+    const float floorY = std::floor(fy);
+    const float tx = fx - floorX;
+    const float ty = fy - floorY;
+
+    // -1 .. size - 1 and 0 .. size
+    int x0 = (int)floorX, y0 = (int)floorY;
+    int x1 = x0 + 1, y1 = y0 + 1;
+    if(clampToEdge) {
+        x0 = std::max(x0, 0);
+        y0 = std::max(y0, 0);
+        x1 = std::min(x1, width - 1);
+        y1 = std::min(y1, height - 1);
+    }
+    else {
+        x0 = x0 < 0 ? width - 1 : x0;
+        y0 = y0 < 0 ? height - 1 : y0;
+        x1 = x1 >= width ? 0 : x1;
+        y1 = y1 >= height ? 0 : y1;
+    }
+
+    taps.texels[0] = texels + ((size_t)y0 * width + x0) * 4;
+    taps.texels[1] = texels + ((size_t)y0 * width + x1) * 4;
+    taps.texels[2] = texels + ((size_t)y1 * width + x0) * 4;
+    taps.texels[3] = texels + ((size_t)y1 * width + x1) * 4;
+    taps.weights[0] = (1.0f - tx) * (1.0f - ty);
+    taps.weights[1] = tx * (1.0f - ty);
+    taps.weights[2] = (1.0f - tx) * ty;
+    taps.weights[3] = tx * ty;
+}
+
+// Clip space planes as dot(plane, position) >= 0: near, far, w > 0 and a guard band around the viewport.
+// Inside the guard band window coordinates stay small enough for exact 1/256 pixel snapping in floats.
+int ClipPlanes(float guardBand, glm::vec4 planes[7]) {
+    planes[0] = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);   // z >= -w
+    planes[1] = glm::vec4(0.0f, 0.0f, -1.0f, 1.0f);  // z <= w
+    planes[2] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);   // w > 0: checked against a small epsilon instead of 0
+    planes[3] = glm::vec4(-1.0f, 0.0f, 0.0f, guardBand);
+    planes[4] = glm::vec4(1.0f, 0.0f, 0.0f, guardBand);
+    planes[5] = glm::vec4(0.0f, -1.0f, 0.0f, guardBand);
+    planes[6] = glm::vec4(0.0f, 1.0f, 0.0f, guardBand);
+    return 7;
+}
+
+// The coverage mask (bit i = pixel x + i) and perspective-correct attributes of four pixels of one row
+struct RowAttributes {
+    float values[5][4]; // r, g, b, u, v per pixel
+};
+
+// ---------------------------------------------- coverage kernels ----------------------------------------------
+// Both kernels compute E = A * x + (B * y + C) with the same operations in the same order, so the result does not
+// depend on the kernel and a shared edge evaluates to exactly the negated value in the neighbouring triangle.
+
+template<typename Triangle>
+int RowCoverageScalar(const Triangle& triangle, int x, int y, int columnMask, RowAttributes& out) {
+    const float centerY = (float)y + 0.5f;
+    float rowTerms[3];
+    for(int e = 0; e < 3; ++e) {
+        rowTerms[e] = triangle.edgeB[e] * centerY + triangle.edgeC[e];
+    }
+
+    int mask = 0;
+    for(int i = 0; i < 4; ++i) {
+        if(!(columnMask & (1 << i))) {
+            continue;
+        }
+        const float centerX = (float)(x + i) + 0.5f;
+        bool inside = true;
+        for(int e = 0; e < 3 && inside; ++e) {
+            const float value = triangle.edgeA[e] * centerX + rowTerms[e];
+            inside = triangle.topLeft[e] ? value >= 0.0f : value > 0.0f;
+        }
+        if(!inside) {
+            continue;
+        }
+        mask |= 1 << i;
+
+        const float dx = centerX - triangle.originX;
+        const float dy = centerY - triangle.originY;
+        const float w = 1.0f / (triangle.planes[0][2] + triangle.planes[0][0] * dx + triangle.planes[0][1] * dy);
+        for(int a = 0; a < 5; ++a) {
+            const float* plane = triangle.planes[a + 1];
+            out.values[a][i] = (plane[2] + plane[0] * dx + plane[1] * dy) * w;
+        }
+    }
+    return mask;
+}
+
+#if LEARNGL_X86
+template<typename Triangle>
+int RowCoverageSse2(const Triangle& triangle, int x, int y, int columnMask, RowAttributes& out) {
+    const float centerY = (float)y + 0.5f;
+    const __m128 centerX = _mm_add_ps(_mm_set1_ps((float)x), _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f));
+    const __m128 zero = _mm_setzero_ps();
+
+    __m128 inside = _mm_castsi128_ps(_mm_setr_epi32(columnMask & 1 ? -1 : 0, columnMask & 2 ? -1 : 0,
+                                                    columnMask & 4 ? -1 : 0, columnMask & 8 ? -1 : 0));
+    for(int e = 0; e < 3; ++e) {
+        const float rowTerm = triangle.edgeB[e] * centerY + triangle.edgeC[e];
+        const __m128 value = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(triangle.edgeA[e]), centerX), _mm_set1_ps(rowTerm));
+        inside = _mm_and_ps(inside, triangle.topLeft[e] ? _mm_cmpge_ps(value, zero) : _mm_cmpgt_ps(value, zero));
+    }
+    const int mask = _mm_movemask_ps(inside);
+    if(mask == 0) {
+        return 0;
+    }
+
+    const __m128 dx = _mm_sub_ps(centerX, _mm_set1_ps(triangle.originX));
+    const __m128 dy = _mm_set1_ps(centerY - triangle.originY);
+    auto plane = [&dx, &dy](const float* p) {
+        return _mm_add_ps(_mm_add_ps(_mm_set1_ps(p[2]), _mm_mul_ps(_mm_set1_ps(p[0]), dx)), _mm_mul_ps(_mm_set1_ps(p[1]), dy));
+    };
+    const __m128 w = _mm_div_ps(_mm_set1_ps(1.0f), plane(triangle.planes[0]));
+    for(int a = 0; a < 5; ++a) {
+        _mm_storeu_ps(out.values[a], _mm_mul_ps(plane(triangle.planes[a + 1]), w));
+    }
+    return mask;
+}
+#endif
+
+// GL_LESS for the covered pixels of one row; the ones that pass store their depth
+template<typename Triangle>
+int DepthTestRow(const Triangle& triangle, int x, int y, int mask, float* depthRow) {
+    const float dy = (float)y + 0.5f - triangle.originY;
+    const float rowDepth = triangle.depthPlane[2] + triangle.depthPlane[1] * dy;
+    for(int i = 0; i < 4; ++i) {
+        if(!(mask & (1 << i))) {
+            continue;
+        }
+        const float z = rowDepth + triangle.depthPlane[0] * ((float)(x + i) + 0.5f - triangle.originX);
+        if(z < depthRow[x + i]) {
+            depthRow[x + i] = z;
+        }
+        else {
+            mask &= ~(1 << i);
+        }
+    }
+    return mask;
+}
+
+// ---------------------------------------------- shading kernels ----------------------------------------------
+// fragColor = vec4(vColor, 1) * texture(u_Texture, vTexCoord), encoded like GL_FRAMEBUFFER_SRGB. Same operations
+// in the same order in both kernels, so they produce identical bytes.
+
+void ShadePixelScalar(const ColorTables& tables, const float* texels, int width, int height, bool clampToEdge,
+                      const RowAttributes& row, int i, uint8_t* pixel) {
+    float color[4] = {row.values[0][i], row.values[1][i], row.values[2][i], 1.0f};
+    if(texels != nullptr) {
+        BilinearTaps taps;
+        BilinearTapsAt(texels, width, height, clampToEdge, row.values[3][i], row.values[4][i], taps);
+        for(int c = 0; c < 4; ++c) {
+            const float sample = taps.weights[0] * taps.texels[0][c] + taps.weights[1] * taps.texels[1][c] +
+                                 taps.weights[2] * taps.texels[2][c] + taps.weights[3] * taps.texels[3][c];
+            color[c] *= sample;
+        }
+    }
+    pixel[0] = EncodeSrgb(tables, color[0]);
+    pixel[1] = EncodeSrgb(tables, color[1]);
+    pixel[2] = EncodeSrgb(tables, color[2]);
+    pixel[3] = EncodeUnorm(color[3]);
+}
+
+#if LEARNGL_X86
+void ShadePixelSse2(const ColorTables& tables, const float* texels, int width, int height, bool clampToEdge,
+                    const RowAttributes& row, int i, uint8_t* pixel) {
+    __m128 color = _mm_setr_ps(row.values[0][i], row.values[1][i], row.values[2][i], 1.0f);
+    if(texels != nullptr) {
+        BilinearTaps taps;
+        BilinearTapsAt(texels, width, height, clampToEdge, row.values[3][i], row.values[4][i], taps);
+        __m128 sample = _mm_mul_ps(_mm_set1_ps(taps.weights[0]), _mm_loadu_ps(taps.texels[0]));
+        sample = _mm_add_ps(sample, _mm_mul_ps(_mm_set1_ps(taps.weights[1]), _mm_loadu_ps(taps.texels[1])));
+        sample = _mm_add_ps(sample, _mm_mul_ps(_mm_set1_ps(taps.weights[2]), _mm_loadu_ps(taps.texels[2])));
+        sample = _mm_add_ps(sample, _mm_mul_ps(_mm_set1_ps(taps.weights[3]), _mm_loadu_ps(taps.texels[3])));
+        color = _mm_mul_ps(color, sample);
+    }
+    // rgb index the 12 bit sRGB table, alpha is plain unorm
+    color = _mm_min_ps(_mm_max_ps(color, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+    const __m128 scale = _mm_setr_ps((float)(LinearToSrgbTableSize - 1), (float)(LinearToSrgbTableSize - 1),
+                                     (float)(LinearToSrgbTableSize - 1), 255.0f);
+    alignas(16) int32_t index[4];
+    _mm_store_si128((__m128i*)index, _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(color, scale), _mm_set1_ps(0.5f))));
+    pixel[0] = tables.linearToSrgb[index[0]];
+    pixel[1] = tables.linearToSrgb[index[1]];
+    pixel[2] = tables.linearToSrgb[index[2]];
+    pixel[3] = (uint8_t)index[3];
+}
+#endif
+
+} // namespace
+
+// ---------------------------------------------- SoftRasterizer ----------------------------------------------
+
+SoftRasterizer::SoftRasterizer(JobSystem& jobs) : mJobs(jobs), mSimd(GetSimdLevel()) {
+    Tables(); // built once, not on the first worker that happens to need them
+}
+
+void SoftRasterizer::Resize(int width, int height) {
+    if(width == mColor.width && height == mColor.height) {
+        return;
+    }
+    mColor.width = width;
+    mColor.height = height;
+    mColor.pixels.resize(mColor.ByteSize());
+    mDepth.resize((size_t)width * height);
+    mTilesX = (width + TileSize - 1) / TileSize;
+    mTilesY = (height + TileSize - 1) / TileSize;
+}
+
+void SoftRasterizer::SetTexture(const Image* srgbImage, bool clampToEdge) {
+    mTexture.clampToEdge = clampToEdge;
+    if(srgbImage == nullptr || srgbImage->width <= 0 || srgbImage->height <= 0) {
+        mTexture.width = mTexture.height = 0;
+        mTexture.texels.clear();
+        return;
+    }
+    const ColorTables& tables = Tables();
+    mTexture.width = srgbImage->width;
+    mTexture.height = srgbImage->height;
+    mTexture.texels.resize((size_t)mTexture.width * mTexture.height * 4);
+    mJobs.ParallelFor((size_t)mTexture.height, [this, srgbImage, &tables](size_t begin, size_t end) {
+        for(size_t y = begin; y < end; ++y) {
+            const uint8_t* source = srgbImage->Row((int)y);
+            float* texel = mTexture.texels.data() + y * mTexture.width * 4;
+            for(int i = 0; i < mTexture.width * 4; i += 4) {
+                texel[i + 0] = tables.srgbToLinear[source[i + 0]];
+                texel[i + 1] = tables.srgbToLinear[source[i + 1]];
+                texel[i + 2] = tables.srgbToLinear[source[i + 2]];
+                texel[i + 3] = source[i + 3] * (1.0f / 255.0f);
+            }
+        }
+    });
+}
+
+void SoftRasterizer::Clear(const glm::vec4& linearColor) {
+    const ColorTables& tables = Tables();
+    const uint8_t texel[4] = {EncodeSrgb(tables, linearColor.x), EncodeSrgb(tables, linearColor.y),
+                              EncodeSrgb(tables, linearColor.z), EncodeUnorm(linearColor.w)};
+    uint32_t value;
+    std::memcpy(&value, texel, 4);
+
+    mJobs.ParallelFor((size_t)mColor.height, [this, value](size_t begin, size_t end) {
+        for(size_t y = begin; y < end; ++y) {
+            uint32_t* row = (uint32_t*)mColor.Row((int)y);
+            std::fill(row, row + mColor.width, value);
+            std::fill(mDepth.begin() + y * mColor.width, mDepth.begin() + (y + 1) * mColor.width, 1.0f);
+        }
+    });
+}
+
+void SoftRasterizer::Draw(const SoftDrawCall& draw) {
+    mTriangleCount = 0;
+    mBinnedCount = 0;
+    const size_t trianglesPerInstance = draw.indexCount / 3;
+    const size_t triangleCount = trianglesPerInstance * draw.instanceCount;
+    if(triangleCount == 0 || mColor.width == 0 || mColor.height == 0) {
+        return;
+    }
+
+    // 1) vertex stage
+    const glm::mat4 viewProjectionModel = draw.projection * draw.view * draw.modelMatrix;
+    mClipVertices.resize(draw.vertexCount * draw.instanceCount);
+    mJobs.ParallelFor(draw.instanceCount, [this, &draw, &viewProjectionModel](size_t begin, size_t end) {
+        for(size_t instance = begin; instance < end; ++instance) {
+            const glm::mat4 matrix = viewProjectionModel * draw.instanceMatrices[instance];
+            const glm::vec4 uvRect = draw.instanceUvRects ? draw.instanceUvRects[instance] : glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+            ClipVertex* out = mClipVertices.data() + instance * draw.vertexCount;
+            for(size_t i = 0; i < draw.vertexCount; ++i) {
+                const float* vertex = draw.vertices + i * MeshData::FloatsPerVertex;
+                out[i].position = matrix * glm::vec4(vertex[0], vertex[1], vertex[2], 1.0f);
+                out[i].attributes[0] = vertex[3];
+                out[i].attributes[1] = vertex[4];
+                out[i].attributes[2] = vertex[5];
+                out[i].attributes[3] = uvRect.x + vertex[6] * uvRect.z;
+                out[i].attributes[4] = uvRect.y + vertex[7] * uvRect.w;
+            }
+        }
+    }, std::max<size_t>(1, 4096 / std::max<size_t>(1, draw.vertexCount)));
+
+    // 2) setup and binning, chunk by chunk in primitive order
+    const size_t tileCount = (size_t)mTilesX * mTilesY;
+    const size_t trianglesPerChunk = std::max<size_t>(1024, triangleCount / (mJobs.GetThreadCount() * 4) + 1);
+    const size_t chunkCount = (triangleCount + trianglesPerChunk - 1) / trianglesPerChunk;
+    if(mChunks.size() < chunkCount) {
+        mChunks.resize(chunkCount);
+    }
+    const float guardBand = std::max(1.0f, 32000.0f / (float)std::max(mColor.width, mColor.height) - 1.0f);
+    mJobs.ParallelFor(chunkCount, [&](size_t begin, size_t end) {
+        glm::vec4 planes[7];
+        const int planeCount = ClipPlanes(guardBand, planes);
+        for(size_t c = begin; c < end; ++c) {
+            Chunk& chunk = mChunks[c];
+            chunk.triangles.clear();
+            chunk.bins.resize(tileCount);
+            for(std::vector<uint32_t>& bin : chunk.bins) {
+                bin.clear();
+            }
+
+            const size_t last = std::min(triangleCount, (c + 1) * trianglesPerChunk);
+            for(size_t t = c * trianglesPerChunk; t < last; ++t) {
+                const size_t instance = t / trianglesPerInstance;
+                const uint32_t* index = draw.indices + (t % trianglesPerInstance) * 3;
+                if(index[0] >= draw.vertexCount || index[1] >= draw.vertexCount || index[2] >= draw.vertexCount) {
+                    continue;
+                }
+                const ClipVertex* base = mClipVertices.data() + instance * draw.vertexCount;
+                const ClipVertex* corners[3] = {base + index[0], base + index[1], base + index[2]};
+
+                // most triangles are entirely inside and skip the clipper
+                unsigned outside = 0;
+                for(int p = 0; p < planeCount; ++p) {
+                    for(int k = 0; k < 3; ++k) {
+                        if(glm::dot(planes[p], corners[k]->position) < (p == 2 ? 1e-6f : 0.0f)) {
+                            outside |= 1u << p;
+                        }
+                    }
+                }
+                if(outside == 0) {
+                    SetupTriangle(corners, chunk);
+                    continue;
+                }
+
+                // Sutherland-Hodgman against the planes the triangle crosses, then a fan
+                ClipVertex polygon[2][16];
+                int count = 3;
+                for(int k = 0; k < 3; ++k) {
+                    polygon[0][k] = *corners[k];
+                }
+                int current = 0;
+                for(int p = 0; p < planeCount && count >= 3; ++p) {
+                    if(!(outside & (1u << p))) {
+                        continue;
+                    }
+                    const float epsilon = p == 2 ? 1e-6f : 0.0f;
+                    const ClipVertex* in = polygon[current];
+                    ClipVertex* out = polygon[current ^ 1];
+                    int outCount = 0;
+                    for(int k = 0; k < count; ++k) {
+                        const ClipVertex& a = in[k];
+                        const ClipVertex& b = in[(k + 1) % count];
+                        const float da = glm::dot(planes[p], a.position) - epsilon;
+                        const float db = glm::dot(planes[p], b.position) - epsilon;
+                        if(da >= 0.0f) {
+                            out[outCount++] = a;
+                        }
+                        if((da >= 0.0f) != (db >= 0.0f)) {
+                            const float s = da / (da - db);
+                            ClipVertex& v = out[outCount++];
+                            v.position = a.position + (b.position - a.position) * s;
+                            for(int i = 0; i < 5; ++i) {
+                                v.attributes[i] = a.attributes[i] + (b.attributes[i] - a.attributes[i]) * s;
+                            }
+                        }
+                    }
+                    count = outCount;
+                    current ^= 1;
+                }
+                for(int k = 1; k + 1 < count; ++k) {
+                    const ClipVertex* fan[3] = {&polygon[current][0], &polygon[current][k], &polygon[current][k + 1]};
+                    SetupTriangle(fan, chunk);
+                }
+            }
+        }
+    }, 1);
+
+    for(size_t c = 0; c < chunkCount; ++c) {
+        mTriangleCount += mChunks[c].triangles.size();
+        for(const std::vector<uint32_t>& bin : mChunks[c].bins) {
+            mBinnedCount += bin.size();
+        }
+    }
+    for(size_t c = chunkCount; c < mChunks.size(); ++c) {
+        mChunks[c].triangles.clear(); // not part of this draw
+        for(std::vector<uint32_t>& bin : mChunks[c].bins) {
+            bin.clear();
+        }
+    }
+
+    // 3) tiles, one thread each
+    mJobs.ParallelFor(tileCount, [this, &draw](size_t begin, size_t end) {
+        for(size_t tile = begin; tile < end; ++tile) {
+            RasterizeTile((int)(tile % mTilesX), (int)(tile / mTilesX), draw.depthTest);
+        }
+    }, 1);
+}
+
+void SoftRasterizer::SetupTriangle(const ClipVertex* const vertices[3], Chunk& chunk) {
+    float x[3], y[3], inverseW[3];
+    for(int k = 0; k < 3; ++k) {
+        const glm::vec4& p = vertices[k]->position;
+        inverseW[k] = 1.0f / p.w;
+        // viewport transform, snapped to 1/256 pixel: every later computation starts from exact values
+        x[k] = std::nearbyint((p.x * inverseW[k] * 0.5f + 0.5f) * mColor.width * 256.0f) * (1.0f / 256.0f);
+        y[k] = std::nearbyint((p.y * inverseW[k] * 0.5f + 0.5f) * mColor.height * 256.0f) * (1.0f / 256.0f);
+    }
+
+    // no face culling: clockwise triangles are turned around so the inside is always positive
+    int order[3] = {0, 1, 2};
+    float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+    if(area == 0.0f) {
+        return;
+    }
+    if(area < 0.0f) {
+        std::swap(order[1], order[2]);
+        area = -area;
+    }
+
+    Triangle triangle;
+    triangle.originX = x[order[0]];
+    triangle.originY = y[order[0]];
+    float minX = x[0], maxX = x[0], minY = y[0], maxY = y[0];
+    for(int k = 1; k < 3; ++k) {
+        minX = std::min(minX, x[k]);
+        maxX = std::max(maxX, x[k]);
+        minY = std::min(minY, y[k]);
+        maxY = std::max(maxY, y[k]);
+    }
+    // pixel centers at +0.5 inside the bounds
+    triangle.minX = std::max(0, (int)std::ceil(minX - 0.5f));
+    triangle.maxX = std::min(mColor.width - 1, (int)std::floor(maxX - 0.5f));
+    triangle.minY = std::max(0, (int)std::ceil(minY - 0.5f));
+    triangle.maxY = std::min(mColor.height - 1, (int)std::floor(maxY - 0.5f));
+    if(triangle.minX > triangle.maxX || triangle.minY > triangle.maxY) {
+        return; // falls between pixel centers or lies outside the viewport
+    }
+
+    // edge e runs from vertex e+1 to vertex e+2 (the edge opposite vertex e), so E_e / area is the weight of e
+    for(int e = 0; e < 3; ++e) {
+        const int a = order[(e + 1) % 3];
+        const int b = order[(e + 2) % 3];
+        triangle.edgeA[e] = y[a] - y[b];
+        triangle.edgeB[e] = x[b] - x[a];
+        triangle.edgeC[e] = x[a] * y[b] - x[b] * y[a];
+        // inside is to the left (y up): left edges point down, top edges point left
+        const float dx = x[b] - x[a];
+        const float dy = y[b] - y[a];
+        triangle.topLeft[e] = dy < 0.0f || (dy == 0.0f && dx < 0.0f);
+    }
+
+    // f(x, y) = f0 + a (x - x0) + b (y - y0) for 1/w, every attribute / w and z / w
+    for(int plane = 0; plane < 7; ++plane) {
+        float values[3];
+        for(int k = 0; k < 3; ++k) {
+            const int v = order[k];
+            values[k] = plane == 0 ? inverseW[v]
+                      : plane == 6 ? vertices[v]->position.z * inverseW[v]
+                                   : vertices[v]->attributes[plane - 1] * inverseW[v];
+        }
+        float a = 0.0f, b = 0.0f;
+        for(int e = 0; e < 3; ++e) {
+            a += triangle.edgeA[e] * values[e];
+            b += triangle.edgeB[e] * values[e];
+        }
+        float* out = plane < 6 ? triangle.planes[plane] : triangle.depthPlane;
+        out[0] = a / area;
+        out[1] = b / area;
+        out[2] = values[0];
+    }
+
+    const uint32_t index = (uint32_t)chunk.triangles.size();
+    chunk.triangles.push_back(triangle);
+    for(int ty = triangle.minY / TileSize; ty <= triangle.maxY / TileSize; ++ty) {
+        for(int tx = triangle.minX / TileSize; tx <= triangle.maxX / TileSize; ++tx) {
+            chunk.bins[(size_t)ty * mTilesX + tx].push_back(index);
+        }
+    }
+}
+
+void SoftRasterizer::RasterizeTile(int tileX, int tileY, bool depthTest) {
+    const ColorTables& tables = Tables();
+    const float* texels = mTexture.texels.empty() ? nullptr : mTexture.texels.data();
+    const size_t tile = (size_t)tileY * mTilesX + tileX;
+    const int tileMinX = tileX * TileSize;
+    const int tileMinY = tileY * TileSize;
+    const int tileMaxX = std::min(mColor.width, tileMinX + TileSize) - 1;
+    const int tileMaxY = std::min(mColor.height, tileMinY + TileSize) - 1;
+#if LEARNGL_X86
+    const bool sse2 = mSimd >= SimdLevel::SSE2;
+#else
+    const bool sse2 = false;
+#endif
+    RowAttributes row;
+
+    for(const Chunk& chunk : mChunks) {
+        if(chunk.bins.size() <= tile) {
+            continue;
+        }
+        for(uint32_t index : chunk.bins[tile]) {
+            const Triangle& triangle = chunk.triangles[index];
+            const int minX = std::max(tileMinX, triangle.minX);
+            const int maxX = std::min(tileMaxX, triangle.maxX);
+            const int minY = std::max(tileMinY, triangle.minY);
+            const int maxY = std::min(tileMaxY, triangle.maxY);
+
+            // 4x4 quads aligned to the tile; the bounds mask the columns and rows outside the triangle
+            for(int quadY = minY & ~3; quadY <= maxY; quadY += 4) {
+                for(int quadX = minX & ~3; quadX <= maxX; quadX += 4) {
+                    int columnMask = 0;
+                    for(int i = 0; i < 4; ++i) {
+                        if(quadX + i >= minX && quadX + i <= maxX) {
+                            columnMask |= 1 << i;
+                        }
+                    }
+                    for(int y = std::max(quadY, minY); y <= std::min(quadY + 3, maxY); ++y) {
+                        uint8_t* pixels = mColor.Row(y) + quadX * 4;
+                        float* depthRow = mDepth.data() + (size_t)y * mColor.width;
+#if LEARNGL_X86
+                        if(sse2) {
+                            int mask = RowCoverageSse2(triangle, quadX, y, columnMask, row);
+                            if(depthTest && mask != 0) {
+                                mask = DepthTestRow(triangle, quadX, y, mask, depthRow);
+                            }
+                            for(int i = 0; i < 4; ++i) {
+                                if(mask & (1 << i)) {
+                                    ShadePixelSse2(tables, texels, mTexture.width, mTexture.height, mTexture.clampToEdge, row, i, pixels + i * 4);
+                                }
+                            }
+                            continue;
+                        }
+#endif
+                        int mask = RowCoverageScalar(triangle, quadX, y, columnMask, row);
+                        if(depthTest && mask != 0) {
+                            mask = DepthTestRow(triangle, quadX, y, mask, depthRow);
+                        }
+                        for(int i = 0; i < 4; ++i) {
+                            if(mask & (1 << i)) {
+                                ShadePixelScalar(tables, texels, mTexture.width, mTexture.height, mTexture.clampToEdge, row, i, pixels + i * 4);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+/*
+Software rasterizer: the scene pipeline on the CPU (--backend soft), for hosts without a GPU where going through
+a general-purpose GL driver costs more than the few features the scene uses.
+
+It implements exactly what the scene shaders and PreDraw() do, nothing more:
+- vertices in the MeshData layout (position, color, texture coordinate), instanced with a world matrix and an
+  atlas UV rect per instance; gl_Position = u_Projection * u_View * u_ModelMatrix * instanceModel * position
+- clipping against the near and far planes and a guard band, no face culling. The depth test (GL_LESS on z / w,
+  with depth writes) is on only for draws that ask for it, like PreDraw() enables GL_DEPTH_TEST for occlusion
+  culling; otherwise draw order wins, like the GL path with GL_DEPTH_TEST off
+- perspective-correct vColor and vTexCoord, fragColor = vec4(vColor, 1) * texture(u_Texture, vTexCoord) with a
+  bilinear sample of level 0 in linear light (sRGB decoded), written sRGB encoded like GL_FRAMEBUFFER_SRGB
+
+Pipeline of Draw(), every stage a ParallelFor on the job system:
+1. vertex stage: every vertex of every instance to clip space
+2. setup and binning: triangles are clipped, snapped to 1/256 pixel and appended to the bins of the 64x64 tiles
+   their bounding box touches. Each chunk of triangles has bins of its own, so no locks, and walking the chunks
+   in order keeps the primitive order GL guarantees.
+3. tiles: each tile is rasterized by one thread, triangle by triangle, in 4x4 pixel quads. Coverage comes from
+   the three half-space edge functions with a top-left fill rule; shared edges evaluate to exactly negated
+   values, so neighbouring triangles neither overlap nor leave gaps. The SSE2 kernel handles a quad as four
+   rows of four pixels.
+
+The color buffer is RGBA8, bottom row first, like glReadPixels returns it, so it can be uploaded or written as is.
+*/
+
+#include "cpu_features.hpp"
+#include "image_decoder.hpp"
+#include "job_system.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+struct SoftDrawCall {
+    const float* vertices = nullptr;      // MeshData::FloatsPerVertex floats each
+    size_t vertexCount = 0;
+    const uint32_t* indices = nullptr;    // triangle list
+    size_t indexCount = 0;
+    const glm::mat4* instanceMatrices = nullptr;
+    const glm::vec4* instanceUvRects = nullptr; // null = (0, 0, 1, 1) for every instance
+    size_t instanceCount = 0;
+
+    glm::mat4 modelMatrix = glm::mat4(1.0f); // u_ModelMatrix
+    glm::mat4 view = glm::mat4(1.0f);        // u_View
+    glm::mat4 projection = glm::mat4(1.0f);  // u_Projection
+    bool depthTest = false;                  // GL_DEPTH_TEST with GL_LESS
+};
+
+class SoftRasterizer {
+public:
+    static const int TileSize = 64;
+
+    explicit SoftRasterizer(JobSystem& jobs);
+
+    SoftRasterizer(const SoftRasterizer&) = delete;
+    SoftRasterizer& operator=(const SoftRasterizer&) = delete;
+
+    // Reallocates the color and depth buffers when the size changed (their contents are undefined afterwards)
+    void Resize(int width, int height);
+
+    // u_Texture for the following draws: RGBA8 sRGB, bottom row first (glGetTexImage order). Decoded to linear
+    // floats once here, so sampling is a weighted sum of four texels. Null or empty = white.
+    void SetTexture(const Image* srgbImage, bool clampToEdge = false);
+
+    // Fills the color buffer and resets the depth buffer to the far plane; 'linearColor' is encoded like
+    // glClearColor with GL_FRAMEBUFFER_SRGB on
+    void Clear(const glm::vec4& linearColor);
+
+    void Draw(const SoftDrawCall& draw);
+
+    const Image& ColorBuffer() const { return mColor; }
+
+    // Triangles binned by the last Draw() after clipping, and how many tile entries they made
+    size_t TriangleCount() const { return mTriangleCount; }
+    size_t BinnedCount() const { return mBinnedCount; }
+
+private:
+    struct ClipVertex {
+        glm::vec4 position;
+        float attributes[5]; // r, g, b, u, v
+    };
+
+    // A triangle after clipping, in window coordinates, ready for the tiles
+    struct Triangle {
+        float edgeA[3], edgeB[3], edgeC[3]; // E(x, y) = A x + B y + C, positive inside
+        bool topLeft[3];                    // pixel centers exactly on the edge belong to this triangle
+        float planes[6][3];                 // 1/w and every attribute / w: a, b and the value c at the origin
+        float depthPlane[3];                // z / w, linear in window space, in the same form
+        float originX, originY;             // first vertex, the planes are relative to it (small, exact offsets)
+        int minX, minY, maxX, maxY;         // pixel bounds, inclusive, inside the viewport
+    };
+
+    struct LinearTexture {
+        int width = 0;
+        int height = 0;
+        bool clampToEdge = false;  // GL_CLAMP_TO_EDGE instead of GL_REPEAT
+        std::vector<float> texels; // RGBA
+    };
+
+    struct Chunk {
+        std::vector<Triangle> triangles;
+        std::vector<std::vector<uint32_t>> bins; // per tile: indices into 'triangles', in primitive order
+    };
+
+    void SetupTriangle(const ClipVertex* const vertices[3], Chunk& chunk);
+    void RasterizeTile(int tileX, int tileY, bool depthTest);
+
+    JobSystem& mJobs;
+    SimdLevel mSimd;
+    Image mColor;
+    std::vector<float> mDepth; // z / w per pixel, same layout as mColor
+    LinearTexture mTexture;
+    int mTilesX = 0;
+    int mTilesY = 0;
+
+    std::vector<ClipVertex> mClipVertices; // instance after instance
+    std::vector<Chunk> mChunks;            // reused between draws, keeps the allocations
+    size_t mTriangleCount = 0;
+    size_t mBinnedCount = 0;
+};
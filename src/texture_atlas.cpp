@@ -0,0 +1,211 @@
+#include "texture_atlas.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+static bool Fail(std::string* error, const std::string& message) {
+    if(error) {
+        *error = message;
+    }
+    return false;
+}
+
+SkylinePacker::SkylinePacker(int width, int height) : mWidth(width), mHeight(height) {
+    mSkyline.push_back(Segment{0, 0, width});
+}
+
+int SkylinePacker::FitAt(size_t index, int width, int height) const {
+    int x = mSkyline[index].x;
+    if(x + width > mWidth) {
+        return -1;
+    }
+    int y = 0;
+    int remaining = width;
+    for(size_t i = index; remaining > 0; ++i) {
+        if(i >= mSkyline.size()) {
+            return -1;
+        }
+        y = std::max(y, mSkyline[i].y);
+        if(y + height > mHeight) {
+            return -1;
+        }
+        remaining -= mSkyline[i].width;
+    }
+    return y;
+}
+
+bool SkylinePacker::Insert(int width, int height, int& outX, int& outY) {
+    int bestIndex = -1, bestY = 0, bestTop = mHeight + 1, bestSegmentWidth = 0;
+    for(size_t i = 0; i < mSkyline.size(); ++i) {
+        int y = FitAt(i, width, height);
+        if(y < 0) {
+            continue;
+        }
+        // lowest top edge wins; ties go to the narrower segment (less wasted space under the rectangle)
+        int top = y + height;
+        if(top < bestTop || (top == bestTop && mSkyline[i].width < bestSegmentWidth)) {
+            bestIndex = (int)i;
+            bestY = y;
+            bestTop = top;
+            bestSegmentWidth = mSkyline[i].width;
+        }
+    }
+    if(bestIndex < 0) {
+        return false;
+    }
+
+    outX = mSkyline[bestIndex].x;
+    outY = bestY;
+    mUsedArea += (long long)width * height;
+
+    // the new segment covers [x, x + width); shrink or remove the segments it shadows
+    Segment added{outX, bestY + height, width};
+    mSkyline.insert(mSkyline.begin() + bestIndex, added);
+    for(size_t i = bestIndex + 1; i < mSkyline.size(); ) {
+        const int coveredEnd = added.x + added.width;
+        if(mSkyline[i].x >= coveredEnd) {
+            break;
+        }
+        int shrink = coveredEnd - mSkyline[i].x;
+        mSkyline[i].x += shrink;
+        mSkyline[i].width -= shrink;
+        if(mSkyline[i].width <= 0) {
+            mSkyline.erase(mSkyline.begin() + i);
+        }
+        else {
+            break;
+        }
+    }
+
+    // merge neighbours at the same height
+    for(size_t i = 0; i + 1 < mSkyline.size(); ) {
+        if(mSkyline[i].y == mSkyline[i + 1].y) {
+            mSkyline[i].width += mSkyline[i + 1].width;
+            mSkyline.erase(mSkyline.begin() + i + 1);
+        }
+        else {
+            ++i;
+        }
+    }
+    return true;
+}
+
+int AtlasMipLevelLimit(int padding) {
+    int levels = 1;
+    while(padding > 1) {
+        padding >>= 1;
+        ++levels;
+    }
+    return levels;
+}
+
+static int RoundUp(int value, int multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+bool BuildTextureAtlas(const std::vector<Image>& images, const AtlasOptions& options, Image& atlas,
+                       std::vector<AtlasRegion>& regions, std::string* error) {
+    if(images.empty()) {
+        return Fail(error, "no images to pack");
+    }
+    const int padding = std::max(0, options.padding);
+    const int alignment = 4; // block-compression friendly
+
+    // padded, aligned footprint of every image
+    std::vector<int> footprintWidth(images.size()), footprintHeight(images.size());
+    long long area = 0;
+    for(size_t i = 0; i < images.size(); ++i) {
+        footprintWidth[i] = RoundUp(images[i].width + 2 * padding, alignment);
+        footprintHeight[i] = RoundUp(images[i].height + 2 * padding, alignment);
+        area += (long long)footprintWidth[i] * footprintHeight[i];
+    }
+
+    // tallest first: the skyline stays flat and leaves fewer holes
+    std::vector<size_t> order(images.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        if(footprintHeight[a] != footprintHeight[b]) {
+            return footprintHeight[a] > footprintHeight[b];
+        }
+        return footprintWidth[a] > footprintWidth[b];
+    });
+
+    // power-of-two sizes starting at the smallest (square or 2:1) one that could hold the area, growing alternately
+    int width = 1;
+    while((long long)width * width < area) {
+        width <<= 1;
+    }
+    int height = (long long)width * (width / 2) >= area ? width / 2 : width;
+    regions.assign(images.size(), AtlasRegion());
+    bool packed = false;
+    while(!packed && width <= options.maxSize && height <= options.maxSize) {
+        SkylinePacker packer(width, height);
+        packed = true;
+        for(size_t i : order) {
+            int x = 0, y = 0;
+            if(!packer.Insert(footprintWidth[i], footprintHeight[i], x, y)) {
+                packed = false;
+                break;
+            }
+            regions[i].x = x + padding;
+            regions[i].y = y + padding;
+        }
+        if(!packed) {
+            if(height < width) {
+                height <<= 1;
+            }
+            else {
+                width <<= 1;
+            }
+        }
+    }
+    if(!packed) {
+        return Fail(error, "textures do not fit into a " + std::to_string(options.maxSize) + " atlas");
+    }
+
+    atlas.width = width;
+    atlas.height = height;
+    atlas.pixels.assign(atlas.ByteSize(), 0);
+    for(size_t i = 0; i < images.size(); ++i) {
+        const Image& image = images[i];
+        AtlasRegion& region = regions[i];
+        region.width = image.width;
+        region.height = image.height;
+        region.layer = 0;
+        region.uvOffset[0] = (float)region.x / (float)width;
+        region.uvOffset[1] = (float)region.y / (float)height;
+        region.uvScale[0] = (float)image.width / (float)width;
+        region.uvScale[1] = (float)image.height / (float)height;
+
+        // copy with the border: texels outside the image repeat its nearest edge texel
+        for(int y = -padding; y < image.height + padding; ++y) {
+            const uint8_t* sourceRow = image.Row(std::min(std::max(y, 0), image.height - 1));
+            uint8_t* destination = atlas.Row(region.y + y) + (size_t)(region.x - padding) * 4;
+            for(int x = -padding; x < image.width + padding; ++x, destination += 4) {
+                const uint8_t* source = sourceRow + (size_t)std::min(std::max(x, 0), image.width - 1) * 4;
+                destination[0] = source[0];
+                destination[1] = source[1];
+                destination[2] = source[2];
+                destination[3] = source[3];
+            }
+        }
+    }
+    return true;
+}
+
+bool BuildTextureArrayRegions(const std::vector<Image>& images, std::vector<AtlasRegion>& regions, std::string* error) {
+    if(images.empty()) {
+        return Fail(error, "no images to pack");
+    }
+    regions.assign(images.size(), AtlasRegion());
+    for(size_t i = 0; i < images.size(); ++i) {
+        if(images[i].width != images[0].width || images[i].height != images[0].height) {
+            return Fail(error, "texture array layers must share one size");
+        }
+        regions[i].width = images[i].width;
+        regions[i].height = images[i].height;
+        regions[i].layer = (int)i;
+    }
+    return true;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+/*
+Packing many small textures into one bind point.
+
+- Atlas (GL_TEXTURE_2D): images of any size are placed with a skyline bottom-left packer. Every image gets
+  'padding' pixels of border around it, filled by extruding its edge pixels, so bilinear filtering and the
+  first few mip levels do not bleed neighbours into it. Positions are aligned to 4 pixels so the atlas can
+  also be block-compressed without blocks straddling two images.
+  Only UVs inside [0, 1] remap correctly; textures that rely on GL_REPEAT tiling do not belong in an atlas.
+- Array (GL_TEXTURE_2D_ARRAY): images of identical size become layers; no padding or mip limits needed.
+
+Both produce one AtlasRegion per input image, in input order: the remap table a material uses to turn its
+mesh UVs into atlas UVs (uv * uvScale + uvOffset, and the array layer), e.g. as a per-instance attribute.
+*/
+
+#include "image_decoder.hpp"
+
+#include <string>
+#include <vector>
+
+struct AtlasRegion {
+    int x = 0, y = 0;          // texel position of the image (inside its padding), bottom-left origin
+    int width = 0, height = 0;
+    int layer = 0;             // array layer (always 0 in an atlas)
+    float uvOffset[2] = {0.0f, 0.0f};
+    float uvScale[2] = {1.0f, 1.0f};
+};
+
+struct AtlasOptions {
+    int padding = 8;     // border texels per side; mip level n keeps padding >> n of them
+    int maxSize = 8192;  // largest atlas side tried
+};
+
+// Skyline bottom-left rectangle packer: keeps the top edge of the packed area as a list of horizontal
+// segments and puts each rectangle where its top ends up lowest. Fast, and good for texture-sized inputs
+// sorted by height.
+class SkylinePacker {
+public:
+    SkylinePacker(int width, int height);
+
+    // false if the rectangle does not fit anywhere
+    bool Insert(int width, int height, int& x, int& y);
+
+    int Width() const { return mWidth; }
+    int Height() const { return mHeight; }
+    float Occupancy() const { return (float)mUsedArea / ((float)mWidth * (float)mHeight); }
+
+private:
+    struct Segment {
+        int x, y, width;
+    };
+
+    // lowest y a rectangle of 'width' can sit at when its left edge is at segment 'index'; -1 if it does not fit
+    int FitAt(size_t index, int width, int height) const;
+
+    int mWidth, mHeight;
+    long long mUsedArea = 0;
+    std::vector<Segment> mSkyline;
+};
+
+// Packs 'images' into one atlas. Fails if they do not fit into maxSize x maxSize.
+bool BuildTextureAtlas(const std::vector<Image>& images, const AtlasOptions& options, Image& atlas,
+                       std::vector<AtlasRegion>& regions, std::string* error = nullptr);
+
+// Mip levels an atlas with this padding can have before neighbours bleed into each other
+int AtlasMipLevelLimit(int padding);
+
+// Validates that all images share one size and fills the regions (layer = index). The images become the layers.
+bool BuildTextureArrayRegions(const std::vector<Image>& images, std::vector<AtlasRegion>& regions, std::string* error = nullptr);
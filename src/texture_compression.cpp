@@ -0,0 +1,795 @@
+#include "texture_compression.hpp"
+#include "cpu_features.hpp"
+#include "job_system.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sys/stat.h>
+
+#if LEARNGL_X86
+#include <immintrin.h>
+#endif
+
+size_t BlockBytes(BlockFormat format) {
+    return (format == BlockFormat::BC1 || format == BlockFormat::BC4) ? 8 : 16;
+}
+
+size_t CompressedImageBytes(BlockFormat format, int width, int height) {
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * BlockBytes(format);
+}
+
+const char* BlockFormatName(BlockFormat format) {
+    switch(format) {
+        case BlockFormat::BC1: return "BC1";
+        case BlockFormat::BC3: return "BC3";
+        case BlockFormat::BC4: return "BC4";
+        case BlockFormat::BC5: return "BC5";
+        case BlockFormat::BC7: return "BC7";
+    }
+    return "?";
+}
+
+bool ParseBlockFormat(const std::string& name, BlockFormat& format) {
+    std::string lower = name;
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+    for(BlockFormat candidate : {BlockFormat::BC1, BlockFormat::BC3, BlockFormat::BC4, BlockFormat::BC5, BlockFormat::BC7}) {
+        std::string candidateName = BlockFormatName(candidate);
+        std::transform(candidateName.begin(), candidateName.end(), candidateName.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+        if(lower == candidateName) {
+            format = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+namespace {
+
+// One 4x4 block as channel streams: c[channel][pixel], pixel = y * 4 + x
+struct BlockPixels {
+    alignas(32) float c[4][16];
+};
+
+void LoadBlock(const Image& image, int blockX, int blockY, BlockPixels& block) {
+    // partial blocks at the right/top edge repeat the last row/column
+    for(int y = 0; y < 4; ++y) {
+        const int sy = std::min(blockY * 4 + y, image.height - 1);
+        const uint8_t* row = image.Row(sy);
+        for(int x = 0; x < 4; ++x) {
+            const int sx = std::min(blockX * 4 + x, image.width - 1);
+            const uint8_t* p = row + sx * 4;
+            for(int channel = 0; channel < 4; ++channel) {
+                block.c[channel][y * 4 + x] = p[channel];
+            }
+        }
+    }
+}
+
+// ---- palette search -------------------------------------------------------------------------------------------------
+// For every pixel: index of the nearest palette entry (squared distance over 'channels'). Returns the total error.
+
+float SelectIndicesScalar(const BlockPixels& block, int channels, const float (*palette)[4], int paletteSize, uint8_t* indices) {
+    float total = 0.0f;
+    for(int i = 0; i < 16; ++i) {
+        float best = 1e30f;
+        int bestIndex = 0;
+        for(int k = 0; k < paletteSize; ++k) {
+            float d = 0.0f;
+            for(int channel = 0; channel < channels; ++channel) {
+                float diff = block.c[channel][i] - palette[k][channel];
+                d += diff * diff;
+            }
+            if(d < best) {
+                best = d;
+                bestIndex = k;
+            }
+        }
+        indices[i] = (uint8_t)bestIndex;
+        total += best;
+    }
+    return total;
+}
+
+#if LEARNGL_X86
+float SelectIndicesSse2(const BlockPixels& block, int channels, const float (*palette)[4], int paletteSize, uint8_t* indices) {
+    __m128 total = _mm_setzero_ps();
+    for(int i = 0; i < 16; i += 4) {
+        __m128 best = _mm_set1_ps(1e30f);
+        __m128i bestIndex = _mm_setzero_si128();
+        for(int k = 0; k < paletteSize; ++k) {
+            __m128 d = _mm_setzero_ps();
+            for(int channel = 0; channel < channels; ++channel) {
+                __m128 diff = _mm_sub_ps(_mm_load_ps(block.c[channel] + i), _mm_set1_ps(palette[k][channel]));
+                d = _mm_add_ps(d, _mm_mul_ps(diff, diff));
+            }
+            __m128i closer = _mm_castps_si128(_mm_cmplt_ps(d, best));
+            best = _mm_min_ps(best, d);
+            bestIndex = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(k)), _mm_andnot_si128(closer, bestIndex));
+        }
+        alignas(16) int32_t lanes[4];
+        _mm_store_si128((__m128i*)lanes, bestIndex);
+        for(int lane = 0; lane < 4; ++lane) {
+            indices[i + lane] = (uint8_t)lanes[lane];
+        }
+        total = _mm_add_ps(total, best);
+    }
+    alignas(16) float sums[4];
+    _mm_store_ps(sums, total);
+    return sums[0] + sums[1] + sums[2] + sums[3];
+}
+
+LEARNGL_TARGET_AVX2
+float SelectIndicesAvx2(const BlockPixels& block, int channels, const float (*palette)[4], int paletteSize, uint8_t* indices) {
+    __m256 total = _mm256_setzero_ps();
+    for(int i = 0; i < 16; i += 8) {
+        __m256 best = _mm256_set1_ps(1e30f);
+        __m256 bestIndex = _mm256_setzero_ps(); // indices kept as floats so blendv can pick them
+        for(int k = 0; k < paletteSize; ++k) {
+            __m256 d = _mm256_setzero_ps();
+            for(int channel = 0; channel < channels; ++channel) {
+                __m256 diff = _mm256_sub_ps(_mm256_load_ps(block.c[channel] + i), _mm256_set1_ps(palette[k][channel]));
+                d = _mm256_fmadd_ps(diff, diff, d);
+            }
+            __m256 closer = _mm256_cmp_ps(d, best, _CMP_LT_OQ);
+            best = _mm256_min_ps(best, d);
+            bestIndex = _mm256_blendv_ps(bestIndex, _mm256_set1_ps((float)k), closer);
+        }
+        alignas(32) int32_t lanes[8];
+        _mm256_store_si256((__m256i*)lanes, _mm256_cvtps_epi32(bestIndex));
+        for(int lane = 0; lane < 8; ++lane) {
+            indices[i + lane] = (uint8_t)lanes[lane];
+        }
+        total = _mm256_add_ps(total, best);
+    }
+    alignas(32) float sums[8];
+    _mm256_store_ps(sums, total);
+    return sums[0] + sums[1] + sums[2] + sums[3] + sums[4] + sums[5] + sums[6] + sums[7];
+}
+#endif
+
+float SelectIndices(const BlockPixels& block, int channels, const float (*palette)[4], int paletteSize, uint8_t* indices) {
+    switch(GetSimdLevel()) {
+#if LEARNGL_X86
+        case SimdLevel::AVX2: return SelectIndicesAvx2(block, channels, palette, paletteSize, indices);
+        case SimdLevel::SSE2: return SelectIndicesSse2(block, channels, palette, paletteSize, indices);
+#endif
+        default: return SelectIndicesScalar(block, channels, palette, paletteSize, indices);
+    }
+}
+
+// ---- endpoint fitting -----------------------------------------------------------------------------------------------
+
+// Endpoints along the principal axis of the block, spanning the projected extent
+void FitPrincipalAxis(const BlockPixels& block, int channels, float low[4], float high[4]) {
+    float mean[4] = {0, 0, 0, 0};
+    float minimum[4], maximum[4];
+    for(int channel = 0; channel < channels; ++channel) {
+        minimum[channel] = maximum[channel] = block.c[channel][0];
+        for(int i = 0; i < 16; ++i) {
+            float v = block.c[channel][i];
+            mean[channel] += v;
+            minimum[channel] = std::min(minimum[channel], v);
+            maximum[channel] = std::max(maximum[channel], v);
+        }
+        mean[channel] /= 16.0f;
+    }
+
+    float covariance[4][4] = {};
+    for(int i = 0; i < 16; ++i) {
+        for(int a = 0; a < channels; ++a) {
+            for(int b = a; b < channels; ++b) {
+                covariance[a][b] += (block.c[a][i] - mean[a]) * (block.c[b][i] - mean[b]);
+            }
+        }
+    }
+    for(int a = 0; a < channels; ++a) {
+        for(int b = 0; b < a; ++b) {
+            covariance[a][b] = covariance[b][a];
+        }
+    }
+
+    // power iteration, seeded with the bounding box diagonal
+    float axis[4] = {0, 0, 0, 0};
+    for(int channel = 0; channel < channels; ++channel) {
+        axis[channel] = maximum[channel] - minimum[channel];
+    }
+    for(int iteration = 0; iteration < 8; ++iteration) {
+        float next[4] = {0, 0, 0, 0};
+        float length = 0.0f;
+        for(int a = 0; a < channels; ++a) {
+            for(int b = 0; b < channels; ++b) {
+                next[a] += covariance[a][b] * axis[b];
+            }
+            length += next[a] * next[a];
+        }
+        if(length < 1e-12f) {
+            break; // flat block (or the seed was orthogonal to all variance): keep the seed
+        }
+        length = 1.0f / std::sqrt(length);
+        for(int a = 0; a < channels; ++a) {
+            axis[a] = next[a] * length;
+        }
+    }
+
+    float axisLength = 0.0f;
+    for(int channel = 0; channel < channels; ++channel) {
+        axisLength += axis[channel] * axis[channel];
+    }
+    if(axisLength < 1e-12f) {
+        for(int channel = 0; channel < channels; ++channel) {
+            low[channel] = high[channel] = mean[channel];
+        }
+        return;
+    }
+    axisLength = 1.0f / std::sqrt(axisLength);
+
+    float tMin = 1e30f, tMax = -1e30f;
+    for(int i = 0; i < 16; ++i) {
+        float t = 0.0f;
+        for(int channel = 0; channel < channels; ++channel) {
+            t += (block.c[channel][i] - mean[channel]) * axis[channel] * axisLength;
+        }
+        tMin = std::min(tMin, t);
+        tMax = std::max(tMax, t);
+    }
+    for(int channel = 0; channel < channels; ++channel) {
+        low[channel] = std::min(255.0f, std::max(0.0f, mean[channel] + axis[channel] * axisLength * tMin));
+        high[channel] = std::min(255.0f, std::max(0.0f, mean[channel] + axis[channel] * axisLength * tMax));
+    }
+}
+
+// Least-squares endpoints for fixed interpolation weights (w = 0 -> e0, w = 1 -> e1). False if degenerate.
+bool RefitEndpoints(const BlockPixels& block, int channels, const float* weights, float e0[4], float e1[4]) {
+    float a = 0, b = 0, c = 0;
+    float x0[4] = {0, 0, 0, 0}, x1[4] = {0, 0, 0, 0};
+    for(int i = 0; i < 16; ++i) {
+        float w = weights[i], v = 1.0f - w;
+        a += v * v;
+        b += v * w;
+        c += w * w;
+        for(int channel = 0; channel < channels; ++channel) {
+            x0[channel] += v * block.c[channel][i];
+            x1[channel] += w * block.c[channel][i];
+        }
+    }
+    float determinant = a * c - b * b;
+    if(std::fabs(determinant) < 1e-6f) {
+        return false;
+    }
+    float inverse = 1.0f / determinant;
+    for(int channel = 0; channel < channels; ++channel) {
+        e0[channel] = std::min(255.0f, std::max(0.0f, (c * x0[channel] - b * x1[channel]) * inverse));
+        e1[channel] = std::min(255.0f, std::max(0.0f, (a * x1[channel] - b * x0[channel]) * inverse));
+    }
+    return true;
+}
+
+// ---- BC1 color block ------------------------------------------------------------------------------------------------
+
+uint16_t Pack565(const float c[3]) {
+    int r = (int)std::lround(c[0] * 31.0f / 255.0f);
+    int g = (int)std::lround(c[1] * 63.0f / 255.0f);
+    int b = (int)std::lround(c[2] * 31.0f / 255.0f);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+void Unpack565(uint16_t packed, float c[4]) {
+    int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+    c[0] = (float)((r << 3) | (r >> 2));
+    c[1] = (float)((g << 2) | (g >> 4));
+    c[2] = (float)((b << 3) | (b >> 2));
+    c[3] = 255.0f;
+}
+
+struct ColorBlockCandidate {
+    uint16_t color0, color1;
+    uint8_t indices[16];
+    float error;
+};
+
+// Four-color mode needs color0 > color1; palette order = index code (0: c0, 1: c1, 2: 2/3 c0 + 1/3 c1, 3: 1/3 c0 + 2/3 c1)
+ColorBlockCandidate EvaluateColorEndpoints(const BlockPixels& block, const float e0[3], const float e1[3]) {
+    ColorBlockCandidate candidate;
+    candidate.color0 = Pack565(e0);
+    candidate.color1 = Pack565(e1);
+    if(candidate.color0 < candidate.color1) {
+        std::swap(candidate.color0, candidate.color1);
+    }
+
+    float palette[4][4];
+    Unpack565(candidate.color0, palette[0]);
+    Unpack565(candidate.color1, palette[1]);
+    if(candidate.color0 == candidate.color1) {
+        std::memset(candidate.indices, 0, sizeof(candidate.indices));
+        candidate.error = SelectIndices(block, 3, palette, 1, candidate.indices);
+        return candidate;
+    }
+    for(int channel = 0; channel < 3; ++channel) {
+        palette[2][channel] = (2.0f * palette[0][channel] + palette[1][channel]) / 3.0f;
+        palette[3][channel] = (palette[0][channel] + 2.0f * palette[1][channel]) / 3.0f;
+    }
+    candidate.error = SelectIndices(block, 3, palette, 4, candidate.indices);
+    return candidate;
+}
+
+void EncodeColorBlock(const BlockPixels& block, uint8_t* out) {
+    float low[4], high[4];
+    FitPrincipalAxis(block, 3, low, high);
+    ColorBlockCandidate best = EvaluateColorEndpoints(block, high, low);
+
+    if(best.color0 != best.color1) {
+        static const float codeWeights[4] = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+        float weights[16];
+        for(int i = 0; i < 16; ++i) {
+            weights[i] = codeWeights[best.indices[i]];
+        }
+        float e0[4], e1[4];
+        if(RefitEndpoints(block, 3, weights, e0, e1)) {
+            ColorBlockCandidate refined = EvaluateColorEndpoints(block, e0, e1);
+            if(refined.error < best.error) {
+                best = refined;
+            }
+        }
+    }
+
+    out[0] = (uint8_t)(best.color0 & 0xFF);
+    out[1] = (uint8_t)(best.color0 >> 8);
+    out[2] = (uint8_t)(best.color1 & 0xFF);
+    out[3] = (uint8_t)(best.color1 >> 8);
+    uint32_t bits = 0;
+    for(int i = 0; i < 16; ++i) {
+        bits |= (uint32_t)best.indices[i] << (i * 2);
+    }
+    std::memcpy(out + 4, &bits, 4); // little endian (x86/ARM)
+}
+
+void DecodeColorBlock(const uint8_t* in, bool forceFourColor, uint8_t* out, int outStride) {
+    uint16_t color0 = (uint16_t)(in[0] | (in[1] << 8));
+    uint16_t color1 = (uint16_t)(in[2] | (in[3] << 8));
+    float palette[4][4];
+    Unpack565(color0, palette[0]);
+    Unpack565(color1, palette[1]);
+    if(color0 > color1 || forceFourColor) {
+        for(int channel = 0; channel < 3; ++channel) {
+            palette[2][channel] = (2.0f * palette[0][channel] + palette[1][channel]) / 3.0f;
+            palette[3][channel] = (palette[0][channel] + 2.0f * palette[1][channel]) / 3.0f;
+        }
+        palette[2][3] = palette[3][3] = 255.0f;
+    }
+    else {
+        for(int channel = 0; channel < 3; ++channel) {
+            palette[2][channel] = (palette[0][channel] + palette[1][channel]) * 0.5f;
+            palette[3][channel] = 0.0f;
+        }
+        palette[2][3] = 255.0f;
+        palette[3][3] = 0.0f; // transparent black
+    }
+    uint32_t bits = in[4] | (in[5] << 8) | (in[6] << 16) | ((uint32_t)in[7] << 24);
+    for(int i = 0; i < 16; ++i) {
+        const float* color = palette[(bits >> (i * 2)) & 3];
+        uint8_t* p = out + (i / 4) * outStride + (i % 4) * 4;
+        for(int channel = 0; channel < 4; ++channel) {
+            p[channel] = (uint8_t)std::lround(color[channel]);
+        }
+    }
+}
+
+// ---- BC4 single-channel block (also BC3 alpha and both BC5 channels) ------------------------------------------------
+
+void EncodeChannelBlock(const float* values, uint8_t* out) {
+    float minimum = values[0], maximum = values[0];
+    for(int i = 1; i < 16; ++i) {
+        minimum = std::min(minimum, values[i]);
+        maximum = std::max(maximum, values[i]);
+    }
+    const int a0 = (int)std::lround(maximum), a1 = (int)std::lround(minimum);
+    out[0] = (uint8_t)a0;
+    out[1] = (uint8_t)a1;
+
+    uint64_t bits = 0;
+    if(a0 > a1) {
+        // eight-value mode: code 0 = a0, 1 = a1, 2..7 = (8 - code) / 7 of the way from a1 to a0
+        const float scale = 7.0f / (float)(a0 - a1);
+        for(int i = 0; i < 16; ++i) {
+            int k = (int)std::lround((values[i] - a1) * scale); // 0 = a1 ... 7 = a0
+            k = std::min(7, std::max(0, k));
+            uint64_t code = k == 7 ? 0 : (k == 0 ? 1 : (uint64_t)(8 - k));
+            bits |= code << (i * 3);
+        }
+    }
+    for(int i = 0; i < 6; ++i) {
+        out[2 + i] = (uint8_t)(bits >> (i * 8));
+    }
+}
+
+void DecodeChannelBlock(const uint8_t* in, uint8_t* out, int outStride, int channel) {
+    const int a0 = in[0], a1 = in[1];
+    int palette[8] = {a0, a1};
+    if(a0 > a1) {
+        for(int code = 2; code < 8; ++code) {
+            palette[code] = ((8 - code) * a0 + (code - 1) * a1 + 3) / 7;
+        }
+    }
+    else {
+        for(int code = 2; code < 6; ++code) {
+            palette[code] = ((6 - code) * a0 + (code - 1) * a1 + 2) / 5;
+        }
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+    uint64_t bits = 0;
+    for(int i = 0; i < 6; ++i) {
+        bits |= (uint64_t)in[2 + i] << (i * 8);
+    }
+    for(int i = 0; i < 16; ++i) {
+        out[(i / 4) * outStride + (i % 4) * 4 + channel] = (uint8_t)palette[(bits >> (i * 3)) & 7];
+    }
+}
+
+// ---- BC7 mode 6 -----------------------------------------------------------------------------------------------------
+
+const int Bc7Weights4[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+struct Bc7Endpoint {
+    int q[4]; // 7-bit per channel
+    int p;    // shared p-bit
+    int Value(int channel) const { return (q[channel] << 1) | p; }
+};
+
+Bc7Endpoint QuantizeBc7Endpoint(const float e[4]) {
+    Bc7Endpoint best{};
+    float bestError = 1e30f;
+    for(int p = 0; p < 2; ++p) {
+        Bc7Endpoint candidate{};
+        candidate.p = p;
+        float error = 0.0f;
+        for(int channel = 0; channel < 4; ++channel) {
+            int q = (int)std::lround((e[channel] - p) * 0.5f);
+            candidate.q[channel] = std::min(127, std::max(0, q));
+            float diff = (float)candidate.Value(channel) - e[channel];
+            error += diff * diff;
+        }
+        if(error < bestError) {
+            bestError = error;
+            best = candidate;
+        }
+    }
+    return best;
+}
+
+struct Bc7Candidate {
+    Bc7Endpoint e0, e1;
+    uint8_t indices[16];
+    float error;
+};
+
+Bc7Candidate EvaluateBc7Endpoints(const BlockPixels& block, const float e0[4], const float e1[4]) {
+    Bc7Candidate candidate;
+    candidate.e0 = QuantizeBc7Endpoint(e0);
+    candidate.e1 = QuantizeBc7Endpoint(e1);
+    float palette[16][4];
+    for(int k = 0; k < 16; ++k) {
+        for(int channel = 0; channel < 4; ++channel) {
+            int a = candidate.e0.Value(channel), b = candidate.e1.Value(channel);
+            palette[k][channel] = (float)(((64 - Bc7Weights4[k]) * a + Bc7Weights4[k] * b + 32) >> 6);
+        }
+    }
+    candidate.error = SelectIndices(block, 4, palette, 16, candidate.indices);
+    return candidate;
+}
+
+struct BitWriter {
+    uint8_t* out;
+    int position = 0;
+
+    void Put(uint32_t value, int bits) {
+        for(int i = 0; i < bits; ++i, ++position) {
+            if(value & (1u << i)) {
+                out[position >> 3] |= (uint8_t)(1u << (position & 7));
+            }
+        }
+    }
+};
+
+struct BitReader {
+    const uint8_t* in;
+    int position = 0;
+
+    uint32_t Get(int bits) {
+        uint32_t value = 0;
+        for(int i = 0; i < bits; ++i, ++position) {
+            value |= (uint32_t)((in[position >> 3] >> (position & 7)) & 1) << i;
+        }
+        return value;
+    }
+};
+
+void EncodeBc7Block(const BlockPixels& block, uint8_t* out) {
+    float low[4], high[4];
+    FitPrincipalAxis(block, 4, low, high);
+    Bc7Candidate best = EvaluateBc7Endpoints(block, low, high);
+
+    float weights[16];
+    for(int i = 0; i < 16; ++i) {
+        weights[i] = Bc7Weights4[best.indices[i]] / 64.0f;
+    }
+    float e0[4], e1[4];
+    if(RefitEndpoints(block, 4, weights, e0, e1)) {
+        Bc7Candidate refined = EvaluateBc7Endpoints(block, e0, e1);
+        if(refined.error < best.error) {
+            best = refined;
+        }
+    }
+
+    // the anchor (pixel 0) index is stored without its top bit: make sure that bit is zero
+    if(best.indices[0] & 8) {
+        std::swap(best.e0, best.e1);
+        for(uint8_t& index : best.indices) {
+            index = (uint8_t)(15 - index);
+        }
+    }
+
+    std::memset(out, 0, 16);
+    BitWriter writer{out};
+    writer.Put(1u << 6, 7); // mode 6
+    for(int channel = 0; channel < 4; ++channel) {
+        writer.Put((uint32_t)best.e0.q[channel], 7);
+        writer.Put((uint32_t)best.e1.q[channel], 7);
+    }
+    writer.Put((uint32_t)best.e0.p, 1);
+    writer.Put((uint32_t)best.e1.p, 1);
+    writer.Put(best.indices[0], 3);
+    for(int i = 1; i < 16; ++i) {
+        writer.Put(best.indices[i], 4);
+    }
+}
+
+void DecodeBc7Block(const uint8_t* in, uint8_t* out, int outStride) {
+    if((in[0] & 0x7F) != 0x40) {
+        // not mode 6: only our own encoder's output is understood, show it loudly
+        for(int i = 0; i < 16; ++i) {
+            uint8_t* p = out + (i / 4) * outStride + (i % 4) * 4;
+            p[0] = 255; p[1] = 0; p[2] = 255; p[3] = 255;
+        }
+        return;
+    }
+    BitReader reader{in};
+    reader.Get(7);
+    int e[2][4];
+    for(int channel = 0; channel < 4; ++channel) {
+        e[0][channel] = (int)reader.Get(7) << 1;
+        e[1][channel] = (int)reader.Get(7) << 1;
+    }
+    int p0 = (int)reader.Get(1), p1 = (int)reader.Get(1);
+    for(int channel = 0; channel < 4; ++channel) {
+        e[0][channel] |= p0;
+        e[1][channel] |= p1;
+    }
+    for(int i = 0; i < 16; ++i) {
+        int index = (int)reader.Get(i == 0 ? 3 : 4);
+        uint8_t* p = out + (i / 4) * outStride + (i % 4) * 4;
+        for(int channel = 0; channel < 4; ++channel) {
+            p[channel] = (uint8_t)(((64 - Bc7Weights4[index]) * e[0][channel] + Bc7Weights4[index] * e[1][channel] + 32) >> 6);
+        }
+    }
+}
+
+void EncodeBlock(BlockFormat format, const BlockPixels& block, uint8_t* out) {
+    switch(format) {
+        case BlockFormat::BC1:
+            EncodeColorBlock(block, out);
+            break;
+        case BlockFormat::BC3:
+            EncodeChannelBlock(block.c[3], out);
+            EncodeColorBlock(block, out + 8);
+            break;
+        case BlockFormat::BC4:
+            EncodeChannelBlock(block.c[0], out);
+            break;
+        case BlockFormat::BC5:
+            EncodeChannelBlock(block.c[0], out);
+            EncodeChannelBlock(block.c[1], out + 8);
+            break;
+        case BlockFormat::BC7:
+            EncodeBc7Block(block, out);
+            break;
+    }
+}
+
+} // namespace
+
+void CompressImage(BlockFormat format, const Image& image, uint8_t* out, JobSystem* jobs) {
+    const int blocksX = (image.width + 3) / 4;
+    const int blocksY = (image.height + 3) / 4;
+    const size_t blockBytes = BlockBytes(format);
+
+    auto encodeRows = [&](size_t begin, size_t end) {
+        BlockPixels block;
+        for(size_t by = begin; by < end; ++by) {
+            uint8_t* dst = out + by * blocksX * blockBytes;
+            for(int bx = 0; bx < blocksX; ++bx, dst += blockBytes) {
+                LoadBlock(image, bx, (int)by, block);
+                EncodeBlock(format, block, dst);
+            }
+        }
+    };
+
+    if(jobs != nullptr) {
+        jobs->ParallelFor((size_t)blocksY, encodeRows, 1); // one block row is already thousands of palette searches
+    }
+    else {
+        encodeRows(0, (size_t)blocksY);
+    }
+}
+
+void CompressMipChain(const std::vector<Image>& levels, BlockFormat format, bool srgb, CompressedTexture& out, JobSystem* jobs) {
+    out.format = format;
+    out.srgb = srgb;
+    out.levels.resize(levels.size());
+    for(size_t level = 0; level < levels.size(); ++level) {
+        const Image& image = levels[level];
+        CompressedLevel& compressed = out.levels[level];
+        compressed.width = image.width;
+        compressed.height = image.height;
+        compressed.blocks.resize(CompressedImageBytes(format, image.width, image.height));
+        CompressImage(format, image, compressed.blocks.data(), jobs);
+    }
+}
+
+void DecompressImage(BlockFormat format, const uint8_t* blocks, int width, int height, Image& image) {
+    image.width = width;
+    image.height = height;
+    image.pixels.assign(image.ByteSize(), 255);
+
+    const int blocksX = (width + 3) / 4;
+    const int blocksY = (height + 3) / 4;
+    const size_t blockBytes = BlockBytes(format);
+    uint8_t decoded[4 * 4 * 4];
+    for(int by = 0; by < blocksY; ++by) {
+        for(int bx = 0; bx < blocksX; ++bx, blocks += blockBytes) {
+            std::memset(decoded, 0, sizeof(decoded));
+            for(int i = 0; i < 16; ++i) {
+                decoded[i * 4 + 3] = 255;
+            }
+            switch(format) {
+                case BlockFormat::BC1: DecodeColorBlock(blocks, false, decoded, 16); break;
+                case BlockFormat::BC3: DecodeColorBlock(blocks + 8, true, decoded, 16); DecodeChannelBlock(blocks, decoded, 16, 3); break;
+                case BlockFormat::BC4: DecodeChannelBlock(blocks, decoded, 16, 0); break;
+                case BlockFormat::BC5: DecodeChannelBlock(blocks, decoded, 16, 0); DecodeChannelBlock(blocks + 8, decoded, 16, 1); break;
+                case BlockFormat::BC7: DecodeBc7Block(blocks, decoded, 16); break;
+            }
+            for(int y = 0; y < 4 && by * 4 + y < height; ++y) {
+                const int columns = std::min(4, width - bx * 4);
+                std::memcpy(image.Row(by * 4 + y) + bx * 16, decoded + y * 16, (size_t)columns * 4);
+            }
+        }
+    }
+}
+
+GLenum CompressedInternalFormat(BlockFormat format, bool srgb) {
+    switch(format) {
+        case BlockFormat::BC1: return srgb ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case BlockFormat::BC3: return srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case BlockFormat::BC4: return GL_COMPRESSED_RED_RGTC1;
+        case BlockFormat::BC5: return GL_COMPRESSED_RG_RGTC2;
+        case BlockFormat::BC7: return srgb ? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM_ARB : GL_COMPRESSED_RGBA_BPTC_UNORM_ARB;
+    }
+    return GL_NONE;
+}
+
+bool IsBlockFormatSupported(BlockFormat format, bool srgb) {
+    switch(format) {
+        case BlockFormat::BC1:
+        case BlockFormat::BC3:
+            return GLAD_GL_EXT_texture_compression_s3tc && (!srgb || GLAD_GL_EXT_texture_sRGB);
+        case BlockFormat::BC4:
+        case BlockFormat::BC5:
+            return true; // RGTC is core since GL 3.0
+        case BlockFormat::BC7:
+            return GLAD_GL_ARB_texture_compression_bptc != 0;
+    }
+    return false;
+}
+
+// ---- disk cache -----------------------------------------------------------------------------------------------------
+
+namespace {
+
+const char CacheMagic[4] = {'L', 'G', 'B', 'C'};
+const uint32_t CacheVersion = 1; // bump when the encoder output changes
+
+struct CacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint32_t format;
+    uint32_t srgb;
+    uint32_t levelCount;
+    uint32_t reserved;
+};
+
+} // namespace
+
+uint64_t HashBytes(const void* data, size_t size, uint64_t seed) {
+    // FNV-1a, 64 bit
+    const uint8_t* bytes = (const uint8_t*)data;
+    uint64_t hash = seed;
+    for(size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+std::string CompressedCachePath(const std::string& directory, uint64_t key) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.bct", (unsigned long long)key);
+    return directory + "/" + name;
+}
+
+bool ReadCompressedCache(const std::string& path, uint64_t key, CompressedTexture& texture) {
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if(!file.is_open()) {
+        return false;
+    }
+    CacheHeader header;
+    if(!file.read((char*)&header, sizeof(header)) || std::memcmp(header.magic, CacheMagic, 4) != 0 ||
+       header.version != CacheVersion || header.key != key || header.format > (uint32_t)BlockFormat::BC7 || header.levelCount > 32) {
+        return false;
+    }
+
+    texture.format = (BlockFormat)header.format;
+    texture.srgb = header.srgb != 0;
+    texture.levels.resize(header.levelCount);
+    for(CompressedLevel& level : texture.levels) {
+        int32_t size[2];
+        if(!file.read((char*)size, sizeof(size)) || size[0] <= 0 || size[1] <= 0 || size[0] > 32768 || size[1] > 32768) {
+            return false;
+        }
+        level.width = size[0];
+        level.height = size[1];
+        level.blocks.resize(CompressedImageBytes(texture.format, level.width, level.height));
+        if(!file.read((char*)level.blocks.data(), (std::streamsize)level.blocks.size())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool WriteCompressedCache(const std::string& path, uint64_t key, const CompressedTexture& texture) {
+    // create the directory (one level) if needed
+    const size_t slash = path.find_last_of('/');
+    if(slash != std::string::npos) {
+        mkdir(path.substr(0, slash).c_str(), 0755);
+    }
+
+    const std::string temporary = path + ".tmp";
+    {
+        std::ofstream file(temporary.c_str(), std::ios::binary | std::ios::trunc);
+        if(!file.is_open()) {
+            return false;
+        }
+        CacheHeader header{};
+        std::memcpy(header.magic, CacheMagic, 4);
+        header.version = CacheVersion;
+        header.key = key;
+        header.format = (uint32_t)texture.format;
+        header.srgb = texture.srgb ? 1 : 0;
+        header.levelCount = (uint32_t)texture.levels.size();
+        file.write((const char*)&header, sizeof(header));
+        for(const CompressedLevel& level : texture.levels) {
+            int32_t size[2] = {level.width, level.height};
+            file.write((const char*)size, sizeof(size));
+            file.write((const char*)level.blocks.data(), (std::streamsize)level.blocks.size());
+        }
+        if(!file.good()) {
+            std::remove(temporary.c_str());
+            return false;
+        }
+    }
+    return std::rename(temporary.c_str(), path.c_str()) == 0;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+/*
+Block-compressed textures: CPU encoder, CPU decoder and an on-disk cache of encoded mip chains.
+
+Formats (4x4 pixel blocks):
+- BC1 (S3TC DXT1)   8 bytes/block   RGB, 4-color mode only (no punch-through alpha)           8:1 vs RGBA8
+- BC3 (S3TC DXT5)  16 bytes/block   BC1 color + interpolated 8-bit alpha                      4:1
+- BC4 (RGTC1)       8 bytes/block   one channel (red), e.g. masks, roughness                  8:1
+- BC5 (RGTC2)      16 bytes/block   two channels (red, green), e.g. tangent-space normals     4:1
+- BC7 (BPTC)       16 bytes/block   RGBA (4:1); the encoder only emits mode 6 (one subset, 7777 endpoints + p-bits,
+                                    4-bit indices), which is fast and already far better than BC1/BC3 on
+                                    smooth gradients. The decoder also only understands mode 6.
+
+Encoding: endpoints come from the principal axis of the block (power iteration on the covariance), followed
+by one least-squares refit given the chosen indices. The per-pixel palette search runs on SSE2/AVX2 (4/8
+pixels at once, picked through GetSimdLevel()) and block rows are spread over the JobSystem.
+
+sRGB textures are encoded on their stored (gamma) values; only the GL internal format changes.
+*/
+
+#include "image_decoder.hpp"
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class JobSystem;
+
+enum class BlockFormat {
+    BC1,
+    BC3,
+    BC4,
+    BC5,
+    BC7,
+};
+
+struct CompressedLevel {
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> blocks; // block rows bottom-up, like Image
+
+    size_t ByteSize() const { return blocks.size(); }
+};
+
+struct CompressedTexture {
+    BlockFormat format = BlockFormat::BC7;
+    bool srgb = false;
+    std::vector<CompressedLevel> levels; // level 0 first
+};
+
+size_t BlockBytes(BlockFormat format);
+size_t CompressedImageBytes(BlockFormat format, int width, int height);
+const char* BlockFormatName(BlockFormat format);
+bool ParseBlockFormat(const std::string& name, BlockFormat& format); // "bc1", "bc3", ... (case-insensitive)
+
+// Encodes one image; 'out' must hold CompressedImageBytes() bytes. 'jobs' (optional) spreads block rows.
+void CompressImage(BlockFormat format, const Image& image, uint8_t* out, JobSystem* jobs = nullptr);
+void CompressMipChain(const std::vector<Image>& levels, BlockFormat format, bool srgb, CompressedTexture& out, JobSystem* jobs = nullptr);
+
+// Decodes back to RGBA8 (BC4 -> (r, 0, 0, 255), BC5 -> (r, g, 0, 255)). For tools and the software rasterizer.
+void DecompressImage(BlockFormat format, const uint8_t* blocks, int width, int height, Image& image);
+
+// GL side (call after gladLoadGLLoader)
+GLenum CompressedInternalFormat(BlockFormat format, bool srgb);
+bool IsBlockFormatSupported(BlockFormat format, bool srgb);
+
+// ---- disk cache ----
+// Entries are keyed by a 64-bit hash of the source file contents and every setting that affects the result,
+// so editing a texture or changing the format simply misses the cache. Files are written to a temporary
+// name and renamed, so a crash never leaves a truncated entry behind.
+uint64_t HashBytes(const void* data, size_t size, uint64_t seed = 0xcbf29ce484222325ull);
+std::string CompressedCachePath(const std::string& directory, uint64_t key);
+bool ReadCompressedCache(const std::string& path, uint64_t key, CompressedTexture& texture);
+bool WriteCompressedCache(const std::string& path, uint64_t key, const CompressedTexture& texture);
@@ -0,0 +1,213 @@
+#include "transform_hierarchy.hpp"
+#include "job_system.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <numeric>
+
+uint32_t TransformHierarchy::AddNode(uint32_t parent, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale) {
+    const uint32_t node = (uint32_t)mParent.size();
+
+    const uint32_t depth = parent == InvalidNode ? 0 : mDepth[parent] + 1;
+    if(!mDepth.empty() && depth < mDepth.back()) {
+        mDepthSorted = false; // levels are no longer contiguous until SortBreadthFirst()
+    }
+    mLevelsValid = false;
+
+    mLocal.Add(position, rotation, scale);
+    mParent.push_back(parent);
+    mDepth.push_back(depth);
+    mLocalMatrix.push_back(glm::mat4(1.0f));
+    mWorld.push_back(glm::mat4(1.0f));
+    mLocalDirty.push_back(0);
+    mWorldChangedPass.push_back(0);
+
+    MarkDirty(node);
+    return node;
+}
+
+void TransformHierarchy::Clear() {
+    mLocal.Clear();
+    mParent.clear();
+    mDepth.clear();
+    mLocalMatrix.clear();
+    mWorld.clear();
+    mLocalDirty.clear();
+    mWorldChangedPass.clear();
+    mLevelStart.clear();
+    mDepthSorted = true;
+    mLevelsValid = false;
+    mFirstDirty = 0;
+    mAnyDirty = false;
+}
+
+void TransformHierarchy::Reserve(size_t count) {
+    mLocal.Reserve(count);
+    mParent.reserve(count);
+    mDepth.reserve(count);
+    mLocalMatrix.reserve(count);
+    mWorld.reserve(count);
+    mLocalDirty.reserve(count);
+    mWorldChangedPass.reserve(count);
+}
+
+void TransformHierarchy::MarkDirty(uint32_t node) {
+    mLocalDirty[node] = 1;
+    if(!mAnyDirty || node < mFirstDirty) {
+        mFirstDirty = node;
+    }
+    mAnyDirty = true;
+}
+
+void TransformHierarchy::SetLocalPosition(uint32_t node, const glm::vec3& position) {
+    if(mLocal.GetPosition(node) != position) {
+        mLocal.SetPosition(node, position);
+        MarkDirty(node);
+    }
+}
+
+void TransformHierarchy::SetLocalRotation(uint32_t node, const glm::quat& rotation) {
+    glm::quat current = mLocal.GetRotation(node);
+    if(current.x != rotation.x || current.y != rotation.y || current.z != rotation.z || current.w != rotation.w) {
+        mLocal.SetRotation(node, rotation);
+        MarkDirty(node);
+    }
+}
+
+void TransformHierarchy::SetLocalScale(uint32_t node, const glm::vec3& scale) {
+    if(mLocal.GetScale(node) != scale) {
+        mLocal.SetScale(node, scale);
+        MarkDirty(node);
+    }
+}
+
+void TransformHierarchy::SortBreadthFirst(std::vector<uint32_t>* oldToNew) {
+    const size_t count = Size();
+
+    // stable sort by depth keeps siblings together and parents ahead of children
+    std::vector<uint32_t> newToOld(count);
+    std::iota(newToOld.begin(), newToOld.end(), 0u);
+    std::stable_sort(newToOld.begin(), newToOld.end(), [this](uint32_t a, uint32_t b) {
+        return mDepth[a] < mDepth[b];
+    });
+
+    std::vector<uint32_t> remap(count);
+    for(uint32_t newIndex = 0; newIndex < count; ++newIndex) {
+        remap[newToOld[newIndex]] = newIndex;
+    }
+
+    TransformStore local;
+    local.Reserve(count);
+    std::vector<uint32_t> parent(count), depth(count);
+    for(uint32_t newIndex = 0; newIndex < count; ++newIndex) {
+        uint32_t oldIndex = newToOld[newIndex];
+        local.Add(mLocal.GetPosition(oldIndex), mLocal.GetRotation(oldIndex), mLocal.GetScale(oldIndex));
+        parent[newIndex] = mParent[oldIndex] == InvalidNode ? InvalidNode : remap[mParent[oldIndex]];
+        depth[newIndex] = mDepth[oldIndex];
+    }
+
+    mLocal = std::move(local);
+    mParent = std::move(parent);
+    mDepth = std::move(depth);
+    mDepthSorted = true;
+    mLevelsValid = false;
+
+    // everything moved, recompute the whole tree on the next update
+    std::fill(mLocalDirty.begin(), mLocalDirty.end(), 1);
+    mFirstDirty = 0;
+    mAnyDirty = count > 0;
+
+    if(oldToNew != nullptr) {
+        *oldToNew = std::move(remap);
+    }
+}
+
+void TransformHierarchy::BuildLevels() {
+    mLevelStart.clear();
+    for(size_t i = 0; i < mDepth.size(); ++i) {
+        if(i == 0 || mDepth[i] != mDepth[i - 1]) {
+            mLevelStart.push_back(i);
+        }
+    }
+    mLevelStart.push_back(mDepth.size());
+    mLevelsValid = true;
+}
+
+// compose dirty locals in [begin, end), batching contiguous dirty runs through the SIMD kernel
+void TransformHierarchy::ComposeDirtyLocals(size_t begin, size_t end) {
+    for(size_t i = begin; i < end; ) {
+        if(!mLocalDirty[i]) {
+            ++i;
+            continue;
+        }
+        size_t runEnd = i + 1;
+        while(runEnd < end && mLocalDirty[runEnd]) {
+            ++runEnd;
+        }
+        mLocal.ComposeMatrices(i, runEnd - i, &mLocalMatrix[i][0][0]);
+        i = runEnd;
+    }
+}
+
+// parents must already be up to date for this pass
+size_t TransformHierarchy::UpdateWorldRange(size_t begin, size_t end) {
+    size_t changed = 0;
+    for(size_t i = begin; i < end; ++i) {
+        const uint32_t parent = mParent[i];
+        const bool parentChanged = parent != InvalidNode && mWorldChangedPass[parent] == mPass;
+        if(!mLocalDirty[i] && !parentChanged) {
+            continue; // clean subtree root, or a node under a clean parent
+        }
+
+        mWorld[i] = parent == InvalidNode ? mLocalMatrix[i] : mWorld[parent] * mLocalMatrix[i];
+        mWorldChangedPass[i] = mPass;
+        mLocalDirty[i] = 0;
+        ++changed;
+    }
+    return changed;
+}
+
+size_t TransformHierarchy::UpdateWorldMatrices(JobSystem* jobs) {
+    ++mPass;
+    if(!mAnyDirty) {
+        return 0;
+    }
+
+    const size_t count = Size();
+    const size_t first = mFirstDirty;
+    size_t changed = 0;
+
+    if(jobs != nullptr && jobs->GetThreadCount() > 1 && count - first >= ParallelMinNodes && mDepthSorted) {
+        if(!mLevelsValid) {
+            BuildLevels();
+        }
+
+        // 1) locals are independent of each other
+        jobs->ParallelFor(count - first, [this, first](size_t begin, size_t end) {
+            ComposeDirtyLocals(first + begin, first + end);
+        });
+
+        // 2) level by level: a level only reads the level above, which is complete
+        std::atomic<size_t> changedAtomic{0};
+        for(size_t level = 0; level + 1 < mLevelStart.size(); ++level) {
+            size_t levelBegin = std::max(mLevelStart[level], first);
+            size_t levelEnd = mLevelStart[level + 1];
+            if(levelBegin >= levelEnd) {
+                continue;
+            }
+            jobs->ParallelFor(levelEnd - levelBegin, [this, levelBegin, &changedAtomic](size_t begin, size_t end) {
+                changedAtomic.fetch_add(UpdateWorldRange(levelBegin + begin, levelBegin + end), std::memory_order_relaxed);
+            });
+        }
+        changed = changedAtomic.load();
+    }
+    else {
+        // 1) locals, 2) one linear pass: parents precede children, so the parent's world matrix is already final
+        ComposeDirtyLocals(first, count);
+        changed = UpdateWorldRange(first, count);
+    }
+
+    mAnyDirty = false;
+    mFirstDirty = count;
+    return changed;
+}
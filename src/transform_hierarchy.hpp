@@ -0,0 +1,85 @@
+#pragma once
+
+/*
+TransformHierarchy is a parent/child transform tree stored as flat arrays. Parents always come before their
+children (SortBreadthFirst() puts the nodes in breadth-first order), so world matrices are computed in a
+single linear pass:  world[i] = world[parent[i]] * local[i].
+
+Only changed subtrees are recomputed: setting a local transform marks that node dirty, and during the pass a
+node is recomputed only if it is dirty itself or its parent's world matrix changed in the same pass. The
+pass starts at the first dirty node, so a frame in which nothing moved costs almost nothing.
+
+Local TRS lives in a TransformStore, so dirty locals are composed with the SIMD kernels in contiguous runs.
+
+Given a JobSystem, large updates run in parallel: breadth-first order makes every depth level a contiguous
+range whose nodes only read the (already finished) level above, so each level is one ParallelFor.
+*/
+
+#include "transform_store.hpp"
+
+class JobSystem;
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <cstdint>
+#include <vector>
+
+class TransformHierarchy {
+public:
+    static const uint32_t InvalidNode = 0xFFFFFFFFu;
+
+    // 'parent' must be InvalidNode (root) or an existing node; returns the new node index
+    uint32_t AddNode(uint32_t parent,
+                     const glm::vec3& position = glm::vec3(0.0f),
+                     const glm::quat& rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f),
+                     const glm::vec3& scale = glm::vec3(1.0f));
+    void Clear();
+    void Reserve(size_t count);
+    size_t Size() const { return mParent.size(); }
+
+    // Setters are no-ops (and do not mark anything dirty) when the value did not change
+    void SetLocalPosition(uint32_t node, const glm::vec3& position);
+    void SetLocalRotation(uint32_t node, const glm::quat& rotation);
+    void SetLocalScale(uint32_t node, const glm::vec3& scale);
+
+    uint32_t GetParent(uint32_t node) const { return mParent[node]; }
+    uint32_t GetDepth(uint32_t node) const { return mDepth[node]; }
+    const TransformStore& GetLocalTransforms() const { return mLocal; }
+
+    // Reorders nodes breadth-first (by depth, stable). If 'oldToNew' is given it receives the index remap.
+    void SortBreadthFirst(std::vector<uint32_t>* oldToNew = nullptr);
+
+    // One linear pass over the dirty range. Returns how many world matrices changed.
+    // With 'jobs', big updates are spread over its threads level by level.
+    size_t UpdateWorldMatrices(JobSystem* jobs = nullptr);
+
+    const glm::mat4& GetWorldMatrix(uint32_t node) const { return mWorld[node]; }
+    const glm::mat4* WorldMatrices() const { return mWorld.data(); }
+
+    // true if UpdateWorldMatrices() changed the node in the most recent pass
+    bool WorldChangedLastUpdate(uint32_t node) const { return mWorldChangedPass[node] == mPass; }
+
+private:
+    static const size_t ParallelMinNodes = 4096;
+
+    void MarkDirty(uint32_t node);
+    void ComposeDirtyLocals(size_t begin, size_t end);
+    size_t UpdateWorldRange(size_t begin, size_t end);
+    void BuildLevels();
+
+    TransformStore mLocal;                   // local TRS, SoA
+    std::vector<uint32_t> mParent;
+    std::vector<uint32_t> mDepth;
+    std::vector<glm::mat4> mLocalMatrix;
+    std::vector<glm::mat4> mWorld;
+    std::vector<uint8_t> mLocalDirty;
+    std::vector<uint32_t> mWorldChangedPass; // pass number in which the world matrix last changed
+
+    std::vector<size_t> mLevelStart;         // first node of each depth level (valid while mDepthSorted)
+    bool mDepthSorted = true;                // nodes are in non-decreasing depth order
+    bool mLevelsValid = false;
+
+    uint32_t mPass = 1;
+    size_t mFirstDirty = 0;                  // nothing before this index needs work
+    bool mAnyDirty = false;
+};
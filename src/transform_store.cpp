@@ -0,0 +1,237 @@
+#include "transform_store.hpp"
+#include "cpu_features.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#if LEARNGL_X86
+#include <immintrin.h>
+#endif
+
+size_t TransformStore::Add(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale) {
+    mPositionX.push_back(position.x);
+    mPositionY.push_back(position.y);
+    mPositionZ.push_back(position.z);
+    mRotationX.push_back(rotation.x);
+    mRotationY.push_back(rotation.y);
+    mRotationZ.push_back(rotation.z);
+    mRotationW.push_back(rotation.w);
+    mScaleX.push_back(scale.x);
+    mScaleY.push_back(scale.y);
+    mScaleZ.push_back(scale.z);
+    return mPositionX.size() - 1;
+}
+
+void TransformStore::Clear() {
+    for(std::vector<float>* stream : {&mPositionX, &mPositionY, &mPositionZ,
+                                      &mRotationX, &mRotationY, &mRotationZ, &mRotationW,
+                                      &mScaleX, &mScaleY, &mScaleZ}) {
+        stream->clear();
+    }
+}
+
+void TransformStore::Reserve(size_t count) {
+    for(std::vector<float>* stream : {&mPositionX, &mPositionY, &mPositionZ,
+                                      &mRotationX, &mRotationY, &mRotationZ, &mRotationW,
+                                      &mScaleX, &mScaleY, &mScaleZ}) {
+        stream->reserve(count);
+    }
+}
+
+void TransformStore::SetPosition(size_t index, const glm::vec3& position) {
+    mPositionX[index] = position.x;
+    mPositionY[index] = position.y;
+    mPositionZ[index] = position.z;
+}
+
+void TransformStore::SetRotation(size_t index, const glm::quat& rotation) {
+    mRotationX[index] = rotation.x;
+    mRotationY[index] = rotation.y;
+    mRotationZ[index] = rotation.z;
+    mRotationW[index] = rotation.w;
+}
+
+void TransformStore::SetScale(size_t index, const glm::vec3& scale) {
+    mScaleX[index] = scale.x;
+    mScaleY[index] = scale.y;
+    mScaleZ[index] = scale.z;
+}
+
+glm::vec3 TransformStore::GetPosition(size_t index) const {
+    return glm::vec3(mPositionX[index], mPositionY[index], mPositionZ[index]);
+}
+
+glm::quat TransformStore::GetRotation(size_t index) const {
+    return glm::quat(mRotationW[index], mRotationX[index], mRotationY[index], mRotationZ[index]);
+}
+
+glm::vec3 TransformStore::GetScale(size_t index) const {
+    return glm::vec3(mScaleX[index], mScaleY[index], mScaleZ[index]);
+}
+
+glm::mat4 TransformStore::ComposeMatrix(size_t index) const {
+    glm::mat4 model = glm::translate(glm::mat4(1.0f), GetPosition(index));
+    model = model * glm::mat4_cast(GetRotation(index));
+    return glm::scale(model, GetScale(index));
+}
+
+void TransformStore::ComposeMatrices(size_t first, size_t count, float* out) const {
+    switch(GetSimdLevel()) {
+        case SimdLevel::AVX2: ComposeAVX2(first, count, out); break;
+        case SimdLevel::SSE2: ComposeSSE2(first, count, out); break;
+        default:              ComposeScalar(first, count, out); break;
+    }
+}
+
+void TransformStore::ComposeScalar(size_t first, size_t count, float* out) const {
+    for(size_t i = 0; i < count; ++i) {
+        glm::mat4 model = ComposeMatrix(first + i);
+        const float* m = &model[0][0];
+        for(int k = 0; k < 16; ++k) {
+            out[i * 16 + k] = m[k];
+        }
+    }
+}
+
+/*
+Quaternion -> rotation, column-major (same as glm::mat3_cast), then each column scaled:
+    col0 = (1 - 2(yy + zz),     2(xy + wz),     2(xz - wy)) * sx
+    col1 = (    2(xy - wz), 1 - 2(xx + zz),     2(yz + wx)) * sy
+    col2 = (    2(xz + wy),     2(yz - wx), 1 - 2(xx + yy)) * sz
+    col3 = (px, py, pz, 1)
+The SIMD kernels compute each of those 16 terms for N objects at once (one lane per object) and then
+transpose lanes back into per-object columns.
+*/
+
+#if LEARNGL_X86
+void TransformStore::ComposeSSE2(size_t first, size_t count, float* out) const {
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 two = _mm_set1_ps(2.0f);
+    const __m128 zero = _mm_setzero_ps();
+
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4) {
+        const size_t o = first + i;
+        __m128 qx = _mm_loadu_ps(&mRotationX[o]);
+        __m128 qy = _mm_loadu_ps(&mRotationY[o]);
+        __m128 qz = _mm_loadu_ps(&mRotationZ[o]);
+        __m128 qw = _mm_loadu_ps(&mRotationW[o]);
+        __m128 sx = _mm_loadu_ps(&mScaleX[o]);
+        __m128 sy = _mm_loadu_ps(&mScaleY[o]);
+        __m128 sz = _mm_loadu_ps(&mScaleZ[o]);
+
+        __m128 xx = _mm_mul_ps(qx, qx), yy = _mm_mul_ps(qy, qy), zz = _mm_mul_ps(qz, qz);
+        __m128 xy = _mm_mul_ps(qx, qy), xz = _mm_mul_ps(qx, qz), yz = _mm_mul_ps(qy, qz);
+        __m128 wx = _mm_mul_ps(qw, qx), wy = _mm_mul_ps(qw, qy), wz = _mm_mul_ps(qw, qz);
+
+        __m128 c0x = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx);
+        __m128 c0y = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx);
+        __m128 c0z = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx);
+        __m128 c1x = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy);
+        __m128 c1y = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy);
+        __m128 c1z = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy);
+        __m128 c2x = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz);
+        __m128 c2y = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz);
+        __m128 c2z = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz);
+        __m128 c3x = _mm_loadu_ps(&mPositionX[o]);
+        __m128 c3y = _mm_loadu_ps(&mPositionY[o]);
+        __m128 c3z = _mm_loadu_ps(&mPositionZ[o]);
+        __m128 c3w = one;
+        __m128 c0w = zero, c1w = zero, c2w = zero;
+
+        // lanes -> objects: after each transpose, cNx holds column N of object 0, cNy of object 1, ...
+        _MM_TRANSPOSE4_PS(c0x, c0y, c0z, c0w);
+        _MM_TRANSPOSE4_PS(c1x, c1y, c1z, c1w);
+        _MM_TRANSPOSE4_PS(c2x, c2y, c2z, c2w);
+        _MM_TRANSPOSE4_PS(c3x, c3y, c3z, c3w);
+
+        float* dst = out + i * 16;
+        _mm_storeu_ps(dst +  0, c0x); _mm_storeu_ps(dst +  4, c1x); _mm_storeu_ps(dst +  8, c2x); _mm_storeu_ps(dst + 12, c3x);
+        _mm_storeu_ps(dst + 16, c0y); _mm_storeu_ps(dst + 20, c1y); _mm_storeu_ps(dst + 24, c2y); _mm_storeu_ps(dst + 28, c3y);
+        _mm_storeu_ps(dst + 32, c0z); _mm_storeu_ps(dst + 36, c1z); _mm_storeu_ps(dst + 40, c2z); _mm_storeu_ps(dst + 44, c3z);
+        _mm_storeu_ps(dst + 48, c0w); _mm_storeu_ps(dst + 52, c1w); _mm_storeu_ps(dst + 56, c2w); _mm_storeu_ps(dst + 60, c3w);
+    }
+
+    ComposeScalar(first + i, count - i, out + i * 16);
+}
+
+// Transposes 4 vectors of 8 lanes (x, y, z, w of one column for 8 objects) and stores each object's column
+LEARNGL_TARGET_AVX2
+static inline void StoreColumnAVX2(float* out, int column, __m256 x, __m256 y, __m256 z, __m256 w) {
+    __m256 t0 = _mm256_unpacklo_ps(x, y); // x0 y0 x1 y1 | x4 y4 x5 y5
+    __m256 t1 = _mm256_unpackhi_ps(x, y); // x2 y2 x3 y3 | x6 y6 x7 y7
+    __m256 t2 = _mm256_unpacklo_ps(z, w);
+    __m256 t3 = _mm256_unpackhi_ps(z, w);
+    __m256 u0 = _mm256_shuffle_ps(t0, t2, 0x44); // object 0 | object 4
+    __m256 u1 = _mm256_shuffle_ps(t0, t2, 0xEE); // object 1 | object 5
+    __m256 u2 = _mm256_shuffle_ps(t1, t3, 0x44); // object 2 | object 6
+    __m256 u3 = _mm256_shuffle_ps(t1, t3, 0xEE); // object 3 | object 7
+
+    float* dst = out + column * 4;
+    _mm_storeu_ps(dst + 0 * 16, _mm256_castps256_ps128(u0));
+    _mm_storeu_ps(dst + 1 * 16, _mm256_castps256_ps128(u1));
+    _mm_storeu_ps(dst + 2 * 16, _mm256_castps256_ps128(u2));
+    _mm_storeu_ps(dst + 3 * 16, _mm256_castps256_ps128(u3));
+    _mm_storeu_ps(dst + 4 * 16, _mm256_extractf128_ps(u0, 1));
+    _mm_storeu_ps(dst + 5 * 16, _mm256_extractf128_ps(u1, 1));
+    _mm_storeu_ps(dst + 6 * 16, _mm256_extractf128_ps(u2, 1));
+    _mm_storeu_ps(dst + 7 * 16, _mm256_extractf128_ps(u3, 1));
+}
+
+LEARNGL_TARGET_AVX2
+void TransformStore::ComposeAVX2(size_t first, size_t count, float* out) const {
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 two = _mm256_set1_ps(2.0f);
+    const __m256 zero = _mm256_setzero_ps();
+
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+        const size_t o = first + i;
+        __m256 qx = _mm256_loadu_ps(&mRotationX[o]);
+        __m256 qy = _mm256_loadu_ps(&mRotationY[o]);
+        __m256 qz = _mm256_loadu_ps(&mRotationZ[o]);
+        __m256 qw = _mm256_loadu_ps(&mRotationW[o]);
+        __m256 sx = _mm256_loadu_ps(&mScaleX[o]);
+        __m256 sy = _mm256_loadu_ps(&mScaleY[o]);
+        __m256 sz = _mm256_loadu_ps(&mScaleZ[o]);
+
+        // pre-double x, y, z so every product below already carries the factor 2
+        __m256 x2 = _mm256_mul_ps(qx, two), y2 = _mm256_mul_ps(qy, two), z2 = _mm256_mul_ps(qz, two);
+        __m256 xx = _mm256_mul_ps(qx, x2), yy = _mm256_mul_ps(qy, y2), zz = _mm256_mul_ps(qz, z2);
+        __m256 xy = _mm256_mul_ps(qx, y2), xz = _mm256_mul_ps(qx, z2), yz = _mm256_mul_ps(qy, z2);
+        __m256 wx = _mm256_mul_ps(qw, x2), wy = _mm256_mul_ps(qw, y2), wz = _mm256_mul_ps(qw, z2);
+
+        float* dst = out + i * 16;
+        StoreColumnAVX2(dst, 0,
+                        _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(yy, zz)), sx),
+                        _mm256_mul_ps(_mm256_add_ps(xy, wz), sx),
+                        _mm256_mul_ps(_mm256_sub_ps(xz, wy), sx),
+                        zero);
+        StoreColumnAVX2(dst, 1,
+                        _mm256_mul_ps(_mm256_sub_ps(xy, wz), sy),
+                        _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, zz)), sy),
+                        _mm256_mul_ps(_mm256_add_ps(yz, wx), sy),
+                        zero);
+        StoreColumnAVX2(dst, 2,
+                        _mm256_mul_ps(_mm256_add_ps(xz, wy), sz),
+                        _mm256_mul_ps(_mm256_sub_ps(yz, wx), sz),
+                        _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, yy)), sz),
+                        zero);
+        StoreColumnAVX2(dst, 3,
+                        _mm256_loadu_ps(&mPositionX[o]),
+                        _mm256_loadu_ps(&mPositionY[o]),
+                        _mm256_loadu_ps(&mPositionZ[o]),
+                        one);
+    }
+
+    // finish with the 4-wide kernel (which itself falls back to scalar for the last 0-3 objects)
+    ComposeSSE2(first + i, count - i, out + i * 16);
+}
+#else
+void TransformStore::ComposeSSE2(size_t first, size_t count, float* out) const {
+    ComposeScalar(first, count, out);
+}
+
+void TransformStore::ComposeAVX2(size_t first, size_t count, float* out) const {
+    ComposeScalar(first, count, out);
+}
+#endif
@@ -0,0 +1,59 @@
+#pragma once
+
+/*
+TransformStore keeps object transforms as a structure of arrays (position, rotation quaternion, scale) so
+they can be composed into 4x4 TRS matrices several objects at a time:
+- AVX2: 8 objects per iteration
+- SSE2: 4 objects per iteration
+- scalar glm path for CPUs without either (and for the tail of each batch)
+
+ComposeMatrices() writes column-major mat4s (the layout glUniformMatrix4fv / instanced attributes expect)
+straight into caller memory, typically a mapped GL_ARRAY_BUFFER.
+*/
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <cstddef>
+#include <vector>
+
+class TransformStore {
+public:
+    // returns the index of the new transform
+    size_t Add(const glm::vec3& position,
+               const glm::quat& rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f),
+               const glm::vec3& scale = glm::vec3(1.0f));
+    void Clear();
+    void Reserve(size_t count);
+    size_t Size() const { return mPositionX.size(); }
+
+    void SetPosition(size_t index, const glm::vec3& position);
+    void SetRotation(size_t index, const glm::quat& rotation);
+    void SetScale(size_t index, const glm::vec3& scale);
+
+    glm::vec3 GetPosition(size_t index) const;
+    glm::quat GetRotation(size_t index) const;
+    glm::vec3 GetScale(size_t index) const;
+
+    // Composes T * R * S for objects [first, first + count) into out[0 .. count * 16)
+    void ComposeMatrices(size_t first, size_t count, float* out) const;
+
+    // Single-object reference path (glm)
+    glm::mat4 ComposeMatrix(size_t index) const;
+
+    // SoA streams, exposed read-only for other batch kernels
+    const float* PositionX() const { return mPositionX.data(); }
+    const float* PositionY() const { return mPositionY.data(); }
+    const float* PositionZ() const { return mPositionZ.data(); }
+    const float* ScaleX() const { return mScaleX.data(); }
+    const float* ScaleY() const { return mScaleY.data(); }
+    const float* ScaleZ() const { return mScaleZ.data(); }
+
+private:
+    void ComposeScalar(size_t first, size_t count, float* out) const;
+    void ComposeSSE2(size_t first, size_t count, float* out) const;
+    void ComposeAVX2(size_t first, size_t count, float* out) const;
+
+    std::vector<float> mPositionX, mPositionY, mPositionZ;
+    std::vector<float> mRotationX, mRotationY, mRotationZ, mRotationW;
+    std::vector<float> mScaleX, mScaleY, mScaleZ;
+};
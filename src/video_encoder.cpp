@@ -0,0 +1,415 @@
+#include "video_encoder.hpp"
+
+#include <sys/wait.h>
+
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+#if LEARNGL_X86
+#include <immintrin.h>
+#endif
+
+static bool Fail(std::string* error, const std::string& message) {
+    if(error) {
+        *error = message;
+    }
+    return false;
+}
+
+// ------------------------------------------------------------------ RGB -> YUV 4:2:0 ------------------------------------------------------------------
+//
+// BT.709, limited range, 8.8 fixed point:
+//   Y  = ( 47 R + 157 G +  16 B) / 256 + 16
+//   Cb = (-26 R -  86 G + 112 B) / 256 + 128
+//   Cr = (112 R - 102 G -  10 B) / 256 + 128
+// Chroma is computed from the sum of a 2x2 block, so its divisor is 1024. All kernels round the same way and
+// produce identical bytes.
+
+namespace {
+
+const int LumaR = 47, LumaG = 157, LumaB = 16;
+const int CbR = -26, CbG = -86, CbB = 112;
+const int CrR = 112, CrG = -102, CrB = -10;
+
+// Two source rows (row0 is the upper one) -> two luma rows and one chroma row, from pixel 'first' on
+void ConvertRowPairScalar(const uint8_t* row0, const uint8_t* row1, int width, uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v, int first) {
+    for(int x = first; x < width; x += 2) {
+        const uint8_t* p[4] = {row0 + x * 4, row0 + x * 4 + 4, row1 + x * 4, row1 + x * 4 + 4};
+        uint8_t* luma[4] = {y0 + x, y0 + x + 1, y1 + x, y1 + x + 1};
+        int r = 0, g = 0, b = 0;
+        for(int i = 0; i < 4; ++i) {
+            *luma[i] = (uint8_t)(((LumaR * p[i][0] + LumaG * p[i][1] + LumaB * p[i][2] + 128) >> 8) + 16);
+            r += p[i][0];
+            g += p[i][1];
+            b += p[i][2];
+        }
+        u[x / 2] = (uint8_t)(((CbR * r + CbG * g + CbB * b + 512) >> 10) + 128);
+        v[x / 2] = (uint8_t)(((CrR * r + CrG * g + CrB * b + 512) >> 10) + 128);
+    }
+}
+
+#if LEARNGL_X86
+// 4 RGBA pixels -> 4 int32 luma values
+inline __m128i LumaSse2(__m128i pixels, __m128i coefficients) {
+    const __m128i zero = _mm_setzero_si128();
+    // (R*cR + G*cG, B*cB + A*0) per pixel, then the two halves added
+    const __m128 a = _mm_castsi128_ps(_mm_madd_epi16(_mm_unpacklo_epi8(pixels, zero), coefficients));
+    const __m128 b = _mm_castsi128_ps(_mm_madd_epi16(_mm_unpackhi_epi8(pixels, zero), coefficients));
+    const __m128i sum = _mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))),
+                                      _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))));
+    return _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(sum, _mm_set1_epi32(128)), 8), _mm_set1_epi32(16));
+}
+
+// 4 pixels of two rows -> RGBA sums of the two 2x2 blocks as 16-bit lanes
+inline __m128i BlockSumsSse2(__m128i top, __m128i bottom) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i left = _mm_add_epi16(_mm_unpacklo_epi8(top, zero), _mm_unpacklo_epi8(bottom, zero));
+    __m128i right = _mm_add_epi16(_mm_unpackhi_epi8(top, zero), _mm_unpackhi_epi8(bottom, zero));
+    left = _mm_add_epi16(left, _mm_srli_si128(left, 8));
+    right = _mm_add_epi16(right, _mm_srli_si128(right, 8));
+    return _mm_unpacklo_epi64(left, right);
+}
+
+// block sums of 4 blocks (2 + 2) -> 4 int32 chroma values
+inline __m128i ChromaSse2(__m128i blocks01, __m128i blocks23, __m128i coefficients) {
+    const __m128 a = _mm_castsi128_ps(_mm_madd_epi16(blocks01, coefficients));
+    const __m128 b = _mm_castsi128_ps(_mm_madd_epi16(blocks23, coefficients));
+    const __m128i sum = _mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))),
+                                      _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))));
+    return _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(sum, _mm_set1_epi32(512)), 10), _mm_set1_epi32(128));
+}
+
+void ConvertRowPairSse2(const uint8_t* row0, const uint8_t* row1, int width, uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v) {
+    const __m128i lumaCoefficients = _mm_setr_epi16(LumaR, LumaG, LumaB, 0, LumaR, LumaG, LumaB, 0);
+    const __m128i cbCoefficients = _mm_setr_epi16(CbR, CbG, CbB, 0, CbR, CbG, CbB, 0);
+    const __m128i crCoefficients = _mm_setr_epi16(CrR, CrG, CrB, 0, CrR, CrG, CrB, 0);
+    int x = 0;
+    for(; x + 8 <= width; x += 8) {
+        const __m128i top0 = _mm_loadu_si128((const __m128i*)(row0 + x * 4));
+        const __m128i top1 = _mm_loadu_si128((const __m128i*)(row0 + x * 4 + 16));
+        const __m128i bottom0 = _mm_loadu_si128((const __m128i*)(row1 + x * 4));
+        const __m128i bottom1 = _mm_loadu_si128((const __m128i*)(row1 + x * 4 + 16));
+
+        const __m128i lumaTop = _mm_packs_epi32(LumaSse2(top0, lumaCoefficients), LumaSse2(top1, lumaCoefficients));
+        const __m128i lumaBottom = _mm_packs_epi32(LumaSse2(bottom0, lumaCoefficients), LumaSse2(bottom1, lumaCoefficients));
+        _mm_storel_epi64((__m128i*)(y0 + x), _mm_packus_epi16(lumaTop, lumaTop));
+        _mm_storel_epi64((__m128i*)(y1 + x), _mm_packus_epi16(lumaBottom, lumaBottom));
+
+        const __m128i blocks01 = BlockSumsSse2(top0, bottom0);
+        const __m128i blocks23 = BlockSumsSse2(top1, bottom1);
+        const __m128i chroma = _mm_packs_epi32(ChromaSse2(blocks01, blocks23, cbCoefficients), ChromaSse2(blocks01, blocks23, crCoefficients));
+        const __m128i bytes = _mm_packus_epi16(chroma, chroma); // u0..u3 v0..v3
+        const int cb = _mm_cvtsi128_si32(bytes);
+        const int cr = _mm_cvtsi128_si32(_mm_srli_si128(bytes, 4));
+        std::memcpy(u + x / 2, &cb, 4);
+        std::memcpy(v + x / 2, &cr, 4);
+    }
+    ConvertRowPairScalar(row0, row1, width, y0, y1, u, v, x);
+}
+
+// Same as the SSE2 helpers; every 256-bit op works on two independent 128-bit lanes
+LEARNGL_TARGET_AVX2
+inline __m256i LumaAvx2(__m256i pixels, __m256i coefficients) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256 a = _mm256_castsi256_ps(_mm256_madd_epi16(_mm256_unpacklo_epi8(pixels, zero), coefficients));
+    const __m256 b = _mm256_castsi256_ps(_mm256_madd_epi16(_mm256_unpackhi_epi8(pixels, zero), coefficients));
+    const __m256i sum = _mm256_add_epi32(_mm256_castps_si256(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))),
+                                         _mm256_castps_si256(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))));
+    return _mm256_add_epi32(_mm256_srai_epi32(_mm256_add_epi32(sum, _mm256_set1_epi32(128)), 8), _mm256_set1_epi32(16));
+}
+
+LEARNGL_TARGET_AVX2
+inline __m256i BlockSumsAvx2(__m256i top, __m256i bottom) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i left = _mm256_add_epi16(_mm256_unpacklo_epi8(top, zero), _mm256_unpacklo_epi8(bottom, zero));
+    __m256i right = _mm256_add_epi16(_mm256_unpackhi_epi8(top, zero), _mm256_unpackhi_epi8(bottom, zero));
+    left = _mm256_add_epi16(left, _mm256_srli_si256(left, 8));
+    right = _mm256_add_epi16(right, _mm256_srli_si256(right, 8));
+    return _mm256_unpacklo_epi64(left, right);
+}
+
+LEARNGL_TARGET_AVX2
+inline __m256i ChromaAvx2(__m256i blocks0123, __m256i blocks4567, __m256i coefficients) {
+    const __m256 a = _mm256_castsi256_ps(_mm256_madd_epi16(blocks0123, coefficients));
+    const __m256 b = _mm256_castsi256_ps(_mm256_madd_epi16(blocks4567, coefficients));
+    const __m256i sum = _mm256_add_epi32(_mm256_castps_si256(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))),
+                                         _mm256_castps_si256(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))));
+    // the lanes hold blocks 0 1 4 5 | 2 3 6 7
+    const __m256i ordered = _mm256_permutevar8x32_epi32(sum, _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7));
+    return _mm256_add_epi32(_mm256_srai_epi32(_mm256_add_epi32(ordered, _mm256_set1_epi32(512)), 10), _mm256_set1_epi32(128));
+}
+
+LEARNGL_TARGET_AVX2
+void ConvertRowPairAvx2(const uint8_t* row0, const uint8_t* row1, int width, uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v) {
+    const __m256i lumaCoefficients = _mm256_setr_epi16(LumaR, LumaG, LumaB, 0, LumaR, LumaG, LumaB, 0, LumaR, LumaG, LumaB, 0, LumaR, LumaG, LumaB, 0);
+    const __m256i cbCoefficients = _mm256_setr_epi16(CbR, CbG, CbB, 0, CbR, CbG, CbB, 0, CbR, CbG, CbB, 0, CbR, CbG, CbB, 0);
+    const __m256i crCoefficients = _mm256_setr_epi16(CrR, CrG, CrB, 0, CrR, CrG, CrB, 0, CrR, CrG, CrB, 0, CrR, CrG, CrB, 0);
+    int x = 0;
+    for(; x + 16 <= width; x += 16) {
+        const __m256i top0 = _mm256_loadu_si256((const __m256i*)(row0 + x * 4));
+        const __m256i top1 = _mm256_loadu_si256((const __m256i*)(row0 + x * 4 + 32));
+        const __m256i bottom0 = _mm256_loadu_si256((const __m256i*)(row1 + x * 4));
+        const __m256i bottom1 = _mm256_loadu_si256((const __m256i*)(row1 + x * 4 + 32));
+
+        // packs interleaves the lanes: 0-3 8-11 | 4-7 12-15, the 64-bit permute restores the order
+        const __m256i lumaTop = _mm256_permute4x64_epi64(
+            _mm256_packs_epi32(LumaAvx2(top0, lumaCoefficients), LumaAvx2(top1, lumaCoefficients)), _MM_SHUFFLE(3, 1, 2, 0));
+        const __m256i lumaBottom = _mm256_permute4x64_epi64(
+            _mm256_packs_epi32(LumaAvx2(bottom0, lumaCoefficients), LumaAvx2(bottom1, lumaCoefficients)), _MM_SHUFFLE(3, 1, 2, 0));
+        const __m256i bytesTop = _mm256_permute4x64_epi64(_mm256_packus_epi16(lumaTop, lumaTop), _MM_SHUFFLE(3, 1, 2, 0));
+        const __m256i bytesBottom = _mm256_permute4x64_epi64(_mm256_packus_epi16(lumaBottom, lumaBottom), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm_storeu_si128((__m128i*)(y0 + x), _mm256_castsi256_si128(bytesTop));
+        _mm_storeu_si128((__m128i*)(y1 + x), _mm256_castsi256_si128(bytesBottom));
+
+        const __m256i blocks0123 = BlockSumsAvx2(top0, bottom0);
+        const __m256i blocks4567 = BlockSumsAvx2(top1, bottom1);
+        const __m256i chroma = _mm256_permute4x64_epi64(
+            _mm256_packs_epi32(ChromaAvx2(blocks0123, blocks4567, cbCoefficients), ChromaAvx2(blocks0123, blocks4567, crCoefficients)),
+            _MM_SHUFFLE(3, 1, 2, 0)); // u0..u7 | v0..v7
+        const __m256i bytes = _mm256_packus_epi16(chroma, chroma);
+        _mm_storel_epi64((__m128i*)(u + x / 2), _mm256_castsi256_si128(bytes));
+        _mm_storel_epi64((__m128i*)(v + x / 2), _mm256_extracti128_si256(bytes, 1));
+    }
+    ConvertRowPairScalar(row0, row1, width, y0, y1, u, v, x);
+}
+#endif
+
+} // namespace
+
+void ConvertRgbaToYuv420(const uint8_t* rgba, int width, int height, int sourceWidth, int sourceHeight,
+                         uint8_t* y, uint8_t* u, uint8_t* v, SimdLevel level) {
+    const size_t stride = (size_t)sourceWidth * 4;
+    const int chromaWidth = width / 2;
+    for(int row = 0; row + 1 < height; row += 2) {
+        // output row 'row' is source row sourceHeight - 1 - row (bottom-up source)
+        const uint8_t* row0 = rgba + stride * (size_t)(sourceHeight - 1 - row);
+        const uint8_t* row1 = row0 - stride;
+        uint8_t* y0 = y + (size_t)width * row;
+        uint8_t* y1 = y0 + width;
+        uint8_t* cb = u + (size_t)chromaWidth * (row / 2);
+        uint8_t* cr = v + (size_t)chromaWidth * (row / 2);
+        switch(level) {
+#if LEARNGL_X86
+            case SimdLevel::AVX2: ConvertRowPairAvx2(row0, row1, width, y0, y1, cb, cr); break;
+            case SimdLevel::SSE2: ConvertRowPairSse2(row0, row1, width, y0, y1, cb, cr); break;
+#endif
+            default: ConvertRowPairScalar(row0, row1, width, y0, y1, cb, cr, 0); break;
+        }
+    }
+}
+
+// ------------------------------------------------------------------ VideoEncoder ------------------------------------------------------------------
+
+// single quotes for /bin/sh, a quote inside becomes '\''
+static std::string ShellQuote(const std::string& text) {
+    std::string quoted = "'";
+    for(char c : text) {
+        if(c == '\'') {
+            quoted += "'\\''";
+        }
+        else {
+            quoted += c;
+        }
+    }
+    return quoted + "'";
+}
+
+VideoEncoder::VideoEncoder(JobSystem& jobs, const VideoEncoderOptions& options)
+    : mJobs(jobs), mOptions(options), mSimd(GetSimdLevel()) {
+    mOptions.maxQueuedFrames = std::max(mOptions.maxQueuedFrames, 1);
+    mOptions.framesPerSecond = std::max(mOptions.framesPerSecond, 1);
+    if(mOptions.sink == VideoSink::Ffmpeg) {
+        // an ffmpeg that exits early must show up as a write error, not kill the renderer
+        std::signal(SIGPIPE, SIG_IGN);
+    }
+}
+
+VideoEncoder::~VideoEncoder() {
+    Finish();
+}
+
+bool VideoEncoder::Open(int width, int height) {
+    mSourceWidth = width;
+    mSourceHeight = height;
+    mWidth = width & ~1;
+    mHeight = height & ~1;
+    if(mWidth < 2 || mHeight < 2) {
+        mError = "frame too small for 4:2:0";
+        return false;
+    }
+
+    if(mOptions.sink == VideoSink::Ffmpeg) {
+        const std::string command = "ffmpeg -y -loglevel error -f yuv4mpegpipe -i - " + mOptions.ffmpegArguments + " " + ShellQuote(mOptions.path);
+        mOutput = popen(command.c_str(), "w");
+        mPipe = true;
+    }
+    else {
+        mOutput = std::fopen(mOptions.path.c_str(), "wb");
+    }
+    if(!mOutput) {
+        mError = "cannot open " + mOptions.path;
+        return false;
+    }
+    std::setvbuf(mOutput, nullptr, _IOFBF, 1 << 20);
+
+    // C420jpeg: chroma sited in the middle of each 2x2 block, which is what the block average gives
+    std::fprintf(mOutput, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n", mWidth, mHeight, mOptions.framesPerSecond);
+    std::cout << "Video " << mWidth << "x" << mHeight << " @ " << mOptions.framesPerSecond << " fps -> " << mOptions.path
+              << (mPipe ? " (ffmpeg)" : "") << ", YUV conversion: " << SimdLevelName(mSimd) << "\n";
+
+    mWriter = std::thread(&VideoEncoder::WriterMain, this);
+    return true;
+}
+
+std::vector<uint8_t> VideoEncoder::AcquireFrame(size_t size) {
+    std::vector<uint8_t> storage;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if(!mFreeRgba.empty()) {
+            storage = std::move(mFreeRgba.back());
+            mFreeRgba.pop_back();
+        }
+    }
+    storage.resize(size);
+    return storage;
+}
+
+void VideoEncoder::Submit(std::vector<uint8_t> rgba, int width, int height) {
+    if(mFinished || rgba.size() < (size_t)width * height * 4) {
+        return;
+    }
+    if(!mOutput) {
+        if(mSubmitted > 0 || !mError.empty() || !Open(width, height)) {
+            return; // the output could not be opened, Finish() reports it
+        }
+    }
+    if(width != mSourceWidth || height != mSourceHeight) {
+        std::cout << "Video: skipping a " << width << "x" << height << " frame, the video is " << mSourceWidth << "x" << mSourceHeight << "\n";
+        return;
+    }
+
+    // backpressure: converting on this thread is the most useful way to wait (Wait() runs a conversion here when
+    // no worker took it yet); once every conversion ran, the writer is the bottleneck and we sleep until it catches up
+    for(;;) {
+        while(!mConversions.empty() && JobSystem::IsFinished(mConversions.front())) {
+            mConversions.pop_front();
+        }
+        std::unique_lock<std::mutex> lock(mMutex);
+        if(mSubmitted - mWritten < (uint64_t)mOptions.maxQueuedFrames) {
+            break;
+        }
+        if(mConversions.empty()) {
+            mCondition.wait(lock, [this] { return mSubmitted - mWritten < (uint64_t)mOptions.maxQueuedFrames; });
+            break;
+        }
+        lock.unlock();
+        mJobs.Wait(mConversions.front());
+        mConversions.pop_front();
+    }
+
+    uint64_t index = 0;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        index = mSubmitted++;
+    }
+    // std::function needs a copyable callable, so the pixels travel in a shared_ptr instead of being copied
+    auto pixels = std::make_shared<std::vector<uint8_t>>(std::move(rgba));
+    mConversions.push_back(mJobs.Run([this, index, pixels] { Convert(index, *pixels); }));
+}
+
+void VideoEncoder::Convert(uint64_t index, std::vector<uint8_t>& rgba) {
+    YuvFrame frame;
+    frame.index = index;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if(!mFreeYuv.empty()) {
+            frame.planes = std::move(mFreeYuv.back());
+            mFreeYuv.pop_back();
+        }
+    }
+    const size_t lumaSize = (size_t)mWidth * mHeight;
+    frame.planes.resize(lumaSize + lumaSize / 2);
+    uint8_t* y = frame.planes.data();
+    ConvertRgbaToYuv420(rgba.data(), mWidth, mHeight, mSourceWidth, mSourceHeight, y, y + lumaSize, y + lumaSize + lumaSize / 4, mSimd);
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    if(mFreeRgba.size() < (size_t)mOptions.maxQueuedFrames) {
+        mFreeRgba.push_back(std::move(rgba));
+    }
+    mReady.emplace(index, std::move(frame));
+    mCondition.notify_all();
+}
+
+void VideoEncoder::WriterMain() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    for(;;) {
+        mCondition.wait(lock, [this] { return mReady.count(mWritten) > 0 || (mStop && mWritten == mSubmitted); });
+        auto next = mReady.find(mWritten);
+        if(next == mReady.end()) {
+            break; // stopping and everything is written
+        }
+        YuvFrame frame = std::move(next->second);
+        mReady.erase(next);
+        const bool failed = !mError.empty();
+        lock.unlock();
+
+        // after the first error the frames are only drained, so Submit() never waits forever
+        bool ok = false;
+        if(!failed) {
+            ok = std::fwrite("FRAME\n", 1, 6, mOutput) == 6 &&
+                 std::fwrite(frame.planes.data(), 1, frame.planes.size(), mOutput) == frame.planes.size();
+        }
+
+        lock.lock();
+        if(ok) {
+            ++mWrittenOk;
+        }
+        else if(!failed) {
+            mError = mPipe ? "writing to ffmpeg failed (did it exit?)" : "writing " + mOptions.path + " failed";
+        }
+        if(mFreeYuv.size() < (size_t)mOptions.maxQueuedFrames) {
+            mFreeYuv.push_back(std::move(frame.planes));
+        }
+        ++mWritten;
+        mCondition.notify_all();
+    }
+}
+
+bool VideoEncoder::Finish(std::string* error) {
+    if(!mFinished) {
+        mFinished = true;
+        while(!mConversions.empty()) {
+            mJobs.Wait(mConversions.front());
+            mConversions.pop_front();
+        }
+        if(mWriter.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                mStop = true;
+            }
+            mCondition.notify_all();
+            mWriter.join();
+        }
+        if(mOutput) {
+            const int status = mPipe ? pclose(mOutput) : std::fclose(mOutput);
+            mOutput = nullptr;
+            if(status != 0 && mError.empty()) {
+                // 127: the shell did not find ffmpeg
+                mError = mPipe ? "ffmpeg exited with status " + std::to_string(WIFEXITED(status) ? WEXITSTATUS(status) : status)
+                               : "closing " + mOptions.path + " failed";
+            }
+        }
+    }
+    if(!mError.empty()) {
+        return Fail(error, mError);
+    }
+    return true;
+}
+
+uint64_t VideoEncoder::WrittenCount() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mWrittenOk;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+/*
+Video output for captured frames: YUV 4:2:0 into a Y4M file, or the same Y4M stream piped into an ffmpeg
+process that does the actual compression.
+
+Pipeline (one VideoEncoder per output):
+- Submit() takes a read-back RGBA frame and starts a job converting it to planar YUV on a worker thread
+  (SSE2 / AVX2 kernels picked through GetSimdLevel(), BT.709 limited range, 2x2 averaged centered chroma)
+- a dedicated writer thread puts the converted frames in submission order and writes them; a blocking pipe
+  write never ties up a job worker
+- at most 'maxQueuedFrames' frames are between Submit() and the finished write. Submit() blocks beyond that,
+  so a slow encoder throttles rendering instead of piling up memory
+
+The size is taken from the first frame and cropped to even dimensions (4:2:0 needs them); later frames of a
+different size are skipped.
+*/
+
+#include "cpu_features.hpp"
+#include "job_system.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class VideoSink {
+    Y4m,    // uncompressed YUV4MPEG2 file
+    Ffmpeg, // "ffmpeg -f yuv4mpegpipe -i - <arguments> <path>" fed through a pipe
+};
+
+struct VideoEncoderOptions {
+    std::string path;
+    VideoSink sink = VideoSink::Y4m;
+    int framesPerSecond = 60;
+    int maxQueuedFrames = 8;
+    std::string ffmpegArguments = "-c:v libx264 -preset veryfast -crf 18 -pix_fmt yuv420p "
+                                  "-colorspace bt709 -color_primaries bt709 -color_trc bt709 -color_range tv";
+};
+
+class VideoEncoder {
+public:
+    VideoEncoder(JobSystem& jobs, const VideoEncoderOptions& options);
+    ~VideoEncoder(); // Finish()
+
+    VideoEncoder(const VideoEncoder&) = delete;
+    VideoEncoder& operator=(const VideoEncoder&) = delete;
+
+    // Storage for the next Submit(), recycled from frames already converted
+    std::vector<uint8_t> AcquireFrame(size_t size);
+
+    // RGBA8, bottom row first (as glReadPixels returns it). Blocks while the queue is full.
+    void Submit(std::vector<uint8_t> rgba, int width, int height);
+
+    // Writes everything still queued and closes the output. False if anything went wrong along the way.
+    bool Finish(std::string* error = nullptr);
+
+    uint64_t WrittenCount();
+
+private:
+    struct YuvFrame {
+        uint64_t index = 0;
+        std::vector<uint8_t> planes; // Y (width * height), then U and V (each width/2 * height/2)
+    };
+
+    bool Open(int width, int height);
+    void Convert(uint64_t index, std::vector<uint8_t>& rgba);
+    void WriterMain();
+
+    JobSystem& mJobs;
+    VideoEncoderOptions mOptions;
+    SimdLevel mSimd;
+    int mWidth = 0;      // output size, even
+    int mHeight = 0;
+    int mSourceWidth = 0;
+    int mSourceHeight = 0;
+    uint64_t mSubmitted = 0;
+    bool mFinished = false;
+    std::deque<JobHandle> mConversions; // oldest first
+
+    FILE* mOutput = nullptr;
+    bool mPipe = false;
+    std::thread mWriter;
+
+    std::mutex mMutex; // guards everything below, shared with the jobs and the writer thread
+    std::condition_variable mCondition;
+    std::map<uint64_t, YuvFrame> mReady;          // converted, waiting for their turn
+    std::vector<std::vector<uint8_t>> mFreeRgba;  // recycled frame storage
+    std::vector<std::vector<uint8_t>> mFreeYuv;
+    uint64_t mWritten = 0;                        // frames fully handled by the writer (written or failed)
+    uint64_t mWrittenOk = 0;
+    bool mStop = false;
+    std::string mError;
+};
+
+// BT.709 limited range RGBA8 -> planar YUV 4:2:0 of the top 'height' rows, top-down (width and height even).
+// 'rgba' is bottom-up with 'sourceHeight' rows; exposed for tools and benchmarks.
+void ConvertRgbaToYuv420(const uint8_t* rgba, int width, int height, int sourceWidth, int sourceHeight,
+                         uint8_t* y, uint8_t* u, uint8_t* v, SimdLevel level);
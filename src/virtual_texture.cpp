@@ -0,0 +1,891 @@
+#include "virtual_texture.hpp"
+#include "mipmap_generator.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static bool Fail(std::string* error, const std::string& message) {
+    if(error) {
+        *error = message;
+    }
+    return false;
+}
+
+static bool IsPowerOfTwo(int value) {
+    return value > 0 && (value & (value - 1)) == 0;
+}
+
+namespace {
+
+const char FileMagic[4] = {'L', 'G', 'V', 'T'};
+const uint32_t FileVersion = 1;
+const int MaxTilesPerSide = 8192; // 13 bits of the tile key
+
+struct FileHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t tileSize;
+    uint32_t border;
+    uint32_t levelCount;
+    uint32_t srgb;
+};
+
+// Levels until either side is down to a single tile
+int VirtualLevelCount(int tilesX, int tilesY) {
+    int levels = 1;
+    while((tilesX >> levels) >= 1 && (tilesY >> levels) >= 1) {
+        ++levels;
+    }
+    return levels;
+}
+
+} // namespace
+
+// ------------------------------------------------------------------ file ------------------------------------------------------------------
+
+VirtualTextureFile::~VirtualTextureFile() {
+    if(mFile >= 0) {
+        close(mFile);
+    }
+}
+
+bool VirtualTextureFile::Open(const std::string& path, std::string* error) {
+    mFile = open(path.c_str(), O_RDONLY);
+    if(mFile < 0) {
+        return Fail(error, "cannot open " + path);
+    }
+
+    FileHeader header;
+    if(pread(mFile, &header, sizeof(header), 0) != (ssize_t)sizeof(header) || std::memcmp(header.magic, FileMagic, 4) != 0 ||
+       header.version != FileVersion) {
+        return Fail(error, path + " is not a virtual texture file");
+    }
+    mWidth = (int)header.width;
+    mHeight = (int)header.height;
+    mTileSize = (int)header.tileSize;
+    mBorder = (int)header.border;
+    mLevelCount = (int)header.levelCount;
+    mSrgb = header.srgb != 0;
+    if(!IsPowerOfTwo(mWidth) || !IsPowerOfTwo(mHeight) || mTileSize <= 0 || mBorder < 0 || mBorder > mTileSize / 2 ||
+       mWidth % mTileSize != 0 || mHeight % mTileSize != 0 || mWidth / mTileSize > MaxTilesPerSide ||
+       mHeight / mTileSize > MaxTilesPerSide || mLevelCount != VirtualLevelCount(mWidth / mTileSize, mHeight / mTileSize)) {
+        return Fail(error, path + ": invalid virtual texture header");
+    }
+
+    uint64_t pages = 0;
+    mLevelFirstPage.clear();
+    for(int level = 0; level < mLevelCount; ++level) {
+        mLevelFirstPage.push_back(pages);
+        pages += (uint64_t)TilesX(level) * TilesY(level);
+    }
+    struct stat info;
+    if(fstat(mFile, &info) != 0 || (uint64_t)info.st_size < sizeof(FileHeader) + pages * PageBytes()) {
+        return Fail(error, path + ": truncated virtual texture file");
+    }
+    return true;
+}
+
+bool VirtualTextureFile::ReadPage(int level, int x, int y, uint8_t* out) const {
+    const uint64_t page = mLevelFirstPage[level] + (uint64_t)y * TilesX(level) + (uint64_t)x;
+    const size_t size = PageBytes();
+    const off_t offset = (off_t)(sizeof(FileHeader) + page * size);
+
+    // pread keeps no file position, so any number of workers can read at once
+    size_t done = 0;
+    while(done < size) {
+        ssize_t count = pread(mFile, out + done, size - done, offset + (off_t)done);
+        if(count < 0 && errno == EINTR) {
+            continue;
+        }
+        if(count <= 0) {
+            return false;
+        }
+        done += (size_t)count;
+    }
+    return true;
+}
+
+bool BuildVirtualTextureFile(const Image& image, bool srgb, const std::string& path, int tileSize, int border, std::string* error) {
+    if(!IsPowerOfTwo(image.width) || !IsPowerOfTwo(image.height)) {
+        return Fail(error, "virtual textures must be power-of-two sized (" + std::to_string(image.width) + "x" +
+                           std::to_string(image.height) + ")");
+    }
+    if(!IsPowerOfTwo(tileSize) || border < 0 || border > tileSize / 2 || image.width < tileSize || image.height < tileSize) {
+        return Fail(error, "tile size " + std::to_string(tileSize) + " does not fit the image");
+    }
+    const int tilesX = image.width / tileSize;
+    const int tilesY = image.height / tileSize;
+    if(tilesX > MaxTilesPerSide || tilesY > MaxTilesPerSide) {
+        return Fail(error, "too many tiles, use a larger tile size");
+    }
+
+    const int levelCount = VirtualLevelCount(tilesX, tilesY);
+    std::vector<Image> levels = GenerateMipChain(image, MipFilter::Kaiser, srgb);
+    levels.resize(levelCount);
+
+    const size_t slash = path.find_last_of('/');
+    if(slash != std::string::npos) {
+        mkdir(path.substr(0, slash).c_str(), 0755);
+    }
+
+    const std::string temporary = path + ".tmp";
+    {
+        std::ofstream file(temporary.c_str(), std::ios::binary | std::ios::trunc);
+        if(!file.is_open()) {
+            return Fail(error, "cannot write " + temporary);
+        }
+        FileHeader header{};
+        std::memcpy(header.magic, FileMagic, 4);
+        header.version = FileVersion;
+        header.width = (uint32_t)image.width;
+        header.height = (uint32_t)image.height;
+        header.tileSize = (uint32_t)tileSize;
+        header.border = (uint32_t)border;
+        header.levelCount = (uint32_t)levelCount;
+        header.srgb = srgb ? 1 : 0;
+        file.write((const char*)&header, sizeof(header));
+
+        // every page carries 'border' texels of its neighbours, clamped at the edges of the level
+        const int pageSize = tileSize + 2 * border;
+        std::vector<uint8_t> page((size_t)pageSize * pageSize * 4);
+        for(int level = 0; level < levelCount; ++level) {
+            const Image& source = levels[level];
+            for(int tileY = 0; tileY < (tilesY >> level); ++tileY) {
+                for(int tileX = 0; tileX < (tilesX >> level); ++tileX) {
+                    uint8_t* out = page.data();
+                    for(int py = 0; py < pageSize; ++py) {
+                        const int sy = std::min(std::max(tileY * tileSize + py - border, 0), source.height - 1);
+                        const uint8_t* row = source.Row(sy);
+                        for(int px = 0; px < pageSize; ++px) {
+                            const int sx = std::min(std::max(tileX * tileSize + px - border, 0), source.width - 1);
+                            std::memcpy(out, row + (size_t)sx * 4, 4);
+                            out += 4;
+                        }
+                    }
+                    file.write((const char*)page.data(), (std::streamsize)page.size());
+                }
+            }
+        }
+        if(!file.good()) {
+            std::remove(temporary.c_str());
+            return Fail(error, "cannot write " + temporary);
+        }
+    }
+    if(std::rename(temporary.c_str(), path.c_str()) != 0) {
+        return Fail(error, "cannot rename " + temporary);
+    }
+    return true;
+}
+
+// ------------------------------------------------------------------ GPU side ------------------------------------------------------------------
+
+VirtualTexture::VirtualTexture(JobSystem& jobs, PixelBufferPool& staging, const VirtualTextureOptions& options)
+    : mJobs(jobs), mStaging(staging), mOptions(options) {
+    mOptions.cacheTiles = std::max(mOptions.cacheTiles, 2);
+    mOptions.feedbackScale = std::max(mOptions.feedbackScale, 1);
+    mOptions.maxPendingTiles = std::max(mOptions.maxPendingTiles, 1);
+}
+
+VirtualTexture::~VirtualTexture() {
+    // the read jobs write into this object
+    for(const JobHandle& job : mLoadJobs) {
+        mJobs.Wait(job);
+    }
+    for(LoadedTile& loaded : mLoaded) {
+        if(loaded.staging.IsValid()) {
+            mStaging.Abandon(loaded.staging);
+        }
+    }
+
+    for(Readback& readback : mReadbacks) {
+        if(readback.fence != nullptr) {
+            glDeleteSync(readback.fence);
+        }
+        glDeleteBuffers(1, &readback.buffer);
+    }
+    glDeleteRenderbuffers(1, &mFeedbackColor);
+    glDeleteFramebuffers(1, &mFeedbackFramebuffer);
+    glDeleteTextures(1, &mTableTexture);
+    glDeleteTextures(1, &mCacheTexture);
+}
+
+bool VirtualTexture::Open(const std::string& path, std::string* error) {
+    if(!mFile.Open(path, error)) {
+        return false;
+    }
+    const int levels = mFile.LevelCount();
+
+    mResidentSlot.assign(levels, std::vector<int>());
+    for(int level = 0; level < levels; ++level) {
+        mResidentSlot[level].assign((size_t)mFile.TilesX(level) * mFile.TilesY(level), -1);
+    }
+
+    mSparse = mOptions.allowSparse && GLAD_GL_ARB_sparse_texture && CreateSparseTexture();
+    if(!mSparse) {
+        CreateIndirectionTextures();
+    }
+
+    const int slotCount = mOptions.cacheTiles * mOptions.cacheTiles;
+    for(int slot = slotCount - 1; slot >= 0; --slot) {
+        mFreeSlots.push_back(slot); // slot 0 is handed out first
+    }
+
+    // always resident: the coarsest level, plus the sparse mip tail (committed as a whole)
+    const int firstPinned = mSparse ? std::min(levels - 1, mSparseLevels) : levels - 1;
+    size_t pinnedCount = 0;
+    for(int level = firstPinned; level < levels; ++level) {
+        pinnedCount += (size_t)mFile.TilesX(level) * mFile.TilesY(level);
+    }
+    if(pinnedCount * 2 > (size_t)slotCount) {
+        return Fail(error, "cache of " + std::to_string(slotCount) + " tiles is too small for the coarsest mip level");
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    for(int level = firstPinned; level < levels; ++level) {
+        if(!LoadPinnedLevel(level)) {
+            return Fail(error, path + ": cannot read mip level " + std::to_string(level));
+        }
+    }
+    if(mSparse) {
+        RebuildMinLevelTable();
+    }
+    else {
+        RebuildPageTable();
+    }
+    mTableDirty = false;
+
+    glGenFramebuffers(1, &mFeedbackFramebuffer);
+    glGenRenderbuffers(1, &mFeedbackColor);
+    for(Readback& readback : mReadbacks) {
+        glGenBuffers(1, &readback.buffer);
+    }
+
+    std::cout << "Virtual texture: " << path << " (" << mFile.Width() << "x" << mFile.Height() << ", " << levels
+              << " levels, " << mFile.TileSize() << " texel tiles, "
+              << (mSparse ? "ARB_sparse_texture" : "page table + " + std::to_string(mCacheSize) + " texel cache") << ")\n";
+    return true;
+}
+
+bool VirtualTexture::CreateSparseTexture() {
+    const GLenum format = mFile.IsSrgb() ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+    if(!GLAD_GL_ARB_texture_storage || !GLAD_GL_ARB_internalformat_query) {
+        return false;
+    }
+
+    // page size index 0; tiles must be whole pages so committing one never touches a neighbour
+    GLint pageSizes = 0;
+    glGetInternalformativ(GL_TEXTURE_2D, format, GL_NUM_VIRTUAL_PAGE_SIZES_ARB, 1, &pageSizes);
+    GLint pageX = 0, pageY = 0;
+    glGetInternalformativ(GL_TEXTURE_2D, format, GL_VIRTUAL_PAGE_SIZE_X_ARB, 1, &pageX);
+    glGetInternalformativ(GL_TEXTURE_2D, format, GL_VIRTUAL_PAGE_SIZE_Y_ARB, 1, &pageY);
+    const int tileSize = mFile.TileSize();
+    if(pageSizes < 1 || pageX <= 0 || pageY <= 0 || tileSize % pageX != 0 || tileSize % pageY != 0) {
+        return false;
+    }
+
+    while(glGetError() != GL_NO_ERROR) {
+    }
+    glGenTextures(1, &mCacheTexture);
+    glBindTexture(GL_TEXTURE_2D, mCacheTexture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SPARSE_ARB, GL_TRUE);
+    glTexParameteri(GL_TEXTURE_2D, GL_VIRTUAL_PAGE_SIZE_INDEX_ARB, 0);
+    glTexStorage2D(GL_TEXTURE_2D, mFile.LevelCount(), format, mFile.Width(), mFile.Height());
+    glGetTexParameteriv(GL_TEXTURE_2D, GL_NUM_SPARSE_LEVELS_ARB, &mSparseLevels);
+
+    // the mip tail cannot be committed per tile; it stays resident, so it has to be small
+    size_t tailTiles = 0;
+    for(int level = std::max(mSparseLevels, 0); level < mFile.LevelCount(); ++level) {
+        tailTiles += (size_t)mFile.TilesX(level) * mFile.TilesY(level);
+    }
+    if(glGetError() != GL_NO_ERROR || mSparseLevels < 1 || tailTiles * 4 > (size_t)(mOptions.cacheTiles * mOptions.cacheTiles)) {
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glDeleteTextures(1, &mCacheTexture);
+        mCacheTexture = 0;
+        return false;
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    for(int level = mSparseLevels; level < mFile.LevelCount(); ++level) {
+        glTexPageCommitmentARB(GL_TEXTURE_2D, level, 0, 0, 0, std::max(mFile.Width() >> level, 1),
+                               std::max(mFile.Height() >> level, 1), 1, GL_TRUE);
+    }
+
+    // finest committed level per level-0 tile
+    glGenTextures(1, &mTableTexture);
+    glBindTexture(GL_TEXTURE_2D, mTableTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8UI, mFile.TilesX(0), mFile.TilesY(0), 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return true;
+}
+
+void VirtualTexture::CreateIndirectionTextures() {
+    const GLenum format = mFile.IsSrgb() ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+    const int levels = mFile.LevelCount();
+
+    GLint maxSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+    mOptions.cacheTiles = std::max(2, std::min(mOptions.cacheTiles, (int)maxSize / mFile.PageSize()));
+    mCacheSize = mOptions.cacheTiles * mFile.PageSize();
+
+    // physical pages: sampled without mips, the page table already picked the level
+    glGenTextures(1, &mCacheTexture);
+    glBindTexture(GL_TEXTURE_2D, mCacheTexture);
+    if(GLAD_GL_ARB_texture_storage) {
+        glTexStorage2D(GL_TEXTURE_2D, 1, format, mCacheSize, mCacheSize);
+    }
+    else {
+        glTexImage2D(GL_TEXTURE_2D, 0, format, mCacheSize, mCacheSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+    // page table: (slot x, slot y, resident level) per tile, one mip level per virtual level
+    glGenTextures(1, &mTableTexture);
+    glBindTexture(GL_TEXTURE_2D, mTableTexture);
+    if(GLAD_GL_ARB_texture_storage) {
+        glTexStorage2D(GL_TEXTURE_2D, levels, GL_RGBA8UI, mFile.TilesX(0), mFile.TilesY(0));
+    }
+    else {
+        for(int level = 0; level < levels; ++level) {
+            glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8UI, mFile.TilesX(level), mFile.TilesY(level), 0,
+                         GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, nullptr);
+        }
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+bool VirtualTexture::LoadPinnedLevel(int level) {
+    std::vector<uint8_t> page(mFile.PageBytes());
+    for(int y = 0; y < mFile.TilesY(level); ++y) {
+        for(int x = 0; x < mFile.TilesX(level); ++x) {
+            if(!mFile.ReadPage(level, x, y, page.data())) {
+                return false;
+            }
+            const uint32_t key = TileKey(level, x, y);
+            Tile& tile = mTiles[key];
+            tile.pinned = true;
+            tile.slot = mFreeSlots.back();
+            mFreeSlots.pop_back();
+            WritePage(tile, key, page.data());
+        }
+    }
+    return true;
+}
+
+void VirtualTexture::WritePage(const Tile& tile, uint32_t key, const void* pixels) {
+    const int level = KeyLevel(key);
+    const int x = KeyX(key);
+    const int y = KeyY(key);
+    const int tileSize = mFile.TileSize();
+    const int pageSize = mFile.PageSize();
+
+    glBindTexture(GL_TEXTURE_2D, mCacheTexture);
+    if(mSparse) {
+        // the hardware filters across tiles, the border is not needed: upload the inner tileSize^2 texels
+        if(level < mSparseLevels) {
+            glTexPageCommitmentARB(GL_TEXTURE_2D, level, x * tileSize, y * tileSize, 0, tileSize, tileSize, 1, GL_TRUE);
+        }
+        const size_t inner = ((size_t)mFile.Border() * pageSize + mFile.Border()) * 4;
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, pageSize);
+        glTexSubImage2D(GL_TEXTURE_2D, level, x * tileSize, y * tileSize, tileSize, tileSize, GL_RGBA, GL_UNSIGNED_BYTE,
+                        (const uint8_t*)pixels + inner);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    }
+    else {
+        const int slotX = tile.slot % mOptions.cacheTiles;
+        const int slotY = tile.slot / mOptions.cacheTiles;
+        glTexSubImage2D(GL_TEXTURE_2D, 0, slotX * pageSize, slotY * pageSize, pageSize, pageSize, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    mResidentSlot[level][(size_t)y * mFile.TilesX(level) + x] = tile.slot;
+    mTableDirty = true;
+}
+
+void VirtualTexture::Evict(uint32_t key) {
+    auto it = mTiles.find(key);
+    const int level = KeyLevel(key);
+    const int x = KeyX(key);
+    const int y = KeyY(key);
+    if(mSparse) {
+        const int tileSize = mFile.TileSize();
+        glBindTexture(GL_TEXTURE_2D, mCacheTexture);
+        glTexPageCommitmentARB(GL_TEXTURE_2D, level, x * tileSize, y * tileSize, 0, tileSize, tileSize, 1, GL_FALSE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    mResidentSlot[level][(size_t)y * mFile.TilesX(level) + x] = -1;
+    mFreeSlots.push_back(it->second.slot);
+    mLru.erase(it->second.lru);
+    mTiles.erase(it);
+    mTableDirty = true;
+}
+
+// Every tile points at itself if resident, otherwise at whatever its parent points at. The coarsest level is
+// always resident, so the recursion ends there.
+void VirtualTexture::RebuildPageTable() {
+    const int levels = mFile.LevelCount();
+    std::vector<uint8_t> parent;
+    std::vector<uint8_t> entries;
+
+    glBindTexture(GL_TEXTURE_2D, mTableTexture);
+    for(int level = levels - 1; level >= 0; --level) {
+        const int tilesX = mFile.TilesX(level);
+        const int tilesY = mFile.TilesY(level);
+        const int parentX = level + 1 < levels ? mFile.TilesX(level + 1) : 0;
+        entries.assign((size_t)tilesX * tilesY * 4, 0);
+        for(int y = 0; y < tilesY; ++y) {
+            for(int x = 0; x < tilesX; ++x) {
+                uint8_t* entry = &entries[((size_t)y * tilesX + x) * 4];
+                const int slot = mResidentSlot[level][(size_t)y * tilesX + x];
+                if(slot >= 0) {
+                    entry[0] = (uint8_t)(slot % mOptions.cacheTiles);
+                    entry[1] = (uint8_t)(slot / mOptions.cacheTiles);
+                    entry[2] = (uint8_t)level;
+                    entry[3] = 255;
+                }
+                else if(!parent.empty()) {
+                    std::memcpy(entry, &parent[((size_t)(y / 2) * parentX + x / 2) * 4], 4);
+                }
+            }
+        }
+        glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, tilesX, tilesY, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, entries.data());
+        parent.swap(entries);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// A level may be sampled around a tile once that tile, its 8 neighbours (bilinear taps cross page edges) and
+// the same for the next coarser level (trilinear) are committed. Reads from uncommitted pages are undefined.
+void VirtualTexture::RebuildMinLevelTable() {
+    const int levels = mFile.LevelCount();
+    std::vector<std::vector<uint8_t>> usable(levels);
+
+    for(int level = levels - 1; level >= 0; --level) {
+        const int tilesX = mFile.TilesX(level);
+        const int tilesY = mFile.TilesY(level);
+        const std::vector<int>& resident = mResidentSlot[level];
+        usable[level].assign((size_t)tilesX * tilesY, 0);
+        for(int y = 0; y < tilesY; ++y) {
+            for(int x = 0; x < tilesX; ++x) {
+                bool ok = level + 1 >= levels || usable[level + 1][(size_t)(y / 2) * mFile.TilesX(level + 1) + x / 2];
+                for(int dy = -1; dy <= 1 && ok; ++dy) {
+                    for(int dx = -1; dx <= 1 && ok; ++dx) {
+                        const int nx = x + dx;
+                        const int ny = y + dy;
+                        if(nx >= 0 && ny >= 0 && nx < tilesX && ny < tilesY) {
+                            ok = resident[(size_t)ny * tilesX + nx] >= 0;
+                        }
+                    }
+                }
+                usable[level][(size_t)y * tilesX + x] = ok ? 1 : 0;
+            }
+        }
+    }
+
+    const int tilesX = mFile.TilesX(0);
+    const int tilesY = mFile.TilesY(0);
+    std::vector<uint8_t> minLevel((size_t)tilesX * tilesY);
+    for(int y = 0; y < tilesY; ++y) {
+        for(int x = 0; x < tilesX; ++x) {
+            int level = 0;
+            while(level < levels - 1 && !usable[level][(size_t)(y >> level) * mFile.TilesX(level) + (x >> level)]) {
+                ++level;
+            }
+            minLevel[(size_t)y * tilesX + x] = (uint8_t)level;
+        }
+    }
+
+    glBindTexture(GL_TEXTURE_2D, mTableTexture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, tilesX, tilesY, GL_RED_INTEGER, GL_UNSIGNED_BYTE, minLevel.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// ------------------------------------------------------------------ shaders ------------------------------------------------------------------
+
+static const char* VirtualTextureCommonSource = R"(#version 410 core
+in vec3 vColor;
+in vec2 vTexCoord;
+uniform vec2 u_VtSize;      // level 0 size in texels
+uniform float u_VtTileSize; // texels per tile, without the border
+uniform int u_VtMaxLevel;
+out vec4 fragColor;
+
+float VtLod(vec2 texel) {
+    vec2 dx = dFdx(texel);
+    vec2 dy = dFdy(texel);
+    return clamp(0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8)), 0.0, float(u_VtMaxLevel));
+}
+)";
+
+static const char* VirtualTextureIndirectionSource = R"(
+uniform float u_VtBorder;
+uniform float u_VtCacheSize;     // physical cache side in texels
+uniform usampler2D u_VtPageTable; // (slot x, slot y, level) of the closest resident tile
+uniform sampler2D u_VtCache;
+
+vec4 VtSample(vec2 uv, int level) {
+    ivec2 tiles = ivec2(u_VtSize / u_VtTileSize) >> level;
+    ivec2 page = clamp(ivec2(uv * vec2(tiles)), ivec2(0), tiles - 1);
+    uvec4 entry = texelFetch(u_VtPageTable, page, level);
+
+    // position inside the resident tile, which may be an ancestor at a coarser level
+    vec2 texel = uv * u_VtSize / exp2(float(entry.z));
+    vec2 within = texel - floor(texel / u_VtTileSize) * u_VtTileSize;
+    vec2 physical = vec2(entry.xy) * (u_VtTileSize + 2.0 * u_VtBorder) + u_VtBorder + within;
+    return textureLod(u_VtCache, physical / u_VtCacheSize, 0.0);
+}
+
+void main()
+{
+    vec2 uv = clamp(vTexCoord, vec2(0.0), vec2(1.0) - 0.5 / u_VtSize);
+    float lod = VtLod(uv * u_VtSize);
+    int level = int(lod);
+    vec4 color = mix(VtSample(uv, level), VtSample(uv, min(level + 1, u_VtMaxLevel)), fract(lod));
+    fragColor = vec4(vColor, 1.0) * color;
+}
+)";
+
+static const char* VirtualTextureSparseSource = R"(
+uniform sampler2D u_VtSparse;
+uniform usampler2D u_VtMinLevel; // finest level committed around each level-0 tile
+
+void main()
+{
+    vec2 uv = clamp(vTexCoord, vec2(0.0), vec2(1.0));
+    float lod = VtLod(uv * u_VtSize);
+    ivec2 tiles = ivec2(u_VtSize / u_VtTileSize);
+    ivec2 page = clamp(ivec2(uv * vec2(tiles)), ivec2(0), tiles - 1);
+    float minLevel = float(texelFetch(u_VtMinLevel, page, 0).r);
+    fragColor = vec4(vColor, 1.0) * textureLod(u_VtSparse, uv, max(lod, minLevel));
+}
+)";
+
+static const char* VirtualTextureFeedbackSource = R"(#version 410 core
+in vec2 vTexCoord;
+uniform vec2 u_VtSize;
+uniform float u_VtTileSize;
+uniform int u_VtMaxLevel;
+uniform float u_VtFeedbackBias; // log2(feedback scale): derivatives are that much larger at the reduced size
+layout(location = 0) out uvec4 feedback;
+void main()
+{
+    vec2 uv = clamp(vTexCoord, vec2(0.0), vec2(1.0) - 0.5 / u_VtSize);
+    vec2 texel = uv * u_VtSize;
+    vec2 dx = dFdx(texel);
+    vec2 dy = dFdy(texel);
+    float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8)) - u_VtFeedbackBias;
+    int level = clamp(int(floor(lod)), 0, u_VtMaxLevel);
+    feedback = uvec4(uvec2(texel / u_VtTileSize) >> uint(level), uint(level), 1u);
+}
+)";
+
+std::string VirtualTexture::FragmentShaderSource() const {
+    return std::string(VirtualTextureCommonSource) + (mSparse ? VirtualTextureSparseSource : VirtualTextureIndirectionSource);
+}
+
+std::string VirtualTexture::FeedbackShaderSource() {
+    return VirtualTextureFeedbackSource;
+}
+
+void VirtualTexture::Bind(GLuint program, int firstUnit) {
+    glActiveTexture(GL_TEXTURE0 + firstUnit);
+    glBindTexture(GL_TEXTURE_2D, mSparse ? mCacheTexture : mTableTexture);
+    glActiveTexture(GL_TEXTURE0 + firstUnit + 1);
+    glBindTexture(GL_TEXTURE_2D, mSparse ? mTableTexture : mCacheTexture);
+    glActiveTexture(GL_TEXTURE0);
+
+    // uniform values live in the program object and never change for this texture: set them once
+    if(std::find(mConfiguredPrograms.begin(), mConfiguredPrograms.end(), program) != mConfiguredPrograms.end()) {
+        return;
+    }
+    mConfiguredPrograms.push_back(program);
+
+    GLint location = glGetUniformLocation(program, "u_VtSize");
+    if(location >= 0) {
+        glUniform2f(location, (float)mFile.Width(), (float)mFile.Height());
+    }
+    if((location = glGetUniformLocation(program, "u_VtTileSize")) >= 0) {
+        glUniform1f(location, (float)mFile.TileSize());
+    }
+    if((location = glGetUniformLocation(program, "u_VtMaxLevel")) >= 0) {
+        glUniform1i(location, mFile.LevelCount() - 1);
+    }
+    if((location = glGetUniformLocation(program, "u_VtBorder")) >= 0) {
+        glUniform1f(location, (float)mFile.Border());
+    }
+    if((location = glGetUniformLocation(program, "u_VtCacheSize")) >= 0) {
+        glUniform1f(location, (float)mCacheSize);
+    }
+    if((location = glGetUniformLocation(program, "u_VtFeedbackBias")) >= 0) {
+        glUniform1f(location, std::log2((float)mOptions.feedbackScale));
+    }
+    if((location = glGetUniformLocation(program, mSparse ? "u_VtSparse" : "u_VtPageTable")) >= 0) {
+        glUniform1i(location, firstUnit);
+    }
+    if((location = glGetUniformLocation(program, mSparse ? "u_VtMinLevel" : "u_VtCache")) >= 0) {
+        glUniform1i(location, firstUnit + 1);
+    }
+}
+
+// ------------------------------------------------------------------ feedback ------------------------------------------------------------------
+
+bool VirtualTexture::BeginFeedback(int screenWidth, int screenHeight) {
+    if(mReadbacksInFlight == ReadbackCount) {
+        return false; // the CPU is behind; requests from the frames already queued are enough
+    }
+
+    const int width = std::max(1, screenWidth / mOptions.feedbackScale);
+    const int height = std::max(1, screenHeight / mOptions.feedbackScale);
+    glBindFramebuffer(GL_FRAMEBUFFER, mFeedbackFramebuffer);
+    if(width != mFeedbackWidth || height != mFeedbackHeight) {
+        glBindRenderbuffer(GL_RENDERBUFFER, mFeedbackColor);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA16UI, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, mFeedbackColor);
+        if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cout << "Virtual texture feedback target is incomplete\n";
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            return false;
+        }
+        mFeedbackWidth = width;
+        mFeedbackHeight = height;
+    }
+
+    glViewport(0, 0, width, height);
+    const GLuint nothing[4] = {0, 0, 0, 0}; // alpha 0 = no virtual texture under this pixel
+    glClearBufferuiv(GL_COLOR, 0, nothing);
+    return true;
+}
+
+void VirtualTexture::EndFeedback() {
+    Readback& readback = mReadbacks[mNextReadback];
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+    if(readback.width != mFeedbackWidth || readback.height != mFeedbackHeight) {
+        readback.width = mFeedbackWidth;
+        readback.height = mFeedbackHeight;
+        glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)readback.width * readback.height * 8, nullptr, GL_STREAM_READ);
+    }
+    // into the buffer: returns immediately, the copy happens when the GPU gets there
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glReadPixels(0, 0, readback.width, readback.height, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, nullptr);
+    readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    mNextReadback = (mNextReadback + 1) % ReadbackCount;
+    ++mReadbacksInFlight;
+}
+
+void VirtualTexture::ProcessFeedback(const uint16_t* pixels, int width, int height) {
+    const int levels = mFile.LevelCount();
+    mRequests.clear();
+    for(size_t i = 0; i < (size_t)width * height; ++i) {
+        const uint16_t* texel = pixels + i * 4;
+        if(texel[3] == 0 || texel[2] >= levels || texel[0] >= mFile.TilesX(texel[2]) || texel[1] >= mFile.TilesY(texel[2])) {
+            continue;
+        }
+        mRequests.push_back(TileKey(texel[2], texel[0], texel[1]));
+    }
+    std::sort(mRequests.begin(), mRequests.end());
+    mRequests.erase(std::unique(mRequests.begin(), mRequests.end()), mRequests.end());
+
+    // the ancestors are needed as well: the page table falls back to them while a tile loads, and the
+    // sparse path only samples a level once its neighbours and the next coarser level are committed
+    const size_t direct = mRequests.size();
+    for(size_t i = 0; i < direct; ++i) {
+        const int level = KeyLevel(mRequests[i]);
+        const int x = KeyX(mRequests[i]);
+        const int y = KeyY(mRequests[i]);
+        if(mSparse) {
+            for(int dy = -1; dy <= 1; ++dy) {
+                for(int dx = -1; dx <= 1; ++dx) {
+                    if(x + dx >= 0 && y + dy >= 0 && x + dx < mFile.TilesX(level) && y + dy < mFile.TilesY(level)) {
+                        mRequests.push_back(TileKey(level, x + dx, y + dy));
+                    }
+                }
+            }
+        }
+        for(int parent = level + 1; parent < levels; ++parent) {
+            mRequests.push_back(TileKey(parent, x >> (parent - level), y >> (parent - level)));
+        }
+    }
+    std::sort(mRequests.begin(), mRequests.end());
+    mRequests.erase(std::unique(mRequests.begin(), mRequests.end()), mRequests.end());
+
+    // keys sort by level first. Touch fine to coarse, so coarser tiles end up more recently used and are
+    // evicted after the tiles that depend on them...
+    ++mFrame;
+    for(uint32_t key : mRequests) {
+        auto it = mTiles.find(key);
+        if(it != mTiles.end()) {
+            it->second.lastUsed = mFrame;
+            if(it->second.slot >= 0 && !it->second.pinned) {
+                mLru.splice(mLru.begin(), mLru, it->second.lru);
+            }
+        }
+    }
+    // ...and load coarse to fine: a coarse tile sharpens more pixels than a fine one
+    for(auto it = mRequests.rbegin(); it != mRequests.rend() && mLoadingCount < (size_t)mOptions.maxPendingTiles; ++it) {
+        RequestTile(*it);
+    }
+}
+
+// ------------------------------------------------------------------ streaming ------------------------------------------------------------------
+
+void VirtualTexture::RequestTile(uint32_t key) {
+    if(mTiles.find(key) != mTiles.end()) {
+        return; // resident or already loading
+    }
+    Tile& tile = mTiles[key];
+    tile.lastUsed = mFrame;
+    ++mLoadingCount;
+
+    mLoadJobs.push_back(mJobs.Run([this, key] {
+        // worker: read straight into staging memory when there is room, the GL thread then only issues the copy
+        LoadedTile loaded;
+        loaded.key = key;
+        uint8_t* target = nullptr;
+        if(mStaging.IsPersistent() && mStaging.TryAcquire(mFile.PageBytes(), loaded.staging)) {
+            target = loaded.staging.data;
+        }
+        else {
+            loaded.pixels.resize(mFile.PageBytes());
+            target = loaded.pixels.data();
+        }
+        loaded.ok = mFile.ReadPage(KeyLevel(key), KeyX(key), KeyY(key), target);
+        if(!loaded.ok && loaded.staging.IsValid()) {
+            mStaging.Abandon(loaded.staging);
+            loaded.staging = StagingBlock();
+        }
+
+        std::lock_guard<std::mutex> lock(mLoadedMutex);
+        mLoaded.push_back(std::move(loaded));
+    }));
+}
+
+bool VirtualTexture::UploadTile(LoadedTile& loaded) {
+    auto it = mTiles.find(loaded.key);
+    --mLoadingCount;
+    if(!loaded.ok) {
+        std::cout << "Virtual texture: cannot read tile " << KeyX(loaded.key) << "," << KeyY(loaded.key)
+                  << " of level " << KeyLevel(loaded.key) << "\n";
+        mTiles.erase(it);
+        return false;
+    }
+
+    // free slot, or the least recently used tile - unless even that one is still on screen
+    if(mFreeSlots.empty() && !mLru.empty() && mTiles[mLru.back()].lastUsed != mFrame) {
+        Evict(mLru.back());
+    }
+    if(mFreeSlots.empty()) {
+        if(!mWarnedThrashing) {
+            std::cout << "Virtual texture cache is too small for the current view, increase cacheTiles\n";
+            mWarnedThrashing = true;
+        }
+        if(loaded.staging.IsValid()) {
+            mStaging.Abandon(loaded.staging);
+        }
+        mTiles.erase(it);
+        return false;
+    }
+
+    Tile& tile = it->second;
+    tile.slot = mFreeSlots.back();
+    mFreeSlots.pop_back();
+    mLru.push_front(loaded.key);
+    tile.lru = mLru.begin();
+
+    if(loaded.staging.IsValid()) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, loaded.staging.buffer);
+        WritePage(tile, loaded.key, loaded.staging.PixelOffset());
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        mStaging.Release(loaded.staging); // reusable once the GPU has pulled the page
+    }
+    else {
+        WritePage(tile, loaded.key, loaded.pixels.data());
+    }
+    return true;
+}
+
+bool VirtualTexture::Update() {
+    bool changed = false;
+
+    // 1) feedback readbacks, oldest first, only once the GPU has written them (never stalls)
+    while(mReadbacksInFlight > 0) {
+        Readback& readback = mReadbacks[mOldestReadback];
+        const GLenum status = glClientWaitSync(readback.fence, 0, 0);
+        if(status == GL_TIMEOUT_EXPIRED) {
+            break;
+        }
+        glDeleteSync(readback.fence);
+        readback.fence = nullptr;
+        if(status != GL_WAIT_FAILED) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+            const uint16_t* pixels = (const uint16_t*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+                                                                       (GLsizeiptr)readback.width * readback.height * 8, GL_MAP_READ_BIT);
+            if(pixels != nullptr) {
+                ProcessFeedback(pixels, readback.width, readback.height);
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            }
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+        mOldestReadback = (mOldestReadback + 1) % ReadbackCount;
+        --mReadbacksInFlight;
+    }
+
+    // 2) tiles the workers finished reading
+    {
+        std::lock_guard<std::mutex> lock(mLoadedMutex);
+        mUploading.swap(mLoaded);
+    }
+    if(!mUploading.empty()) {
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        for(LoadedTile& loaded : mUploading) {
+            changed |= UploadTile(loaded);
+        }
+        mUploading.clear();
+    }
+    mLoadJobs.erase(std::remove_if(mLoadJobs.begin(), mLoadJobs.end(), [](const JobHandle& job) {
+        return JobSystem::IsFinished(job);
+    }), mLoadJobs.end());
+
+    // 3) one page table / min level update per frame, however many tiles changed
+    if(mTableDirty) {
+        if(mSparse) {
+            RebuildMinLevelTable();
+        }
+        else {
+            RebuildPageTable();
+        }
+        mTableDirty = false;
+        changed = true;
+    }
+    return changed;
+}
+
+bool VirtualTexture::HasPendingWork() const {
+    return mReadbacksInFlight > 0 || mLoadingCount > 0;
+}
@@ -0,0 +1,202 @@
+#pragma once
+
+/*
+Virtual texturing: textures far larger than GPU (or even CPU) memory, streamed in fixed-size tiles.
+
+    draw the scene with the feedback shader   -> small RGBA16UI target (window size / feedbackScale),
+                                                 one (tile x, tile y, mip level) per pixel
+    glReadPixels into a PBO + fence           -> a frame or two later: map, dedupe, sort coarse first
+    missing tiles are read on worker threads  -> pread() from the tiled file straight into PixelBufferPool memory
+    Update() on the main thread               -> upload into the cache, evict the least recently used tile,
+                                                 rewrite the page table
+
+Two GPU representations:
+- Indirection (always available): a physical cache texture of cacheTiles x cacheTiles pages, each page one tile
+  plus 'border' texels per side, and a page table texture (one texel per tile, with the virtual mip chain)
+  pointing every tile at the cache slot of the closest resident tile at its level or a coarser one. The border
+  keeps bilinear filtering inside a page; trilinear blends two page lookups in the shader.
+- Sparse (ARB_sparse_texture): one sparse texture with the full virtual size and mip chain, resident tiles are
+  committed pages and the rest costs no memory. A per-tile "minimum level" texture clamps the sampled LOD to
+  what is committed, so the hardware filters across tiles by itself. Used when the driver supports it and its
+  page size divides the tile size; cacheTiles^2 is then the page budget.
+
+The coarsest level is loaded up front and never evicted, so every lookup has something to show.
+
+Tiled file (.vtex): header, then every page of every level, level 0 first, tile rows bottom-up. A page is
+(tileSize + 2 * border)^2 RGBA8 texels with its border copied from the neighbouring tiles (clamped at the
+texture edges). Pages have a fixed size, so a tile's offset is computed rather than looked up. Width and height
+must be powers of two and at least one tile; BuildVirtualTextureFile() converts an image.
+*/
+
+#include "image_decoder.hpp"
+#include "job_system.hpp"
+#include "pixel_buffer_pool.hpp"
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Read-only access to a .vtex file; ReadPage() may be called from any thread
+class VirtualTextureFile {
+public:
+    VirtualTextureFile() = default;
+    ~VirtualTextureFile();
+
+    VirtualTextureFile(const VirtualTextureFile&) = delete;
+    VirtualTextureFile& operator=(const VirtualTextureFile&) = delete;
+
+    bool Open(const std::string& path, std::string* error = nullptr);
+
+    int Width() const { return mWidth; }
+    int Height() const { return mHeight; }
+    int TileSize() const { return mTileSize; }
+    int Border() const { return mBorder; }
+    int PageSize() const { return mTileSize + 2 * mBorder; }
+    size_t PageBytes() const { return (size_t)PageSize() * PageSize() * 4; }
+    int LevelCount() const { return mLevelCount; }
+    bool IsSrgb() const { return mSrgb; }
+    int TilesX(int level) const { return (mWidth / mTileSize) >> level; }
+    int TilesY(int level) const { return (mHeight / mTileSize) >> level; }
+
+    // Copies one page (PageBytes()) into 'out'
+    bool ReadPage(int level, int x, int y, uint8_t* out) const;
+
+private:
+    int mFile = -1;
+    int mWidth = 0;
+    int mHeight = 0;
+    int mTileSize = 0;
+    int mBorder = 0;
+    int mLevelCount = 0;
+    bool mSrgb = false;
+    std::vector<uint64_t> mLevelFirstPage; // index of the first page of every level
+};
+
+// Builds the mip chain of 'image' (power-of-two sized) and writes it as a .vtex file
+bool BuildVirtualTextureFile(const Image& image, bool srgb, const std::string& path, int tileSize = 128, int border = 4,
+                             std::string* error = nullptr);
+
+struct VirtualTextureOptions {
+    int cacheTiles = 24;      // indirection: cache is cacheTiles x cacheTiles pages; sparse: committed page budget
+    int feedbackScale = 8;    // feedback target is the window size divided by this
+    int maxPendingTiles = 16; // tile reads in flight on the workers
+    bool allowSparse = true;  // use ARB_sparse_texture when the driver has it
+};
+
+class VirtualTexture {
+public:
+    // Main thread. 'staging' must belong to a context sharing objects with the main one.
+    VirtualTexture(JobSystem& jobs, PixelBufferPool& staging, const VirtualTextureOptions& options = VirtualTextureOptions());
+    ~VirtualTexture();
+
+    VirtualTexture(const VirtualTexture&) = delete;
+    VirtualTexture& operator=(const VirtualTexture&) = delete;
+
+    // Main thread: opens the file, creates the GL objects and loads the coarsest level
+    bool Open(const std::string& path, std::string* error = nullptr);
+
+    bool IsSparse() const { return mSparse; }
+    const VirtualTextureFile& File() const { return mFile; }
+    size_t ResidentTiles() const { return mTiles.size() - mLoadingCount; }
+
+    // Fragment shaders: both read 'in vec2 vTexCoord'; the material one also multiplies by 'in vec3 vColor'
+    std::string FragmentShaderSource() const;
+    static std::string FeedbackShaderSource();
+
+    // Binds the textures to units firstUnit and firstUnit + 1 and, the first time 'program' (bound) is seen,
+    // sets its u_Vt* uniforms. Works for the material and the feedback program.
+    void Bind(GLuint program, int firstUnit = 1);
+
+    // Feedback pass: BeginFeedback() binds and clears the feedback target and sets its viewport; draw the scene
+    // with the feedback program, then EndFeedback() starts the readback and rebinds the default framebuffer.
+    // Returns false (skip the pass) while every readback buffer is still waiting to be consumed.
+    bool BeginFeedback(int screenWidth, int screenHeight);
+    void EndFeedback();
+
+    // Main thread, once per frame: consumes finished readbacks, starts tile reads, uploads finished tiles.
+    // Returns true if the resident set changed (the frame should be redrawn).
+    bool Update();
+
+    // Readbacks or tile reads in flight
+    bool HasPendingWork() const;
+
+private:
+    struct Tile {
+        int slot = -1;            // cache slot (indirection) / budget slot (sparse); -1 while loading
+        bool pinned = false;      // coarsest level (and the sparse mip tail), never evicted
+        unsigned lastUsed = 0;    // feedback frame that last asked for it
+        std::list<uint32_t>::iterator lru; // position in mLru (resident, not pinned)
+    };
+    struct LoadedTile {
+        uint32_t key;
+        StagingBlock staging;         // page in staging memory, or
+        std::vector<uint8_t> pixels;  // in client memory when the pool was full
+        bool ok;
+    };
+    struct Readback {
+        GLuint buffer = 0;
+        GLsync fence = nullptr;
+        int width = 0;
+        int height = 0;
+    };
+
+    static uint32_t TileKey(int level, int x, int y) { return ((uint32_t)level << 26) | ((uint32_t)y << 13) | (uint32_t)x; }
+    static int KeyLevel(uint32_t key) { return (int)(key >> 26); }
+    static int KeyY(uint32_t key) { return (int)((key >> 13) & 0x1fff); }
+    static int KeyX(uint32_t key) { return (int)(key & 0x1fff); }
+
+    bool CreateSparseTexture();
+    void CreateIndirectionTextures();
+    bool LoadPinnedLevel(int level);
+    void ProcessFeedback(const uint16_t* pixels, int width, int height);
+    void RequestTile(uint32_t key);
+    bool UploadTile(LoadedTile& loaded);
+    void WritePage(const Tile& tile, uint32_t key, const void* pixels); // pixels: client pointer or PBO offset
+    void Evict(uint32_t key);
+    void RebuildPageTable();
+    void RebuildMinLevelTable();
+
+    JobSystem& mJobs;
+    PixelBufferPool& mStaging;
+    VirtualTextureOptions mOptions;
+    VirtualTextureFile mFile;
+    bool mSparse = false;
+
+    // GL objects
+    GLuint mCacheTexture = 0;     // indirection: physical pages; sparse: the sparse texture itself
+    GLuint mTableTexture = 0;     // indirection: page table (RGBA8UI, mip chain); sparse: minimum level (R8UI)
+    int mCacheSize = 0;           // indirection: cache texture side in texels
+    int mSparseLevels = 0;        // sparse: levels below this are committed per tile, the rest is the mip tail
+
+    GLuint mFeedbackFramebuffer = 0;
+    GLuint mFeedbackColor = 0;    // RGBA16UI renderbuffer
+    int mFeedbackWidth = 0;
+    int mFeedbackHeight = 0;
+    static const int ReadbackCount = 3;
+    Readback mReadbacks[ReadbackCount];
+    int mNextReadback = 0;        // ring position of the next feedback pass
+    int mOldestReadback = 0;      // ring position of the next readback to consume
+    int mReadbacksInFlight = 0;
+    std::vector<uint32_t> mRequests; // scratch, reused every feedback frame
+
+    // residency
+    std::unordered_map<uint32_t, Tile> mTiles; // resident and loading tiles
+    std::list<uint32_t> mLru;                  // front = most recently used; pinned tiles are not in it
+    std::vector<int> mFreeSlots;
+    std::vector<std::vector<int>> mResidentSlot; // [level][y * tilesX + x] -> slot, -1 if not resident
+    size_t mLoadingCount = 0;
+    unsigned mFrame = 0;                       // feedback frames processed
+    bool mTableDirty = false;
+    bool mWarnedThrashing = false;
+
+    std::mutex mLoadedMutex;
+    std::vector<LoadedTile> mLoaded;           // finished reads, uploaded by Update()
+    std::vector<LoadedTile> mUploading;        // swapped with mLoaded, keeps its capacity
+    std::vector<JobHandle> mLoadJobs;          // waited for on destruction
+
+    std::vector<GLuint> mConfiguredPrograms;   // programs whose u_Vt* uniforms were set
+};